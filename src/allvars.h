@@ -376,6 +376,8 @@ struct UnbindInfo
     Double_t approxpotminnum;
     ///method of subsampling to calculate potential
     int approxpotmethod;
+    ///seed used when randomly subsampling particles to calculate potential
+    unsigned long long approxpotrandseed;
     /// whether to include baryons before running unbinding in a simulation
     int iunbindwithbaryons;
     //@}
@@ -400,6 +402,7 @@ struct UnbindInfo
         approxpotnumfrac = 0.1;
         approxpotminnum = 5000;
         approxpotmethod = POTAPPROXMETHODTREE;
+        approxpotrandseed = 4357;
         iunbindwithbaryons = 1;
     }
 };
@@ -417,6 +420,19 @@ struct PropInfo
     }
 };
 
+/// Structure stores the state carried over from the previous snapshot to warm start a run (see \ref ReadWarmStart)
+struct WarmStartInfo
+{
+    ///mesh resolution and number of mpi tasks of the previous mesh decomposition (zero if none)
+    int numcellsperdim = 0, nprocs = 0;
+    ///task of each top-level cell in the previous decomposition
+    vector<int> cellnodeids;
+    ///number of particles in each top-level cell of the previous snapshot
+    vector<unsigned long long> cellnodenumparts;
+    ///largest spherical overdensity radius of each previous structure keyed by the id of its most bound particle
+    unordered_map<long long, Double_t> soradius;
+};
+
 /* Structure to hold the location of a top-level cell. */
 struct cell_loc {
 
@@ -487,6 +503,9 @@ struct Options
     Double_t mpipartfac = 0.1;
     /// if using parallel output, number of mpi threads to group together
     int mpinprocswritesize = 1;
+    /// if using parallel output, number of tasks in a write communicator per MPI-IO aggregator
+    /// that gathers their data and writes it to the file. 0 leaves the choice to the MPI library
+    int mpinprocsperwriteaggregator = 0;
 
     /// run FOF using OpenMP
     int iopenmpfof = 1;
@@ -643,6 +662,34 @@ struct Options
     int iverbose = 0;
     ///whether or not to write a fof.grp tipsy like array file
     int iwritefof = 0;
+    ///whether or not to write a binary FOF membership file that can be reloaded to skip the FOF search
+    int iwritefofmembership = 0;
+    ///base name of FOF membership files to read instead of running the FOF search (empty if FOF search is run)
+    string fofmembershipinputname;
+    ///whether or not to write a warm start file for the next snapshot
+    int iwritewarmstart = 0;
+    ///base name of the warm start file written by the previous snapshot (empty if starting cold)
+    string warmstartinputname;
+    ///factor applied to the previous spherical overdensity radius to give the first shell of the SO search
+    Double_t warmstartsoradiusfac = 1.5;
+    ///warm start state read from the previous snapshot
+    WarmStartInfo warmstart;
+    /// \name HDF output filters, chosen per dataset by its type (see \ref H5OutputFile)
+    //@{
+#ifdef USEHDFCOMPRESSION
+    ///deflate level of integer and string datasets, 0 disables compression
+    int hdfoutputintdeflate = 6;
+    ///deflate level of floating point datasets, 0 disables compression
+    int hdfoutputfloatdeflate = 1;
+#else
+    int hdfoutputintdeflate = 0;
+    int hdfoutputfloatdeflate = 0;
+#endif
+    ///whether the byte shuffle filter is applied before deflating
+    int ihdfoutputshuffle = 1;
+    ///target size in bytes of a chunk of a filtered dataset. Datasets no larger than one chunk are not filtered
+    unsigned long long hdfoutputchunkbytes = 262144;
+    //@}
     ///whether mass properties for field objects are inclusive
     int iInclusiveHalo = 0;
 
@@ -732,12 +779,20 @@ struct Options
     /// if want full spherical overdensity, factor by which size is multiplied to get
     ///bucket of particles
     Double_t SphericalOverdensitySeachFac = 2.5;
+    /// factor (>1) by which successive shells grow when particles are gathered in expanding shells about SO centres,
+    /// starting at the search radius divided by \ref SphericalOverdensitySeachFac
+    Double_t SphericalOverdensityShellFac = 1.25;
     ///if want to the particle IDs that are within the SO overdensity of a halo
     int iSphericalOverdensityPartList = 0;
     /// if want to include more than just field objects (halos) in full SO calculations
     int SphericalOverdensitySeachMaxStructLevel = HALOSTYPE;
     /// flag to store whether SO calculations need extra properties
     bool iSphericalOverdensityExtraFieldCalculations = false;
+    /// if halo SO search regions overlap other mpi domains, evaluate partial radial profiles on those domains
+    /// using only the exported halo centres rather than importing particles
+    int iSphericalOverdensityRemoteProfile = 0;
+    /// number of logarithmic radial bins in the partial radial profiles returned by other mpi domains
+    int SphericalOverdensityRemoteProfileNumBins = 128;
     /// \name Extra variables to store information useful in zoom simluations
     //@{
     /// store the lowest dark matter particle mass
@@ -786,6 +841,8 @@ struct Options
 
     /// holds the number of particles in a given top-level cell
     vector<unsigned long long> cellnodenumparts;
+    /// total number of particles in each top-level cell over all mpi domains, kept for the warm start file
+    vector<unsigned long long> cellnodetotalnumparts;
 
     /// allowed mesh based mpi decomposition load imbalance
 #ifndef SWIFTINTERFACE
@@ -2986,6 +3043,53 @@ struct DataGroupNames {
 };
 #endif
 
+///particle id and the global id of the group it belongs to, used to match FOF membership read from
+///file (see \ref ReadFOFMembership) to local particles
+struct fofmembership_entry {
+    long long PID;
+    Int_t iGroup;
+    Int_t Index;
+    int Task;
+};
+
+///ids of a particle written to the extended output, along with its position in the original input
+///file (see \ref WriteExtendedOutput)
+struct extendedoutput_entry {
+    long long PID;
+    Int_t IdStruct, IdHost, IdTopHost;
+    Int_t OIndex;
+    int OFile;
+};
+
+///centre, mean velocity and inverse velocity dispersion of a grid cell sent to tasks whose particles need it
+///to interpolate the background velocity distribution (see \ref MPIBuildGridData)
+struct gridexport_entry {
+    Double_t xm[3];
+    Coordinate gvel;
+    Matrix gveldisp;
+};
+
+///Node of a \ref GroupMemberIndex, covering members [start,end) with bounds in position and velocity.
+///Leaf nodes have left=right=-1
+struct groupmember_node {
+    Int_t start, end;
+    Int_t left, right;
+    Double_t xbnd[3][2], vbnd[3][2];
+};
+
+///k-d index over particles belonging to groups, used to associate baryons with the group of the closest
+///dark matter particle in phase-space (see \ref SearchBaryons). Members are accessed through an index
+///permutation and their phase-space coordinates are stored in index order so the particle array is not reordered
+struct GroupMemberIndex {
+    ///index of each member in the particle array the index was built from
+    vector<Int_t> member;
+    ///group id and length used to decide whether a member is a candidate
+    vector<Int_t> gid, glen;
+    ///positions and velocities, 3 per member
+    vector<Double_t> x, v;
+    vector<groupmember_node> nodes;
+};
+
 ///Useful structore to store information of leaf nodes in the tree
 struct leaf_node_info{
     int num, numtot;
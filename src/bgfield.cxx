@@ -50,7 +50,6 @@ private(i,vel) if (nbodies > ompsubsearchnum)
     //then build tree
     KDTree *tree;
     int itreetype = tree->TPHYS, ikerntype = tree->KEPAN, isplittingcriterion = 0, ianiso = 0 , iscale = 0;
-    bool runomp = (nbodies > ompsubsearchnum);
     LOG(trace) << "Grid system using leaf nodes with maximum size of " << opt.Ncell;
     if (opt.gridtype==PHYSGRID) {
         LOG(trace) << "Building Physical Tree using simple spatial extend as splitting criterion";
@@ -71,7 +70,7 @@ private(i,vel) if (nbodies > ompsubsearchnum)
         //if phase tree, use entropy criterion with anisotropic kernel
         //tree=new KDTree(Part,nbodies,opt.Ncell,tree->TPHS,tree->KEPAN,100,1,1);
     }
-    tree=new KDTree(Part,nbodies,opt.Ncell,itreetype,ikerntype,100,isplittingcriterion,ianiso,iscale,NULL,NULL,runomp);
+    tree=BuildKDTree(Part,nbodies,opt.Ncell,itreetype,ikerntype,100,isplittingcriterion,ianiso,iscale);
     return tree;
 }
 
@@ -225,14 +225,20 @@ void ReorderGroupIDs(const Int_t numgroups, const Int_t newnumgroups, Int_t *num
 }
 void ReorderGroupIDs(const Int_t numgroups, const Int_t newnumgroups, Int_t *numingroup, Int_t *pfof, Int_t **pglist, Particle *Partsubset)
 {
-    PriorityQueue *pq=new PriorityQueue(newnumgroups);
-    Int_t groupid,size;
-    for (Int_t i = 1; i <=numgroups; i++) if (numingroup[i]>0) pq->Push(i, numingroup[i]);
-    for (Int_t i = 1; i<=newnumgroups; i++) {
-        groupid=pq->TopQueue();size=pq->TopPriority();pq->Pop();
-        for (Int_t j=0;j<size;j++) pfof[Partsubset[pglist[groupid][j]].GetID()]=i;
+    //order surviving groups by size, ties broken by old id so the new ids are deterministic,
+    //then relabel the members of each group, which are disjoint so groups can be relabelled in parallel
+    vector<Int_t> groupids;
+    groupids.reserve(newnumgroups);
+    for (Int_t i = 1; i <=numgroups; i++) if (numingroup[i]>0) groupids.push_back(i);
+    std::stable_sort(groupids.begin(), groupids.end(), [&](Int_t a, Int_t b) {return numingroup[a]>numingroup[b];});
+    Int_t ngroups = groupids.size();
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (ngroups > ompunbindnum)
+#endif
+    for (Int_t i = 0; i < ngroups; i++) {
+        Int_t groupid = groupids[i];
+        for (Int_t j=0;j<numingroup[groupid];j++) pfof[Partsubset[pglist[groupid][j]].GetID()]=i+1;
     }
-    delete pq;
 }
 
 ///similar to \ref ReorderGroupIDs but weight by value
@@ -9,11 +9,13 @@
 
 void H5OutputFile::truncate(const std::string &filename, hid_t access_plist)
 {
+    file_name = filename;
     file_id = safe_hdf5(H5Fcreate, filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, access_plist);
 }
 
 void H5OutputFile::open(const std::string &filename, hid_t access_plist)
 {
+    file_name = filename;
     file_id = safe_hdf5(H5Fopen, filename.c_str(), H5F_ACC_RDWR, access_plist);
 }
 
@@ -28,7 +30,11 @@ void H5OutputFile::create(CreationFunction file_creator, hid_t flag, int rank)
     MPI_Comm comm = mpi_comm_write;
     if (writing_rank == ALL_RANKS) {
         auto parallel_access_id = safe_hdf5(H5Pcreate, H5P_FILE_ACCESS);
-        safe_hdf5(H5Pset_fapl_mpio, parallel_access_id, comm, MPI_INFO_NULL);
+        safe_hdf5(H5Pset_fapl_mpio, parallel_access_id, comm, mpi_info_write);
+#if H5_VERSION_GE(1, 10, 0)
+        // metadata is flushed with one collective write rather than small writes from every rank
+        safe_hdf5(H5Pset_coll_metadata_write, parallel_access_id, true);
+#endif
         file_creator(parallel_access_id);
         safe_hdf5(H5Pclose, parallel_access_id);
     }
@@ -79,8 +85,42 @@ void H5OutputFile::close()
     if(file_id < 0) {
         io_error("Attempted to close file which is not open!");
     }
+    if (bytes_written > 0) {
+        hsize_t file_size = 0;
+        H5Fget_filesize(file_id, &file_size);
+        LOG(info) << "Wrote " << vr::memory_amount(bytes_written) << " of data to " << file_name
+            << " in " << vr::us_time(write_time) << ", file size is " << vr::memory_amount(file_size);
+    }
     H5Fclose(file_id);
     file_id = -1;
+    bytes_written = 0;
+    write_time = 0;
+    has_layout = false;
+}
+
+void H5OutputFile::set_parallel_layout(hsize_t nlocal)
+{
+    has_layout = true;
+    layout_nlocal = nlocal;
+    layout_offset = 0;
+    layout_total = nlocal;
+    layout_nmax = nlocal;
+#ifdef USEPARALLELHDF
+    if (writing_rank != ALL_RANKS) return;
+    int comm_size;
+    int comm_rank;
+    MPI_Comm_size(mpi_comm_write, &comm_size);
+    MPI_Comm_rank(mpi_comm_write, &comm_rank);
+    std::vector<hsize_t> all_nlocal(comm_size);
+    MPI_Allgather(&nlocal, 1, MPI_UNSIGNED_LONG_LONG,
+        all_nlocal.data(), 1, MPI_UNSIGNED_LONG_LONG, mpi_comm_write);
+    layout_total = 0;
+    for (auto rank = 0; rank != comm_size; rank++) {
+        if (rank < comm_rank) layout_offset += all_nlocal[rank];
+        layout_total += all_nlocal[rank];
+        layout_nmax = std::max(layout_nmax, all_nlocal[rank]);
+    }
+#endif
 }
 
 
@@ -110,37 +150,47 @@ void H5OutputFile::write_dataset(Options opt, string name, hsize_t len, string d
 }
 
 
-static hid_t get_dataset_creation_property(int rank, hsize_t *dims)
+/// Choose the filters of a dataset from the class of its data. Integer data such as IDs and counts compresses
+/// well once byte shuffled, while floating point properties gain little from high deflate levels so are given
+/// their own (typically lower) level. Chunks span whole rows and are sized to be close to opt.hdfoutputchunkbytes.
+/// Datasets no larger than a single chunk are not filtered.
+static hid_t get_dataset_creation_property(const Options &opt, int rank, hsize_t *dims, hid_t filetype_id, bool write_in_parallel)
 {
-#ifdef USEHDFCOMPRESSION
-    // Compress data only if all dimensions are > 0
-    // and at least one dimension must be "large enough"
-    auto positive_dims = std::all_of(dims, dims + rank, [](hsize_t dim) { return dim > 0; });
-    auto large_dataset = std::any_of(dims, dims + rank, [](hsize_t dim) { return dim > HDFOUTPUTCHUNKSIZE; });
-
-    if (positive_dims && large_dataset) {
-        vector<hsize_t> chunks(rank);
-        std::transform(dims, dims + rank, chunks.begin(),
-            [](hsize_t dim) { return std::min(dim, static_cast<hsize_t>(HDFOUTPUTCHUNKSIZE)); }
-        );
-        auto prop_id = H5Pcreate(H5P_DATASET_CREATE);
-        H5Pset_layout(prop_id, H5D_CHUNKED);
-        H5Pset_chunk(prop_id, rank, chunks.data());
-        H5Pset_deflate(prop_id, HDFDEFLATE);
-        return prop_id;
-    }
+    auto level = (H5Tget_class(filetype_id) == H5T_FLOAT) ? opt.hdfoutputfloatdeflate : opt.hdfoutputintdeflate;
+    if (level <= 0) return H5P_DEFAULT;
+#if defined(USEPARALLELHDF) && !defined(PARALLELCOMPRESSIONACTIVE)
+    // filtered datasets can only be written in parallel by HDF5 >= 1.10.2
+    if (write_in_parallel) return H5P_DEFAULT;
 #endif
-    return H5P_DEFAULT;
+    if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) <= 0) return H5P_DEFAULT;
+    auto positive_dims = std::all_of(dims, dims + rank, [](hsize_t dim) { return dim > 0; });
+    if (!positive_dims) return H5P_DEFAULT;
+
+    hsize_t row_size = std::accumulate(dims + 1, dims + rank, hsize_t{1}, std::multiplies<hsize_t>{});
+    row_size *= H5Tget_size(filetype_id);
+    hsize_t chunk_rows = std::max(hsize_t{1}, static_cast<hsize_t>(opt.hdfoutputchunkbytes) / row_size);
+    if (dims[0] <= chunk_rows) return H5P_DEFAULT;
+
+    vector<hsize_t> chunks(dims, dims + rank);
+    chunks[0] = chunk_rows;
+    auto prop_id = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_layout(prop_id, H5D_CHUNKED);
+    H5Pset_chunk(prop_id, rank, chunks.data());
+    if (opt.ihdfoutputshuffle) H5Pset_shuffle(prop_id);
+    H5Pset_deflate(prop_id, level);
+    return prop_id;
 }
 
 static void write_in_chunks(const void *data, hsize_t *dims,
     std::vector<hsize_t> &offsets,
     hid_t dset_id, hid_t prop_id,
     hid_t filespace_id, hid_t memtype_id,
-    bool write_in_parallel, bool verbose)
+    hsize_t nmax, bool verbose)
 {
     // hdf5 has trouble writing >= 2GB at once, so we write in chunks
-    // We cut chunks on the first dimension, the rest are always taken fully
+    // We cut chunks on the first dimension, the rest are always taken fully.
+    // The number of rounds follows from the largest first dimension of all writing ranks (nmax),
+    // so parallel writers agree on it without exchanging messages
     constexpr std::size_t MAX_HDF5_WRITE_SIZE = 2147483647;
     auto type_size = safe_hdf5(H5Tget_size, memtype_id);
     auto ndims = offsets.size();
@@ -156,8 +206,9 @@ static void write_in_chunks(const void *data, hsize_t *dims,
         LOG(debug) << "Preparing to write in chunks. Type size: " << type_size <<  ", slice size: " << slice_size << ", max_chunk_count: " << max_chunk_count;
     }
 
+    hsize_t nrounds = std::max(hsize_t{1}, static_cast<hsize_t>((nmax + max_chunk_count - 1) / max_chunk_count));
     const char *start = static_cast<const char *>(data);
-    while (true) {
+    for (hsize_t iround = 0; iround < nrounds; iround++) {
 
         hsize_t nchunks = std::min(std::size_t{dims[0]}, max_chunk_count);
         assert(nchunks * slice_size <= MAX_HDF5_WRITE_SIZE);
@@ -177,17 +228,6 @@ static void write_in_chunks(const void *data, hsize_t *dims,
         safe_hdf5(H5Dwrite, dset_id, memtype_id, memspace_id, filespace_id, prop_id, start);
         safe_hdf5(H5Sclose, memspace_id);
 
-        // all written?
-        int done = nchunks == dims[0];
-#ifdef USEPARALLELHDF
-        if (write_in_parallel) {
-            MPI_Allreduce(MPI_IN_PLACE, &done, 1, MPI_INT, MPI_MIN, mpi_comm_write);
-        }
-#endif // USEPARALLELHDF
-        if (done) {
-            break;
-        }
-
         // adjust for next round
         offsets[0] += nchunks;
         start += nchunks * slice_size;
@@ -196,37 +236,41 @@ static void write_in_chunks(const void *data, hsize_t *dims,
 };
 
 
-void H5OutputFile::write_dataset_nd(Options opt, std::string name,
-    int ndims, hsize_t *dims, void *data,
-    hid_t memtype_id, hid_t filetype_id,
-    bool flag_parallel)
+// Collective transfers when writing in parallel, default otherwise
+static hid_t get_transfer_property(bool write_in_parallel)
 {
-    bool write_in_parallel = flag_parallel && opt.mpinprocswritesize > 1;
-    assert(ndims > 0);
-
-    if (verbose && LOG_ENABLED(debug)) {
-        std::ostringstream os;
-        os << "Writing dataset " << name << " with dimensions ";
-        os << vr::printable_range(dims, ndims);
-        os << " in " << (write_in_parallel ? "parallel" : "serial");
-        LOG(debug) << os.str();
-    }
-    // Get HDF5 data type of the array in memory
-    if (memtype_id == -1) {
-        throw std::runtime_error("Write data set called with void pointer but no type info passed.");
-    }
-    // Determine type of the dataset to create
-    if (filetype_id < 0) {
-        filetype_id = memtype_id;
+    hid_t prop_id = H5P_DEFAULT;
+#ifdef USEPARALLELHDF
+    if (write_in_parallel) {
+        prop_id = safe_hdf5(H5Pcreate, H5P_DATASET_XFER);
+        safe_hdf5(H5Pset_dxpl_mpio, prop_id, H5FD_MPIO_COLLECTIVE);
     }
+#endif // USEPARALLELHDF
+    return prop_id;
+}
 
+hid_t H5OutputFile::create_dataset(const Options &opt, const std::string &name,
+    int ndims, hsize_t *dims, hid_t filetype_id, bool write_in_parallel,
+    std::vector<hsize_t> &offsets, hid_t &filespace_id, hsize_t &nmax)
+{
     // Get full extent of the dataset and calculate local offsets, if required.
     // Only the first dimension is written in parallel, it's assumed
     // all other dimensions are the same in all MPI ranks
-    std::vector<hsize_t> offsets(ndims);
+    offsets.assign(ndims, 0);
+    nmax = dims[0];
 #ifdef USEPARALLELHDF
     std::vector<hsize_t> extended_dims(dims, dims + ndims);
-    if (write_in_parallel) {
+    if (write_in_parallel && has_layout) {
+        // the other ranks are already committed to the collective create, so a mismatch cannot be recovered
+        if (!parallel_layout_matches(dims[0])) {
+            io_error("Dataset " + name + " has " + std::to_string(dims[0]) +
+                " rows but the parallel output layout expects " + std::to_string(layout_nlocal));
+        }
+        offsets[0] = layout_offset;
+        extended_dims[0] = layout_total;
+        nmax = layout_nmax;
+    }
+    else if (write_in_parallel) {
 
         int comm_size;
         int comm_rank;
@@ -256,6 +300,7 @@ void H5OutputFile::write_dataset_nd(Options opt, std::string name,
         for (auto rank = 0; rank != comm_size; rank++) {
             auto first_dim_size = all_dims[rank * ndims];
             extended_dims[0] += first_dim_size;
+            nmax = std::max(nmax, first_dim_size);
             if (rank < comm_rank) {
                 offsets[0] += first_dim_size;
             }
@@ -265,7 +310,6 @@ void H5OutputFile::write_dataset_nd(Options opt, std::string name,
 
     // Create dataspaces. When writing in parallel, the file dataspace spans
     // the full extent of the (distributed) data, so it's different
-    hid_t filespace_id;
 #ifdef USEPARALLELHDF
     if (write_in_parallel) {
         filespace_id = safe_hdf5(H5Screate_simple, ndims, extended_dims.data(), nullptr);
@@ -280,31 +324,101 @@ void H5OutputFile::write_dataset_nd(Options opt, std::string name,
     hid_t prop_id;
 #ifdef USEPARALLELHDF
     if (write_in_parallel) {
-        prop_id = get_dataset_creation_property(ndims, extended_dims.data());
+        prop_id = get_dataset_creation_property(opt, ndims, extended_dims.data(), filetype_id, write_in_parallel);
     }
     else
 #endif
     {
-        prop_id = get_dataset_creation_property(ndims, dims);
+        prop_id = get_dataset_creation_property(opt, ndims, dims, filetype_id, write_in_parallel);
     }
     auto dset_id = safe_hdf5(H5Dcreate, file_id, name.c_str(), filetype_id, filespace_id,
         H5P_DEFAULT, prop_id, H5P_DEFAULT);
     safe_hdf5(H5Pclose, prop_id);
+    return dset_id;
+}
 
-    prop_id = H5P_DEFAULT;
-#ifdef USEPARALLELHDF
-    if (write_in_parallel) {
-        // set up the collective transfer properties list
-        prop_id = safe_hdf5(H5Pcreate, H5P_DATASET_XFER);
-        safe_hdf5(H5Pset_dxpl_mpio, prop_id, H5FD_MPIO_COLLECTIVE);
+void H5OutputFile::write_dataset_nd(Options opt, std::string name,
+    int ndims, hsize_t *dims, void *data,
+    hid_t memtype_id, hid_t filetype_id,
+    bool flag_parallel)
+{
+    bool write_in_parallel = flag_parallel && opt.mpinprocswritesize > 1;
+    assert(ndims > 0);
+
+    if (verbose && LOG_ENABLED(debug)) {
+        std::ostringstream os;
+        os << "Writing dataset " << name << " with dimensions ";
+        os << vr::printable_range(dims, ndims);
+        os << " in " << (write_in_parallel ? "parallel" : "serial");
+        LOG(debug) << os.str();
+    }
+    // Get HDF5 data type of the array in memory
+    if (memtype_id == -1) {
+        throw std::runtime_error("Write data set called with void pointer but no type info passed.");
+    }
+    // Determine type of the dataset to create
+    if (filetype_id < 0) {
+        filetype_id = memtype_id;
     }
-#endif // USEPARALLELHDF
-    write_in_chunks(data, dims, offsets, dset_id, prop_id, filespace_id, memtype_id, write_in_parallel, verbose);
+
+    std::vector<hsize_t> offsets;
+    hsize_t nmax;
+    hid_t filespace_id;
+    vr::Timer timer;
+    auto dset_id = create_dataset(opt, name, ndims, dims, filetype_id, write_in_parallel, offsets, filespace_id, nmax);
+    auto prop_id = get_transfer_property(write_in_parallel);
+    bytes_written += std::accumulate(dims, dims + ndims, hsize_t{1}, std::multiplies<hsize_t>{}) * H5Tget_size(memtype_id);
+    write_in_chunks(data, dims, offsets, dset_id, prop_id, filespace_id, memtype_id, nmax, verbose);
 
     // Clean up (note that dtype_id is NOT a new object so don't need to close it)
     safe_hdf5(H5Pclose, prop_id);
     safe_hdf5(H5Dclose, dset_id);
     safe_hdf5(H5Sclose, filespace_id);
+    write_time += timer.get();
+}
+
+void H5OutputFile::write_dataset_streamed(Options opt, std::string name, hsize_t len,
+    hsize_t nbuffer, const std::function<void(hsize_t, hsize_t, void *)> &fill,
+    hid_t memtype_id, hid_t filetype_id, bool flag_parallel)
+{
+    bool write_in_parallel = flag_parallel && opt.mpinprocswritesize > 1;
+    if (filetype_id < 0) {
+        filetype_id = memtype_id;
+    }
+    hsize_t dims[1] = {len};
+    std::vector<hsize_t> offsets;
+    hsize_t nmax;
+    hid_t filespace_id;
+    vr::Timer timer;
+    auto dset_id = create_dataset(opt, name, 1, dims, filetype_id, write_in_parallel, offsets, filespace_id, nmax);
+    auto prop_id = get_transfer_property(write_in_parallel);
+    auto type_size = H5Tget_size(memtype_id);
+    nbuffer = std::max(hsize_t{1}, std::min(nbuffer, hsize_t(2147483647 / type_size)));
+    std::vector<char> buffer(std::min(len, nbuffer) * type_size);
+
+    // every rank takes part in the same number of (collective) writes, those done early write nothing
+    hsize_t nrounds = std::max(hsize_t{1}, (nmax + nbuffer - 1) / nbuffer);
+    for (hsize_t iround = 0, start = 0; iround < nrounds; iround++) {
+        hsize_t n = std::min(nbuffer, len - start);
+        hsize_t offset = offsets[0] + start;
+        if (n > 0) fill(start, n, buffer.data());
+        hid_t memspace_id = safe_hdf5(H5Screate_simple, 1, &n, nullptr);
+        if (n == 0) {
+            safe_hdf5(H5Sselect_none, filespace_id);
+        }
+        else {
+            safe_hdf5(H5Sselect_hyperslab, filespace_id, H5S_SELECT_SET, &offset, nullptr, &n, nullptr);
+        }
+        safe_hdf5(H5Dwrite, dset_id, memtype_id, memspace_id, filespace_id, prop_id, buffer.data());
+        safe_hdf5(H5Sclose, memspace_id);
+        start += n;
+    }
+    bytes_written += len * type_size;
+
+    safe_hdf5(H5Pclose, prop_id);
+    safe_hdf5(H5Dclose, dset_id);
+    safe_hdf5(H5Sclose, filespace_id);
+    write_time += timer.get();
 }
 
 void H5OutputFile::write_attribute(string parent, string name, string data)
@@ -595,6 +595,58 @@ inline void LoadExtraPropertiesFromDataset(
 
 
 ///reads an hdf5 formatted file.
+#ifdef USEMPI
+///Convert a chunk of nchunk particles read into native type columns (see \ref HDF5ReadHyperSlabNative) to the buffers
+///used to build the particles in one parallel pass. Positions stay in input units since they place the particles in
+///the input domain decomposition, and are scaled as particles are built. Velocities are converted to internal units,
+///including the Hubble flow, which uses the input positions. Masses (read only if imass) stay in input units for the
+///minimum mass checks made as particles are built, ids are widened to long long
+static void HDFConvertNativeChunk(unsigned long long nchunk,
+    const HDF5NativeColumn &poscol, const HDF5NativeColumn &velcol,
+    const HDF5NativeColumn &idcol, const HDF5NativeColumn &masscol, bool imass,
+    double boxsize, double vscale, double Hubbleflow,
+    double *pos, double *vel, long long *ids, double *mass)
+{
+#ifdef USEOPENMP
+#pragma omp parallel default(shared) if (nchunk > ompsearchnum)
+{
+#endif
+    HDF5VisitNativeColumn(poscol, [&](auto *x) {
+#ifdef USEOPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (unsigned long long nn=0;nn<nchunk;nn++) {
+            for (auto j=0;j<3;j++) pos[nn*3+j] = x[nn*3+j];
+#ifdef PERIODWRAPINPUT
+            PeriodWrapInput<double>(boxsize, pos[nn*3], pos[nn*3+1], pos[nn*3+2]);
+#endif
+        }
+    });
+    HDF5VisitNativeColumn(velcol, [&](auto *v) {
+#ifdef USEOPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (unsigned long long nn=0;nn<nchunk;nn++)
+            for (auto j=0;j<3;j++) vel[nn*3+j] = v[nn*3+j]*vscale + Hubbleflow*pos[nn*3+j];
+    });
+    HDF5VisitNativeColumn(idcol, [&](auto *id) {
+#ifdef USEOPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (unsigned long long nn=0;nn<nchunk;nn++) ids[nn] = id[nn];
+    });
+    if (imass) HDF5VisitNativeColumn(masscol, [&](auto *m) {
+#ifdef USEOPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (unsigned long long nn=0;nn<nchunk;nn++) mass[nn] = m[nn];
+    });
+#ifdef USEOPENMP
+}
+#endif
+}
+#endif
+
 void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle *&Pbaryons, Int_t nbaryons)
 {
     //structure stores the names of the groups in the hdf input
@@ -741,6 +793,10 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
     Int_t BufSize=opt.mpiparticlebufsize;
     Int_t *Nbuf, *Nreadbuf,*nreadoffset;
     int ibuf=0;
+    vector<int> chunkproc;
+    //positions, velocities, ids and masses of a chunk read in the native type of their datasets
+    HDF5NativeColumn poscol, velcol, idcol, masscol;
+    double massval;
     Int_t ibufindex;
     Int_t *Nlocalthreadbuf;
     int *irecv, *mpi_irecvflag;
@@ -2224,6 +2280,19 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
     //for all mpi threads that are reading input data, open file load access to data structures and begin loading into either local buffer or temporary buffer to be send to
     //non-read threads
     if (ireadtask[ThisTask]>=0) {
+        //read tasks know the scale factor from the header, so particles are converted to internal units as they are read
+        double vscale = 0.0;
+
+        // SWIFT snapshot velocities already contain the sqrt(a) factor,
+        // so there is no need to include it.
+        if(opt.ihdfnameconvention == HDFSWIFTEAGLENAMES || opt.ihdfnameconvention == HDFOLDSWIFTEAGLENAMES ||
+            opt.ihdfnameconvention == HDFSWIFTFLAMINGONAMES) {
+            vscale = opt.velocityinputconversion;
+        }
+        else {
+            vscale = opt.velocityinputconversion*sqrt(opt.a);
+        }
+
         inreadsend=0;
         count2=bcount2=0;
         for(i=0; i<opt.num_files; i++) if(ireadfile[i])
@@ -2636,9 +2705,9 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
 
 #ifdef USEPARALLELHDF
             if (opt.num_files<opt.nsnapread) {
-                LOG(trace)<< "Now since num_files is less than number of reading tasks create an independent mpio";
+                LOG(trace)<< "Now since num_files is less than number of reading tasks create a collective mpio";
                 plist_id = H5Pcreate(H5P_DATASET_XFER);
-                H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_INDEPENDENT);
+                H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
             }
 #endif
             LOG(debug) << "Now looking at reading information, first standard fields";
@@ -2655,28 +2724,36 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                         nend = nlocalsize + nstart;
                 }
 #endif
-                if (nend-nstart<chunksize)nchunk=nend-nstart;
-                else nchunk=chunksize;
+                unsigned long long nreads = (nend-nstart+chunksize-1)/chunksize;
+#ifdef USEPARALLELHDF
+                //collective reads need every task sharing the file to take part in each read,
+                //so all loop over the largest share (the last task's) and read nothing once done
+                if (opt.num_files<opt.nsnapread) {
+                    nreads = hdf_header_info[i].npart[k] - nlocalsize*(NProcsParallelReadTask-1);
+                    nreads = (nreads+chunksize-1)/chunksize;
+                }
+#endif
                 ninputoffset = 0;
-                for(n=nstart;n<nend;n+=nchunk)
+                n = nstart;
+                for(unsigned long long iread=0;iread<nreads;iread++,n+=nchunk)
                 {
-                    if (nend - n < chunksize && nend - n > 0) nchunk=nend-n;
+                    nchunk = (n < nend) ? min(chunksize, nend-n) : 0;
                     //setup hyperslab so that it is loaded into the buffer
                     //load positions
                     itemp=0;
-                    //set hyperslab
-                    HDF5ReadHyperSlabReal(doublebuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 3, nchunk, n, plist_id);
+                    //set hyperslab, reading positions, velocities, ids and masses in their native type
+                    HDF5ReadHyperSlabNative(poscol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     //velocities
                     itemp++;
-                    HDF5ReadHyperSlabReal(veldoublebuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 3, nchunk, n, plist_id);
+                    HDF5ReadHyperSlabNative(velcol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     //ids
                     itemp++;
-                    HDF5ReadHyperSlabInteger(longbuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 1, nchunk, n, plist_id);
+                    HDF5ReadHyperSlabNative(idcol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
 
                     //masses
                     itemp++;
                     if (hdf_header_info[i].mass[k]==0) {
-                        HDF5ReadHyperSlabReal(massdoublebuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 1, nchunk, n, plist_id);
+                        HDF5ReadHyperSlabNative(masscol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     }
 #ifdef GASON
                     //self-energy
@@ -2995,12 +3072,13 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                         iextraoffset += opt.extra_dm_internalprop_names.size();
 #endif
                     }
+                HDFConvertNativeChunk(nchunk, poscol, velcol, idcol, masscol, hdf_header_info[i].mass[k]==0,
+                    hdf_header_info[i].BoxSize, vscale, Hubbleflow, doublebuff, veldoublebuff, longbuff, massdoublebuff);
                 LOG(debug) << "Now getting where the data should be sent";
+                //destinations of the whole chunk are determined at once
+                MPIGetParticlesProcessor(opt, nchunk, doublebuff, chunkproc);
                 for (unsigned long long nn=0;nn<nchunk;nn++) {
-#ifdef PERIODWRAPINPUT
-                    PeriodWrapInput<double>(hdf_header_info[i].BoxSize, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
-#endif
-                    ibuf=MPIGetParticlesProcessor(opt, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
+                    ibuf=chunkproc[nn];
                     ibufindex=ibuf*BufSize+Nbuf[ibuf];
                     //reset hydro quantities of buffer
 #ifdef GASON
@@ -3023,7 +3101,8 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                     Pbuf[ibufindex].SetExtraDMProperties();
 #endif
 
-                    Pbuf[ibufindex].SetPosition(doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
+                    //positions and masses are converted to internal units here, velocities already are
+                    Pbuf[ibufindex].SetPosition(doublebuff[nn*3]*lscale,doublebuff[nn*3+1]*lscale,doublebuff[nn*3+2]*lscale);
                     Pbuf[ibufindex].SetVelocity(veldoublebuff[nn*3],veldoublebuff[nn*3+1],veldoublebuff[nn*3+2]);
 #ifdef NOMASS
                     if (k==HDFDMTYPE) {
@@ -3031,8 +3110,8 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                         else opt.MassValue = hdf_header_info[i].mass[k];
                     }
 #endif
-                    if (hdf_header_info[i].mass[k]==0)Pbuf[ibufindex].SetMass(massdoublebuff[nn]);
-                    else Pbuf[ibufindex].SetMass(hdf_header_info[i].mass[k]);
+                    massval = (hdf_header_info[i].mass[k]==0) ? massdoublebuff[nn] : hdf_header_info[i].mass[k];
+                    Pbuf[ibufindex].SetMass(massval*mscale);
                     Pbuf[ibufindex].SetPID(longbuff[nn]);
                     Pbuf[ibufindex].SetID(nn);
                     if (k==HDFGASTYPE) Pbuf[ibufindex].SetType(GASTYPE);
@@ -3045,8 +3124,8 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                     else if (k==HDFBHTYPE) Pbuf[ibufindex].SetType(BHTYPE);
 
 #ifdef HIGHRES
-                    if (k==HDFDMTYPE && MP_DM>Pbuf[ibufindex].GetMass()) MP_DM=Pbuf[ibufindex].GetMass();
-                    if (k==HDFGASTYPE && MP_B<Pbuf[ibufindex].GetMass()) MP_B=Pbuf[ibufindex].GetMass();
+                    if (k==HDFDMTYPE && MP_DM>massval) MP_DM=massval;
+                    if (k==HDFGASTYPE && MP_B<massval) MP_B=massval;
 #endif
 #ifdef GASON
                     if (k==HDFGASTYPE) {
@@ -3344,27 +3423,35 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                         nend = nlocalsize + nstart;
                 }
 #endif
-                if (nend-nstart<chunksize)nchunk=nend-nstart;
-                else nchunk=chunksize;
+                unsigned long long nreads = (nend-nstart+chunksize-1)/chunksize;
+#ifdef USEPARALLELHDF
+                //collective reads need every task sharing the file to take part in each read,
+                //so all loop over the largest share (the last task's) and read nothing once done
+                if (opt.num_files<opt.nsnapread) {
+                    nreads = hdf_header_info[i].npart[k] - nlocalsize*(NProcsParallelReadTask-1);
+                    nreads = (nreads+chunksize-1)/chunksize;
+                }
+#endif
                 ninputoffset = 0;
-                for(n=nstart;n<nend;n+=nchunk)
+                n = nstart;
+                for(unsigned long long iread=0;iread<nreads;iread++,n+=nchunk)
                 {
-                    if (nend - n < chunksize && nend - n > 0) nchunk=nend-n;
+                    nchunk = (n < nend) ? min(chunksize, nend-n) : 0;
                     //setup hyperslab so that it is loaded into the buffer
                     //load positions
                     itemp=0;
-                    //set hyperslab
-                    HDF5ReadHyperSlabReal(doublebuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 3, nchunk, n, plist_id);
+                    //set hyperslab, reading positions, velocities, ids and masses in their native type
+                    HDF5ReadHyperSlabNative(poscol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     //velocities
                     itemp++;
-                    HDF5ReadHyperSlabReal(veldoublebuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 3, nchunk, n, plist_id);
+                    HDF5ReadHyperSlabNative(velcol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     //ids
                     itemp++;
-                    HDF5ReadHyperSlabInteger(longbuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 3, nchunk, n, plist_id);
+                    HDF5ReadHyperSlabNative(idcol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     //masses
                     itemp++;
                     if (hdf_header_info[i].mass[k]==0) {
-                        HDF5ReadHyperSlabReal(massdoublebuff,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], 1, 1, nchunk, n, plist_id);
+                        HDF5ReadHyperSlabNative(masscol,partsdatasetall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], partsdataspaceall[i*NHDFTYPE*NHDFDATABLOCK+k*NHDFDATABLOCK+itemp], nchunk, n, plist_id);
                     }
 #ifdef GASON
                     //self-energy
@@ -3403,11 +3490,12 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
 
 #endif
 #endif
+                    HDFConvertNativeChunk(nchunk, poscol, velcol, idcol, masscol, hdf_header_info[i].mass[k]==0,
+                        hdf_header_info[i].BoxSize, vscale, Hubbleflow, doublebuff, veldoublebuff, longbuff, massdoublebuff);
+                    //destinations of the whole chunk are determined at once
+                    MPIGetParticlesProcessor(opt, nchunk, doublebuff, chunkproc);
                     for (int nn=0;nn<nchunk;nn++) {
-#ifdef PERIODWRAPINPUT
-                    PeriodWrapInput<double>(hdf_header_info[i].BoxSize, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
-#endif
-                    ibuf=MPIGetParticlesProcessor(opt, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
+                    ibuf=chunkproc[nn];
                     ibufindex=ibuf*BufSize+Nbuf[ibuf];
                     //reset hydro quantities of buffer
 #ifdef GASON
@@ -3424,10 +3512,11 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
 #ifdef BHON
 #endif
                     //store particle info in Ptemp;
-                    Pbuf[ibufindex].SetPosition(doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
+                    //positions and masses are converted to internal units here, velocities already are
+                    Pbuf[ibufindex].SetPosition(doublebuff[nn*3]*lscale,doublebuff[nn*3+1]*lscale,doublebuff[nn*3+2]*lscale);
                     Pbuf[ibufindex].SetVelocity(veldoublebuff[nn*3],veldoublebuff[nn*3+1],veldoublebuff[nn*3+2]);
-                    if (hdf_header_info[i].mass[k]==0)Pbuf[ibufindex].SetMass(massdoublebuff[nn]);
-                    else Pbuf[ibufindex].SetMass(hdf_header_info[i].mass[k]);
+                    massval = (hdf_header_info[i].mass[k]==0) ? massdoublebuff[nn] : hdf_header_info[i].mass[k];
+                    Pbuf[ibufindex].SetMass(massval*mscale);
                     Pbuf[ibufindex].SetPID(longbuff[nn]);
                     Pbuf[ibufindex].SetID(nn);
                     if (k==HDFGASTYPE) Pbuf[ibufindex].SetType(GASTYPE);
@@ -3439,7 +3528,7 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
                     else if (k==HDFSTARTYPE) Pbuf[ibufindex].SetType(STARTYPE);
                     else if (k==HDFBHTYPE) Pbuf[ibufindex].SetType(BHTYPE);
 #ifdef HIGHRES
-                    if (k==HDFDMTYPE && MP_DM>Pbuf[ibufindex].GetMass()) MP_DM=Pbuf[ibufindex].GetMass();
+                    if (k==HDFDMTYPE && MP_DM>massval) MP_DM=massval;
 #endif
 #ifdef GASON
                     if (k==HDFGASTYPE) {
@@ -3647,19 +3736,6 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
 #endif
 
 #ifdef USEMPI
-
-    double vscale = 0.0;
-
-    // SWIFT snapshot velocities already contain the sqrt(a) factor,
-    // so there is no need to include it.
-    if(opt.ihdfnameconvention == HDFSWIFTEAGLENAMES || opt.ihdfnameconvention == HDFOLDSWIFTEAGLENAMES ||
-        opt.ihdfnameconvention == HDFSWIFTFLAMINGONAMES) {
-        vscale = opt.velocityinputconversion;
-    } 
-    else {
-        vscale = opt.velocityinputconversion*sqrt(opt.a);
-    }
-    
     if(opt.ihdfnameconvention == HDFSWIFTEAGLENAMES || opt.ihdfnameconvention == HDFOLDSWIFTEAGLENAMES ||
         opt.ihdfnameconvention == HDFSWIFTFLAMINGONAMES) {
         opt.internalenergyinputconversion = opt.a*opt.a*opt.velocityinputconversion*opt.velocityinputconversion;
@@ -3668,22 +3744,7 @@ void ReadHDF(Options &opt, vector<Particle> &Part, const Int_t nbodies,Particle
         opt.internalenergyinputconversion = opt.velocityinputconversion*opt.velocityinputconversion;
     }
 
-
-    //finally adjust to appropriate units
-    for (i=0;i<Nlocal;i++)
-    {
-      Part[i].SetMass(Part[i].GetMass()*mscale);
-      for (int j=0;j<3;j++) Part[i].SetVelocity(j,Part[i].GetVelocity(j)*vscale+Hubbleflow*Part[i].GetPosition(j));
-      for (int j=0;j<3;j++) Part[i].SetPosition(j,Part[i].GetPosition(j)*lscale);
-    }
-    if (Pbaryons!=NULL && opt.iBaryonSearch==1) {
-      for (i=0;i<Nlocalbaryon[0];i++)
-      {
-        Pbaryons[i].SetMass(Pbaryons[i].GetMass()*mscale);
-        for (int j=0;j<3;j++) Pbaryons[i].SetVelocity(j,Pbaryons[i].GetVelocity(j)*vscale+Hubbleflow*Pbaryons[i].GetPosition(j));
-        for (int j=0;j<3;j++) Pbaryons[i].SetPosition(j,Pbaryons[i].GetPosition(j)*lscale);
-    }
-    }
+    //particles were converted to internal units as they were read (see \ref HDFConvertNativeChunk)
 #endif
 
     delete[] intbuff;
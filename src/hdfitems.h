@@ -7,6 +7,7 @@
 #ifndef HDFITEMS_H
 #define HDFITEMS_H
 
+#include <functional>
 #include <hdf5.h>
 #include <string>
 
@@ -14,6 +15,7 @@
 #include "ioutils.h"
 #include "io.h"
 #include "logging.h"
+#include "timer.h"
 
 
 ///\name ILLUSTRIS specific constants
@@ -90,10 +92,6 @@
 #define HDFSWIFTFLAMINGONAMES    9
 //@}
 
-///size of chunks in hdf files for Compression
-#define HDFOUTPUTCHUNKSIZE 8192
-#define HDFDEFLATE    6
-
 
 #if H5_VERSION_GE(1,10,1)
 #define HDF5_FILE_GROUP_COMMON_BASE H5::Group
@@ -432,10 +430,19 @@ static inline void HDF5ReadHyperSlabReal(double *buffer,
     else {
         memdims.push_back(memsize);
     }
-    H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, start.data(), stride.data(), count.data(), block.data());
-    memspace = H5Screate_simple (1, memdims.data(), NULL);
+    //a task with nothing left to read still takes part in collective reads,
+    //so it selects nothing in both the file and memory dataspaces
+    if (memsize == 0) {
+        H5Sselect_none(dataspace);
+        memspace = H5Screate(H5S_SCALAR);
+        H5Sselect_none(memspace);
+    }
+    else {
+        H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, start.data(), stride.data(), count.data(), block.data());
+        memspace = H5Screate_simple (1, memdims.data(), NULL);
+    }
     safe_hdf5(H5Dread, dataset, H5T_NATIVE_DOUBLE, memspace, dataspace, plist_id, buffer);
-
+    H5Sclose(memspace);
 }
 
 static inline void HDF5ReadHyperSlabInteger(long long *buffer,
@@ -497,9 +504,96 @@ static inline void HDF5ReadHyperSlabInteger(long long *buffer,
     else {
         memdims.push_back(memsize);
     }
-    H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, start.data(), stride.data(), count.data(), block.data());
-    memspace = H5Screate_simple (1, memdims.data(), NULL);
+    //a task with nothing left to read still takes part in collective reads,
+    //so it selects nothing in both the file and memory dataspaces
+    if (memsize == 0) {
+        H5Sselect_none(dataspace);
+        memspace = H5Screate(H5S_SCALAR);
+        H5Sselect_none(memspace);
+    }
+    else {
+        H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, start.data(), stride.data(), count.data(), block.data());
+        memspace = H5Screate_simple (1, memdims.data(), NULL);
+    }
     safe_hdf5(H5Dread, dataset, H5T_NATIVE_LONG, memspace, dataspace, plist_id, buffer);
+    H5Sclose(memspace);
+}
+
+///Column of values read from a dataset in its own (native) type, so HDF5 does no type conversion on read.
+///Values are accessed with \ref HDF5VisitNativeColumn
+struct HDF5NativeColumn {
+    vector<char> data;
+    hid_t type = -1;
+    ~HDF5NativeColumn() {
+        if (type >= 0) H5Tclose(type);
+    }
+};
+
+///Read nchunk rows starting at row noffset of a 1D or 2D dataset (all of the second dimension) into col in the
+///native type of the dataset. As for \ref HDF5ReadHyperSlabReal, a task with nothing left to read still takes part
+///in collective reads by selecting nothing
+static inline void HDF5ReadHyperSlabNative(HDF5NativeColumn &col,
+    const hid_t &dataset, const hid_t &dataspace,
+    unsigned long long nchunk, unsigned long long noffset,
+    hid_t plist_id = H5P_DEFAULT)
+{
+    hsize_t ndim, memsize;
+    hid_t memspace, filetype;
+
+    if (col.type >= 0) H5Tclose(col.type);
+    filetype = safe_hdf5(H5Dget_type, dataset);
+    col.type = safe_hdf5(H5Tget_native_type, filetype, H5T_DIR_ASCEND);
+    H5Tclose(filetype);
+
+    ndim = H5Sget_simple_extent_ndims(dataspace);
+    vector<hsize_t> dims(ndim), start(ndim, 0), count(ndim);
+    H5Sget_simple_extent_dims(dataspace, dims.data(), NULL);
+    start[0] = noffset;
+    count = dims;
+    count[0] = nchunk;
+    memsize = 1;
+    for (auto x:count) memsize *= x;
+    col.data.resize(memsize*H5Tget_size(col.type));
+    if (memsize == 0) {
+        H5Sselect_none(dataspace);
+        memspace = H5Screate(H5S_SCALAR);
+        H5Sselect_none(memspace);
+    }
+    else {
+        H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, start.data(), NULL, count.data(), NULL);
+        memspace = H5Screate_simple(1, &memsize, NULL);
+    }
+    safe_hdf5(H5Dread, dataset, col.type, memspace, dataspace, plist_id, col.data.data());
+    H5Sclose(memspace);
+}
+
+///Call f with a pointer to the values of col in their C++ type, so conversions are done by the caller's own loop
+template<typename F> static inline void HDF5VisitNativeColumn(const HDF5NativeColumn &col, F &&f)
+{
+    const void *p = col.data.data();
+    size_t size = H5Tget_size(col.type);
+    H5T_class_t typeclass = H5Tget_class(col.type);
+    if (typeclass == H5T_FLOAT) {
+        if (size == sizeof(float)) return f(static_cast<const float *>(p));
+        if (size == sizeof(double)) return f(static_cast<const double *>(p));
+    }
+    else if (typeclass == H5T_INTEGER) {
+        bool issigned = (H5Tget_sign(col.type) == H5T_SGN_2);
+        if (size == 8) {
+            if (issigned) return f(static_cast<const int64_t *>(p));
+            return f(static_cast<const uint64_t *>(p));
+        }
+        if (size == 4) {
+            if (issigned) return f(static_cast<const int32_t *>(p));
+            return f(static_cast<const uint32_t *>(p));
+        }
+    }
+    LOG(error) << "Unsupported HDF5 input type of class " << typeclass << " and size " << size << ". Exiting";
+#ifdef USEMPI
+    MPI_Abort(MPI_COMM_WORLD, 8);
+#else
+    exit(8);
+#endif
 }
 
 ///\name HDF class to manage writing information
@@ -512,6 +606,14 @@ private:
     bool verbose = false;
     hid_t file_id = -1;
     int writing_rank = ALL_RANKS;
+    std::string file_name;
+    /// bytes of data written to datasets and time spent writing them, reported when the file is closed
+    unsigned long long bytes_written = 0;
+    vr::Timer::duration write_time = 0;
+    /// layout of the first (parallel) dimension shared by a block of datasets, gathered once by
+    /// set_parallel_layout so the datasets written with it need no size exchange of their own
+    bool has_layout = false;
+    hsize_t layout_nlocal = 0, layout_offset = 0, layout_total = 0, layout_nmax = 0;
 
     // Called if a HDF5 call fails (might need to MPI_Abort)
     void io_error(std::string message) {
@@ -530,6 +632,12 @@ private:
 
     void write_attribute(const std::string &parent, const std::string &name, hid_t dtype_id, const void *data);
 
+    /// create a dataset whose first dimension may be distributed over the write communicator,
+    /// returning its file dataspace, this rank's offsets and the largest local extent
+    hid_t create_dataset(const Options &opt, const std::string &name, int ndims, hsize_t *dims,
+        hid_t filetype_id, bool write_in_parallel, std::vector<hsize_t> &offsets,
+        hid_t &filespace_id, hsize_t &nmax);
+
 public:
 
     void set_verbose(bool verbose)
@@ -547,6 +655,25 @@ public:
     // Close the file
     void close();
 
+    /// Collectively set the number of rows this rank contributes to every following parallel dataset.
+    /// Offsets, the global extent and the number of write rounds are then fixed until the layout is
+    /// cleared or the file closed, so all ranks must write datasets of this length in the meantime.
+    void set_parallel_layout(hsize_t nlocal);
+    void clear_parallel_layout()
+    {
+        has_layout = false;
+    }
+    /// whether a parallel dataset of nlocal rows on this rank can be written with the current layout
+    bool parallel_layout_matches(hsize_t nlocal) const
+    {
+        return !has_layout || nlocal == layout_nlocal;
+    }
+    /// offset of this rank's rows in the datasets written with the current layout
+    hsize_t parallel_layout_offset() const
+    {
+        return layout_offset;
+    }
+
     hid_t create_group(string groupname) {
         hid_t group_id = H5Gcreate(file_id, groupname.c_str(),
             H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
@@ -598,6 +725,13 @@ public:
     void write_dataset_nd(Options opt, std::string name, int rank, hsize_t *dims, void *data,
         hid_t memtype_id = -1, hid_t filetype_id = -1, bool flag_parallel = true);
 
+    /// Write a 1D dataset of len elements without holding it in memory. The data is produced
+    /// by fill(start, n, buffer), which stores elements [start, start+n) of this rank's share
+    /// into buffer, at most nbuffer elements of memtype_id at a time.
+    void write_dataset_streamed(Options opt, std::string name, hsize_t len,
+        hsize_t nbuffer, const std::function<void(hsize_t, hsize_t, void *)> &fill,
+        hid_t memtype_id, hid_t filetype_id = -1, bool flag_parallel = true);
+
     /// write an attribute
     template <typename T> void write_attribute(std::string parent, std::string name, T data)
     {
@@ -325,6 +325,162 @@ void WriteFOF(Options &opt, const Int_t nbodies, Int_t *pfof){
     LOG(info) << "Done";
 }
 
+///Exit if a binary file could not be fully read or written, or if its header is inconsistent
+static void CheckBinaryFile(bool iok, const char *fname, const char *what)
+{
+    if (iok) return;
+    LOG(error) << "Error " << what << " " << fname << ", file is truncated, corrupt or unwritable. Exiting";
+#ifdef USEMPI
+    MPI_Abort(MPI_COMM_WORLD,8);
+#else
+    exit(8);
+#endif
+}
+
+///Number of bytes between the current read position of a binary file and its end
+static long long BinaryFileBytesLeft(fstream &Fin)
+{
+    auto pos = Fin.tellg();
+    Fin.seekg(0, ios::end);
+    long long nbytes = Fin.tellg() - pos;
+    Fin.seekg(pos);
+    return nbytes;
+}
+
+/*! Writes a binary FOF membership file that can be read with \ref ReadFOFMembership so that the
+    FOF search can be skipped when reanalysing a snapshot. The file contains a header (task, number of tasks,
+    number of groups in the file, group id offset, total number of groups, number of particle ids), the number
+    of particles in each group and the particle ids of each group sorted in ascending order. With MPI each task
+    writes the groups local to it.
+*/
+void WriteFOFMembership(Options &opt, const Int_t nbodies, Particle *Part, const Int_t ngroup, Int_t *pfof){
+    fstream Fout;
+    char fname[1000];
+    long long nlocalgroups = ngroup, goffset = 0, ngrouptotal = ngroup, nids;
+#ifdef USEMPI
+    sprintf(fname,"%s.fof.membership.%d",opt.outname,ThisTask);
+    ngrouptotal = 0;
+    for (auto j=0;j<NProcs;j++) {
+        if (j<ThisTask) goffset += mpi_nhalos[j];
+        ngrouptotal += mpi_nhalos[j];
+    }
+#else
+    int ThisTask = 0, NProcs = 1;
+    sprintf(fname,"%s.fof.membership",opt.outname);
+#endif
+    vector<long long> numingroup(ngroup+1,0), noffset(ngroup+2,0);
+    for (Int_t i=0;i<nbodies;i++) if (pfof[i]>0) numingroup[pfof[i]]++;
+    for (Int_t i=1;i<=ngroup;i++) noffset[i+1] = noffset[i] + numingroup[i];
+    nids = noffset[ngroup+1];
+    vector<long long> pids(nids), count(noffset);
+    for (Int_t i=0;i<nbodies;i++) if (pfof[i]>0) pids[count[pfof[i]]++] = Part[i].GetPID();
+    count.clear();
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) default(shared) if (nids > ompsearchnum)
+#endif
+    for (Int_t i=1;i<=ngroup;i++) sort(pids.begin()+noffset[i], pids.begin()+noffset[i+1]);
+
+    LOG(info) << "Saving fof membership to " << fname;
+    Fout.open(fname,ios::out|ios::binary);
+    Fout.write((char*)&ThisTask,sizeof(int));
+    Fout.write((char*)&NProcs,sizeof(int));
+    Fout.write((char*)&nlocalgroups,sizeof(long long));
+    Fout.write((char*)&goffset,sizeof(long long));
+    Fout.write((char*)&ngrouptotal,sizeof(long long));
+    Fout.write((char*)&nids,sizeof(long long));
+    Fout.write((char*)&numingroup[1],sizeof(long long)*nlocalgroups);
+    Fout.write((char*)pids.data(),sizeof(long long)*nids);
+    Fout.close();
+    CheckBinaryFile(!Fout.fail(), fname, "writing FOF membership file");
+}
+///Broadcast the SO radii of the previous structures held by task 0 and store them keyed by most bound particle id
+static void SetWarmStartSORadii(Options &opt, vector<long long> &pids, vector<double> &radii)
+{
+    long long nstructures = pids.size();
+#ifdef USEMPI
+    MPI_Bcast(&nstructures, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    pids.resize(nstructures);
+    radii.resize(nstructures);
+    MPI_Bcast(pids.data(), nstructures, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    MPI_Bcast(radii.data(), nstructures, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+    opt.warmstart.soradius.clear();
+    opt.warmstart.soradius.reserve(nstructures);
+    for (long long i=0;i<nstructures;i++) {
+        auto &r = opt.warmstart.soradius[pids[i]];
+        r = max(r, (Double_t)radii[i]);
+    }
+}
+
+/*! Writes the warm start file read by \ref ReadWarmStart when analysing the next snapshot. The file contains a
+    header (mesh cells per dimension, number of mpi tasks, number of mesh cells, number of cell particle counts,
+    number of structures), the task of each mesh cell, the total number of particles in each cell and, for each
+    structure with a spherical overdensity, the id of its most bound particle followed by its largest SO radius.
+    The mesh is only stored when the mesh mpi decomposition is used. Task 0 gathers the radii and writes the file.
+*/
+void WriteWarmStart(Options &opt, const Int_t ngroup, PropData *pdata, const char *outname)
+{
+    fstream Fout;
+    char fname[1000];
+    vector<long long> pids;
+    vector<double> radii;
+    for (Int_t i=1;i<=ngroup;i++) {
+        Double_t r = max({pdata[i].gRvir, pdata[i].gR200c, pdata[i].gR200m, pdata[i].gR500c, pdata[i].gRBN98});
+        for (auto &x:pdata[i].SO_radius) r = max(r, x);
+        if (r <= 0) continue;
+        pids.push_back(pdata[i].ibound);
+        radii.push_back(r);
+    }
+#ifdef USEMPI
+    int nlocal = pids.size();
+    vector<int> counts(NProcs), offsets(NProcs, 0);
+    MPI_Gather(&nlocal, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for (auto j=1;j<NProcs;j++) offsets[j] = offsets[j-1] + counts[j-1];
+    vector<long long> allpids;
+    vector<double> allradii;
+    if (ThisTask == 0) {
+        allpids.resize(offsets[NProcs-1] + counts[NProcs-1]);
+        allradii.resize(allpids.size());
+    }
+    MPI_Gatherv(pids.data(), nlocal, MPI_LONG_LONG, allpids.data(), counts.data(), offsets.data(), MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(radii.data(), nlocal, MPI_DOUBLE, allradii.data(), counts.data(), offsets.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    pids.swap(allpids);
+    radii.swap(allradii);
+#else
+    int ThisTask = 0, NProcs = 1;
+#endif
+
+    if (ThisTask == 0) {
+        int numcellsperdim = 0;
+        long long ncells = 0, ncellcounts = 0, nstructures = pids.size();
+#ifdef USEMPI
+        if (opt.impiusemesh && NProcs > 1) {
+            numcellsperdim = opt.numcellsperdim;
+            ncells = opt.cellnodeids.size();
+            ncellcounts = opt.cellnodetotalnumparts.size();
+        }
+#endif
+        sprintf(fname,"%s.warmstart",outname);
+        LOG(info) << "Saving warm start data to " << fname;
+        Fout.open(fname,ios::out|ios::binary);
+        Fout.write((char*)&numcellsperdim,sizeof(int));
+        Fout.write((char*)&NProcs,sizeof(int));
+        Fout.write((char*)&ncells,sizeof(long long));
+        Fout.write((char*)&ncellcounts,sizeof(long long));
+        Fout.write((char*)&nstructures,sizeof(long long));
+        Fout.write((char*)opt.cellnodeids.data(),sizeof(int)*ncells);
+        Fout.write((char*)opt.cellnodetotalnumparts.data(),sizeof(unsigned long long)*ncellcounts);
+        Fout.write((char*)pids.data(),sizeof(long long)*nstructures);
+        Fout.write((char*)radii.data(),sizeof(double)*nstructures);
+        Fout.close();
+        CheckBinaryFile(!Fout.fail(), fname, "writing warm start file");
+    }
+#ifdef SWIFTINTERFACE
+    //the library persists between invocations so the next snapshot uses the radii directly
+    SetWarmStartSORadii(opt, pids, radii);
+#endif
+}
+
 /*! Writes a particle group list array file that contains the total number of groups,
     local number of groups (if using MPI) and group id followed by number of particles
     in that group and particle ids in the group
@@ -412,6 +568,63 @@ void WritePGList(Options &opt, const Int_t ngroups, const Int_t ng, Int_t *numin
     Fout.close();
 }
 
+///number of group members gathered at a time when writing the particle lists of groups
+#define GROUPMEMBERBUFSIZE 1048576
+
+///Offsets of each group's bound (or unbound) members in the group ordered particle list, a prefix sum
+///of the member counts with the members of group i occupying [groupoffset[i-1], groupoffset[i])
+static vector<unsigned long long> GroupMemberOffsets(const Int_t ngroups, Int_t *numingroup, Int_t **pglist, bool ibound)
+{
+    vector<unsigned long long> groupoffset(ngroups+1);
+    groupoffset[0]=0;
+    for (Int_t i=1;i<=ngroups;i++) {
+        Int_t nbound=pglist[i][numingroup[i]];
+        groupoffset[i]=groupoffset[i-1]+(ibound?nbound:numingroup[i]-nbound);
+    }
+    return groupoffset;
+}
+
+///Stores value(index) for entries [start, start+n) of the group ordered bound (or unbound) particle list in buffer.
+///The group holding start is found from the offsets so any chunk can be produced without walking the earlier groups.
+template<typename T, typename F> static void FillGroupMembers(const vector<unsigned long long> &groupoffset,
+    Int_t *numingroup, Int_t **pglist, bool ibound, unsigned long long start, unsigned long long n, T *buffer, F value)
+{
+    Int_t i=upper_bound(groupoffset.begin(), groupoffset.end(), start)-groupoffset.begin();
+    unsigned long long k=0, jskip=start-groupoffset[i-1];
+    for (;k<n;i++,jskip=0) {
+        Int_t jbegin=(ibound?0:pglist[i][numingroup[i]])+jskip;
+        Int_t jend=(ibound?pglist[i][numingroup[i]]:numingroup[i]);
+        for (Int_t j=jbegin;j<jend && k<n;j++) buffer[k++]=value(pglist[i][j]);
+    }
+}
+
+///Writes the bound (or unbound) particle list of the groups to binary, ascii or HDF output through a fixed size buffer
+template<typename T, typename F> static void WriteGroupMembers(Options &opt, const Int_t ngroups, Int_t *numingroup, Int_t **pglist,
+    bool ibound, unsigned long long nmembers, fstream &Fout,
+#ifdef USEHDF
+    H5OutputFile &Fhdf, const string &datasetname, hid_t filetype_id,
+#endif
+    F value)
+{
+    vector<unsigned long long> groupoffset=GroupMemberOffsets(ngroups, numingroup, pglist, ibound);
+    auto fill=[&](unsigned long long start, unsigned long long n, void *buffer) {
+        FillGroupMembers(groupoffset, numingroup, pglist, ibound, start, n, static_cast<T*>(buffer), value);
+    };
+#ifdef USEHDF
+    if (opt.ibinaryout==OUTHDF) {
+        Fhdf.write_dataset_streamed(opt, datasetname, nmembers, GROUPMEMBERBUFSIZE, fill, hdf5_type(T{}), filetype_id);
+        return;
+    }
+#endif
+    vector<T> buffer(min(nmembers, (unsigned long long)GROUPMEMBERBUFSIZE));
+    for (unsigned long long start=0;start<nmembers;start+=buffer.size()) {
+        unsigned long long n=min(nmembers-start, (unsigned long long)buffer.size());
+        fill(start, n, buffer.data());
+        if (opt.ibinaryout==OUTBINARY) Fout.write((char*)buffer.data(),sizeof(T)*n);
+        else for (unsigned long long k=0;k<n;k++) Fout<<buffer[k]<<endl;
+    }
+}
+
 void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int_t **pglist, vector<Particle> &Part, Int_t nadditional){
     fstream Fout,Fout2,Fout3;
     string fname, fname2, fname3;
@@ -422,7 +635,6 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
 #endif
     vector<unsigned long long> groupdata;
     vector<unsigned long long> offset;
-    vector<long long> partdata;
 #ifdef USEMPI
     MPIBuildWriteComm(opt);
 #endif
@@ -441,6 +653,7 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
     int64_t adios_grp_handle, adios_grp_handle3;
     int64_t adios_var_handle;
     int64_t adios_attr_handle;
+    vector<long long> partdata;
 #endif
 #if defined(USEHDF)||defined(USEADIOS)
     DataGroupNames datagroupnames;
@@ -583,6 +796,8 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
     if (opt.ibinaryout==OUTBINARY) Fout.write((char*)&numingroup[1],sizeof(Int_t)*ngroups);
 #ifdef USEHDF
     else if (opt.ibinaryout==OUTHDF) {
+        //all group datasets share the same per-task layout, so gather it once
+        Fhdf.set_parallel_layout(ng);
         groupdata.resize(ng+1,0);
         for (Int_t i=1;i<=ng;i++) groupdata[i-1]=numingroup[i];
         Fhdf.write_dataset(opt, datagroupnames.group[itemp], ng, groupdata.data());
@@ -892,22 +1107,17 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
         Fout3<<nuids<<" "<<nuidstot<<endl;
     }
 
-    Int_t *idval;
-    idval=new Int_t[nids+1];
-    nids=0;
-    for (Int_t i=1;i<=ngroups;i++)
-        for (Int_t j=0;j<pglist[i][numingroup[i]];j++)
-            idval[nids++]=Part[pglist[i][j]].GetPID();
-    if (opt.ibinaryout==OUTBINARY) Fout.write((char*)idval,sizeof(Int_t)*nids);
+    //ids are streamed straight from the group ordered pglist in fixed size chunks
+    auto partid=[&Part](Int_t index){return (Int_t)Part[index].GetPID();};
+    if (opt.ibinaryout!=OUTADIOS) {
+        WriteGroupMembers<Int_t>(opt, ngroups, numingroup, pglist, true, nids, Fout,
 #ifdef USEHDF
-    else if (opt.ibinaryout==OUTHDF) {
-        partdata.resize(nids+1);
-        for (Int_t i=0;i<nids;i++) partdata[i]=idval[i];
-        Fhdf.write_dataset(opt, datagroupnames.part[itemp], nids, partdata.data());
-    }
+            Fhdf, datagroupnames.part[itemp], H5T_NATIVE_LLONG,
 #endif
+            partid);
+    }
 #ifdef USEADIOS
-    else if (opt.ibinaryout==OUTADIOS) {
+    else {
         adios_err=adios_declare_group(&adios_grp_handle,"Catalog_Data", "" , adios_stat_full);
         adios_select_method (adios_grp_handle, "MPI", "", "");
         //store local dim
@@ -924,13 +1134,11 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
         adios_err=adios_write(adios_file_handle,"nidsmpioffset",&mpioffset);
         if (nids > 0) {
             partdata.resize(nids+1);
-            for (Int_t i=0;i<nids;i++) partdata[i-1]=idval[i];
+            FillGroupMembers(GroupMemberOffsets(ngroups, numingroup, pglist, true), numingroup, pglist, true, 0, nids, partdata.data(), partid);
             adios_err=adios_write(adios_file_handle,datagroupnames.group[itemp].c_str(),partdata.data());
         }
     }
 #endif
-    else for (Int_t i=0;i<nids;i++) Fout<<idval[i]<<endl;
-    delete[] idval;
     if (opt.ibinaryout==OUTASCII || opt.ibinaryout==OUTBINARY) Fout.close();
 #ifdef USEHDF
     if (opt.ibinaryout==OUTHDF) Fhdf.close();
@@ -939,21 +1147,15 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
     else if (opt.ibinaryout==OUTADIOS) adios_err=adios_close(adios_file_handle);
 #endif
 
-    idval=new Int_t[nuids+1];
-    nuids=0;
-    for (Int_t i=1;i<=ngroups;i++)
-        for (Int_t j=pglist[i][numingroup[i]];j<numingroup[i];j++)
-            idval[nuids++]=Part[pglist[i][j]].GetPID();
-    if (opt.ibinaryout==OUTBINARY) Fout3.write((char*)idval,sizeof(Int_t)*nuids);
+    if (opt.ibinaryout!=OUTADIOS) {
+        WriteGroupMembers<Int_t>(opt, ngroups, numingroup, pglist, false, nuids, Fout3,
 #ifdef USEHDF
-    else if (opt.ibinaryout==OUTHDF) {
-        partdata.resize(nuids+1);
-        for (Int_t i=0;i<nuids;i++) partdata[i]=idval[i];
-        Fhdf3.write_dataset(opt, datagroupnames.part[itemp], nuids, partdata.data());
-    }
+            Fhdf3, datagroupnames.part[itemp], H5T_NATIVE_LLONG,
 #endif
+            partid);
+    }
 #ifdef USEADIOS
-    else if (opt.ibinaryout==OUTADIOS) {
+    else {
         adios_err=adios_declare_group(&adios_grp_handle3,"Catalog_Data", "" , adios_stat_full);
         adios_select_method (adios_grp_handle3, "MPI", "", "");
         //store local dim
@@ -970,14 +1172,11 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
         adios_err=adios_write(adios_file_handle3,"nidsmpioffset",&mpioffset);
         if (nuids > 0) {
             partdata.resize(nuids+1);
-            for (Int_t i=0;i<nuids;i++) partdata[i-1]=idval[i];
+            FillGroupMembers(GroupMemberOffsets(ngroups, numingroup, pglist, false), numingroup, pglist, false, 0, nuids, partdata.data(), partid);
             adios_err=adios_write(adios_file_handle3,datagroupnames.group[itemp].c_str(),partdata.data());
-            delete[] data;
         }
     }
 #endif
-    else for (Int_t i=0;i<nuids;i++) Fout3<<idval[i]<<endl;
-    delete[] idval;
 
     if (opt.ibinaryout==OUTASCII || opt.ibinaryout==OUTBINARY) Fout3.close();
 #ifdef USEHDF
@@ -987,9 +1186,6 @@ void WriteGroupCatalog(Options &opt, const Int_t ngroups, Int_t *numingroup, Int
     else if (opt.ibinaryout==OUTADIOS) adios_err=adios_close(adios_file_handle3);
 #endif
 
-#ifdef USEMPI
-    MPIBuildWriteComm(opt);
-#endif
     LOG(info) << "Wrote catalogues in " << write_timer;
 }
 
@@ -1002,7 +1198,6 @@ void WriteGroupPartType(Options &opt, const Int_t ngroups, Int_t *numingroup, In
 #ifdef USEPARALLELHDF
     unsigned long long nwritecommtot=0, nuwritecommtot=0;
 #endif
-    int *typeval;
 
 #ifdef USEMPI
     MPIBuildWriteComm(opt);
@@ -1167,51 +1362,28 @@ void WriteGroupPartType(Options &opt, const Int_t ngroups, Int_t *numingroup, In
         Fout2<<nuids<<" "<<nuidstot<<endl;
     }
 
-    typeval=new int[nids+1];
-    nids=0;
-    for (Int_t i=1;i<=ngroups;i++)
-        for (Int_t j=0;j<pglist[i][numingroup[i]];j++)
-            typeval[nids++]=Part[pglist[i][j]].GetType();
-    if (opt.ibinaryout==OUTBINARY) Fout.write((char*)typeval,sizeof(int)*nids);
+    //types are streamed straight from the group ordered pglist in fixed size chunks
+    auto parttype=[&Part](Int_t index){return (int)Part[index].GetType();};
+    WriteGroupMembers<int>(opt, ngroups, numingroup, pglist, true, nids, Fout,
 #ifdef USEHDF
-    else if (opt.ibinaryout==OUTHDF) {
-        unsigned short *data=new unsigned short[nids];
-        for (Int_t i=0;i<nids;i++) data[i]=typeval[i];
-        Fhdf.write_dataset(opt, datagroupnames.types[itemp], nids, data);
-        delete[] data;
-    }
+        Fhdf, datagroupnames.types[itemp], H5T_NATIVE_USHORT,
 #endif
-    else for (Int_t i=0;i<nids;i++) Fout<<typeval[i]<<endl;
-    delete[] typeval;
+        parttype);
     if (opt.ibinaryout!=OUTHDF) Fout.close();
 #ifdef USEHDF
     else Fhdf.close();
 #endif
 
-    typeval=new int[nuids];
-    nuids=0;
-    for (Int_t i=1;i<=ngroups;i++)
-        for (Int_t j=pglist[i][numingroup[i]];j<numingroup[i];j++)
-            typeval[nuids++]=Part[pglist[i][j]].GetType();
-    if (opt.ibinaryout==OUTBINARY) Fout2.write((char*)typeval,sizeof(int)*nuids);
+    WriteGroupMembers<int>(opt, ngroups, numingroup, pglist, false, nuids, Fout2,
 #ifdef USEHDF
-    else if (opt.ibinaryout==OUTHDF) {
-        unsigned short *data=new unsigned short[nuids];
-        for (Int_t i=0;i<nuids;i++) data[i]=typeval[i];
-        Fhdf2.write_dataset(opt, datagroupnames.types[itemp], nuids, data);
-        delete[] data;
-    }
+        Fhdf2, datagroupnames.types[itemp], H5T_NATIVE_USHORT,
 #endif
-    else for (Int_t i=0;i<nuids;i++) Fout2<<typeval[i]<<endl;
-    delete[] typeval;
+        parttype);
     if (opt.ibinaryout!=OUTHDF) Fout2.close();
 #ifdef USEHDF
     else Fhdf2.close();
 #endif
 
-#ifdef USEMPI
-    MPIBuildWriteComm(opt);
-#endif
     LOG(info) << "Wrote particle type info in " << write_timer;
 }
 
@@ -1429,6 +1601,7 @@ void WriteSOCatalog(Options &opt, const Int_t ngroups,
     }
 #ifdef USEHDF
     else if (opt.ibinaryout==OUTHDF) {
+        Fhdf.set_parallel_layout(ng);
         auto data = get_sizes<Int_t, unsigned int>(SOpids);
         Fhdf.write_dataset(opt, datagroupnames.SO[itemp], ng, data.data());
         itemp++;
@@ -1521,6 +1694,7 @@ void WriteSOCatalog(Options &opt, const Int_t ngroups,
     }
 #ifdef USEHDF
     else if (opt.ibinaryout==OUTHDF) {
+        Fhdf.set_parallel_layout(nSOids);
         {
             auto ids = flatten<Int_t, long long>(SOpids, nSOids);
             Fhdf.write_dataset(opt, datagroupnames.SO[itemp], nSOids, ids.data());
@@ -1581,9 +1755,6 @@ void WriteSOCatalog(Options &opt, const Int_t ngroups,
     else if (opt.ibinaryout==OUTADIOS) adios_err=adios_close(adios_file_handle);
 #endif
 
-#ifdef USEMPI
-    MPIFreeWriteComm();
-#endif
     LOG(info) << "Wrote " << fname << " in " << write_timer;
 }
 
@@ -1791,6 +1962,8 @@ void WriteProperties(Options &opt, const Int_t ngroups, PropData *pdata){
         //allocate enough memory to store largest data type
         data= ::operator new(sizeof(long long)*(ng+1));
         itemp=0;
+        //every property dataset has one entry per group, so the per-task layout is gathered once
+        Fhdf.set_parallel_layout(ng);
 
         //first is halo ids, then id of most bound particle, host halo id, number of direct subhaloes, number of particles
         for (Int_t i=0;i<ngroups;i++) ((unsigned long*)data)[i]=pdata[i+1].haloid;
@@ -2909,10 +3082,6 @@ void WriteProperties(Options &opt, const Int_t ngroups, PropData *pdata){
     Fhdf.close();
 #endif
 
-#ifdef USEMPI
-    MPIFreeWriteComm();
-#endif
-
     LOG(info) << "Wrote " << fname << " in " << write_timer;
 }
 
@@ -3121,6 +3290,7 @@ void WriteProfiles(Options &opt, const Int_t ngroups, PropData *pdata){
 #ifdef USEHDF
     else if (opt.ibinaryout==OUTHDF) {
         itemp=0;
+        Fhdf.set_parallel_layout(ng);
         data= ::operator new(sizeof(long long)*(ng));
         //first is halo ids, then normalisation
         for (auto i=0;i<ng;i++) ((unsigned long*)data)[i]=pdata[indices[i]].haloid;
@@ -3184,6 +3354,8 @@ void WriteProfiles(Options &opt, const Int_t ngroups, PropData *pdata){
 
         //write all the npart arrays for halos only if inclusive masses calculated
         if (opt.iInclusiveHalo >0) {
+            //these datasets have one row per halo rather than per group
+            Fhdf.set_parallel_layout(nhalos);
             data= ::operator new(sizeof(int)*(nhalos)*(opt.profilenbins));
             dims.resize(2);dims[0]=nhalos;dims[1]=opt.profilenbins;
 
@@ -3232,10 +3404,6 @@ void WriteProfiles(Options &opt, const Int_t ngroups, PropData *pdata){
     else Fhdf.close();
 #endif
 
-#ifdef USEMPI
-    MPIFreeWriteComm();
-#endif
-
     LOG(info) << "Wrote " << fname << " in " << write_timer;
 }
 
@@ -3459,6 +3627,7 @@ void WriteHierarchy(Options &opt, const Int_t &ngroups, const Int_t & nhierarchy
 #ifdef USEHDF
         else if (opt.ibinaryout==OUTHDF) {
             itemp=4;
+            Fhdf.set_parallel_layout(nfield);
             unsigned int *data=new unsigned int[nfield];
             for (Int_t i=1;i<=nfield;i++) data[i-1]=nsub[i];
             Fhdf.write_dataset(opt, datagroupnames.hierarchy[itemp++], nfield, data);
@@ -3478,6 +3647,7 @@ void WriteHierarchy(Options &opt, const Int_t &ngroups, const Int_t & nhierarchy
         }
 #ifdef USEHDF
         else if (opt.ibinaryout==OUTHDF) {
+            Fhdf.set_parallel_layout(ngroups-nfield);
             unsigned int *data=new unsigned int[ngroups-nfield];
             for (Int_t i=nfield+1;i<=ngroups;i++) data[i-nfield-1]=nsub[i];
             Fhdf.write_dataset(opt, datagroupnames.hierarchy[itemp++], ngroups-nfield, data);
@@ -3498,6 +3668,7 @@ void WriteHierarchy(Options &opt, const Int_t &ngroups, const Int_t & nhierarchy
         }
 #ifdef USEHDF
         else if (opt.ibinaryout==OUTHDF) {
+            Fhdf.set_parallel_layout(ngroups);
             unsigned int *data=new unsigned int[ngroups];
             for (Int_t i=1;i<=ngroups;i++) data[i-1]=nsub[i];
             Fhdf.write_dataset(opt, datagroupnames.hierarchy[itemp++], ngroups, data);
@@ -3516,9 +3687,6 @@ void WriteHierarchy(Options &opt, const Int_t &ngroups, const Int_t & nhierarchy
     if (opt.ibinaryout!=OUTHDF) Fout.close();
 #ifdef USEHDF
     else Fhdf.close();
-#endif
-#ifdef USEMPI
-    MPIFreeWriteComm();
 #endif
     LOG(info) << "Wrote " << fname << " in " << write_timer;
 }
@@ -3606,6 +3774,7 @@ void WriteCellValues(Options &opt, const Int_t nbodies, const Int_t ngrid, GridC
     }
     Fout.close();
 }
+
 //@}
 
 
@@ -3628,6 +3797,243 @@ Int_t ReadPFOF(Options &opt, Int_t nbodies, Int_t *pfof){
     return ngroup;
 }
 
+///hash of a particle id used to partition FOF membership entries between mpi tasks and openmp threads
+unsigned long long FOFMembershipHash(long long pid, unsigned long long salt)
+{
+    unsigned long long x = static_cast<unsigned long long>(pid) + salt*0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+///Partition the indices of v into nbuckets buckets by the hash of their particle id. Each of nbuckets contiguous
+///chunks of v is hashed and counted once, the counts are turned into offsets and the chunks then scatter their
+///indices, so order holds the indices of bucket b in [bucketstart[b], bucketstart[b+1]) in increasing order
+static void FOFMembershipBuckets(const vector<fofmembership_entry> &v, int nbuckets,
+    vector<Int_t> &order, vector<Int_t> &bucketstart)
+{
+    Int_t n = v.size(), offset = 0;
+    vector<int> bucket(n);
+    //number of elements of chunk ichunk in bucket b, stored at ichunk*nbuckets+b and replaced by their offset
+    vector<Int_t> counts(nbuckets*nbuckets, 0);
+    order.resize(n);
+    bucketstart.assign(nbuckets+1, 0);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) num_threads(nbuckets) if (nbuckets > 1)
+#endif
+    for (int ichunk=0;ichunk<nbuckets;ichunk++) {
+        Int_t ilo = (long long)n*ichunk/nbuckets, ihi = (long long)n*(ichunk+1)/nbuckets;
+        for (Int_t i=ilo;i<ihi;i++) {
+            bucket[i] = FOFMembershipHash(v[i].PID, 1) % nbuckets;
+            counts[ichunk*nbuckets+bucket[i]]++;
+        }
+    }
+    for (int b=0;b<nbuckets;b++) {
+        bucketstart[b] = offset;
+        for (int ichunk=0;ichunk<nbuckets;ichunk++) {
+            Int_t count = counts[ichunk*nbuckets+b];
+            counts[ichunk*nbuckets+b] = offset;
+            offset += count;
+        }
+    }
+    bucketstart[nbuckets] = offset;
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) num_threads(nbuckets) if (nbuckets > 1)
+#endif
+    for (int ichunk=0;ichunk<nbuckets;ichunk++) {
+        Int_t ilo = (long long)n*ichunk/nbuckets, ihi = (long long)n*(ichunk+1)/nbuckets;
+        for (Int_t i=ilo;i<ihi;i++) order[counts[ichunk*nbuckets+bucket[i]]++] = i;
+    }
+}
+
+/*! For each request find the entry with the same particle id, returning the index of the entry
+    (or -1 if no entry exists). Entries and requests are hashed once into one bucket per openmp thread
+    (see \ref FOFMembershipBuckets) and each thread then builds and probes the hash table of its own bucket.
+*/
+vector<Int_t> FOFMembershipHashJoin(const vector<fofmembership_entry> &requests, const vector<fofmembership_entry> &entries)
+{
+    Int_t nrequests = requests.size(), nentries = entries.size();
+    vector<Int_t> match(nrequests, -1);
+    vector<Int_t> entryorder, entrystart, requestorder, requeststart;
+    int nthreads = 1;
+#ifdef USEOPENMP
+    if (nrequests + nentries > ompsearchnum) nthreads = omp_get_max_threads();
+#endif
+    FOFMembershipBuckets(entries, nthreads, entryorder, entrystart);
+    FOFMembershipBuckets(requests, nthreads, requestorder, requeststart);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) num_threads(nthreads) if (nthreads > 1)
+#endif
+    for (int b=0;b<nthreads;b++) {
+        unordered_map<long long, Int_t> table;
+        table.reserve(entrystart[b+1]-entrystart[b]);
+        for (Int_t j=entrystart[b];j<entrystart[b+1];j++) table.emplace(entries[entryorder[j]].PID, entryorder[j]);
+        for (Int_t j=requeststart[b];j<requeststart[b+1];j++) {
+            auto it = table.find(requests[requestorder[j]].PID);
+            if (it != table.end()) match[requestorder[j]] = it->second;
+        }
+    }
+    return match;
+}
+
+/*! Reads the binary FOF membership files written by \ref WriteFOFMembership and sets the group id of
+    local particles by matching particle ids, returning the total number of groups. \n
+    With MPI, each task reads a subset of the files, the entries are matched with the particles on the
+    task given by the hash of the particle id (see \ref MPIAssignFOFMembership) and mpi_foftask is set to the task
+    the particle's group should reside on.
+*/
+Int_t ReadFOFMembership(Options &opt, const Int_t nbodies, Particle *Part, Int_t *pfof)
+{
+    fstream Fin;
+    char fname[1000];
+    int itask, nprocs = 1, nfiles = 1;
+    long long nlocalgroups, goffset, ngrouptotal = 0, nids;
+    vector<fofmembership_entry> entries;
+    vector<long long> numingroup, pids;
+#ifndef USEMPI
+    int ThisTask = 0, NProcs = 1;
+#endif
+    vr::Timer timer;
+
+    //a single file is written without mpi, otherwise one file per task
+    const char *basename = opt.fofmembershipinputname.c_str();
+    bool isplit = false;
+    sprintf(fname,"%s.fof.membership",basename);
+    if (!FileExists(fname)) {
+        sprintf(fname,"%s.fof.membership.0",basename);
+        isplit = true;
+    }
+    if (!FileExists(fname)) {
+        LOG(error) << "Unable to find FOF membership file " << fname << ". Exiting";
+#ifdef USEMPI
+        MPI_Abort(MPI_COMM_WORLD,8);
+#else
+        exit(8);
+#endif
+    }
+    if (isplit) {
+        Fin.open(fname,ios::in|ios::binary);
+        Fin.read((char*)&itask,sizeof(int));
+        Fin.read((char*)&nfiles,sizeof(int));
+        CheckBinaryFile(Fin.good() && nfiles > 0, fname, "reading FOF membership file");
+        Fin.close();
+    }
+    LOG_RANK0(info) << "Reading FOF membership from " << nfiles << " file(s) with base name " << basename;
+
+    for (auto ifile=ThisTask;ifile<nfiles;ifile+=NProcs) {
+        if (isplit) sprintf(fname,"%s.fof.membership.%d",basename,ifile);
+        Fin.open(fname,ios::in|ios::binary);
+        Fin.read((char*)&itask,sizeof(int));
+        Fin.read((char*)&nprocs,sizeof(int));
+        Fin.read((char*)&nlocalgroups,sizeof(long long));
+        Fin.read((char*)&goffset,sizeof(long long));
+        Fin.read((char*)&ngrouptotal,sizeof(long long));
+        Fin.read((char*)&nids,sizeof(long long));
+        //the header counts must match the size of the rest of the file before anything is allocated from them
+        CheckBinaryFile(Fin.good() && nlocalgroups >= 0 && nids >= 0 && goffset >= 0
+            && BinaryFileBytesLeft(Fin) == (long long)sizeof(long long)*(nlocalgroups + nids),
+            fname, "reading FOF membership file");
+        numingroup.resize(nlocalgroups);
+        pids.resize(nids);
+        Fin.read((char*)numingroup.data(),sizeof(long long)*nlocalgroups);
+        Fin.read((char*)pids.data(),sizeof(long long)*nids);
+        CheckBinaryFile(Fin.good() && accumulate(numingroup.begin(), numingroup.end(), 0LL) == nids,
+            fname, "reading FOF membership file");
+        Fin.close();
+        Int_t nold = entries.size();
+        entries.resize(nold+nids);
+        for (long long i=0,count=nold;i<nlocalgroups;i++) {
+            for (long long j=0;j<numingroup[i];j++) {
+                entries[count].PID = pids[count-nold];
+                entries[count].iGroup = goffset+i+1;
+                entries[count].Index = -1;
+                entries[count].Task = itask;
+                count++;
+            }
+        }
+    }
+    numingroup.clear();
+    pids.clear();
+
+#ifdef USEMPI
+    //every task needs the total number of groups, which is stored in every file
+    MPI_Bcast(&ngrouptotal, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (NProcs > 1) {
+        MPIAssignFOFMembership(opt, nbodies, Part, entries, pfof);
+        LOG_RANK0(info) << "Finished reading FOF membership in " << timer;
+        return ngrouptotal;
+    }
+#endif
+    vector<fofmembership_entry> requests(nbodies);
+    for (Int_t i=0;i<nbodies;i++) {
+        requests[i].PID = Part[i].GetPID();
+        requests[i].Index = i;
+    }
+    auto match = FOFMembershipHashJoin(requests, entries);
+    for (Int_t i=0;i<nbodies;i++) pfof[i] = (match[i] >= 0) ? entries[match[i]].iGroup : 0;
+    LOG(info) << "Finished reading FOF membership in " << timer;
+    return ngrouptotal;
+}
+
+/*! Reads the warm start file written by \ref WriteWarmStart for the previous snapshot. Task 0 reads the file
+    and keeps the previous mesh decomposition and cell particle counts, used to seed
+    \ref MPIInitialDomainDecompositionWithMesh (which is only run on task 0). The SO radii of the previous
+    structures are broadcast to all tasks and used to seed the SO searches (see \ref GetSOMasses).
+*/
+void ReadWarmStart(Options &opt)
+{
+    fstream Fin;
+    char fname[1000];
+    WarmStartInfo &warmstart = opt.warmstart;
+    vector<long long> pids;
+    vector<double> radii;
+    long long ncells, ncellcounts, nstructures;
+#ifndef USEMPI
+    int ThisTask = 0;
+#endif
+    vr::Timer timer;
+
+    sprintf(fname,"%s.warmstart",opt.warmstartinputname.c_str());
+    if (ThisTask == 0) {
+        if (!FileExists(fname)) {
+            LOG(error) << "Unable to find warm start file " << fname << ". Exiting";
+#ifdef USEMPI
+            MPI_Abort(MPI_COMM_WORLD,8);
+#else
+            exit(8);
+#endif
+        }
+        Fin.open(fname,ios::in|ios::binary);
+        Fin.read((char*)&warmstart.numcellsperdim,sizeof(int));
+        Fin.read((char*)&warmstart.nprocs,sizeof(int));
+        Fin.read((char*)&ncells,sizeof(long long));
+        Fin.read((char*)&ncellcounts,sizeof(long long));
+        Fin.read((char*)&nstructures,sizeof(long long));
+        //the mesh, if stored, must be complete and the counts must match the size of the rest of the file
+        //before anything is allocated from them
+        long long nmesh = (long long)warmstart.numcellsperdim*warmstart.numcellsperdim*warmstart.numcellsperdim;
+        CheckBinaryFile(Fin.good() && warmstart.numcellsperdim >= 0 && warmstart.nprocs > 0 && nstructures >= 0
+            && (ncells == 0 || ncells == nmesh) && (ncellcounts == 0 || ncellcounts == nmesh)
+            && BinaryFileBytesLeft(Fin) == (long long)(sizeof(int)*ncells + sizeof(unsigned long long)*ncellcounts
+                + (sizeof(long long) + sizeof(double))*nstructures),
+            fname, "reading warm start file");
+        warmstart.cellnodeids.resize(ncells);
+        warmstart.cellnodenumparts.resize(ncellcounts);
+        pids.resize(nstructures);
+        radii.resize(nstructures);
+        Fin.read((char*)warmstart.cellnodeids.data(),sizeof(int)*ncells);
+        Fin.read((char*)warmstart.cellnodenumparts.data(),sizeof(unsigned long long)*ncellcounts);
+        Fin.read((char*)pids.data(),sizeof(long long)*nstructures);
+        Fin.read((char*)radii.data(),sizeof(double)*nstructures);
+        CheckBinaryFile(Fin.good() && all_of(warmstart.cellnodeids.begin(), warmstart.cellnodeids.end(),
+            [&](int itask) {return itask >= 0 && itask < warmstart.nprocs;}), fname, "reading warm start file");
+        Fin.close();
+    }
+    SetWarmStartSORadii(opt, pids, radii);
+    LOG_RANK0(info) << "Read warm start data from " << fname << " with " << opt.warmstart.soradius.size()
+        << " structures in " << timer;
+}
+
 //load binary group fof catalogue
 Int_t ReadFOFGroupBinary(Options &opt, Int_t nbodies, Int_t *pfof, Int_t *idtoindex, Int_t minid, Particle *p)
 {//old groupcat format
@@ -3862,47 +4268,10 @@ void WriteExtendedOutput (Options &opt, Int_t numgroups, Int_t nbodies, PropData
     LOG(info) << "numgroups  " << numgroups;
     numgroups++;
 
-    Int_t *  nfilespergroup = new Int_t   [numgroups];
-    Int_t ** filesofgroup   = new Int_t * [numgroups];
-
-    Int_t *  ntaskspergroup = new Int_t   [numgroups];
-    Int_t ** tasksofgroup   = new Int_t * [numgroups];
-
-    // First send to Task 0, Groups and number of files over which the group is distributed
-    // from original reading
-
-    // Groups id have already the offset
-    Int_t ** npartsofgroupinfile = new Int_t * [numgroups];
-    Int_t ** npartsofgroupintask = new Int_t * [numgroups];
-
-#ifdef USEMPI
-    Int_t ntosendtotask      [NProcs];
-    Int_t ntorecievefromtask [NProcs];
-    for (Int_t i = 0; i < NProcs; i++)
-    {
-        ntosendtotask[i] = 0;
-        ntorecievefromtask[i] = 0;
-    }
-#endif
-
-    // Initialize arrays
-    for (Int_t i = 0; i < numgroups; i++)
-    {
-        npartsofgroupinfile[i] = new Int_t [opt.num_files];
-
-#ifdef USEMPI
-        npartsofgroupintask[i] = new Int_t [NProcs];
-        ntaskspergroup[i] = 0;
-        for(Int_t j = 0; j < NProcs; j++)
-            npartsofgroupintask[i][j] = 0;
+    // Set IdStruct IdTopHost
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (nbodies > ompsearchnum)
 #endif
-
-        nfilespergroup[i] = 0;
-        for(Int_t j = 0; j < opt.num_files; j++)
-            npartsofgroupinfile[i][j] = 0;
-    }
-
-    // Set IdStruct IdTopHost and fill arrays
     for (Int_t i = 0; i < nbodies; i++)
     {
         if (pfof[i] == 0)
@@ -3923,302 +4292,111 @@ void WriteExtendedOutput (Options &opt, Int_t numgroups, Int_t nbodies, PropData
             else
                 p[i].SetIdHost (pdata[pfof[i]].hostid);
         }
-
-        npartsofgroupinfile[pfof[i]][p[i].GetOFile()]++;
-#ifdef USEMPI
-        npartsofgroupintask[pfof[i]][p[i].GetOTask()]++;
-#endif
     }
 
-    for (Int_t i = 0; i < numgroups; i++)
-    {
-#ifdef USEMPI
-        for(Int_t j = 0; j < NProcs; j++)
-            if(npartsofgroupintask[i][j] > 0)
-                ntaskspergroup[i]++;
+    // Determine the files over which each group is distributed from the original reading.
+    // Rather than filling a dense numgroups x num_files table, sort the (group, file) pair of
+    // every particle packed into a single key and run-length encode the result, so that the
+    // memory scales with the number of particles and the number of distinct pairs.
+    vector<unsigned long long> groupfilekey(nbodies);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (nbodies > ompsearchnum)
 #endif
-        for(Int_t j = 0; j < opt.num_files; j++)
-            if(npartsofgroupinfile[i][j] > 0)
-                nfilespergroup[i]++;
-    }
-
-    // Shorten arrays
-    for (Int_t i = 0; i < numgroups; i++)
+    for (Int_t i = 0; i < nbodies; i++)
+        groupfilekey[i] = (unsigned long long)pfof[i] * opt.num_files + p[i].GetOFile();
+    OMPSort(groupfilekey.begin(), groupfilekey.end());
+    groupfilekey.erase(unique(groupfilekey.begin(), groupfilekey.end()), groupfilekey.end());
+
+    // filesofgroup[filesofgroupoffset[i]:filesofgroupoffset[i+1]] are the files of group i
+    vector<Int_t> filesofgroupoffset(numgroups+1, 0);
+    vector<Int_t> filesofgroup(groupfilekey.size());
+    for (size_t k = 0; k < groupfilekey.size(); k++)
     {
-        Int_t k = 0;
-#ifdef USEMPI
-        tasksofgroup[i] = new Int_t [ntaskspergroup[i]];
-        for(Int_t j = 0; j < NProcs; j++)
-        {
-            if(npartsofgroupintask[i][j] > 0)
-            {
-                tasksofgroup[i][k] = j;
-                ntosendtotask[j] += npartsofgroupintask[i][j];
-                k++;
-            }
-        }
-        k = 0;
-#endif
-        filesofgroup[i] = new Int_t [nfilespergroup[i]];
-        for(Int_t j = 0; j < opt.num_files; j++)
-        {
-            if(npartsofgroupinfile[i][j] > 0)
-            {
-                filesofgroup[i][k] = j;
-                k++;
-            }
-        }
-        delete [] npartsofgroupinfile[i];
-#ifdef USEMPI
-        delete [] npartsofgroupintask[i];
-#endif
+        filesofgroupoffset[groupfilekey[k] / opt.num_files + 1]++;
+        filesofgroup[k] = groupfilekey[k] % opt.num_files;
     }
-    delete [] npartsofgroupinfile;
-#ifdef USEMPI
-    delete [] npartsofgroupintask;
-#endif
-    // Now nfilespergroup has the number of files over which the group is distributed and
-    // filesofgroup has the id of the files
-    //
-    // Write FilesOfGroup File
-    int myturn = 0;
+    for (Int_t i = 1; i <= numgroups; i++) filesofgroupoffset[i] += filesofgroupoffset[i-1];
+    vector<unsigned long long>().swap(groupfilekey);
 
+    // Write FilesOfGroup File, one task after another
+    char fog [1000];
+    sprintf (fog, "%s.filesofgroup", opt.outname);
+    int myturn = 1;
 #ifdef USEMPI
     MPI_Status status;
-    MPI_Request rqst;
-
-    if (ThisTask == 0)
-    {
+    if (ThisTask > 0)
+        MPI_Recv (&myturn, 1, MPI_INT, ThisTask-1, TAG_EXTENDED_B, MPI_COMM_WORLD, &status);
 #endif
-        myturn = 1;
-        char fog [1000];
-        sprintf (fog, "%s.filesofgroup", opt.outname);
-        Fout.open (fog, ios::out);
-        for (Int_t i = 1; i < numgroups; i++)
-        {
-            Fout << pdata[i].haloid << "  " << nfilespergroup[i] << endl;
-            for (Int_t j = 0; j < nfilespergroup[i]; j++)
-            Fout << filesofgroup[i][j] << " ";
-            Fout << endl;
-        }
-        Fout.close();
-
-#ifdef USEMPI
-        if (NProcs > 1)
-            MPI_Isend (&myturn, 1, MPI_INT, ThisTask+1, ThisTask, MPI_COMM_WORLD, &rqst);
-    }
-    else
-    {
-        MPI_Recv (&myturn, 1, MPI_INT, ThisTask-1, ThisTask-1, MPI_COMM_WORLD, &status);
-
-        ofstream fout;
-        char fog[1000];
-        sprintf (fog, "%s.filesofgroup", opt.outname);
-        fout.open (fog, ios::app);
-        for (Int_t i = 1; i < numgroups; i++)
-        {
-            fout << pdata[i].haloid << " " << nfilespergroup[i] << endl;
-            for (Int_t j = 0; j < nfilespergroup[i]; j++)fout << filesofgroup[i][j] << " ";
-            fout << endl;
-        }
-        fout.close();
-
-        if (ThisTask != NProcs-1)
-            MPI_Isend (&myturn, 1, MPI_INT, ThisTask+1, ThisTask, MPI_COMM_WORLD, &rqst);
-    }
-    delete [] filesofgroup;
-    delete [] tasksofgroup;
-    delete [] ntaskspergroup;
-    delete [] nfilespergroup;
-
-    LOG(debug) << "filesofgroup written";
-    // Send and Particles before writing Extended Files
-    // Communicate to all other processors how many particles are going to be sent
-    ntosendtotask[ThisTask] = 0;
-    for (Int_t i = 1; i < NProcs; i++)
-    {
-        int src = (ThisTask + NProcs - i) % NProcs;
-        int dst = (ThisTask + i) % NProcs;
-        MPI_Isend (&ntosendtotask[dst], 1, MPI_INT, dst, ThisTask, MPI_COMM_WORLD, &rqst);
-        MPI_Recv (&ntorecievefromtask[src], 1, MPI_INT, src, src, MPI_COMM_WORLD, &status);
-    }
-
-    // Declare and allocate Particle arrays for sending and receiving
-    Particle ** PartsToSend = new Particle * [NProcs];
-    Particle ** PartsToRecv = new Particle * [NProcs];
-
-    int * count = new int [NProcs];
-    for (Int_t i = 0; i < NProcs; i++)
-    {
-        count[i] = 0;
-        PartsToSend[i] = new Particle [ntosendtotask[i]+1];
-        PartsToRecv[i] = new Particle [ntorecievefromtask[i]+1];
-    }
-
-    // Copy Particles to send
-    for (Int_t i = 0; i < nbodies; i++)
-        if (p[i].GetOTask() != ThisTask)
-            PartsToSend[p[i].GetOTask()][count[p[i].GetOTask()]++] = Particle(p[i]);
-
-    //determine if number of particles can fit into a single send
-    int bufferFlag = 1;
-    long int  maxNumPart = LOCAL_MAX_MSGSIZE / (long int) sizeof(Particle);
-    int localMax = 0;
-    int globalMax = 0;
-    //find max local send and global send
-    for (Int_t i = 0; i < NProcs; i++) if (ntosendtotask[i] > localMax) localMax = ntosendtotask[i];
-    MPI_Allreduce (&localMax, &globalMax, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
-
-    if (globalMax >= maxNumPart) bufferFlag = 1;
-
-    // Send and Receive Particles
-    //if splitting sends into chunks
-    if (bufferFlag)
-    {
-        int numBuffersToSend [NProcs];
-        int numBuffersToRecv [NProcs];
-        int numPartInBuffer = maxNumPart;
-
-        for (int jj = 0; jj < NProcs; jj++)
-        {
-            numBuffersToSend[jj] = 0;
-            numBuffersToRecv[jj] = 0;
-            if (ntosendtotask[jj] > 0) numBuffersToSend[jj] = (ntosendtotask[jj]/numPartInBuffer) + 1;
-        }
-        //broadcast numbers sent
-        for (int i = 1; i < NProcs; i++)
-        {
-            int src = (ThisTask + NProcs - i) % NProcs;
-            int dst = (ThisTask + i) % NProcs;
-            MPI_Isend (&numBuffersToSend[dst], 1, MPI_INT, dst, 0, MPI_COMM_WORLD, &rqst);
-            MPI_Recv  (&numBuffersToRecv[src], 1, MPI_INT, src, 0, MPI_COMM_WORLD, &status);
-        }
-        MPI_Barrier (MPI_COMM_WORLD);
-
-        //for each mpi thread send info as necessary
-        for (int i = 1; i < NProcs; i++)
-        {
-            int src = (ThisTask + NProcs - i) % NProcs;
-            int dst = (ThisTask + i) % NProcs;
-            Int_t size = numPartInBuffer;
-            int buffOffset = 0;
-            //send buffers
-            for (int jj = 0; jj < numBuffersToSend[dst]-1; jj++)
-            {
-              MPI_Isend (&size, 1, MPI_Int_t, dst, (int)(jj+1), MPI_COMM_WORLD, &rqst);
-              MPI_Isend (&PartsToSend[dst][buffOffset], sizeof(Particle)*size, MPI_BYTE,
-                         dst, (int)(10000+jj+1), MPI_COMM_WORLD, &rqst);
-            }
-            //and if anything is remaining
-            size = ntosendtotask[dst] % numPartInBuffer;
-            if (size > 0 && numBuffersToSend[dst] > 0)
-            {
-              MPI_Isend (&size, 1, MPI_Int_t, dst, (int)(numBuffersToSend[dst]), MPI_COMM_WORLD, &rqst);
-              MPI_Isend (&PartsToSend[dst][buffOffset], sizeof(Particle)*size, MPI_BYTE,
-                         dst, (int)(10000+numBuffersToSend[dst]), MPI_COMM_WORLD, &rqst);
-            }
-
-            // Receive Buffers
-            buffOffset = 0;
-            for (int jj = 0; jj < numBuffersToRecv[src]; jj++)
-            {
-              Int_t numInBuffer = 0;
-              MPI_Recv (&numInBuffer, 1, MPI_Int_t, src, (int)(jj+1), MPI_COMM_WORLD, &status);
-              MPI_Recv (&PartsToRecv[src][buffOffset], sizeof(Particle)*numInBuffer,
-                        MPI_BYTE, src, (int)(10000+jj+1), MPI_COMM_WORLD, &status);
-              buffOffset += numInBuffer;
-            }
-        }
-    }
-    else
+    Fout.open (fog, (ThisTask == 0) ? ios::out : (ios::out | ios::app));
+    for (Int_t i = 1; i < numgroups; i++)
     {
-        for (Int_t i = 1; i < NProcs; i++)
-        {
-            int src = (ThisTask + NProcs - i) % NProcs;
-            int dst = (ThisTask + i) % NProcs;
-            MPI_Isend (PartsToSend[dst], ntosendtotask[dst]*sizeof(Particle), MPI_BYTE, dst, ThisTask, MPI_COMM_WORLD, &rqst);
-            MPI_Recv (PartsToRecv[src], ntorecievefromtask[src]*sizeof(Particle), MPI_BYTE, src, src, MPI_COMM_WORLD, &status);
-        }
+        Fout << pdata[i].haloid << "  " << filesofgroupoffset[i+1] - filesofgroupoffset[i] << endl;
+        for (Int_t j = filesofgroupoffset[i]; j < filesofgroupoffset[i+1]; j++)
+            Fout << filesofgroup[j] << " ";
+        Fout << endl;
     }
+    Fout.close();
+#ifdef USEMPI
+    if (ThisTask < NProcs-1)
+        MPI_Send (&myturn, 1, MPI_INT, ThisTask+1, TAG_EXTENDED_B, MPI_COMM_WORLD);
 #endif
+    vector<Int_t>().swap(filesofgroup);
+    vector<Int_t>().swap(filesofgroupoffset);
+    LOG(debug) << "filesofgroup written";
 
-    // Organize particles in files for the ExtendedOutput
-    // First determine which files ThisTask should write
-    int npartthistask = 0;
-    int npartperfile[opt.num_files];
-
-    for (Int_t i = 0; i < opt.num_files; i++)
-        npartperfile[i] = 0;
-
-    // Loop over particles to get how many go to each file
-    for (Int_t i = 0; i < nbodies; i++) if (p[i].GetOTask() == ThisTask)
-    {
-        npartthistask++;
-        npartperfile[p[i].GetOFile()]++;
-    }
-
+    // Pack the ids written to the extended output, ordered by the task that originally read
+    // the particle, and send them back to that task. Only the ids and the original file
+    // position are needed, not the full particle.
+    Int_t nsendtotask[NProcs], sendoffset[NProcs];
+    for (int j = 0; j < NProcs; j++) nsendtotask[j] = 0;
 #ifdef USEMPI
-    for (Int_t i = 0; i < NProcs; i++)
-        for (Int_t j = 0; j < ntorecievefromtask[i]; j++)
-            if (PartsToRecv[i][j].GetOTask() == ThisTask)
-            {
-                npartthistask++;
-                npartperfile[PartsToRecv[i][j].GetOFile()]++;
-            }
+    for (Int_t i = 0; i < nbodies; i++) nsendtotask[p[i].GetOTask()]++;
+#else
+    nsendtotask[0] = nbodies;
 #endif
+    sendoffset[0] = 0;
+    for (int j = 1; j < NProcs; j++) sendoffset[j] = sendoffset[j-1] + nsendtotask[j-1];
 
-    // Allocate and fill arrays of particle, halo, host, and igm ids
-    // Here I am assuming that we have n particles with indexes rangin from 0 to n-1
-    int ** Id, ** IdStruct, ** IdTopHost, ** IdHost;
-
-    Id       = new int * [opt.num_files];
-    IdStruct = new int * [opt.num_files];
-    IdTopHost    = new int * [opt.num_files];
-    IdHost   = new int * [opt.num_files];
-
-    for (Int_t i = 0; i < opt.num_files; i++)
-    if (npartperfile[i] > 0)
-    {
-        Id[i]       = new int [npartperfile[i]];
-        IdStruct[i] = new int [npartperfile[i]];
-        IdTopHost[i]    = new int [npartperfile[i]];
-        IdHost[i]   = new int [npartperfile[i]];
-    }
-
+    vector<extendedoutput_entry> entries(nbodies);
     for (Int_t i = 0; i < nbodies; i++)
     {
-        if (p[i].GetOTask() == ThisTask)
-        {
-            Id       [p[i].GetOFile()][p[i].GetOIndex()] = p[i].GetPID();
-            IdStruct [p[i].GetOFile()][p[i].GetOIndex()] = p[i].GetIdStruct();
-            IdHost   [p[i].GetOFile()][p[i].GetOIndex()] = p[i].GetIdHost();
-            IdTopHost    [p[i].GetOFile()][p[i].GetOIndex()] = p[i].GetIdTopHost();
-        }
+#ifdef USEMPI
+        Int_t k = sendoffset[p[i].GetOTask()]++;
+#else
+        Int_t k = i;
+#endif
+        entries[k].PID = p[i].GetPID();
+        entries[k].IdStruct = p[i].GetIdStruct();
+        entries[k].IdHost = p[i].GetIdHost();
+        entries[k].IdTopHost = p[i].GetIdTopHost();
+        entries[k].OIndex = p[i].GetOIndex();
+        entries[k].OFile = p[i].GetOFile();
     }
 #ifdef USEMPI
-    for (Int_t i = 0; i < NProcs; i++)
-        for (Int_t j = 0; j < ntorecievefromtask[i]; j++)
-            if (PartsToRecv[i][j].GetOTask() == ThisTask)
-            {
-                Id       [PartsToRecv[i][j].GetOFile()][PartsToRecv[i][j].GetOIndex()] = PartsToRecv[i][j].GetPID();
-                IdStruct [PartsToRecv[i][j].GetOFile()][PartsToRecv[i][j].GetOIndex()] = PartsToRecv[i][j].GetIdStruct();
-                IdHost   [PartsToRecv[i][j].GetOFile()][PartsToRecv[i][j].GetOIndex()] = PartsToRecv[i][j].GetIdHost();
-                IdTopHost    [PartsToRecv[i][j].GetOFile()][PartsToRecv[i][j].GetOIndex()] = PartsToRecv[i][j].GetIdTopHost();
-            }
+    if (NProcs > 1) entries = MPIExchangeExtendedOutput(entries, nsendtotask);
 #endif
 
+    // Organize particles in files for the ExtendedOutput, placing each at its original
+    // index within the file it was read from
+    vector<Int_t> npartperfile(opt.num_files, 0), fileoffset(opt.num_files, 0);
+    for (auto &entry : entries) npartperfile[entry.OFile]++;
+    for (Int_t i = 1; i < opt.num_files; i++) fileoffset[i] = fileoffset[i-1] + npartperfile[i-1];
+    vector<extendedoutput_entry> fileentries(entries.size());
+    for (auto &entry : entries) fileentries[fileoffset[entry.OFile] + entry.OIndex] = entry;
+    vector<extendedoutput_entry>().swap(entries);
+
     // Write ExtendedFiles
     for (Int_t i = 0; i < opt.num_files; i++)
         if (npartperfile[i] > 0)
         {
             sprintf (fname,"%s.extended.%d",opt.outname,i);
             Fout.open (fname,ios::out);
-            for (Int_t j = 0; j < npartperfile[i]; j++)
+            for (Int_t j = fileoffset[i]; j < fileoffset[i] + npartperfile[i]; j++)
             {
-                Fout << setw(12) << Id[i][j]       << "  ";
-                Fout << setw(7)  << IdStruct[i][j] << "  ";
-                Fout << setw(7)  << IdHost[i][j]   << "  ";
-                Fout << setw(7)  << IdTopHost[i][j]    << "  ";
+                Fout << setw(12) << fileentries[j].PID       << "  ";
+                Fout << setw(7)  << fileentries[j].IdStruct  << "  ";
+                Fout << setw(7)  << fileentries[j].IdHost    << "  ";
+                Fout << setw(7)  << fileentries[j].IdTopHost << "  ";
                 Fout << endl;
             }
             Fout.close();
@@ -8,10 +8,8 @@
 #include "vr_exceptions.h"
 
 /*! This calculates the logarithmic ratio of the measured velocity density and the expected velocity density assuming a bg muiltivariate gaussian distribution
-    \todo must adjust interpolation scheme so that if NN has cells in a neighbouring MPI domain, the information is stored locally. This may require a rewrite
-    of the grid cell structure or the near neighbour list so that if grid cell has NN in another processor, actually physically store the information cm, cmvel, veldisp
-    locally to that grid cell. Another option is to determine all cells that are NN of a cell in another mpi's domain, build a grid export list that contains the relevant information
-    and an index that is easily accessible when searching the list of NN cells locally.
+    With MPI, the cells of other processors that can be among the nearest cells of local particles are imported (see \ref MPIBuildGridData)
+    and interpolation uses the local cells along with this halo of imported cells.
 */
 void GetDenVRatio(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngrid, GridCell *grid, Coordinate *gvel, Matrix *gveldisp)
 {
@@ -41,15 +39,10 @@ private(i) if (nbodies > ompsubsearchnum)
 #endif
 
     //build grid tree so that one can find nearest cells for each particle
-    //if using MPI since number of cells is far fewer than number of particles, simple gather collect all the data so that each processor has access to it
+    //if using MPI, collect the cells of other processors that are close enough to local particles to be among their nearest cells
 #ifdef USEMPI
     if(opt.iSingleHalo) {
-        Ngridlocal=ngrid;
-        MPI_Allreduce(&ngrid,&Ngridtotal,1,MPI_Int_t,MPI_SUM,MPI_COMM_WORLD);
-        mpi_grid=new GridCell[Ngridtotal];
-        mpi_gvel=new Coordinate[Ngridtotal];
-        mpi_gveldisp=new Matrix[Ngridtotal];
-        MPIBuildGridData(ngrid, grid, gvel, gveldisp);
+        MPIBuildGridData(ngrid, grid, gvel, gveldisp, nbodies, Part);
         delete[] grid;
         delete[] gvel;
         delete[] gveldisp;
@@ -61,7 +54,7 @@ private(i) if (nbodies > ompsubsearchnum)
 #endif
     ptemp=new Particle[ngrid];
     for (i=0;i<ngrid;i++) ptemp[i]=Particle(1.0,grid[i].xm[0],grid[i].xm[1],grid[i].xm[2],0.0,0.0,0.0,i);
-    tree=new KDTree(ptemp,ngrid,1,tree->TPHYS, tree->KEPAN,100,0,0,0,NULL,NULL,false);
+    tree=BuildKDTree(ptemp,ngrid,1,KDTree::TPHYS, KDTree::KEPAN,100,0,0,0);
 
 #ifdef USEOPENMP
 #pragma omp parallel
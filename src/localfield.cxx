@@ -164,7 +164,7 @@ private(i,j,k,tid,id,v2,nnids,nnr2,nnidsneighbours,nnr2neighbours,weight,pqx,pqv
     //now with imported particle list and local particle list can run proper NN search
     //first build neighbouring tree
     KDTree *treeneighbours=NULL;
-    if (nimport>0) treeneighbours=new KDTree(PartDataGet,nimport,1,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
+    if (nimport>0) treeneighbours=BuildKDTree(PartDataGet,nimport,1,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
     //then run search
 #ifdef USEOPENMP
 #pragma omp parallel default(shared) \
@@ -447,7 +447,7 @@ void GetVelocityDensityHaloOnlyDen(Options &opt, const Int_t nbodies, Particle *
     }
 #endif
 
-    tree=new KDTree(Part,nbodies,opt.Bsize,tree->TPHYS,tree->KEPAN,1000,0,0,0);
+    tree=BuildKDTree(Part,nbodies,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,1000,0,0,0);
     Int_t *nnids;
     Double_t *nnr2;
     PriorityQueue **pqx, **pqv;
@@ -624,7 +624,7 @@ private(i,j,k,tid,id,v2,nnids,nnr2,weight,pqv)
     //now with imported particle list and local particle list can run proper NN search
     //first build neighbouring tree
     KDTree *treeneighbours=NULL;
-    if (nimport>0) treeneighbours=new KDTree(PartDataGet,nimport,1,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
+    if (nimport>0) treeneighbours=BuildKDTree(PartDataGet,nimport,1,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
 
     MEMORY_USAGE_REPORT(debug);
 
@@ -797,7 +797,7 @@ void GetVelocityDensityApproximative(Options &opt, const Int_t nbodies, Particle
     //only build tree if necessary
     if (tree==NULL) {
         itreeflag=1;
-        tree=new KDTree(Part,nbodies,opt.Bsize,tree->TPHYS,tree->KEPAN,1000,0,0,0,period);
+        tree=BuildKDTree(Part,nbodies,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,1000,0,0,0,period);
     }
     //In loop determine if particles NN search radius overlaps another mpi threads domain.
     //If not, then proceed as usually to determine velocity density.
@@ -977,7 +977,7 @@ reduction(+:nprocessed,ntot)
     //first build neighbouring tree
     KDTree *treeneighbours=NULL;
     if (nimport>0) {
-        treeneighbours=new KDTree(PartDataGet,nimport,1,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
+        treeneighbours=BuildKDTree(PartDataGet,nimport,1,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
         treeneighbours->SetResetOrder(false);
         nprocessed=0;
     }
@@ -127,6 +127,8 @@ int run(int argc,char **argv)
     adios_set_max_buffer_size(opt.mpiparticletotbufsize/1024/1024);
 #endif
 #endif
+    //load the state of the previous snapshot used to seed the decomposition and SO search
+    if (opt.warmstartinputname.size()>0) ReadWarmStart(opt);
 
     //variables
     //number of particles, (also number of baryons if use dm+baryon search)
@@ -333,7 +335,8 @@ int run(int argc,char **argv)
     if (!opt.iSingleHalo) {
         vr::Timer timer;
 #ifndef USEMPI
-        pfof=SearchFullSet(opt,nbodies,Part,ngroup);
+        if (opt.fofmembershipinputname.size()>0) pfof=SearchFullSetFromFile(opt,nbodies,Part,ngroup);
+        else pfof=SearchFullSet(opt,nbodies,Part,ngroup);
         nhalos=ngroup;
 #else
         //nbodies=Ntotal;
@@ -343,11 +346,14 @@ int run(int argc,char **argv)
         //Now when MPI invoked this returns pfof after local linking and linking across and also reorders groups
         //according to size and localizes the particles belong to the same group to the same mpi thread.
         //after this is called Nlocal is adjusted to the local subset where groups are localized to a given mpi thread.
-        pfof=SearchFullSet(opt,Nlocal,Part,ngroup);
+        if (opt.fofmembershipinputname.size()>0) pfof=SearchFullSetFromFile(opt,Nlocal,Part,ngroup);
+        else pfof=SearchFullSet(opt,Nlocal,Part,ngroup);
         nbodies=Nlocal;
         nhalos=ngroup;
 #endif
         LOG(info) << "Search over " << nbodies << " with " << nthreads << " took " << timer;
+        //store the field structures so that later runs can skip the search
+        if (opt.iwritefofmembership) WriteFOFMembership(opt, nbodies, Part.data(), nhalos, pfof);
         //if compiled to determine inclusive halo masses, then for simplicity, I assume halo id order NOT rearranged!
         //this is not necessarily true if baryons are searched for separately.
         if (opt.iInclusiveHalo > 0 && opt.iInclusiveHalo < 3) {
@@ -536,6 +542,8 @@ int run(int argc,char **argv)
     }
     Int_t indexii=0;
     ng=ngroup;
+    //the warm start file is named after the output base name rather than the sublevels output
+    string warmstartoutname(opt.outname);
     //if separate files, alter offsets
     if (opt.iseparatefiles) {
         sprintf(fname1,"%s.sublevels",opt.outname);
@@ -573,6 +581,7 @@ int run(int argc,char **argv)
     }
 
     if (opt.iprofilecalc) WriteProfiles(opt, ngroup, pdata);
+    if (opt.iwritewarmstart) WriteWarmStart(opt, ngroup, pdata, warmstartoutname.c_str());
 
 #ifdef EXTENDEDHALOOUTPUT
     if (opt.iExtendedOutput) WriteExtendedOutput (opt, ngroup, Nlocal, pdata, Part, pfof);
@@ -636,6 +645,7 @@ int main(int argc, char *argv[])
     }
 
 #ifdef USEMPI
+    MPIFreeWriteComm();
 #ifdef USEADIOS
     adios_finalize(ThisTask);
 #endif
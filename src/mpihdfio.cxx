@@ -129,6 +129,7 @@ void MPINumInDomainHDF(Options &opt)
     unsigned long long chunksize=opt.inputbufsize;
     //buffers to load data
     double *doublebuff=new double[chunksize*3];
+    vector<int> chunkproc;
     vector<int> vintbuff;
     vector<long long> vlongbuff;
     Int_t ibuf=0,*Nbuf, *Nbaryonbuf;
@@ -253,13 +254,11 @@ void MPINumInDomainHDF(Options &opt)
                     if (nend - n < chunksize && nend - n > 0) nchunk=nend-n;
                     //setup hyperslab so that it is loaded into the buffer
                     HDF5ReadHyperSlabReal(doublebuff,partsdataset[i*NHDFTYPE+k], partsdataspace[i*NHDFTYPE+k], 1, 3, nchunk, n, plist_id);
-                    for (auto nn=0;nn<nchunk;nn++) {
 #ifdef PERIODWRAPINPUT
-                    PeriodWrapInput<double>(hdf_header_info[i].BoxSize, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
+                    for (auto nn=0;nn<nchunk;nn++) PeriodWrapInput<double>(hdf_header_info[i].BoxSize, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
 #endif
-                        ibuf=MPIGetParticlesProcessor(opt, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
-                        Nbuf[ibuf]++;
-                    }
+                    MPIGetParticlesProcessor(opt, nchunk, doublebuff, chunkproc);
+                    for (auto nn=0;nn<nchunk;nn++) Nbuf[chunkproc[nn]]++;
                 }
             }
             if (opt.partsearchtype==PSTDARK && opt.iBaryonSearch) {
@@ -282,13 +281,11 @@ void MPINumInDomainHDF(Options &opt)
                         // setup hyperslab so that it is loaded into the buffer
                         HDF5ReadHyperSlabReal(doublebuff, partsdataset[i*NHDFTYPE+k], partsdataspace[i*NHDFTYPE+k], 1, 3, nchunk, n, plist_id);
 
-                        for (auto nn=0;nn<nchunk;nn++) {
 #ifdef PERIODWRAPINPUT
-                    PeriodWrapInput<double>(hdf_header_info[i].BoxSize, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
+                        for (auto nn=0;nn<nchunk;nn++) PeriodWrapInput<double>(hdf_header_info[i].BoxSize, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
 #endif
-                            ibuf=MPIGetParticlesProcessor(opt, doublebuff[nn*3],doublebuff[nn*3+1],doublebuff[nn*3+2]);
-                            Nbaryonbuf[ibuf]++;
-                        }
+                        MPIGetParticlesProcessor(opt, nchunk, doublebuff, chunkproc);
+                        for (auto nn=0;nn<nchunk;nn++) Nbaryonbuf[chunkproc[nn]]++;
                     }
                 }
             }
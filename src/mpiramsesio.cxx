@@ -109,9 +109,7 @@ void MPINumInDomainRAMSES(Options &opt)
     }
     Int_t i,j,k;
     int idim,ivar,igrid;
-    int   typeval;
-    RAMSESFLOAT xtemp[3], ageval;
-    Double_t mtemp;
+    RAMSESFLOAT xtemp[3];
     Int_t ibuf=0,*Nbuf, *Nbaryonbuf;
     int *ngridlevel,*ngridbound,*ngridfile;
     int lmin=1000000,lmax=0;
@@ -119,16 +117,13 @@ void MPINumInDomainRAMSES(Options &opt)
     char buf[2000],buf1[2000],buf2[2000];
     string stringbuf,orderingstring;
     fstream Finfo;
-    fstream *Fpart, *Fpartmass, *Fpartage, *Famr, *Fhydro;
+    fstream *Famr, *Fhydro;
     fstream  Framses;
     RAMSES_Header *header;
     int dummy,byteoffset;
     Int_t chunksize = opt.inputbufsize, nchunk;
-    RAMSESFLOAT *xtempchunk, *mtempchunk, *agetempchunk;
+    RAMSESFLOAT *xtempchunk;
     int *icellchunk;
-    Fpart      = new fstream[opt.num_files];
-    Fpartmass  = new fstream[opt.num_files];
-    Fpartage   = new fstream[opt.num_files];
     Famr       = new fstream[opt.num_files];
     Fhydro     = new fstream[opt.num_files];
     header     = new RAMSES_Header[opt.num_files];
@@ -179,127 +174,58 @@ void MPINumInDomainRAMSES(Options &opt)
 
     if (ireadtask[ThisTask]>=0) {
         if (opt.partsearchtype!=PSTGAS) {
-            for (int i = 0, count2 = 0; i < opt.num_files; i++) if (ireadfile[i]){
-                sprintf(buf1,"%s/part_%s.out%05d",opt.fname,opt.ramsessnapname,static_cast<int>(i+1));
-                sprintf(buf2,"%s/part_%s.out",opt.fname,opt.ramsessnapname);
-                if (FileExists(buf1)) sprintf(buf,"%s",buf1);
-                else if (FileExists(buf2)) sprintf(buf,"%s",buf2);
-                Fpart[i].open      (buf, ios::binary|ios::in);
-                Fpartmass[i].open  (buf, ios::binary|ios::in);
-                Fpartage[i].open   (buf, ios::binary|ios::in);
-                //skip header information in each file save for number in the file
-                //@{
-                byteoffset = 0;
-                // ncpus
-                byteoffset += RAMSES_fortran_skip(Fpart[i], 1);
-                // ndims
-                byteoffset += RAMSES_fortran_read(Fpart[i],header[i].ndim);
-                //store number of particles locally in file
-                byteoffset += RAMSES_fortran_read(Fpart[i],header[i].npartlocal);
-                // skip local seeds, nstartot, mstartot, mstarlost, nsink
-                byteoffset += RAMSES_fortran_skip(Fpart[i], 5);
-                // byteoffset now stores size of header offset for particles
-                Fpartmass[i].seekg  (byteoffset,ios::cur);
-                Fpartage[i].seekg   (byteoffset,ios::cur);
-
-                //skip positions
-                for(idim = 0; idim < header[i].ndim; idim++)
-                {
-                        RAMSES_fortran_skip (Fpartmass[i]);
-                        RAMSES_fortran_skip (Fpartage[i]);
-                }
-                //skip velocities
-                for(idim=0;idim<header[i].ndim;idim++)
-                {
-                    RAMSES_fortran_skip(Fpartmass[i]);
-                    RAMSES_fortran_skip(Fpartage[i]);
-                }
-                //skip mass
-                RAMSES_fortran_skip(Fpartage[i]);
-                //skip ids;
-                RAMSES_fortran_skip(Fpartage[i]);
-                //skip levels
-                RAMSES_fortran_skip(Fpartage[i]);
-                //data loaded into memory in chunks
-                chunksize    = nchunk = header[i].npartlocal;
-                xtempchunk   = new RAMSESFLOAT  [3*chunksize];
-                mtempchunk   = new RAMSESFLOAT  [chunksize];
-                agetempchunk = new RAMSESFLOAT  [chunksize];
-                //now load position data, mass data, and age data
-                for(idim = 0; idim < header[i].ndim; idim++)RAMSES_fortran_read(Fpart[i], &xtempchunk[idim*nchunk]);
-                RAMSES_fortran_read(Fpartmass[i],  mtempchunk);
-                RAMSES_fortran_read(Fpartage[i],   agetempchunk);
-
-                for (int nn = 0; nn < nchunk; nn++)
+            //files are independent, so each thread indexes and reads its own files. The destinations of the
+            //particles of a file are then found at once, serialised as the mesh cell counts are updated
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:ndark,nstar,nghost)
+#endif
+            for (int ifile = 0; ifile < opt.num_files; ifile++) {
+                if (!ireadfile[ifile]) continue;
+                char partfname[2000];
+                RAMSES_Part_Data partdata;
+                vector<double> pos;
+                vector<int> itype, iproc;
+                RAMSES_get_filename(opt.fname, opt.ramsessnapname, "part", ifile, partfname);
+                //only positions, mass and age data are needed
+                RAMSES_read_part_file(partfname, partdata, false);
+                Int_t n=partdata.npartlocal;
+                pos.reserve(3*n);
+                itype.reserve(n);
+                for (Int_t nn = 0; nn < n; nn++)
                 {
+                    Double_t m = partdata.mass[nn];
                     //this should be a ghost star particle
-                    if (fabs((mtempchunk[nn]-dmp_mass)/dmp_mass) > 1e-5 && (agetempchunk[nn] == 0.0)) nghost++;
+                    if (fabs((m-dmp_mass)/dmp_mass) > 1e-5 && (partdata.age[nn] == 0.0)) {nghost++; continue;}
+                    if (fabs(m-dmp_mass)/dmp_mass<1e-5)
+                    {
+                        itype.push_back(DARKTYPE);
+                        ndark++;
+                    }
                     else
                     {
-                        xtemp[0] = xtempchunk[nn];
-                        xtemp[1] = xtempchunk[nn+nchunk];
-                        xtemp[2] = xtempchunk[nn+2*nchunk];
-                        mtemp = mtempchunk[nn];
-                        ageval = agetempchunk[nn];
-
-                        if (fabs(mtemp-dmp_mass)/dmp_mass<1e-5)
-                        {
-                            typeval = DARKTYPE;
-                            ndark++;
-                        }
-                        else
-                        {
-                            typeval = STARTYPE;
-                            nstar++;
-                        }
-
-                        //determine processor this particle belongs on based on its spatial position
-                        ibuf = MPIGetParticlesProcessor(opt, xtemp[0],xtemp[1],xtemp[2]);
-                        /// Count total number of DM particles, Baryons, etc
-                        //@{
-                        if (opt.partsearchtype == PSTALL)
-                        {
-                        Nbuf[ibuf]++;
-                        count2++;
-                        }
-                        else
-                        {
-                            if (opt.partsearchtype == PSTDARK)
-                            {
-                                if (typeval == DARKTYPE)
-                                {
-                                    Nbuf[ibuf]++;
-                                    count2++;
-                                }
-                                else
-                                {
-                                    if (opt.iBaryonSearch)
-                                    {
-                                        Nbaryonbuf[ibuf]++;
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                if (opt.partsearchtype == PSTSTAR)
-                                {
-                                    if (typeval == STARTYPE)
-                                    {
-                                        Nbuf[ibuf]++;
-                                        count2++;
-                                    }
-                                }
-                            }
-                        }
+                        itype.push_back(STARTYPE);
+                        nstar++;
                     }
+                    for (auto idim = 0; idim < 3; idim++) pos.push_back(partdata.x[nn+idim*n]);
+                }
+                partdata = RAMSES_Part_Data();
+#ifdef USEOPENMP
+#pragma omp critical
+#endif
+                {
+                //determine processor these particles belong on based on their spatial position
+                MPIGetParticlesProcessor(opt, itype.size(), pos.data(), iproc);
+                /// Count total number of DM particles, Baryons, etc
+                for (size_t nn = 0; nn < itype.size(); nn++)
+                {
+                    if (opt.partsearchtype == PSTALL) Nbuf[iproc[nn]]++;
+                    else if (opt.partsearchtype == PSTDARK) {
+                        if (itype[nn] == DARKTYPE) Nbuf[iproc[nn]]++;
+                        else if (opt.iBaryonSearch) Nbaryonbuf[iproc[nn]]++;
+                    }
+                    else if (opt.partsearchtype == PSTSTAR && itype[nn] == STARTYPE) Nbuf[iproc[nn]]++;
+                }
                 }
-                delete[] xtempchunk;
-                delete[] mtempchunk;
-                delete[] agetempchunk;
-
-                Fpart[i].close();
-                Fpartmass[i].close();
-                Fpartage[i].close();
             }
         }
 
@@ -137,6 +137,51 @@ Int_t &sendoffset, Int_t &recvoffset)
     currecvchunksize = std::min(static_cast<Int_t>(currecvchunksize), nrecv - recvoffset);
 }
 
+/// @brief Exchange items between all tasks, where the items are ordered by destination task
+/// @param sendbuf items to send, ordered by destination task (items for this task are copied locally)
+/// @param nsend_local number of items to send to each task
+/// @param tag base message tag
+/// @return received items ordered by originating task
+template<typename T> vector<T> MPIExchangeByTask(const vector<T> &sendbuf, Int_t *nsend_local, int tag)
+{
+    Int_t noffset[NProcs], nbuffer[NProcs], nrecv=0;
+    MPI_Status status;
+    int maxchunksize=2147483648/NProcs/sizeof(T);
+    MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
+    noffset[0]=nbuffer[0]=0;
+    for (auto j=1;j<NProcs;j++) {
+        noffset[j]=noffset[j-1]+nsend_local[j-1];
+        nbuffer[j]=nbuffer[j-1]+mpi_nsend[ThisTask+(j-1)*NProcs];
+    }
+    for (auto j=0;j<NProcs;j++) nrecv+=mpi_nsend[ThisTask+j*NProcs];
+    vector<T> recvbuf(nrecv);
+    std::copy(sendbuf.begin()+noffset[ThisTask], sendbuf.begin()+noffset[ThisTask]+nsend_local[ThisTask],
+        recvbuf.begin()+nbuffer[ThisTask]);
+
+    auto commpair = MPIGenerateCommPairs(mpi_nsend);
+    for(auto [task1, task2]:commpair)
+    {
+        if (ThisTask != task1 && ThisTask != task2) continue;
+        auto [sendTask,recvTask] = MPISetSendRecvTask(task1, task2);
+        auto [numsendrecv, cursendchunksize, currecvchunksize, sendoffset, recvoffset] = MPIInitialzeCommChunks(
+            mpi_nsend[recvTask + sendTask * NProcs],
+            mpi_nsend[sendTask + recvTask * NProcs],
+            maxchunksize);
+        for (auto ichunk = 0; ichunk < numsendrecv; ichunk++)
+        {
+            MPI_Sendrecv(&sendbuf.data()[noffset[recvTask]+sendoffset],
+                cursendchunksize * sizeof(T), MPI_BYTE,
+                recvTask, tag+ichunk,
+                &recvbuf.data()[nbuffer[recvTask]+recvoffset],
+                currecvchunksize * sizeof(T), MPI_BYTE,
+                recvTask, tag+ichunk,
+                MPI_COMM_WORLD, &status);
+            MPIUpdateCommChunks(mpi_nsend[recvTask + sendTask * NProcs], mpi_nsend[sendTask + recvTask * NProcs], cursendchunksize, currecvchunksize, sendoffset, recvoffset);
+        }
+    }
+    return recvbuf;
+}
+
 //@}
 
 /// @name Domain decomposition routines and io routines to place particles correctly in local mpi data space
@@ -322,19 +367,48 @@ void MPIInitialDomainDecompositionWithMesh(Options &opt){
         int nsub = max((int)floor(n3/(double)NProcs), 1);
         int itask = 0, count = 0;
         vector<int> numcellspertask(NProcs,0);
+        //if warm starting with the same mesh, reuse the previous cell to task map or, if the number of
+        //tasks has changed, split the curve so each task holds the same number of particles in the previous snapshot
+        auto &warmstart = opt.warmstart;
+        bool iwarmmap = false, iwarmcounts = false;
+        double optimalave = 0;
+        unsigned long long numparts = 0;
+        if (warmstart.numcellsperdim == opt.numcellsperdim) {
+            iwarmmap = (warmstart.nprocs == NProcs && warmstart.cellnodeids.size() == n3);
+            if (!iwarmmap && warmstart.cellnodenumparts.size() == n3) {
+                for (auto &x:warmstart.cellnodenumparts) optimalave += x;
+                optimalave /= (double)NProcs;
+                iwarmcounts = (optimalave > 0);
+            }
+        }
         for (auto i=0;i<n3;i++)
         {
-            if (count == nsub) {
-                count = 0;
-                itask++;
+            auto index = zcurve[i].index;
+            if (iwarmmap) {
+                itask = warmstart.cellnodeids[index];
+            }
+            else if (iwarmcounts) {
+                if (numparts > optimalave && itask < NProcs-1) {
+                    itask++;
+                    numparts = 0;
+                }
+                numparts += warmstart.cellnodenumparts[index];
+            }
+            else {
+                if (count == nsub) {
+                    count = 0;
+                    itask++;
+                }
+                if (itask == NProcs) itask -= 1;
             }
-            if (itask == NProcs) itask -= 1;
-            opt.cellnodeids[zcurve[i].index] = itask;
-            opt.cellnodeorder[i] = zcurve[i].index;
+            opt.cellnodeids[index] = itask;
+            opt.cellnodeorder[i] = index;
             numcellspertask[itask]++;
             count++;
         }
         LOG(info) << "Z-curve Mesh MPI decomposition:";
+        if (iwarmmap) LOG(info) << " Using the decomposition of the warm start file";
+        else if (iwarmcounts) LOG(info) << " Using the mesh cell particle counts of the warm start file";
         LOG(info) << " Mesh has resolution of " << opt.numcellsperdim << " per spatial dim";
         LOG(info) << " with each mesh spanning (" << opt.cellwidth[0] << ", " << opt.cellwidth[1] << ", " << opt.cellwidth[2] << ")";
         LOG(info) << "MPI tasks :";
@@ -390,6 +464,8 @@ bool MPIRepartitionDomainDecompositionWithMesh(Options &opt){
     MPI_Allreduce(opt.cellnodenumparts.data(), buff, opt.numcells, MPI_Int_t, MPI_SUM, MPI_COMM_WORLD);
     for (auto i=0;i<opt.numcells;i++) opt.cellnodenumparts[i]=buff[i];
     delete[] buff;
+    //keep the totals so that the next snapshot can be warm started from them
+    opt.cellnodetotalnumparts = opt.cellnodenumparts;
     double optimalave = 0; for (auto i=0;i<opt.numcells;i++) optimalave += opt.cellnodenumparts[i];
     optimalave /= (double)NProcs;
     auto loadimbalance = MPILoadBalanceWithMesh(opt);
@@ -573,8 +649,75 @@ int MPIGetParticlesProcessor(Options &opt, Double_t x, Double_t y, Double_t z){
     return -1;
 }
 
+/// @brief Determine the processors of a chunk of n particles whose positions are stored as consecutive triplets in x.
+/// Gives the same result as calling \ref MPIGetParticlesProcessor for every particle but destinations are
+/// computed in parallel and the particle counts of the mesh cells are updated once for the whole chunk.
+void MPIGetParticlesProcessor(Options &opt, Int_t n, const double *x, vector<int> &proc)
+{
+    proc.resize(n);
+    if (NProcs==1) {
+        for (auto &p:proc) p=0;
+        return;
+    }
+    Int_t nbad=0, ibad=-1;
+    if (opt.impiusemesh) {
+        vector<unsigned long long> cellindex(n);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (n > ompsearchnum)
+#endif
+        for (Int_t i=0;i<n;i++) {
+            unsigned long long ix, iy, iz;
+            ix=floor(x[3*i]*opt.icellwidth[0]);
+            iy=floor(x[3*i+1]*opt.icellwidth[1]);
+            iz=floor(x[3*i+2]*opt.icellwidth[2]);
+            cellindex[i] = ix*opt.numcellsperdim*opt.numcellsperdim+iy*opt.numcellsperdim+iz;
+        }
+        for (Int_t i=0;i<n;i++) {
+            if (cellindex[i] >= (unsigned long long)opt.numcells) {nbad++; ibad=i; continue;}
+            opt.cellnodenumparts[cellindex[i]]++;
+            proc[i]=opt.cellnodeids[cellindex[i]];
+        }
+    }
+    else {
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) reduction(+:nbad) if (n > ompsearchnum)
+#endif
+        for (Int_t i=0;i<n;i++) {
+            proc[i]=-1;
+            for (int j=0;j<NProcs;j++){
+                if( (mpi_domain[j].bnd[0][0]<=x[3*i]) && (mpi_domain[j].bnd[0][1]>=x[3*i])&&
+                    (mpi_domain[j].bnd[1][0]<=x[3*i+1]) && (mpi_domain[j].bnd[1][1]>=x[3*i+1])&&
+                    (mpi_domain[j].bnd[2][0]<=x[3*i+2]) && (mpi_domain[j].bnd[2][1]>=x[3*i+2]) ) {
+                    proc[i]=j;
+                    break;
+                }
+            }
+            if (proc[i]==-1) nbad++;
+        }
+        if (nbad>0) for (Int_t i=0;i<n;i++) if (proc[i]==-1) {ibad=i; break;}
+    }
+    if (nbad>0) {
+        LOG(error) << "Particle outside the mpi domains of every process (" << x[3*ibad] << "," << x[3*ibad+1] << "," << x[3*ibad+2] << ")";
+        MPI_Abort(MPI_COMM_WORLD,9);
+    }
+}
+
 /// @def Routines related to managing extra properties of baryon particles 
 //@{
+///Copy the extra properties of one particle into its contiguous row of an exchange buffer: internal
+///properties, then chemistry, then chemistry production, each in the order of the names given
+template<typename T> inline void MPIPackExtraProperties(T &&prop,
+    vector<string> &names1, vector<string> &names2, vector<string> &names3, float *row)
+{
+    for (auto &field:names1) *row++ = prop.GetInternalProperties(field);
+    for (auto &field:names2) *row++ = prop.GetChemistry(field);
+    for (auto &field:names3) *row++ = prop.GetChemistryProduction(field);
+}
+template<typename T> inline void MPIPackExtraProperties(T &&prop, vector<string> &names1, float *row)
+{
+    for (auto &field:names1) *row++ = prop.GetExtraProperties(field);
+}
+
 void MPIStripExportParticleOfExtraInfo(Options &opt, Int_t n, Particle *Part)
 {
 #if defined(GASON) || defined(STARON) || defined(BHON) || defined(EXTRADMON)
@@ -625,8 +768,7 @@ void MPIStripExportParticleOfExtraInfo(Options &opt, Int_t n, Particle *Part)
 void MPIFillBuffWithHydroInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vector<Int_t> &indices, vector<float> &propbuff, bool resetbuff)
 {
 #ifdef GASON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -640,24 +782,8 @@ void MPIFillBuffWithHydroInfo(Options &opt, Int_t nlocalbuff, Particle *Part, ve
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.gas_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetInternalProperties(field);
-        }
-        offset += opt.gas_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetChemistry(field);
-        }
-        offset += opt.gas_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetHydroProperties(), opt.gas_internalprop_unique_input_names, opt.gas_chem_unique_input_names,
+            opt.gas_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
         if (resetbuff) Part[index].SetHydroProperties();
     }
 #endif
@@ -666,8 +792,7 @@ void MPIFillBuffWithHydroInfo(Options &opt, Int_t nlocalbuff, Particle *Part, ve
 void MPIFillBuffWithStarInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vector<Int_t> &indices, vector<float> &propbuff, bool resetbuff)
 {
 #ifdef STARON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -681,24 +806,8 @@ void MPIFillBuffWithStarInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vec
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.star_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.star_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetInternalProperties(field);
-        }
-        offset += opt.star_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetChemistry(field);
-        }
-        offset += opt.star_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetStarProperties(), opt.star_internalprop_unique_input_names, opt.star_chem_unique_input_names,
+            opt.star_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
         if (resetbuff) Part[index].SetStarProperties();
     }
 #endif
@@ -707,8 +816,7 @@ void MPIFillBuffWithStarInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vec
 void MPIFillBuffWithBHInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vector<Int_t> &indices, vector<float> &propbuff, bool resetbuff)
 {
 #ifdef BHON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -722,24 +830,8 @@ void MPIFillBuffWithBHInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vecto
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.bh_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetInternalProperties(field);
-        }
-        offset += opt.bh_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetChemistry(field);
-        }
-        offset += opt.bh_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetBHProperties(), opt.bh_internalprop_unique_input_names, opt.bh_chem_unique_input_names,
+            opt.bh_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
         if (resetbuff) Part[index].SetBHProperties();
     }
 #endif
@@ -748,8 +840,7 @@ void MPIFillBuffWithBHInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vecto
 void MPIFillBuffWithExtraDMInfo(Options &opt, Int_t nlocalbuff, Particle *Part, vector<Int_t> &indices, vector<float> &propbuff, bool resetbuff)
 {
 #ifdef EXTRADMON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -763,12 +854,7 @@ void MPIFillBuffWithExtraDMInfo(Options &opt, Int_t nlocalbuff, Particle *Part,
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.extra_dm_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.extra_dm_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetExtraDMProperties().GetExtraProperties(field);
-        }
+        MPIPackExtraProperties(Part[index].GetExtraDMProperties(), opt.extra_dm_internalprop_unique_input_names, &propbuff[i*numextrafields]);
         if (resetbuff) Part[index].SetExtraDMProperties();
     }
 #endif
@@ -777,8 +863,7 @@ void MPIFillBuffWithExtraDMInfo(Options &opt, Int_t nlocalbuff, Particle *Part,
 void MPIFillFOFBuffWithHydroInfo(Options &opt, Int_t numexport, fofid_in *FoFGroupData, Particle *&Part, vector<Int_t> &indices, vector<float> &propbuff, bool iforexport)
 {
 #ifdef GASON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -796,24 +881,8 @@ void MPIFillFOFBuffWithHydroInfo(Options &opt, Int_t numexport, fofid_in *FoFGro
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.gas_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetHydroProperties().GetInternalProperties(field);
-        }
-        offset += opt.gas_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetHydroProperties().GetChemistry(field);
-        }
-        offset += opt.gas_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetHydroProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(FoFGroupData[index].p.GetHydroProperties(), opt.gas_internalprop_unique_input_names, opt.gas_chem_unique_input_names,
+            opt.gas_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
         FoFGroupData[index].p.SetHydroProperties();
         if (iforexport) Part[FoFGroupData[index].Index].SetHydroProperties();
     }
@@ -823,8 +892,7 @@ void MPIFillFOFBuffWithHydroInfo(Options &opt, Int_t numexport, fofid_in *FoFGro
 void MPIFillFOFBuffWithStarInfo(Options &opt, Int_t numexport, fofid_in *FoFGroupData, Particle *&Part, vector<Int_t> &indices, vector<float> &propbuff, bool iforexport)
 {
 #ifdef STARON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -842,24 +910,8 @@ void MPIFillFOFBuffWithStarInfo(Options &opt, Int_t numexport, fofid_in *FoFGrou
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.star_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.star_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetStarProperties().GetInternalProperties(field);
-        }
-        offset += opt.star_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetStarProperties().GetChemistry(field);
-        }
-        offset += opt.star_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetStarProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(FoFGroupData[index].p.GetStarProperties(), opt.star_internalprop_unique_input_names, opt.star_chem_unique_input_names,
+            opt.star_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
         FoFGroupData[index].p.SetStarProperties();
         if (iforexport) Part[FoFGroupData[index].Index].SetStarProperties();
     }
@@ -869,8 +921,7 @@ void MPIFillFOFBuffWithStarInfo(Options &opt, Int_t numexport, fofid_in *FoFGrou
 void MPIFillFOFBuffWithBHInfo(Options &opt, Int_t numexport, fofid_in *FoFGroupData, Particle *&Part, vector<Int_t> &indices, vector<float> &propbuff, bool iforexport)
 {
 #ifdef BHON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -888,24 +939,8 @@ void MPIFillFOFBuffWithBHInfo(Options &opt, Int_t numexport, fofid_in *FoFGroupD
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.bh_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetBHProperties().GetInternalProperties(field);
-        }
-        offset += opt.bh_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetBHProperties().GetChemistry(field);
-        }
-        offset += opt.bh_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetBHProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(FoFGroupData[index].p.GetBHProperties(), opt.bh_internalprop_unique_input_names, opt.bh_chem_unique_input_names,
+            opt.bh_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
         FoFGroupData[index].p.SetBHProperties();
         if (iforexport) Part[FoFGroupData[index].Index].SetBHProperties();
     }
@@ -915,8 +950,7 @@ void MPIFillFOFBuffWithBHInfo(Options &opt, Int_t numexport, fofid_in *FoFGroupD
 void MPIFillFOFBuffWithExtraDMInfo(Options &opt, Int_t numexport, fofid_in *FoFGroupData, Particle *&Part, vector<Int_t> &indices, vector<float> &propbuff, bool iforexport)
 {
 #ifdef EXTRADMON
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
-    string field;
+    Int_t num = 0, numextrafields = 0, index;
     indices.clear();
     propbuff.clear();
 
@@ -934,12 +968,7 @@ void MPIFillFOFBuffWithExtraDMInfo(Options &opt, Int_t numexport, fofid_in *FoFG
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.extra_dm_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.extra_dm_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = FoFGroupData[index].p.GetExtraDMProperties().GetExtraProperties(field);
-        }
+        MPIPackExtraProperties(FoFGroupData[index].p.GetExtraDMProperties(), opt.extra_dm_internalprop_unique_input_names, &propbuff[i*numextrafields]);
         FoFGroupData[index].p.SetExtraDMProperties();
         if (iforexport) Part[FoFGroupData[index].Index].SetExtraDMProperties();
     }
@@ -1141,9 +1170,8 @@ void MPISendHydroInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle *P
 {
 #ifdef GASON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.gas_internalprop_unique_input_names.size() + opt.gas_chem_unique_input_names.size() + opt.gas_chemproduction_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1155,24 +1183,8 @@ void MPISendHydroInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle *P
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.gas_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetInternalProperties(field);
-        }
-        offset += opt.gas_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetChemistry(field);
-        }
-        offset += opt.gas_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetHydroProperties(), opt.gas_internalprop_unique_input_names, opt.gas_chem_unique_input_names,
+            opt.gas_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Send(indices.data(),num,MPI_Int_t,taskID,taskID,MPI_COMM_WORLD);
     MPI_Send(propbuff.data(),num*numextrafields,MPI_FLOAT,taskID,taskID,MPI_COMM_WORLD);
@@ -1183,9 +1195,8 @@ void MPISendStarInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle *Pa
 {
 #ifdef STARON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.star_internalprop_unique_input_names.size() + opt.star_chem_unique_input_names.size()  +opt.star_chemproduction_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1197,24 +1208,8 @@ void MPISendStarInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle *Pa
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.star_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.star_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetInternalProperties(field);
-        }
-        offset += opt.star_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetChemistry(field);
-        }
-        offset += opt.star_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetStarProperties(), opt.star_internalprop_unique_input_names, opt.star_chem_unique_input_names,
+            opt.star_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Send(indices.data(),num,MPI_Int_t,taskID,taskID,MPI_COMM_WORLD);
     MPI_Send(propbuff.data(),num*numextrafields,MPI_FLOAT,taskID,taskID,MPI_COMM_WORLD);
@@ -1225,9 +1220,8 @@ void MPISendBHInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle *Part
 {
 #ifdef BHON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.bh_internalprop_unique_input_names.size() + opt.bh_chem_unique_input_names.size() + opt.bh_chemproduction_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1239,24 +1233,8 @@ void MPISendBHInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle *Part
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.bh_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetInternalProperties(field);
-        }
-        offset += opt.bh_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetChemistry(field);
-        }
-        offset += opt.bh_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetBHProperties(), opt.bh_internalprop_unique_input_names, opt.bh_chem_unique_input_names,
+            opt.bh_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Send(indices.data(),num,MPI_Int_t,taskID,taskID,MPI_COMM_WORLD);
     MPI_Send(propbuff.data(),num*numextrafields,MPI_FLOAT,taskID,taskID,MPI_COMM_WORLD);
@@ -1267,9 +1245,8 @@ void MPISendExtraDMInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle
 {
 #ifdef EXTRADMON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.extra_dm_internalprop_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1281,12 +1258,7 @@ void MPISendExtraDMInfoFromReadThreads(Options &opt, Int_t nlocalbuff, Particle
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.extra_dm_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.extra_dm_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetExtraDMProperties().GetExtraProperties(field);
-        }
+        MPIPackExtraProperties(Part[index].GetExtraDMProperties(), opt.extra_dm_internalprop_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Send(indices.data(),num,MPI_Int_t,taskID,taskID,MPI_COMM_WORLD);
     MPI_Send(propbuff.data(),num*numextrafields,MPI_FLOAT,taskID,taskID,MPI_COMM_WORLD);
@@ -1297,9 +1269,8 @@ void MPIISendHydroInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst,
 {
 #ifdef GASON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.gas_internalprop_unique_input_names.size() + opt.gas_chem_unique_input_names.size() + opt.gas_chemproduction_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1311,24 +1282,8 @@ void MPIISendHydroInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst,
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.gas_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetInternalProperties(field);
-        }
-        offset += opt.gas_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetChemistry(field);
-        }
-        offset += opt.gas_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.gas_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.gas_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetHydroProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetHydroProperties(), opt.gas_internalprop_unique_input_names, opt.gas_chem_unique_input_names,
+            opt.gas_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Isend(indices.data(), num, MPI_Int_t, dst, tag*2, MPI_COMM_WORLD, &rqst);
     MPI_Isend(propbuff.data(), num*numextrafields, MPI_FLOAT, dst, tag*3, MPI_COMM_WORLD, &rqst);
@@ -1339,9 +1294,8 @@ void MPIISendStarInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst, i
 {
 #ifdef STARON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.star_internalprop_unique_input_names.size() + opt.star_chem_unique_input_names.size() + opt.star_chemproduction_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1353,24 +1307,8 @@ void MPIISendStarInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst, i
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.star_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.star_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetInternalProperties(field);
-        }
-        offset += opt.star_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetChemistry(field);
-        }
-        offset += opt.star_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.star_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.star_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetStarProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetStarProperties(), opt.star_internalprop_unique_input_names, opt.star_chem_unique_input_names,
+            opt.star_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Isend(indices.data(), num, MPI_Int_t, dst, tag*2, MPI_COMM_WORLD, &rqst);
     MPI_Isend(propbuff.data(), num*numextrafields, MPI_FLOAT, dst, tag*3, MPI_COMM_WORLD, &rqst);
@@ -1381,9 +1319,8 @@ void MPIISendBHInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst, int
 {
 #ifdef BHON
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.bh_internalprop_unique_input_names.size() + opt.bh_chem_unique_input_names.size() + opt.bh_chemproduction_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1395,24 +1332,8 @@ void MPIISendBHInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst, int
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.bh_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetInternalProperties(field);
-        }
-        offset += opt.bh_internalprop_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chem_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chem_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetChemistry(field);
-        }
-        offset += opt.bh_chem_unique_input_names.size();
-        for (auto iextra=0;iextra<opt.bh_chemproduction_unique_input_names.size();iextra++)
-        {
-            field = opt.bh_chemproduction_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetBHProperties().GetChemistryProduction(field);
-        }
+        MPIPackExtraProperties(Part[index].GetBHProperties(), opt.bh_internalprop_unique_input_names, opt.bh_chem_unique_input_names,
+            opt.bh_chemproduction_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Isend(indices.data(), num, MPI_Int_t, dst, tag*2, MPI_COMM_WORLD, &rqst);
     MPI_Isend(propbuff.data(), num*numextrafields, MPI_FLOAT, dst, tag*3, MPI_COMM_WORLD, &rqst);
@@ -1424,9 +1345,8 @@ void MPIISendExtraDMInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst
 #ifdef EXTRADMON
     MPI_Status status;
     vector<Int_t> indices;
-    Int_t num = 0, numextrafields = 0, index, offset = 0;
+    Int_t num = 0, numextrafields = 0, index;
     vector<float> propbuff;
-    string field;
 
     numextrafields = opt.extra_dm_internalprop_unique_input_names.size();
     if (numextrafields == 0) return;
@@ -1438,12 +1358,7 @@ void MPIISendExtraDMInfo(Options &opt, Int_t nlocalbuff, Particle *Part, int dst
     for (auto i=0;i<num;i++)
     {
         index = indices[i];
-        offset = 0;
-        for (auto iextra=0;iextra<opt.extra_dm_internalprop_unique_input_names.size();iextra++)
-        {
-            field = opt.extra_dm_internalprop_unique_input_names[iextra];
-            propbuff[i*numextrafields + iextra + offset] = Part[index].GetExtraDMProperties().GetExtraProperties(field);
-        }
+        MPIPackExtraProperties(Part[index].GetExtraDMProperties(), opt.extra_dm_internalprop_unique_input_names, &propbuff[i*numextrafields]);
     }
     MPI_Isend(indices.data(), num, MPI_Int_t, dst, tag*2, MPI_COMM_WORLD, &rqst);
     MPI_Isend(propbuff.data(), num*numextrafields, MPI_FLOAT, dst, tag*3, MPI_COMM_WORLD, &rqst);
@@ -2355,7 +2270,8 @@ void MPIAddParticletoAppropriateBuffer(Options &opt, const int &ibuf, Int_t ibuf
         }
         else if (ireadtask[ibuf]>=0) {
             if (ibuf!=ThisTask) {
-                if (Nreadbuf[ireadtask[ibuf]]==Preadbuf[ireadtask[ibuf]].size()) Preadbuf[ireadtask[ibuf]].resize(Preadbuf[ireadtask[ibuf]].size()+BufSize);
+                //grow geometrically so that the number of copies of the buffer is logarithmic in the number of particles
+                if (Nreadbuf[ireadtask[ibuf]]==Preadbuf[ireadtask[ibuf]].size()) Preadbuf[ireadtask[ibuf]].resize(max(2*Preadbuf[ireadtask[ibuf]].size(),(size_t)BufSize));
                 Preadbuf[ireadtask[ibuf]][Nreadbuf[ireadtask[ibuf]]]=Pbuf[ibufindex];
                 Nreadbuf[ireadtask[ibuf]]++;
                 Nbuf[ibuf]=0;
@@ -2701,37 +2617,50 @@ int MPISetFilesRead(Options&opt, std::vector<int> &ireadfile, int *&ireadtask){
 
 /// \name MPI file write related routines
 //@{
-/// @brief Initialize the write communicators
+/// @brief Initialize the write communicators, freeing any built by an earlier initialisation
 void MPIInitWriteComm(){
-    ThisWriteTask = ThisTask;
-    ThisWriteComm = ThisTask;
-    NProcsWrite = NProcs;
-    NWriteComms = NProcs;
-    mpi_comm_write = MPI_COMM_WORLD;
+    MPIFreeWriteComm();
 }
-/// @brief Define the write communicators (what tasks below to what communicators)
+/// @brief Define the write communicators (what tasks below to what communicators).
+/// The communicators are built on the first call and reused by all later writers until \ref MPIFreeWriteComm,
+/// unless the write size or aggregation asked for differs from what they were built with, when they are rebuilt.
+/// When \ref Options.mpinprocsperwriteaggregator is set, the MPI-IO collective buffering hints are set so that
+/// only one task in that many gathers the data of its peers and issues the file system writes (two-phase I/O)
 void MPIBuildWriteComm(Options &opt){
 #ifdef USEPARALLELHDF
     if (opt.mpinprocswritesize > 1) {
+        if (mpi_comm_write != MPI_COMM_WORLD) {
+            if (mpi_comm_write_nprocs == opt.mpinprocswritesize &&
+                mpi_comm_write_nprocsperaggregator == opt.mpinprocsperwriteaggregator) return;
+            MPIFreeWriteComm();
+        }
         ThisWriteComm = (int)(floor(ThisTask/(float)opt.mpinprocswritesize));
         NWriteComms = (int)(ceil(NProcs/(float)opt.mpinprocswritesize));
         MPI_Comm_split(MPI_COMM_WORLD, ThisWriteComm, ThisTask, &mpi_comm_write);
         MPI_Comm_rank(mpi_comm_write, &ThisWriteTask);
         MPI_Comm_size(mpi_comm_write, &NProcsWrite);
-    }
-    else{
-        ThisWriteTask = ThisTask;
-        ThisWriteComm = ThisTask;
-        NProcsWrite = NProcs;
-        NWriteComms = NProcs;
-        mpi_comm_write = MPI_COMM_WORLD;
-    }
+        mpi_comm_write_nprocs = opt.mpinprocswritesize;
+        mpi_comm_write_nprocsperaggregator = opt.mpinprocsperwriteaggregator;
+        if (opt.mpinprocsperwriteaggregator > 0) {
+            int naggregators = (NProcsWrite + opt.mpinprocsperwriteaggregator - 1) / opt.mpinprocsperwriteaggregator;
+            MPI_Info_create(&mpi_info_write);
+            MPI_Info_set(mpi_info_write, "romio_cb_write", "enable");
+            MPI_Info_set(mpi_info_write, "cb_nodes", to_string(naggregators).c_str());
+            //allow several aggregators per node so the count is not capped by the number of nodes
+            MPI_Info_set(mpi_info_write, "cb_config_list", "*:*");
+            LOG_RANK0(info) << "Parallel writes use " << naggregators << " aggregators per write communicator of " << NProcsWrite << " tasks";
+        }
+    }
+    else MPIFreeWriteComm();
 #endif
 }
-/// @brief Free any communicators involved in writing data 
+/// @brief Free any communicators involved in writing data, called once all output is done
 void MPIFreeWriteComm(){
     if (mpi_comm_write != MPI_COMM_WORLD) MPI_Comm_free(&mpi_comm_write);
+    if (mpi_info_write != MPI_INFO_NULL) MPI_Info_free(&mpi_info_write);
     mpi_comm_write = MPI_COMM_WORLD;
+    mpi_info_write = MPI_INFO_NULL;
+    mpi_comm_write_nprocs = mpi_comm_write_nprocsperaggregator = 0;
     ThisWriteTask = ThisTask;
     ThisWriteComm = ThisTask;
     NProcsWrite = NProcs;
@@ -3115,36 +3044,166 @@ void MPIGetExportNum(const Int_t nbodies, Particle *Part, Double_t rdist){
     NImport = nimport;
 }
 
-void MPIGetExportNumUsingMesh(Options &opt, const Int_t nbodies, Particle *Part, Double_t rdist){
-    Int_t i, j, nexport=0,nimport=0;
-    Int_t nsend_local[NProcs];
+/// @brief Flag the mesh cells that are local and whose 26 neighbours are also local (and have not been
+/// newly associated with other domains), so any search box centred in them no wider than a cell stays local
+static vector<char> MPIGetLocalInteriorCellsUsingMesh(Options &opt)
+{
+    int n = opt.numcellsperdim;
+    Int_t ncells = (Int_t)n*n*n;
+    vector<char> interior(ncells, 0);
+    auto islocal = [&](Int_t index) {
+        if (opt.cellnodeids[index] != ThisTask) return false;
+        if (opt.newcellnodeids.size() == 0) return true;
+        for (auto &c:opt.newcellnodeids[index]) if (c != ThisTask) return false;
+        return true;
+    };
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (ncells > ompsearchnum)
+#endif
+    for (Int_t index=0;index<ncells;index++) {
+        if (opt.cellnodeids[index] != ThisTask) continue;
+        int ix = index/(n*n), iy = (index/n)%n, iz = index%n;
+        bool local = true;
+        for (auto dx=-1;dx<=1 && local;dx++)
+            for (auto dy=-1;dy<=1 && local;dy++)
+                for (auto dz=-1;dz<=1 && local;dz++)
+                    local = islocal((Int_t)((ix+dx+n)%n)*n*n + ((iy+dy+n)%n)*n + (iz+dz+n)%n);
+        interior[index] = local;
+    }
+    return interior;
+}
+
+/// @brief Find the (particle index, task) pairs of local particles whose search region, a box of half width
+/// rdist(i) about the particle (no search if zero), overlaps cells of other mpi domains.
+/// Particles sitting in interior cells (see @ref MPIGetLocalInteriorCellsUsingMesh) with search regions no wider
+/// than a cell are culled without a search. Threads sweep contiguous ranges of particles keeping their own
+/// lists and per task counts, a prefix sum over tasks and threads gives each thread's write offsets, and a single
+/// fill pass returns the list ordered by task (and by particle within a task), with the number per task in nsend_local
+template<typename RDist> static vector<pair<Int_t,int>> MPIGetParticleExportListUsingMesh(Options &opt,
+    const Int_t nbodies, Particle *Part, RDist rdist, Int_t *nsend_local)
+{
+    vector<char> interior = MPIGetLocalInteriorCellsUsingMesh(opt);
+    int n = opt.numcellsperdim;
+    int nthreads = 1;
+#ifdef USEOPENMP
+    if (nbodies > ompsearchnum) nthreads = omp_get_max_threads();
+#endif
+    vector<vector<pair<Int_t,int>>> threadexport(nthreads);
+    vector<Int_t> threadcount((Int_t)nthreads*NProcs, 0);
+
+#ifdef USEOPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+{
+    int tid = 0, nt = 1;
+#ifdef USEOPENMP
+    tid = omp_get_thread_num();
+    nt = omp_get_num_threads();
+#endif
     Double_t xsearch[3][2];
-    //siminfo *s = &opt.swiftsiminfo;
-    //Options *s = &opt;
+    auto &exportlist = threadexport[tid];
+    Int_t *count = &threadcount[(Int_t)tid*NProcs];
+    Int_t istart = (long long)nbodies*tid/nt, iend = (long long)nbodies*(tid+1)/nt;
+    for (Int_t i=istart;i<iend;i++) {
+        Double_t r = rdist(i);
+        if (r == 0) continue;
+        Int_t index = 0;
+        bool iwithincell = true;
+        for (auto k=0;k<3;k++) {
+            int icell = floor(Part[i].GetPosition(k)*opt.icellwidth[k]);
+            //particles outside the periodic volume are always searched
+            iwithincell = iwithincell && r*opt.icellwidth[k] < 1.0 && icell >= 0 && icell < n;
+            index = index*n + min(max(icell, 0), n-1);
+        }
+        if (iwithincell && interior[index]) continue;
+        for (auto k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-r;xsearch[k][1]=Part[i].GetPosition(k)+r;}
+        vector<int> cellnodeidlist=MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch);
+        //each domain is sent the particle once
+        sort(cellnodeidlist.begin(), cellnodeidlist.end());
+        cellnodeidlist.erase(unique(cellnodeidlist.begin(), cellnodeidlist.end()), cellnodeidlist.end());
+        for (auto cellnodeID:cellnodeidlist) {
+            exportlist.push_back(make_pair(i, cellnodeID));
+            count[cellnodeID]++;
+        }
+    }
+}
+    //offsets of each thread's share of each task's block
+    vector<Int_t> offset((Int_t)nthreads*NProcs);
+    Int_t nexport = 0;
+    for (auto j=0;j<NProcs;j++) {
+        nsend_local[j] = 0;
+        for (auto t=0;t<nthreads;t++) {
+            offset[(Int_t)t*NProcs+j] = nexport;
+            nexport += threadcount[(Int_t)t*NProcs+j];
+            nsend_local[j] += threadcount[(Int_t)t*NProcs+j];
+        }
+    }
+    vector<pair<Int_t,int>> exportlist(nexport);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static,1) num_threads(nthreads)
+#endif
+    for (auto t=0;t<nthreads;t++) {
+        for (auto &e:threadexport[t]) exportlist[offset[(Int_t)t*NProcs+e.second]++] = e;
+        vector<pair<Int_t,int>>().swap(threadexport[t]);
+    }
+    return exportlist;
+}
 
-    ///\todo would like to add openmp to this code. In particular, loop over nbodies but issue is nexport.
-    ///This would either require making a FoFDataIn[nthreads][NExport] structure so that each omp thread
-    ///can only access the appropriate memory and adjust nsend_local.\n
-    ///\em Or outer loop is over threads, inner loop over nbodies and just have a idlist of size Nlocal that tags particles
-    ///which must be exported. Then its a much quicker follow up loop (no if statement) that stores the data
-    for (j=0;j<NProcs;j++) nsend_local[j]=0;
+/// @brief Export list of the last mesh export count, kept so that the build that follows it does not repeat the
+/// per particle cell search. Keyed on the particles and search distance it was computed for, any other call
+/// recomputes the list.
+struct MeshExportListCache {
+    vector<pair<Int_t,int>> exportlist;
+    vector<Int_t> nsend_local;
+    Int_t nbodies = -1;
+    Particle *Part = NULL;
+    const Double_t *rdistarray = NULL;
+    Double_t rdist = 0;
+};
+static MeshExportListCache meshexportcache;
+
+static void MPIStoreMeshExportList(vector<pair<Int_t,int>> &&exportlist, const Int_t *nsend_local,
+    const Int_t nbodies, Particle *Part, const Double_t *rdistarray, Double_t rdist)
+{
+    meshexportcache.exportlist = std::move(exportlist);
+    meshexportcache.nsend_local.assign(nsend_local, nsend_local+NProcs);
+    meshexportcache.nbodies = nbodies;
+    meshexportcache.Part = Part;
+    meshexportcache.rdistarray = rdistarray;
+    meshexportcache.rdist = rdist;
+}
 
-    LOG(info) << "Finding number of particles to export to other MPI domains...";
+/// @brief Move the cached export list into exportlist if it matches the request, releasing the cache either way
+static bool MPITakeMeshExportList(vector<pair<Int_t,int>> &exportlist, Int_t *nsend_local,
+    const Int_t nbodies, Particle *Part, const Double_t *rdistarray, Double_t rdist)
+{
+    bool match = meshexportcache.Part != NULL && meshexportcache.nbodies == nbodies && meshexportcache.Part == Part
+        && meshexportcache.rdistarray == rdistarray && meshexportcache.rdist == rdist;
+    if (match) {
+        exportlist = std::move(meshexportcache.exportlist);
+        for (auto j=0;j<NProcs;j++) nsend_local[j] = meshexportcache.nsend_local[j];
+    }
+    meshexportcache = MeshExportListCache();
+    return match;
+}
 
-    vector<int>sent_mpi_domain(NProcs);
+/// @brief Search distance of a particle in the nearest neighbour export, zero if the particle is not searched
+inline Double_t NNExportSearchDist(Particle &p, Double_t rdist)
+{
+#ifdef STRUCDEN
+    if (p.GetType()<=0) return 0;
+#endif
+    return rdist;
+}
+
+void MPIGetExportNumUsingMesh(Options &opt, const Int_t nbodies, Particle *Part, Double_t rdist){
+    Int_t j, nexport=0,nimport=0;
+    Int_t nsend_local[NProcs];
 
-    for (i=0;i<nbodies;i++) {
-        for(int k=0; k<NProcs; k++) sent_mpi_domain[k] = 0;
-        for(int k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-rdist;xsearch[k][1]=Part[i].GetPosition(k)+rdist;}
-        vector<int> cellnodeidlist=MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch);
-        for (auto cellnodeID:cellnodeidlist) {
-            /// Only check if particles have overlap with neighbouring cells that are on another MPI domain and have not already been sent to
-            if (sent_mpi_domain[cellnodeID] == 1) continue;
-            nexport++;
-            nsend_local[cellnodeID]++;
-            sent_mpi_domain[cellnodeID]++;
-        }
-    }
+    LOG(info) << "Finding number of particles to export to other MPI domains...";
+    auto exportlist = MPIGetParticleExportListUsingMesh(opt, nbodies, Part, [rdist](Int_t i){return rdist;}, nsend_local);
+    nexport = exportlist.size();
+    MPIStoreMeshExportList(std::move(exportlist), nsend_local, nbodies, Part, NULL, rdist);
     NExport=nexport;//*(1.0+MPIExportFac);
     MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
     for (j=0;j<NProcs;j++)nimport+=mpi_nsend[ThisTask+j*NProcs];
@@ -3275,45 +3334,30 @@ void MPIBuildParticleExportList(Options &opt, const Int_t nbodies, Particle *Par
 void MPIBuildParticleExportListUsingMesh(Options &opt, const Int_t nbodies, Particle *Part, Int_t *&pfof, Int_tree_t *&Len, Double_t rdist){
     Int_t i, j, nexport=0,nimport=0;
     Int_t nsend_local[NProcs],noffset[NProcs],nbuffer[NProcs];
-    Double_t xsearch[3][2];
     Int_t sendTask,recvTask;
     int maxchunksize=LOCAL_MAX_MSGSIZE/NProcs/sizeof(Particle);
     MPI_Status status;
     MPI_Comm mpi_comm = MPI_COMM_WORLD;
-    vector<int>sent_mpi_domain(NProcs);
-
-    ///\todo would like to add openmp to this code. In particular, loop over nbodies but issue is nexport.
-    ///This would either require making a FoFDataIn[nthreads][NExport] structure so that each omp thread
-    ///can only access the appropriate memory and adjust nsend_local.\n
-    ///\em Or outer loop is over threads, inner loop over nbodies and just have a idlist of size Nlocal that tags particles
-    ///which must be exported. Then its a much quicker follow up loop (no if statement) that stores the data
-    for (j=0;j<NProcs;j++) nsend_local[j]=0;
 
     LOG(info) << "Now building exported particle list for FOF search ";
-    for (i=0;i<nbodies;i++) {
-        for(int k=0; k<NProcs; k++) sent_mpi_domain[k] = 0;
-        for(int k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-rdist;xsearch[k][1]=Part[i].GetPosition(k)+rdist;}
-        vector<int> cellnodeidlist=MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch);
-        for (auto cellnodeID:cellnodeidlist) {
-            /// Only check if particles have overlap with neighbouring cells that are on another MPI domain and have not already been sent to
-            if (sent_mpi_domain[cellnodeID] == 1) continue;
-            FoFDataIn[nexport].Index = i;
-            FoFDataIn[nexport].Task = cellnodeID;
-            FoFDataIn[nexport].iGroup = pfof[Part[i].GetID()];//set group id
-            FoFDataIn[nexport].iGroupTask = ThisTask;//and the task of the group
-            FoFDataIn[nexport].iLen = Len[i];
-            nexport++;
-            nsend_local[cellnodeID]++;
-            sent_mpi_domain[cellnodeID]++;
-        }
-    }
+    vector<pair<Int_t,int>> exportlist;
+    if (!MPITakeMeshExportList(exportlist, nsend_local, nbodies, Part, NULL, rdist))
+        exportlist = MPIGetParticleExportListUsingMesh(opt, nbodies, Part, [rdist](Int_t i){return rdist;}, nsend_local);
+    nexport = exportlist.size();
 
     if (nexport>0) {
-        //sort the export data such that all particles to be passed to thread j are together in ascending thread number
-        // qsort(FoFDataIn, nexport, sizeof(struct fofdata_in), fof_export_cmp);
-        std::sort(FoFDataIn, FoFDataIn + nexport, fof_export_cmp_vec);
+        //export list is already grouped by task in ascending order so the buffers are filled in place
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (nexport > ompsearchnum)
+#endif
         for (i=0;i<nexport;i++) {
-            PartDataIn[i] = Part[FoFDataIn[i].Index];
+            auto index = exportlist[i].first;
+            FoFDataIn[i].Index = index;
+            FoFDataIn[i].Task = exportlist[i].second;
+            FoFDataIn[i].iGroup = pfof[Part[index].GetID()];//set group id
+            FoFDataIn[i].iGroupTask = ThisTask;//and the task of the group
+            FoFDataIn[i].iLen = Len[index];
+            PartDataIn[i] = Part[index];
 #ifdef GASON
             PartDataIn[i].SetHydroProperties();
 #endif
@@ -3426,34 +3470,12 @@ void MPIGetNNExportNum(const Int_t nbodies, Particle *Part, Double_t *rdist){
 
 /// @brief like @ref MPIGetExportNum but number based on NN search, useful for reducing mem at the expense of cpu cycles
 void MPIGetNNExportNumUsingMesh(Options &opt, const Int_t nbodies, Particle *Part, Double_t *rdist){
-    Int_t i, j, nexport=0,nimport=0;
+    Int_t j, nexport=0,nimport=0;
     Int_t nsend_local[NProcs];
-    Double_t xsearch[3][2];
-    vector<int>sent_mpi_domain(NProcs);
 
-    ///\todo would like to add openmp to this code. In particular, loop over nbodies but issue is nexport.
-    ///This would either require making a FoFDataIn[nthreads][NExport] structure so that each omp thread
-    ///can only access the appropriate memory and adjust nsend_local.\n
-    ///\em Or outer loop is over threads, inner loop over nbodies and just have a idlist of size Nlocal that tags particles
-    ///which must be exported. Then its a much quicker follow up loop (no if statement) that stores the data
-    for (j=0;j<NProcs;j++) nsend_local[j]=0;
-    for (i=0;i<nbodies;i++)
-    {
-#ifdef STRUCDEN
-        if (Part[i].GetType() <= 0) continue;
-#endif
-        if (rdist[i] == 0) continue;
-        for(int k=0; k<NProcs; k++) sent_mpi_domain[k] = 0;
-        for (int k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-rdist[i];xsearch[k][1]=Part[i].GetPosition(k)+rdist[i];}
-        vector<int> cellnodeidlist=MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch);
-        for (auto cellnodeID:cellnodeidlist) {
-            /// Only check if particles have overlap with neighbouring cells that are on another MPI domain and have not already been sent to
-            if (sent_mpi_domain[cellnodeID] == 1) continue;
-            nexport++;
-            nsend_local[cellnodeID]++;
-            sent_mpi_domain[cellnodeID]++;
-        }
-    }
+    auto exportlist = MPIGetParticleExportListUsingMesh(opt, nbodies, Part, [&](Int_t i){return NNExportSearchDist(Part[i], rdist[i]);}, nsend_local);
+    nexport = exportlist.size();
+    MPIStoreMeshExportList(std::move(exportlist), nsend_local, nbodies, Part, rdist, 0);
     //and then gather the number of particles to be sent from mpi thread m to mpi thread n in the mpi_nsend[NProcs*NProcs] array via [n+m*NProcs]
     NExport=nexport;
     MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
@@ -3549,53 +3571,28 @@ void MPIBuildParticleNNExportList(const Int_t nbodies, Particle *Part, Double_t
 void MPIBuildParticleNNExportListUsingMesh(Options &opt, const Int_t nbodies, Particle *Part, Double_t *rdist){
     Int_t i, j, nexport=0,nimport=0;
     Int_t nsend_local[NProcs],noffset[NProcs],nbuffer[NProcs];
-    Double_t xsearch[3][2];
     Int_t sendTask,recvTask;
     MPI_Status status;
-    vector<int>sent_mpi_domain(NProcs);
     int maxchunksize=2147483648/NProcs/sizeof(nndata_in);
 
-    ///\todo would like to add openmp to this code. In particular, loop over nbodies but issue is nexport.
-    ///This would either require making a FoFDataIn[nthreads][NExport] structure so that each omp thread
-    ///can only access the appropriate memory and adjust nsend_local.\n
-    ///\em Or outer loop is over threads, inner loop over nbodies and just have a idlist of size Nlocal that tags particles
-    ///which must be exported. Then its a much quicker follow up loop (no if statement) that stores the data
-    for (j=0;j<NProcs;j++) nsend_local[j]=0;
-    for (i=0;i<nbodies;i++)
-    {
-#ifdef STRUCDEN
-        if (Part[i].GetType()<=0) continue;
+    vector<pair<Int_t,int>> exportlist;
+    if (!MPITakeMeshExportList(exportlist, nsend_local, nbodies, Part, rdist, 0))
+        exportlist = MPIGetParticleExportListUsingMesh(opt, nbodies, Part, [&](Int_t i){return NNExportSearchDist(Part[i], rdist[i]);}, nsend_local);
+    nexport = exportlist.size();
+    //export list is already grouped by task in ascending order so the buffer is filled in place
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (nexport > ompsearchnum)
 #endif
-        if (rdist[i] == 0) continue;
-        for (int k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-rdist[i];xsearch[k][1]=Part[i].GetPosition(k)+rdist[i];}
-
-        /// Store whether an MPI domain has already been sent to
-        for(int k=0; k<NProcs; k++) sent_mpi_domain[k] = 0;
-        for (int k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-rdist[i];xsearch[k][1]=Part[i].GetPosition(k)+rdist[i];}
-        vector<int> cellnodeidlist=MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch);
-        for (auto cellnodeID:cellnodeidlist) {
-            /// Only check if particles have overlap with neighbouring cells that are on another MPI domain and have not already been sent to
-            if (sent_mpi_domain[cellnodeID] == 1) continue;
-            //NNDataIn[nexport].Index=i;
-            NNDataIn[nexport].ToTask=cellnodeID;
-            NNDataIn[nexport].FromTask=ThisTask;
-            NNDataIn[nexport].R2=rdist[i]*rdist[i];
-            //NNDataIn[nexport].V2=vdist2[i];
-            for (int k=0;k<3;k++) {
-                NNDataIn[nexport].Pos[k]=Part[i].GetPosition(k);
-                NNDataIn[nexport].Vel[k]=Part[i].GetVelocity(k);
-            }
-            nexport++;
-            nsend_local[cellnodeID]++;
-            sent_mpi_domain[cellnodeID]++;
+    for (i=0;i<nexport;i++) {
+        auto index = exportlist[i].first;
+        NNDataIn[i].ToTask=exportlist[i].second;
+        NNDataIn[i].FromTask=ThisTask;
+        NNDataIn[i].R2=rdist[index]*rdist[index];
+        for (int k=0;k<3;k++) {
+            NNDataIn[i].Pos[k]=Part[index].GetPosition(k);
+            NNDataIn[i].Vel[k]=Part[index].GetVelocity(k);
         }
     }
-    //sort the export data such that all particles to be passed to thread j are together in ascending thread number
-    if (nexport>0) {
-	       std::sort(NNDataIn, NNDataIn + nexport, [](const nndata_in &a, const nndata_in &b) {
-            return a.ToTask < b.ToTask;
-        });
-     }
 
     //then store the offset in the export particle data for the jth Task in order to send data.
     for(j = 1, noffset[0] = 0; j < NProcs; j++) noffset[j]=noffset[j-1] + nsend_local[j-1];
@@ -4132,11 +4129,222 @@ Int_t MPIBuildHaloSearchImportList(Options &opt, const Int_t nbodies, KDTree *tr
     return ncount;
 }
 
+/// @brief Determine which other mpi domains a halo's search region overlaps, using either the
+/// mesh or the bisection mpi decomposition
+static vector<int> MPIGetHaloSearchTaskList(Options &opt, Coordinate &pos, Double_t rdist)
+{
+    Double_t xsearch[3][2];
+    vector<int> tasklist;
+    for (int k=0;k<3;k++) {xsearch[k][0]=pos[k]-rdist;xsearch[k][1]=pos[k]+rdist;}
+    if (opt.impiusemesh) {
+        tasklist = MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch);
+        std::sort(tasklist.begin(), tasklist.end());
+        tasklist.erase(std::unique(tasklist.begin(), tasklist.end()), tasklist.end());
+    }
+    else {
+        for (auto j=0;j<NProcs;j++) {
+            if (j==ThisTask) continue;
+            if (MPIInDomain(xsearch,mpi_domain[j].bnd)) tasklist.push_back(j);
+        }
+    }
+    return tasklist;
+}
+
+/// @brief Like \ref MPIBuildHaloSearchExportList but for spherical overdensity calculations where
+/// remote mpi domains evaluate a partial radial profile (see \ref MPIGetHaloSOProfiles) rather than
+/// exporting their particles. Here the halo index and reference velocity are also exported.
+/// @param posref reference position of each halo about which spherical overdensity quantities are calculated
+/// @param rdist search radius of each halo. Halos with radius <= 0 are ignored
+/// @param halooverlap on return flags whether a halo overlaps another mpi domain
+/// @return imported halo centres, ordered by the mpi domain they originate from
+vector<sohalodata_in> MPIBuildHaloSOProfileExportList(Options &opt, const Int_t ngroup, PropData *&pdata, vector<Coordinate> &posref, vector<Double_t> &rdist, vector<bool> &halooverlap)
+{
+    Int_t nimport=0;
+    Int_t nsend_local[NProcs],noffset[NProcs],nbuffer[NProcs];
+    MPI_Status status;
+    int maxchunksize=2147483648/NProcs/sizeof(sohalodata_in);
+    vector<sohalodata_in> haloexport, haloimport;
+    sohalodata_in halo;
+
+    halooverlap.assign(ngroup+1, false);
+    for (auto j=0;j<NProcs;j++) nsend_local[j]=0;
+    for (auto i=1;i<=ngroup;i++)
+    {
+        if (rdist[i]<=0) continue;
+        auto tasklist = MPIGetHaloSearchTaskList(opt, posref[i], rdist[i]);
+        for (auto task:tasklist) {
+            halo.Index=i;
+            halo.ToTask=task;
+            halo.FromTask=ThisTask;
+            halo.Pos=posref[i];
+            halo.Vel=pdata[i].gcmvel;
+            halo.R=rdist[i];
+            haloexport.push_back(halo);
+            nsend_local[task]++;
+            halooverlap[i]=true;
+        }
+    }
+    //keep the halos sent to a given task together while preserving halo order
+    std::stable_sort(haloexport.begin(), haloexport.end(),
+        [](const sohalodata_in &a, const sohalodata_in &b){return a.ToTask < b.ToTask;});
+
+    noffset[0] = 0; for(auto j = 1; j < NProcs; j++) noffset[j]=noffset[j-1] + nsend_local[j-1];
+    MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
+    for (auto j=0;j<NProcs;j++) nimport+=mpi_nsend[ThisTask+j*NProcs];
+    haloimport.resize(nimport);
+
+    auto commpair = MPIGenerateCommPairs(mpi_nsend);
+    for(auto [task1, task2]:commpair)
+    {
+        if (ThisTask != task1 && ThisTask != task2) continue;
+        auto [sendTask,recvTask] = MPISetSendRecvTask(task1, task2);
+        nbuffer[recvTask] = 0;
+        for (int k=0;k<recvTask;k++) nbuffer[recvTask]+=mpi_nsend[sendTask+k*NProcs]; //offset on local receiving buffer
+        auto [numsendrecv, cursendchunksize, currecvchunksize, sendoffset, recvoffset] = MPIInitialzeCommChunks(
+            mpi_nsend[recvTask + sendTask * NProcs],
+            mpi_nsend[sendTask + recvTask * NProcs],
+            maxchunksize);
+        for (auto ichunk = 0; ichunk < numsendrecv; ichunk++)
+        {
+            MPI_Sendrecv(&haloexport.data()[noffset[recvTask]+sendoffset],
+                cursendchunksize * sizeof(sohalodata_in), MPI_BYTE,
+                recvTask, TAG_SO_A+ichunk,
+                &haloimport.data()[nbuffer[recvTask]+recvoffset],
+                currecvchunksize * sizeof(sohalodata_in), MPI_BYTE,
+                recvTask, TAG_SO_A+ichunk,
+                MPI_COMM_WORLD, &status);
+            MPIUpdateCommChunks(mpi_nsend[recvTask + sendTask * NProcs], mpi_nsend[sendTask + recvTask * NProcs], cursendchunksize, currecvchunksize, sendoffset, recvoffset);
+        }
+    }
+    return haloimport;
+}
+
+/// @brief Mirror to \ref MPIBuildHaloSOProfileExportList. For each imported halo centre, search the local
+/// tree and compress all local particles within the search radius into a partial radial profile:
+/// opt.SphericalOverdensityRemoteProfileNumBins logarithmic radial bins per particle type storing the total
+/// mass, the mass weighted radius and the angular momentum relative to the halo's reference frame.
+/// Non-empty bins are returned to the halo's mpi domain, so communication scales with the number of halos
+/// times the number of bins rather than with the number of particles in the overlapping region.
+/// @return partial profiles of local halos evaluated by other mpi domains, sorted by halo index
+vector<soprofiledata_out> MPIGetHaloSOProfiles(Options &opt, KDTree *tree, Particle *Part, vector<sohalodata_in> &haloimport)
+{
+    Int_t nimport=haloimport.size(), nexport=0, nrecv=0;
+    Int_t nsend_local[NProcs],noffset[NProcs],nbuffer[NProcs];
+    MPI_Status status;
+    int maxchunksize=2147483648/NProcs/sizeof(soprofiledata_out);
+    int nbins=opt.SphericalOverdensityRemoteProfileNumBins;
+    vector<vector<soprofiledata_out>> haloprofiles(nimport);
+    vector<soprofiledata_out> profileexport, profileimport;
+
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) default(shared) if (nimport > 1)
+#endif
+    for (Int_t i=0;i<nimport;i++)
+    {
+        auto &halo = haloimport[i];
+        auto taggedparts = tree->SearchBallPosTagged(halo.Pos, halo.R*halo.R);
+        if (taggedparts.size() == 0) continue;
+        vector<Double_t> radii(taggedparts.size());
+        vector<Coordinate> dx(taggedparts.size());
+        Double_t rmin=halo.R;
+        for (auto j=0;j<taggedparts.size();j++) {
+            for (auto k=0;k<3;k++) {
+                dx[j][k]=Part[taggedparts[j]].GetPosition(k)-halo.Pos[k];
+                //correct for period
+                if (opt.p>0) {
+                    if (dx[j][k]>opt.p*0.5) dx[j][k]-=opt.p;
+                    else if (dx[j][k]<-opt.p*0.5) dx[j][k]+=opt.p;
+                }
+            }
+            radii[j]=dx[j].Length();
+            if (radii[j]>0 && radii[j]<rmin) rmin=radii[j];
+        }
+        //logarithmic bins spanning the local particles, where the innermost bin also holds any particle at r=0
+        Double_t lrmin=log(rmin), idlogr=0;
+        if (halo.R>rmin) idlogr=nbins/(log(halo.R)-lrmin);
+        vector<Double_t> binmass(nbins*NPARTTYPES,0), binmassr(nbins*NPARTTYPES,0);
+        vector<Coordinate> binJ;
+        if (opt.iextrahalooutput) binJ.resize(nbins*NPARTTYPES, Coordinate(0.));
+        for (auto j=0;j<taggedparts.size();j++) {
+            auto &p=Part[taggedparts[j]];
+            int ibin=0, itype=p.GetType();
+            if (itype<0 || itype>=NPARTTYPES) itype=DARKTYPE;
+            if (radii[j]>rmin) ibin=min(nbins-1,static_cast<int>((log(radii[j])-lrmin)*idlogr));
+            auto index=ibin*NPARTTYPES+itype;
+            auto massval=p.GetMass();
+            binmass[index]+=massval;
+            binmassr[index]+=massval*radii[j];
+            if (opt.iextrahalooutput) {
+                Coordinate dv;
+                for (auto k=0;k<3;k++) dv[k]=p.GetVelocity(k)-halo.Vel[k];
+                binJ[index]+=dx[j].Cross(dv)*massval;
+            }
+        }
+        soprofiledata_out profile;
+        profile.Index=halo.Index;
+        profile.J=Coordinate(0.);
+        for (auto index=0;index<nbins*NPARTTYPES;index++) {
+            if (binmass[index]<=0) continue;
+            profile.Mass=binmass[index];
+            profile.R=binmassr[index]/binmass[index];
+            profile.Type=index%NPARTTYPES;
+            if (opt.iextrahalooutput) profile.J=binJ[index];
+            haloprofiles[i].push_back(profile);
+        }
+    }
+
+    //imported halos are ordered by originating task so profiles can be sent back in that order
+    for (auto j=0;j<NProcs;j++) nsend_local[j]=0;
+    for (Int_t i=0;i<nimport;i++) {
+        nsend_local[haloimport[i].FromTask]+=haloprofiles[i].size();
+        nexport+=haloprofiles[i].size();
+    }
+    profileexport.reserve(nexport);
+    for (Int_t i=0;i<nimport;i++) {
+        profileexport.insert(profileexport.end(), haloprofiles[i].begin(), haloprofiles[i].end());
+        haloprofiles[i].clear();
+        haloprofiles[i].shrink_to_fit();
+    }
+
+    noffset[0] = 0; for(auto j = 1; j < NProcs; j++) noffset[j]=noffset[j-1] + nsend_local[j-1];
+    MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
+    for (auto j=0;j<NProcs;j++) nrecv+=mpi_nsend[ThisTask+j*NProcs];
+    profileimport.resize(nrecv);
+
+    auto commpair = MPIGenerateCommPairs(mpi_nsend);
+    for(auto [task1, task2]:commpair)
+    {
+        if (ThisTask != task1 && ThisTask != task2) continue;
+        auto [sendTask,recvTask] = MPISetSendRecvTask(task1, task2);
+        nbuffer[recvTask] = 0;
+        for (int k=0;k<recvTask;k++) nbuffer[recvTask]+=mpi_nsend[sendTask+k*NProcs]; //offset on local receiving buffer
+        auto [numsendrecv, cursendchunksize, currecvchunksize, sendoffset, recvoffset] = MPIInitialzeCommChunks(
+            mpi_nsend[recvTask + sendTask * NProcs],
+            mpi_nsend[sendTask + recvTask * NProcs],
+            maxchunksize);
+        for (auto ichunk = 0; ichunk < numsendrecv; ichunk++)
+        {
+            MPI_Sendrecv(&profileexport.data()[noffset[recvTask]+sendoffset],
+                cursendchunksize * sizeof(soprofiledata_out), MPI_BYTE,
+                recvTask, TAG_SO_B+ichunk,
+                &profileimport.data()[nbuffer[recvTask]+recvoffset],
+                currecvchunksize * sizeof(soprofiledata_out), MPI_BYTE,
+                recvTask, TAG_SO_B+ichunk,
+                MPI_COMM_WORLD, &status);
+            MPIUpdateCommChunks(mpi_nsend[recvTask + sendTask * NProcs], mpi_nsend[sendTask + recvTask * NProcs], cursendchunksize, currecvchunksize, sendoffset, recvoffset);
+        }
+    }
+    //group profiles by halo, keeping the order of the originating tasks so results are reproducible
+    std::stable_sort(profileimport.begin(), profileimport.end(),
+        [](const soprofiledata_out &a, const soprofiledata_out &b){return a.Index < b.Index;});
+    return profileimport;
+}
+
 
-/// @brief Similar to \ref MPIBuildParticleExportList, however this is for associated baryon search 
-/// where particles have been moved from original mpi domains and their group id accessed through 
-/// the id array and their stored id and length in numingroup
-void MPIBuildParticleExportBaryonSearchList(Options &opt, const Int_t nbodies, Particle *Part, Int_t *&pfof, Int_t *ids, Int_t *numingroup, Double_t rdist){
+/// @brief Similar to \ref MPIBuildParticleExportList, however this is for associated baryon search
+/// where the dark matter particles in groups are given by the index list members, with their group id
+/// accessed through pfof and their length in numingroup. Allocates the export and import buffers.
+void MPIBuildParticleExportBaryonSearchList(Options &opt, const vector<Int_t> &members, Particle *Part, Int_t *pfof, Int_t *numingroup, Double_t rdist){
     Int_t i, j, nexport=0,nimport=0;
     Int_t nsend_local[NProcs],noffset[NProcs],nbuffer[NProcs];
     Double_t xsearch[3][2];
@@ -4144,45 +4352,57 @@ void MPIBuildParticleExportBaryonSearchList(Options &opt, const Int_t nbodies, P
     int maxchunksize=2147483648/NProcs/sizeof(fofdata_in);
     MPI_Status status;
     MPI_Comm mpi_comm = MPI_COMM_WORLD;
+    vector<fofdata_in> exportdata;
+    vector<int> overlaptasks;
 
-    ///\todo would like to add openmp to this code. In particular, loop over nbodies but issue is nexport.
-    ///This would either require making a FoFDataIn[nthreads][NExport] structure so that each omp thread
-    ///can only access the appropriate memory and adjust nsend_local.\n
-    ///\em Or outer loop is over threads, inner loop over nbodies and just have a idlist of size Nlocal that tags particles
-    ///which must be exported. Then its a much quicker follow up loop (no if statement) that stores the data
+    //tag each member with the other mpi domains its search region overlaps, using the same domain
+    //decomposition for counting and filling the export data
     for (j=0;j<NProcs;j++) nsend_local[j]=0;
-    for (i=0;i<nbodies;i++) {
-        for (int k=0;k<3;k++) {xsearch[k][0]=Part[i].GetPosition(k)-rdist;xsearch[k][1]=Part[i].GetPosition(k)+rdist;}
-        for (j=0;j<NProcs;j++) {
-            if (j!=ThisTask) {
-                //determine if search region is not outside of this processors domain
-                if(MPIInDomain(xsearch,mpi_domain[j].bnd))
-                {
-                    //FoFDataIn[nexport].Part=Part[i];
-                    FoFDataIn[nexport].Index = i;
-                    FoFDataIn[nexport].Task = j;
-                    FoFDataIn[nexport].iGroup = pfof[ids[Part[i].GetID()]];//set group id
-                    FoFDataIn[nexport].iGroupTask = ThisTask;//and the task of the group
-                    FoFDataIn[nexport].iLen = numingroup[pfof[ids[Part[i].GetID()]]];
-                    nexport++;
-                    nsend_local[j]++;
-                }
+    for (auto index:members) {
+        for (int k=0;k<3;k++) {xsearch[k][0]=Part[index].GetPosition(k)-rdist;xsearch[k][1]=Part[index].GetPosition(k)+rdist;}
+        overlaptasks.clear();
+        if (opt.impiusemesh) {
+            for (auto task:MPIGetCellNodeIDListInSearchUsingMesh(opt,xsearch)) {
+                if (task==ThisTask || find(overlaptasks.begin(),overlaptasks.end(),task)!=overlaptasks.end()) continue;
+                overlaptasks.push_back(task);
             }
         }
+        else {
+            for (j=0;j<NProcs;j++) if (j!=ThisTask && MPIInDomain(xsearch,mpi_domain[j].bnd)) overlaptasks.push_back(j);
+        }
+        for (auto task:overlaptasks) {
+            fofdata_in data;
+            data.Index = index;
+            data.Task = task;
+            data.iGroup = pfof[index];//set group id
+            data.iGroupTask = ThisTask;//and the task of the group
+            data.iLen = numingroup[pfof[index]];
+            exportdata.push_back(data);
+            nsend_local[task]++;
+        }
     }
+    nexport=exportdata.size();
+    NExport=nexport;
+    FoFDataIn = new fofdata_in[NExport+1];
+    PartDataIn = new Particle[NExport+1];
     if (nexport>0) {
         //sort the export data such that all particles to be passed to thread j are together in ascending thread number
-        std::sort(FoFDataIn, FoFDataIn + nexport, fof_export_cmp_vec);
-        for (i=0;i<nexport;i++) PartDataIn[i] = Part[FoFDataIn[i].Index];
+        std::sort(exportdata.begin(), exportdata.end(), fof_export_cmp_vec);
+        for (i=0;i<nexport;i++) {
+            FoFDataIn[i] = exportdata[i];
+            PartDataIn[i] = Part[FoFDataIn[i].Index];
+        }
     }
+    vector<fofdata_in>().swap(exportdata);
     //then store the offset in the export particle data for the jth Task in order to send data.
     for(j = 1, noffset[0] = 0; j < NProcs; j++) noffset[j]=noffset[j-1] + nsend_local[j-1];
     //and then gather the number of particles to be sent from mpi thread m to mpi thread n in the mpi_nsend[NProcs*NProcs] array via [n+m*NProcs]
     MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
-    NImport=0;for (j=0;j<NProcs;j++)NImport+=mpi_nsend[ThisTask+j*NProcs];
-    //now send the data.
     for (j=0;j<NProcs;j++)nimport+=mpi_nsend[ThisTask+j*NProcs];
-
+    NImport=nimport;
+    FoFDataGet = new fofdata_in[NImport+1];
+    PartDataGet = new Particle[NImport+1];
+    //now send the data.
     auto commpair = MPIGenerateCommPairs(mpi_nsend);
     for(auto [task1, task2]:commpair)
     {
@@ -4471,6 +4691,91 @@ Int_t MPILinkAcross(const Int_t nbodies, KDTree *&tree, Particle *Part, Int_t *&
     delete[] nn;
     return links;
 }
+
+/// @brief Assign group ids read from FOF membership files to local particles using a distributed hash join.
+/// Entries read by this task and the ids of local particles are sent to the task given by the hash of the
+/// particle id, matched there and the group ids returned to the task holding the particle. mpi_foftask is set to the
+/// task on which the group resides, which is the task that wrote the group (modulo the current number of tasks).
+/// @param opt Options structure containing runtime arguments
+/// @param nbodies number of local particles
+/// @param Part local particles
+/// @param entries FOF membership entries read by this task, freed on return
+/// @param pfof group ids of local particles
+void MPIAssignFOFMembership(Options &opt, const Int_t nbodies, Particle *Part, vector<fofmembership_entry> &entries, Int_t *pfof)
+{
+    Int_t nsend_local[NProcs], nbuffer[NProcs];
+    vector<fofmembership_entry> sendbuf;
+    vector<int> desttask;
+
+    //bin items by destination task preserving their order
+    auto bin_by_task = [&](vector<fofmembership_entry> &items) {
+        for (auto j=0;j<NProcs;j++) nsend_local[j]=0;
+        for (auto &t:desttask) nsend_local[t]++;
+        nbuffer[0]=0;
+        for (auto j=1;j<NProcs;j++) nbuffer[j]=nbuffer[j-1]+nsend_local[j-1];
+        sendbuf.resize(items.size());
+        for (auto i=0;i<items.size();i++) sendbuf[nbuffer[desttask[i]]++]=items[i];
+    };
+
+    //send entries to the task that owns the hash of their particle id
+    desttask.resize(entries.size());
+    for (auto i=0;i<entries.size();i++) desttask[i]=FOFMembershipHash(entries[i].PID, 0) % NProcs;
+    bin_by_task(entries);
+    entries.clear();
+    entries.shrink_to_fit();
+    auto entriesrecv = MPIExchangeByTask(sendbuf, nsend_local, TAG_FOFMEMBERSHIP_A);
+
+    //likewise for the ids of local particles
+    vector<fofmembership_entry> requests(nbodies);
+    desttask.resize(nbodies);
+    for (Int_t i=0;i<nbodies;i++) {
+        pfof[i]=0;
+        mpi_foftask[i]=ThisTask;
+        requests[i].PID=Part[i].GetPID();
+        requests[i].iGroup=0;
+        requests[i].Index=i;
+        requests[i].Task=ThisTask;
+        desttask[i]=FOFMembershipHash(requests[i].PID, 0) % NProcs;
+    }
+    bin_by_task(requests);
+    requests.clear();
+    requests.shrink_to_fit();
+    auto requestsrecv = MPIExchangeByTask(sendbuf, nsend_local, TAG_FOFMEMBERSHIP_A);
+
+    //join and return matched particles to the requesting task, setting Task to that of the group
+    auto match = FOFMembershipHashJoin(requestsrecv, entriesrecv);
+    vector<fofmembership_entry> replies;
+    desttask.clear();
+    for (auto i=0;i<requestsrecv.size();i++) {
+        if (match[i] < 0) continue;
+        auto reply = requestsrecv[i];
+        reply.iGroup = entriesrecv[match[i]].iGroup;
+        reply.Task = entriesrecv[match[i]].Task % NProcs;
+        desttask.push_back(requestsrecv[i].Task);
+        replies.push_back(reply);
+    }
+    entriesrecv.clear();
+    requestsrecv.clear();
+    bin_by_task(replies);
+    replies = MPIExchangeByTask(sendbuf, nsend_local, TAG_FOFMEMBERSHIP_B);
+    for (auto &r:replies) {
+        pfof[r.Index]=r.iGroup;
+        mpi_foftask[r.Index]=r.Task;
+    }
+    LOG(debug) << "Matched " << replies.size() << " local particles to groups read from FOF membership files";
+}
+
+#ifdef EXTENDEDHALOOUTPUT
+/// @brief Send extended output entries to the tasks that originally read the particles
+/// @param sendbuf entries ordered by the task that read the particle
+/// @param nsend_local number of entries to send to each task
+/// @return entries of particles read by this task
+vector<extendedoutput_entry> MPIExchangeExtendedOutput(const vector<extendedoutput_entry> &sendbuf, Int_t *nsend_local)
+{
+    return MPIExchangeByTask(sendbuf, nsend_local, TAG_EXTENDED_A);
+}
+#endif
+
 /*!
     Group particles belong to a group to a particular mpi thread so that locally easy to determine
     the maximum group size and reoder the group ids according to descending group size.
@@ -4974,64 +5279,40 @@ Int_t MPIBaryonCompileGroups(Options &opt, const Int_t nbodies, Particle *Part,
 }
 
 ///Determine which exported dm particle is closest in phase-space to a local baryon particle and assign that particle to the group of that dark matter particle if is closest particle
-Int_t MPISearchBaryons(const Int_t nbaryons, Particle *&Pbaryons, Int_t *&pfofbaryons, Int_t *numingroup, Double_t *localdist, Int_t nsearch, Double_t *param, Double_t *period)
+Int_t MPISearchBaryons(const Int_t nbaryons, Particle *&Pbaryons, Int_t *&pfofbaryons, Int_t *numingroup, Double_t *localdist, Int_t bsize, Double_t *param, Double_t *period)
 {
-    Double_t D2, dval, rval;
-    Coordinate x1;
-    Particle p1;
-    Int_t  i, j, k, pindex,nexport=0;
-    int tid;
-    FOFcompfunc fofcmp=FOF6d;
-    Int_t *nnID;
-    Double_t *dist2;
+    Int_t nexport=0;
     if (NImport>0) {
     //now dark matter particles associated with a group existing on another mpi domain are local and can be searched.
-    KDTree *mpitree =  new KDTree(PartDataGet,NImport,nsearch/2,mpitree->TPHYS,mpitree->KEPAN,100,0,0,0,period);
-    if (nsearch>NImport) nsearch=NImport;
+    //index them in place with the length of their group on the originating domain
+    GroupMemberIndex gmi;
+    vector<Int_t> members(NImport), gid(NImport), glen(NImport);
+    for (Int_t i=0;i<NImport;i++) {
+        members[i]=i;
+        gid[i]=FoFDataGet[i].iGroup;
+        glen[i]=FoFDataGet[i].iLen;
+    }
+    BuildGroupMemberIndex(gmi, PartDataGet, members, gid, glen, bsize);
+    vector<Int_t> baryonorder=SpatiallySortedOrder(nbaryons, Pbaryons);
 #ifdef USEOPENMP
-#pragma omp parallel default(shared) \
-private(i,j,k,tid,p1,pindex,x1,D2,dval,rval,nnID,dist2)
-{
-    nnID=new Int_t[nsearch];
-    dist2=new Double_t[nsearch];
-#pragma omp for reduction(+:nexport)
+#pragma omp parallel for schedule(dynamic,ompbaryonbatchsize) reduction(+:nexport) if (nbaryons>ompsearchnum)
 #endif
-    for (i=0;i<nbaryons;i++)
+    for (Int_t ii=0;ii<nbaryons;ii++)
     {
-#ifdef USEOPENMP
-        tid=omp_get_thread_num();
-#else
-        tid=0;
-#endif
-        p1=Pbaryons[i];
-        x1=Coordinate(p1.GetPosition());
-        rval=MAXVALUE;
-        dval=localdist[i];
-        mpitree->FindNearestPos(x1, nnID, dist2,nsearch);
-        if (dist2[0]<param[6]) {
-        for (j=0;j<nsearch;j++) {
-            D2=0;
-            pindex=PartDataGet[nnID[j]].GetID();
-            if (numingroup[pfofbaryons[i]]<FoFDataGet[pindex].iLen) {
-                if (fofcmp(p1,PartDataGet[nnID[j]],param)) {
-                    for (k=0;k<3;k++) {
-                        D2+=(p1.GetPosition(k)-PartDataGet[nnID[j]].GetPosition(k))*(p1.GetPosition(k)-PartDataGet[nnID[j]].GetPosition(k))/param[6]+(p1.GetVelocity(k)-PartDataGet[nnID[j]].GetVelocity(k))*(p1.GetVelocity(k)-PartDataGet[nnID[j]].GetVelocity(k))/param[7];
-                    }
+        Int_t i=baryonorder[ii], ibest;
+        //distance to beat is that of the local association, less any self-energy term
+        Double_t dval=localdist[i];
 #ifdef GASON
-                    D2+=p1.GetU()/param[7];
+        dval-=Pbaryons[i].GetU()/param[7];
 #endif
-                    if (dval>D2) {dval=D2;pfofbaryons[i]=FoFDataGet[pindex].iGroup;rval=dist2[j];mpi_foftask[i]=FoFDataGet[pindex].iGroupTask;}
-                }
-            }
-        }
+        ibest=SearchGroupMemberIndex(gmi, Pbaryons[i], param, period, numingroup[pfofbaryons[i]], -1, dval);
+        if (ibest>=0) {
+            Int_t pindex=gmi.member[ibest];
+            pfofbaryons[i]=FoFDataGet[pindex].iGroup;
+            mpi_foftask[i]=FoFDataGet[pindex].iGroupTask;
         }
         nexport+=(mpi_foftask[i]!=ThisTask);
     }
-    delete[] nnID;
-    delete[] dist2;
-#ifdef USEOPENMP
-}
-#endif
     }
     return nexport;
 }
@@ -5228,48 +5509,99 @@ void MPICollectFOF(const Int_t nbodies, Int_t *&pfof){
 
 /// \name Routines related to distributing the grid cells used to calculate the coarse-grained mean field
 //@{
-/*! Collects all the grid data
+/*! Collects the grid cells needed to interpolate the background velocity distribution at the positions of local particles.
+    The MAXNGRID+1 nearest cells of a particle can be no further away than its MAXNGRID+1 nearest local cells, so each task
+    only needs the cells of other tasks that lie within the bounding box of its particles expanded by the largest of these
+    distances. These search regions are shared and only cells inside them are exchanged.
+    The local cells followed by the imported cells are stored in mpi_grid, mpi_gvel and mpi_gveldisp.
+    \return total number of cells stored
 */
-void MPIBuildGridData(const Int_t ngrid, GridCell *grid, Coordinate *gvel, Matrix *gveldisp){
-    Int_t i, j;
-    Int_t nsend_local[NProcs],noffset[NProcs];
-    Int_t sendTask,recvTask;
-    MPI_Status status;
+Int_t MPIBuildGridData(const Int_t ngrid, GridCell *grid, Coordinate *gvel, Matrix *gveldisp, const Int_t nbodies, Particle *Part){
+    Int_t nsend_local[NProcs];
+    Double_t searchbox[6], allsearchbox[6*NProcs], rsearch2=0;
+    vector<gridexport_entry> sendbuf, recvbuf;
 
-    for (j=0;j<NProcs;j++) nsend_local[j]=Ngridlocal;
-    MPI_Allgather(nsend_local, NProcs, MPI_Int_t, mpi_nsend, NProcs, MPI_Int_t, MPI_COMM_WORLD);
-    noffset[0]=0;
-    for (j=1;j<NProcs;j++) noffset[j]=noffset[j]+mpi_nsend[ThisTask+j*NProcs];
-    for (i=0;i<Ngridlocal;i++) {
-        for (j=0;j<3;j++) mpi_grid[noffset[ThisTask]+i].xm[j]=grid[i].xm[j];
-        mpi_gvel[noffset[ThisTask]+i]=gvel[i];
-        mpi_gveldisp[noffset[ThisTask]+i]=gveldisp[i];
+    //bounding box of local particles
+    for (auto k=0;k<3;k++) {
+        Double_t xmin=MAXVALUE, xmax=-MAXVALUE;
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) reduction(min:xmin) reduction(max:xmax) if (nbodies > ompsearchnum)
+#endif
+        for (Int_t i=0;i<nbodies;i++) {
+            xmin=min(xmin,(Double_t)Part[i].GetPosition(k));
+            xmax=max(xmax,(Double_t)Part[i].GetPosition(k));
+        }
+        searchbox[2*k]=xmin;
+        searchbox[2*k+1]=xmax;
+    }
+    //distance needed to be sure all the nearest cells are found. If there are too few local cells, every cell is needed
+    if (nbodies > 0) {
+        if (ngrid < MAXNGRID+1) rsearch2=MAXVALUE;
+        else {
+            Particle *ptemp=new Particle[ngrid];
+            for (Int_t i=0;i<ngrid;i++) ptemp[i]=Particle(1.0,grid[i].xm[0],grid[i].xm[1],grid[i].xm[2],0.0,0.0,0.0,i);
+            KDTree *tree=BuildKDTree(ptemp,ngrid,1,KDTree::TPHYS, KDTree::KEPAN,100,0,0,0);
+#ifdef USEOPENMP
+#pragma omp parallel if (nbodies > ompsubsearchnum)
+#endif
+            {
+            Int_t nn[MAXNGRID+1];
+            Double_t dist[MAXNGRID+1];
+#ifdef USEOPENMP
+#pragma omp for schedule(static) reduction(max:rsearch2)
+#endif
+            for (Int_t i=0;i<nbodies;i++) {
+                Coordinate xpos(Part[i].GetPosition());
+                tree->FindNearestPos(xpos,nn,dist,MAXNGRID+1);
+                for (auto j=0;j<=MAXNGRID;j++) rsearch2=max(rsearch2,dist[j]);
+            }
+            }
+            delete tree;
+            delete[] ptemp;
+        }
+        for (auto k=0;k<3;k++) {
+            if (rsearch2 == MAXVALUE) {searchbox[2*k]=-MAXVALUE; searchbox[2*k+1]=MAXVALUE;}
+            else {searchbox[2*k]-=sqrt(rsearch2); searchbox[2*k+1]+=sqrt(rsearch2);}
+        }
     }
+    MPI_Allgather(searchbox, 6, MPI_DOUBLE, allsearchbox, 6, MPI_DOUBLE, MPI_COMM_WORLD);
 
-    auto commpair = MPIGenerateCommPairs(mpi_nsend);
-    for(auto [task1, task2]:commpair)
-    {
-        if (ThisTask != task1 && ThisTask != task2) continue;
-        auto [sendTask,recvTask] = MPISetSendRecvTask(task1, task2);
-        MPI_Sendrecv(grid,
-            Ngridlocal* sizeof(GridCell), MPI_BYTE,
-            recvTask, TAG_GRID_A,
-            &mpi_grid[noffset[recvTask]],
-            mpi_nsend[sendTask+recvTask * NProcs] * sizeof(GridCell),
-            MPI_BYTE, recvTask, TAG_GRID_A, MPI_COMM_WORLD, &status);
-        MPI_Sendrecv(gvel,
-            Ngridlocal* sizeof(Coordinate), MPI_BYTE,
-            recvTask, TAG_GRID_B,
-            &mpi_gvel[noffset[recvTask]],
-            mpi_nsend[sendTask+recvTask * NProcs] * sizeof(Coordinate),
-            MPI_BYTE, recvTask, TAG_GRID_B, MPI_COMM_WORLD, &status);
-        MPI_Sendrecv(gveldisp,
-            Ngridlocal* sizeof(Matrix), MPI_BYTE,
-            recvTask, TAG_GRID_C,
-            &mpi_gveldisp[noffset[recvTask]],
-            mpi_nsend[sendTask+recvTask * NProcs] * sizeof(Matrix),
-            MPI_BYTE, recvTask, TAG_GRID_C, MPI_COMM_WORLD, &status);
+    //export cells that lie in the search region of other tasks
+    for (auto j=0;j<NProcs;j++) {
+        nsend_local[j]=0;
+        if (j==ThisTask) continue;
+        for (Int_t i=0;i<ngrid;i++) {
+            bool iinside=true;
+            for (auto k=0;k<3;k++) iinside = iinside && grid[i].xm[k] >= allsearchbox[6*j+2*k] && grid[i].xm[k] <= allsearchbox[6*j+2*k+1];
+            if (!iinside) continue;
+            gridexport_entry entry;
+            for (auto k=0;k<3;k++) entry.xm[k]=grid[i].xm[k];
+            entry.gvel=gvel[i];
+            entry.gveldisp=gveldisp[i];
+            sendbuf.push_back(entry);
+            nsend_local[j]++;
+        }
+    }
+    recvbuf = MPIExchangeByTask(sendbuf, nsend_local, TAG_GRID_A);
+    vector<gridexport_entry>().swap(sendbuf);
+
+    Ngridlocal=ngrid;
+    Ngridtotal=ngrid+recvbuf.size();
+    mpi_grid=new GridCell[Ngridtotal];
+    mpi_gvel=new Coordinate[Ngridtotal];
+    mpi_gveldisp=new Matrix[Ngridtotal];
+    for (Int_t i=0;i<ngrid;i++) {
+        for (auto k=0;k<3;k++) mpi_grid[i].xm[k]=grid[i].xm[k];
+        mpi_gvel[i]=gvel[i];
+        mpi_gveldisp[i]=gveldisp[i];
+    }
+    for (Int_t i=0;i<(Int_t)recvbuf.size();i++) {
+        for (auto k=0;k<3;k++) mpi_grid[ngrid+i].xm[k]=recvbuf[i].xm[k];
+        mpi_gvel[ngrid+i]=recvbuf[i].gvel;
+        mpi_gveldisp[ngrid+i]=recvbuf[i].gveldisp;
     }
+    LOG(debug) << "Imported " << recvbuf.size() << " grid cells to go with " << ngrid << " local cells";
+    return Ngridtotal;
 }
 //@}
 
@@ -43,8 +43,10 @@ GridCell *mpi_grid;
 Coordinate *mpi_gvel;
 Matrix *mpi_gveldisp;
 
-MPI_Comm mpi_comm_write;
+MPI_Comm mpi_comm_write = MPI_COMM_WORLD;
 int ThisWriteTask, NProcsWrite, ThisWriteComm, NWriteComms;
+MPI_Info mpi_info_write = MPI_INFO_NULL;
+int mpi_comm_write_nprocs = 0, mpi_comm_write_nprocsperaggregator = 0;
 //@}
 
 
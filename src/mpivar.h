@@ -114,6 +114,14 @@ typedef short short_mpi_t;
 #define TAG_NN_A 20
 #define TAG_NN_B 21
 
+///flag for spherical overdensity halo centre and profile exchange
+#define TAG_SO_A 25
+#define TAG_SO_B 26
+
+///flag for FOF membership exchange
+#define TAG_FOFMEMBERSHIP_A 27
+#define TAG_FOFMEMBERSHIP_B 28
+
 ///flag for Grid data exchange
 #define TAG_GRID_A 31
 #define TAG_GRID_B 31
@@ -227,6 +235,38 @@ struct nndata_in
     nndata_in& operator=(nndata_in &&n) = default;
 };
 extern struct nndata_in *NNDataIn, *NNDataGet;
+
+///structure facilitates spherical overdensity calculations of halos whose search region overlaps other mpi domains
+///where only the halo centre, reference velocity and search radius are exported
+struct sohalodata_in
+{
+    Int_t Index;
+    short_mpi_t ToTask, FromTask;
+    Coordinate Pos, Vel;
+    Double_t R;
+    sohalodata_in() = default;
+    sohalodata_in(const sohalodata_in &h) = default;
+    sohalodata_in(sohalodata_in &&h) = default;
+    ~sohalodata_in() = default;
+    sohalodata_in& operator=(const sohalodata_in &h) = default;
+    sohalodata_in& operator=(sohalodata_in &&h) = default;
+};
+
+///structure storing one radial bin of a partial spherical overdensity profile evaluated by another mpi domain.
+///Stores the total mass, mass weighted radius and angular momentum of particles of a given type in the bin
+struct soprofiledata_out
+{
+    Int_t Index;
+    Double_t R, Mass;
+    Coordinate J;
+    int Type;
+    soprofiledata_out() = default;
+    soprofiledata_out(const soprofiledata_out &p) = default;
+    soprofiledata_out(soprofiledata_out &&p) = default;
+    ~soprofiledata_out() = default;
+    soprofiledata_out& operator=(const soprofiledata_out &p) = default;
+    soprofiledata_out& operator=(soprofiledata_out &&p) = default;
+};
 //extern Particle *NNPartReturn, *NNPartReturnLocal;
 
 ///For transmitting grid data
@@ -248,6 +288,10 @@ extern Int_t MinNumMPI,MinNumOld;
 
 extern MPI_Comm mpi_comm_write;
 extern int ThisWriteTask, NProcsWrite, ThisWriteComm, NWriteComms;
+///MPI-IO hints (collective buffering aggregators) passed when opening files for parallel writes
+extern MPI_Info mpi_info_write;
+///write size and tasks per aggregator the current write communicator and hints were built with (zero if none built)
+extern int mpi_comm_write_nprocs, mpi_comm_write_nprocsperaggregator;
 //@}
 
 
@@ -53,7 +53,7 @@ KDTree **OpenMPBuildLocalTrees(Options &opt, const Int_t numompregions, vector<P
     {
     #pragma omp for schedule(static) nowait
     for (i=0;i<numompregions;i++) {
-        tree3dfofomp[i] = new KDTree(&Part.data()[ompdomain[i].noffset],ompdomain[i].ncount,opt.Bsize,tree3dfofomp[i]->TPHYS,tree3dfofomp[i]->KEPAN,100,0,0,0,period,NULL);
+        tree3dfofomp[i] = BuildKDTree(&Part.data()[ompdomain[i].noffset],ompdomain[i].ncount,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
         tree3dfofomp[i]->OverWriteInputOrder();
     }
     }
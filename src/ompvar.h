@@ -5,6 +5,10 @@
 #ifndef OMPVAR_H
 #define OMPVAR_H
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
 #ifdef USEOPENMP
 #include <omp.h>
 #endif
@@ -33,8 +37,92 @@ using namespace NBody;
 #define omppropnum 50000
 #define ompfofsearchnum 2000000
 #define ompsortsize 1000000
+#define ompbaryonbatchsize 256
+#define ompgroupbatchsize 16
 //@}
 
+/// \brief Sort [first,last) with comp. Ranges larger than \ref ompsortsize are split into one chunk per
+/// thread, the chunks sorted concurrently and then merged pairwise, also concurrently
+template<class RandomIt, class Compare> void OMPSort(RandomIt first, RandomIt last, Compare comp)
+{
+#ifdef USEOPENMP
+    long long n = last - first;
+    int nchunks = omp_get_max_threads();
+    if (n < ompsortsize || nchunks < 2 || omp_in_parallel()) {
+        std::sort(first, last, comp);
+        return;
+    }
+    std::vector<long long> bounds(nchunks+1);
+    for (int i = 0; i <= nchunks; i++) bounds[i] = n * i / nchunks;
+    #pragma omp parallel for schedule(static,1)
+    for (int i = 0; i < nchunks; i++) std::sort(first+bounds[i], first+bounds[i+1], comp);
+    for (int width = 1; width < nchunks; width *= 2) {
+        #pragma omp parallel for schedule(dynamic,1)
+        for (int i = 0; i < nchunks - width; i += 2*width) {
+            std::inplace_merge(first+bounds[i], first+bounds[i+width],
+                first+bounds[std::min(i+2*width, nchunks)], comp);
+        }
+    }
+#else
+    std::sort(first, last, comp);
+#endif
+}
+template<class RandomIt> void OMPSort(RandomIt first, RandomIt last)
+{
+    OMPSort(first, last, std::less<>());
+}
+
+/// \brief Sort the n particles starting at first in ascending order of key(particle). The keys are computed once
+/// per particle into a buffer, thread local and reused between calls for ranges smaller than \ref ompsortsize
+/// (so it never grows beyond that) and local to the call otherwise, and sorted along with the particle indices
+/// (ties broken by index, so the order does not depend on the number of threads), with \ref OMPSort doing the work
+/// for large ranges. The particles are then moved into place by following the cycles of the permutation,
+/// so no second copy of the particles is needed
+template<class KeyFunc> void SortParticlesByKey(Particle *first, Int_t n, KeyFunc key)
+{
+    static thread_local std::vector<std::pair<Double_t, Int_t>> keybuff;
+    std::vector<std::pair<Double_t, Int_t>> largekeybuff;
+    if (n < 2) return;
+    //reference used in the parallel loop so every thread fills the calling thread's buffer
+    auto &keys = (n < ompsortsize) ? keybuff : largekeybuff;
+    keys.resize(n);
+#ifdef USEOPENMP
+    #pragma omp parallel for schedule(static) if (n >= ompsortsize)
+#endif
+    for (Int_t j = 0; j < n; j++) keys[j] = std::make_pair(key(first[j]), j);
+    OMPSort(keys.begin(), keys.end());
+    //keys[j].second is the particle that belongs at j, entries are marked with -1 once placed
+    for (Int_t j = 0; j < n; j++) {
+        if (keys[j].second < 0 || keys[j].second == j) continue;
+        Particle ptemp = std::move(first[j]);
+        Int_t dst = j, src = keys[j].second;
+        while (src != j) {
+            first[dst] = std::move(first[src]);
+            keys[dst].second = -1;
+            dst = src;
+            src = keys[src].second;
+        }
+        first[dst] = std::move(ptemp);
+        keys[dst].second = -1;
+    }
+}
+
+/// \brief Sort the particles of groups 1..ngroup, stored contiguously from Part+noffset[i], by key.
+/// Groups smaller than \ref ompsortsize are handed to the threads in batches of \ref ompgroupbatchsize,
+/// larger ones are then sorted one at a time with all threads working on the same group
+template<class KeyFunc> void SortGroupsByKey(Int_t ngroup, Int_t *numingroup, Int_t *noffset, Particle *Part, KeyFunc key)
+{
+    std::vector<Int_t> largegroups;
+    for (Int_t i = 1; i <= ngroup; i++) if (numingroup[i] >= ompsortsize) largegroups.push_back(i);
+#ifdef USEOPENMP
+    #pragma omp parallel for schedule(dynamic, ompgroupbatchsize) if (ngroup > ompgroupbatchsize)
+#endif
+    for (Int_t i = 1; i <= ngroup; i++) {
+        if (numingroup[i] < ompsortsize) SortParticlesByKey(&Part[noffset[i]], numingroup[i], key);
+    }
+    for (auto i : largegroups) SortParticlesByKey(&Part[noffset[i]], numingroup[i], key);
+}
+
 #ifdef USEOPENMP 
 
 ///structure to store relevant info for searching openmp domains
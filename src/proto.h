@@ -64,6 +64,10 @@ void WriteLocalVelocityDensity(Options &opt, const Int_t nbodies, vector<Particl
 
 ///Writes a tipsy formatted fof.grpfile
 void WriteFOF(Options &opt, const Int_t nbodies, Int_t *pfof);
+///Writes a binary FOF membership file of sorted particle ids and group sizes which can be reloaded to skip the FOF search
+void WriteFOFMembership(Options &opt, const Int_t nbodies, Particle *Part, const Int_t ngroup, Int_t *pfof);
+///Writes the warm start file (mesh decomposition, cell particle counts and SO radii) for the next snapshot
+void WriteWarmStart(Options &opt, const Int_t ngroup, PropData *pdata, const char *outname);
 ///Writes a pg list file (first in effective index order of input file(s), second is particle ids
 void WritePGList(Options &opt, const Int_t ngroups, const Int_t ng, Int_t *numingroup, Int_t **pglist, Int_t *ids);
 ///Write catalog information (number of groups, number in groups, number of particles in groups, particle pids)
@@ -112,6 +116,14 @@ void WriteAHFProperties(Options &opt, const Int_t ngroups, PropData *pdata);
 ///identify substructures
 //@{
 Int_t ReadPFOF(Options &opt, Int_t nbodies, Int_t *pfof);
+///Read FOF membership files written by \ref WriteFOFMembership and set the group ids of local particles
+Int_t ReadFOFMembership(Options &opt, const Int_t nbodies, Particle *Part, Int_t *pfof);
+///Read the warm start file written by \ref WriteWarmStart for the previous snapshot
+void ReadWarmStart(Options &opt);
+///Hash of particle id used to partition FOF membership entries
+unsigned long long FOFMembershipHash(long long pid, unsigned long long salt);
+///Match FOF membership requests to entries with the same particle id
+vector<Int_t> FOFMembershipHashJoin(const vector<fofmembership_entry> &requests, const vector<fofmembership_entry> &entries);
 Int_t ReadFOFGroupBinary(Options &opt, Int_t nbodies, Int_t *pfof, Int_t *idtoindex, Int_t minid, Particle *p);
 //@}
 
@@ -201,6 +213,8 @@ Int_t GetOutliersValues(Options &opt, const Int_t nbodies, Particle *Part, int s
 
 ///Search full system without finding outliers first
 Int_t *SearchFullSet(Options &opt, const Int_t nbodies, vector<Particle> &Part, Int_t &numgroups);
+///Load field structures from FOF membership files rather than searching the full system
+Int_t *SearchFullSetFromFile(Options &opt, const Int_t nbodies, vector<Particle> &Part, Int_t &numgroups);
 ///Search the outliers
 Int_t *SearchSubset(Options &opt, const Int_t nbodies, const Int_t nsubset, Particle *Partsubset, Int_t &numgroups, Int_t sublevel=0, Int_t *pnumcores=NULL);
 ///Search for subsubstructures
@@ -216,6 +230,12 @@ void MergeSubstructuresPhase(Options &opt, const Int_t nsubset, Particle *&Parts
 void RemoveSpuriousDynamicalSubstructures(Options &opt, const Int_t nsubset, Int_t *&pfof, Int_t &numgroups, Int_t &numsubs, Int_t &numcores);
 ///Check significance of each group
 int CheckSignificance(Options &opt, const Int_t nsubset, Particle *Partsubset, Int_t &numgroups, Int_t *numingroups, Int_t *pfof, Int_t **pglist);
+///Build a phase-space index over particles in groups without reordering the particles
+void BuildGroupMemberIndex(GroupMemberIndex &gmi, Particle *P, const vector<Int_t> &members, const vector<Int_t> &gid, const vector<Int_t> &glen, Int_t bucketsize);
+///Find the candidate member of the index closest in phase-space to a particle
+Int_t SearchGroupMemberIndex(const GroupMemberIndex &gmi, Particle &p, Double_t *param, Double_t *period, Int_t minlen, Int_t samegroup, Double_t &dval);
+///Return an ordering of particles along a space filling curve
+vector<Int_t> SpatiallySortedOrder(const Int_t n, Particle *P);
 ///Search for Baryonic structures associated with dark matter structures in phase-space
 Int_t* SearchBaryons(Options &opt, Int_t &nbaryons, Particle *&Pbaryons, const Int_t ndark, vector<Particle> &Partsubset, Int_t *&pfofdark, Int_t &ngroupdark, Int_t &nhalos, int ihaloflag=0, int iinclusive=0, PropData *phalos=NULL);
 ///Get the hierarchy of structures found
@@ -268,6 +288,8 @@ inline Int_t MergeHaloGroups(Options &opt, Particle *Partsubset, Int_t numgroups
 
 ///used for tree potential calculation (which is only used for large groups)
 void GetNodeList(Node *np, Int_t &ncell, Node **nodelist, const Int_t bsize);
+///get list of leaf nodes
+void GetLeafNodeList(Node *np, vector<Node*> &leafnodes, const Int_t bsize);
 ///used for tree walk in potential calculation
 inline void MarkCell(Node *np, Int_t *marktreecell, Int_t *markleafcell, Int_t &ntreecell, Int_t &nleafcell, const Int_t bsize, Double_t *cR2max, Coordinate *cm, Double_t *cmtot, Coordinate xpos, Double_t eps2);
 
@@ -359,6 +381,11 @@ void CalcPhaseSigmaTensor(const Int_t n, Particle *p, GMatrix &I, int itype=-1);
 void CalcMTensor(Matrix& M, const Double_t q, const Double_t s, const Int_t n, Particle *p, int itype);
 ///Same as \ref CalcMTensor but include mass
 void CalcMTensorWithMass(Matrix& M, const Double_t q, const Double_t s, const Int_t n, Particle *p, int itype);
+///Pack positions and weights of particles used to determine the spatial morphology into contiguous arrays
+Int_t PackMorphologyData(const Int_t n, Particle *p, vector<Double_t> &x, vector<Double_t> &y, vector<Double_t> &z, vector<Double_t> &w, int imflag=0, int itype=-1);
+///Same as \ref CalcMTensor but for packed positions and weights evaluated in the frame given by R, leaving positions unchanged
+void CalcMTensor(Matrix& M, const Double_t q, const Double_t s, const Int_t n,
+    const Double_t *x, const Double_t *y, const Double_t *z, const Double_t *w, Matrix &R);
 ///Rotate particles to some coordinate frame
 void RotParticles(const Int_t n, Particle *p, Matrix &R);
 ///get phase-space center-of-mass
@@ -439,7 +466,7 @@ void CalculateSphericalOverdensityExclusive(Options &opt, PropData &pdata,
 ///calculate extra properties inside SO apertures
 void CalculateExtraSphericalOverdensityProperties(Options &opt, PropData &pdata,
     vector<Double_t> &radii, vector<Double_t> &masses, vector<Int_t> &indices,
-    vector<Coordinate> &posparts, vector<Coordinate> &velparts, 
+    vector<Coordinate> &angmomparts,
 #if (defined(GASON)) || (defined(GASON) && defined(SWIFTINTERFACE))
     vector<int> &typeparts, int sonum_hotgas, int SOthreshNorm, 
     vector<Double_t> &temp, vector<Double_t> &sfr, vector<Double_t> &Zgas);
@@ -562,6 +589,8 @@ void MPIDomainDecompositionNchilada(Options &opt);
 
 ///determine what processor a particle is sent to based on domain decomposition
 int MPIGetParticlesProcessor(Options &opt, const Double_t,const Double_t,const Double_t);
+///determine what processors a chunk of particles, with positions stored as consecutive triplets, are sent to
+void MPIGetParticlesProcessor(Options &opt, Int_t n, const double *x, vector<int> &proc);
 /// Determine number of local particles wrapper
 void MPINumInDomain(Options &opt);
 
@@ -748,6 +777,12 @@ Int_t MPILinkAcross(const Int_t nbodies, KDTree *&tree, Particle *Part, Int_t *&
 Int_t MPILinkAcross(const Int_t nbodies, KDTree *&tree, Particle *Part, Int_t *&pfof, Int_tree_t *&Len, Int_tree_t *&Head, Int_tree_t *&Next, Double_t rdist2, FOFcheckfunc &check, Double_t *params);
 ///update export list after after linking across
 void MPIUpdateExportList(const Int_t nbodies, Particle *Part, Int_t *&pfof, Int_tree_t *&Len);
+///assign group ids read from FOF membership files to local particles and set the task of their group
+void MPIAssignFOFMembership(Options &opt, const Int_t nbodies, Particle *Part, vector<fofmembership_entry> &entries, Int_t *pfof);
+#ifdef EXTENDEDHALOOUTPUT
+///send extended output entries back to the tasks that read the particles
+vector<extendedoutput_entry> MPIExchangeExtendedOutput(const vector<extendedoutput_entry> &sendbuf, Int_t *nsend_local);
+#endif
 ///localize groups to a single mpi thread
 Int_t MPIGroupExchange(Options &opt, const Int_t nbodies, Particle *Part, Int_t *&pfof);
 ///Determine the local number of groups and their sizes (groups must be local to an mpi thread)
@@ -768,9 +803,9 @@ bool fof_export_cmp_vec(const fofdata_in &a, const fofdata_in &b);
 ///comparison function to order particles for export and fof group localization.
 bool fof_id_cmp_vec(const fofid_in &a, const fofid_in &b);
 ///similar to \ref MPIBuildParticleExportList but specific interface for baryon search
-void MPIBuildParticleExportBaryonSearchList(Options &opt, const Int_t nbodies, Particle *Part, Int_t *&pfof, Int_t *ids, Int_t *numingroup, Double_t rdist);
+void MPIBuildParticleExportBaryonSearchList(Options &opt, const vector<Int_t> &members, Particle *Part, Int_t *pfof, Int_t *numingroup, Double_t rdist);
 ///search local baryons with exported particle list.
-Int_t MPISearchBaryons(const Int_t nbaryons, Particle *&Pbaryons, Int_t *&pfofbaryons, Int_t *numingroup, Double_t *localdist, Int_t nsearch, Double_t *param, Double_t *period);
+Int_t MPISearchBaryons(const Int_t nbaryons, Particle *&Pbaryons, Int_t *&pfofbaryons, Int_t *numingroup, Double_t *localdist, Int_t bsize, Double_t *param, Double_t *period);
 ///localize the baryons to the mpi thread on which their associated DM group exists.
 Int_t MPIBaryonExchange(const Int_t nbaryons, Particle *&Pbaryons, Int_t *&pfofbaryons);
 //@}
@@ -780,7 +815,7 @@ Int_t MPIBaryonExchange(const Int_t nbaryons, Particle *&Pbaryons, Int_t *&pfofb
 //@{
 
 ///Effectively is an allgather for the grid data so that particles can find nearest cells and use appropriate nearest neighbouring cells for calculating estimated background velocity density function
-void MPIBuildGridData(const Int_t ngrid, GridCell *grid, Coordinate *gvel, Matrix *gveldisp);
+Int_t MPIBuildGridData(const Int_t ngrid, GridCell *grid, Coordinate *gvel, Matrix *gveldisp, const Int_t nbodies, Particle *Part);
 ///Determine number of particles that need to be exported to another mpi thread from local mpi thread based on array of distances for each particle for NN search
 void MPIGetNNExportNum(const Int_t nbodies, Particle *Part, Double_t *rdist);
 ///Determine number of particles that need to be exported to another mpi thread from local mpi thread based on array of distances for each particle for NN search
@@ -809,6 +844,10 @@ void MPIBuildHaloSearchExportListUsingMesh(Options &opt, const Int_t ngroup, Pro
 void MPIGetHaloSearchImportNum(const Int_t nbodies, KDTree *tree, Particle *Part);
 ///Builds the import list of particles based on halo positions
 Int_t MPIBuildHaloSearchImportList(Options &opt, const Int_t nbodies, KDTree *tree, Particle *Part);
+///Build and exchange the list of halo centres whose spherical overdensity search regions overlap other mpi domains
+vector<sohalodata_in> MPIBuildHaloSOProfileExportList(Options &opt, const Int_t ngroup, PropData *&pdata, vector<Coordinate> &posref, vector<Double_t> &rdist, vector<bool> &halooverlap);
+///Evaluate partial radial profiles of imported halo centres using local particles and return them to the halo's mpi domain
+vector<soprofiledata_out> MPIGetHaloSOProfiles(Options &opt, KDTree *tree, Particle *Part, vector<sohalodata_in> &haloimport);
 #ifdef SWIFTINTERFACE
 ///Exchange Particles so that particles in group are back original swift task
 void MPISwiftExchange(vector<Particle> &Part);
@@ -890,6 +929,12 @@ namespace vr {
 std::string GetMemUsage(const std::string &function);
 #define MEMORY_USAGE_REPORT(lvl) { if(LOG_ENABLED(lvl)) LOG(lvl) << GetMemUsage(__FUNCTION__); }
 
+///Build a KD-Tree, recursively partitioning in parallel when large enough (or as the library defaults to if
+///not iautoparallel), and report the build time
+KDTree *BuildKDTree(Particle *Part, Int_t nbodies, Int_t bucketsize, int treetype=KDTree::TPHYS,
+    int kerntype=KDTree::KEPAN, int kernres=1000, int splittingcriterion=0, int aniso=0, int scalespace=0,
+    Double_t *period=NULL, Double_t **metric=NULL, bool iautoparallel=true);
+
 /// Core binding 
 //@{
 #ifdef __APPLE__
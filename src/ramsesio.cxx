@@ -23,6 +23,9 @@
 #include "ramsesitems.h"
 #include "endianutils.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 
 int RAMSES_fortran_read(fstream &F, int &i){
     int dummy,byteoffset=0;
@@ -77,17 +80,142 @@ int RAMSES_fortran_skip(fstream &F, int nskips){
     return byteoffset;
 }
 
+///Construct the name of file ifile (starting at 0) of type prefix (amr, hydro, part), falling back to the single file name
+void RAMSES_get_filename(const char *dirname, const char *snapname, const char *prefix, int ifile, char *fname)
+{
+    char buf1[2000],buf2[2000];
+    sprintf(buf1,"%s/%s_%s.out%05d",dirname,prefix,snapname,ifile+1);
+    sprintf(buf2,"%s/%s_%s.out",dirname,prefix,snapname);
+    if (FileExists(buf1)) sprintf(fname,"%s",buf1);
+    else if (FileExists(buf2)) sprintf(fname,"%s",buf2);
+    else sprintf(fname,"%s",buf1);
+}
+
+///Scan the record markers of a Fortran unformatted file once, storing the offset and size of every record.
+///The file is left open for \ref RAMSES_read_record. If nmaxrecords>=0 only the first nmaxrecords records are indexed.
+///Returns the number of records or -1 if the file cannot be opened.
+int RAMSES_index_records(const char *fname, RAMSES_Record_Index &index, int nmaxrecords)
+{
+    struct stat filestat;
+    long long pos=0, filesize;
+    int head, tail;
+    index.offset.clear();
+    index.size.clear();
+    index.fd=open(fname, O_RDONLY);
+    if (index.fd<0) return -1;
+    fstat(index.fd,&filestat);
+    filesize=filestat.st_size;
+    while (pos+2*(long long)sizeof(int)<=filesize) {
+        if (nmaxrecords>=0 && (int)index.offset.size()==nmaxrecords) break;
+        if (pread(index.fd, &head, sizeof(int), pos)!=sizeof(int)) break;
+        if (head<0 || pos+head+2*(long long)sizeof(int)>filesize) break;
+        if (pread(index.fd, &tail, sizeof(int), pos+sizeof(int)+head)!=sizeof(int) || tail!=head) break;
+        index.offset.push_back(pos+sizeof(int));
+        index.size.push_back(head);
+        pos+=head+2*sizeof(int);
+    }
+    return index.offset.size();
+}
+
+///Read the payload of record irecord into data, reading at most maxsize bytes. Returns the number of bytes read or -1 if the record does not exist.
+long long RAMSES_read_record(const RAMSES_Record_Index &index, int irecord, void *data, long long maxsize)
+{
+    if (irecord<0 || irecord>=(int)index.offset.size()) return -1;
+    long long nbytes=min((long long)index.size[irecord],maxsize), nread=0;
+    ssize_t n;
+    while (nread<nbytes) {
+        n=pread(index.fd, (char*)data+nread, nbytes-nread, index.offset[irecord]+nread);
+        if (n<=0) return nread;
+        nread+=n;
+    }
+    return nread;
+}
+
+void RAMSES_close_records(RAMSES_Record_Index &index)
+{
+    if (index.fd>=0) close(index.fd);
+    index.fd=-1;
+    index.offset.clear();
+    index.size.clear();
+}
+
+///Read the particle data of a part_ file into structure of array staging buffers with a single index of the records.
+///The record layout is ncpu, ndim, npart, seeds, nstar_tot, mstar_tot, mstar_lost, nsink followed by
+///positions and velocities (one record per dimension), mass, id, level, birth epoch and metallicity.
+///If ireadall is false, only positions, masses and ages are read (all that is needed to count particles).
+///Records missing from the file (such as ages and metallicities of dark matter only runs) are set to zero.
+void RAMSES_read_part_file(const char *fname, RAMSES_Part_Data &data, bool ireadall)
+{
+    RAMSES_Record_Index index;
+    const int nheader=8;
+    int irecord;
+    if (RAMSES_index_records(fname, index)<nheader) {
+        LOG(error) << "Unable to index RAMSES particle file " << fname << ". Exiting";
+#ifdef USEMPI
+        MPI_Abort(MPI_COMM_WORLD,9);
+#else
+        exit(9);
+#endif
+    }
+    //every record read must hold the expected number of bytes, except the optional trailing ones which may be absent
+    auto readrecord = [&](int irec, void *buff, long long nbytes, bool ioptional) {
+        if (ioptional && irec >= (int)index.offset.size()) return;
+        if (RAMSES_read_record(index, irec, buff, nbytes) != nbytes) {
+            LOG(error) << "RAMSES particle file " << fname << " record " << irec << " is missing or holds fewer than the expected "
+                << nbytes << " bytes. Exiting";
+#ifdef USEMPI
+            MPI_Abort(MPI_COMM_WORLD,9);
+#else
+            exit(9);
+#endif
+        }
+    };
+    readrecord(1, &data.ndim, sizeof(int), false);
+    readrecord(2, &data.npartlocal, sizeof(int), false);
+    if (data.ndim<1 || data.ndim>3 || data.npartlocal<0) {
+        LOG(error) << "RAMSES particle file " << fname << " has an invalid header (ndim " << data.ndim
+            << ", npart " << data.npartlocal << "). Exiting";
+#ifdef USEMPI
+        MPI_Abort(MPI_COMM_WORLD,9);
+#else
+        exit(9);
+#endif
+    }
+    Int_t n=data.npartlocal, ndim=data.ndim;
+    long long floatsize=n*sizeof(RAMSESFLOAT), idsize=n*sizeof(RAMSESIDTYPE);
+    data.x.assign(3*n,0);
+    data.mass.assign(n,0);
+    data.age.assign(n,0);
+    irecord=nheader;
+    for (auto idim=0;idim<ndim;idim++) readrecord(irecord++, &data.x[idim*n], floatsize, false);
+    if (ireadall) {
+        data.v.assign(3*n,0);
+        data.id.assign(n,0);
+        data.level.assign(n,0);
+        data.met.assign(n,0);
+        for (auto idim=0;idim<ndim;idim++) readrecord(irecord++, &data.v[idim*n], floatsize, false);
+    }
+    else irecord+=ndim;
+    readrecord(irecord++, data.mass.data(), floatsize, false);
+    if (ireadall) {
+        readrecord(irecord++, data.id.data(), idsize, false);
+        readrecord(irecord++, data.level.data(), idsize, false);
+    }
+    else irecord+=2;
+    readrecord(irecord++, data.age.data(), floatsize, true);
+    if (ireadall) readrecord(irecord++, data.met.data(), floatsize, true);
+    RAMSES_close_records(index);
+}
+
 Int_t RAMSES_get_nbodies(char *fname, int ptype, Options &opt)
 {
     char buf[2000],buf1[2000],buf2[2000];
-    double * dummy_age, * dummy_mass;
     double dmp_mass;
     double OmegaM, OmegaB;
     int totalghost = 0;
     int totalstars = 0;
     int totaldm    = 0;
     int alltotal   = 0;
-    int ghoststars = 0;
     string stringbuf;
     sprintf(buf1,"%s/amr_%s.out00001",fname,opt.ramsessnapname);
     sprintf(buf2,"%s/amr_%s.out",fname,opt.ramsessnapname);
@@ -225,22 +353,22 @@ Int_t RAMSES_get_nbodies(char *fname, int ptype, Options &opt)
 
     //reopen to get number of amr cells might need to alter to read grid information and what cells have no so-called son cells
     if (opt.partsearchtype==PSTGAS||opt.partsearchtype==PSTALL||(opt.partsearchtype==PSTDARK&&opt.iBaryonSearch)) {
-    for (i=0;i<ramses_header_info.num_files;i++) {
-        sprintf(buf1,"%s/amr_%s.out%05d",fname,opt.ramsessnapname,i+1);
-        sprintf(buf2,"%s/amr_%s.out",fname,opt.ramsessnapname);
-        if (FileExists(buf1)) sprintf(buf,"%s",buf1);
-        else if (FileExists(buf2)) sprintf(buf,"%s",buf2);
-        Framses.open(buf, ios::binary|ios::in);
-        for (j=0;j<6;j++) {
-            Framses.read((char*)&dummy, sizeof(dummy));
-            Framses.seekg(dummy,ios::cur);
-            Framses.read((char*)&dummy, sizeof(dummy));
-        }
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.read((char*)&ramses_header_info.npart[RAMSESGASTYPE], sizeof(int));
-        Framses.read((char*)&dummy, sizeof(dummy));
-        ramses_header_info.npartTotal[RAMSESGASTYPE]+=ramses_header_info.npart[RAMSESGASTYPE];
+    Int_t ngastotal=0;
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:ngastotal)
+#endif
+    for (int ifile=0;ifile<ramses_header_info.num_files;ifile++) {
+        char amrfname[2000];
+        int ngas=0;
+        RAMSES_Record_Index index;
+        RAMSES_get_filename(fname, opt.ramsessnapname, "amr", ifile, amrfname);
+        //only the header records up to the number of grids is needed
+        RAMSES_index_records(amrfname, index, 7);
+        RAMSES_read_record(index, 6, &ngas, sizeof(int));
+        RAMSES_close_records(index);
+        ngastotal+=ngas;
     }
+    ramses_header_info.npartTotal[RAMSESGASTYPE]+=ngastotal;
 
     //now hydro header data
     sprintf(buf1,"%s/hydro_%s.out00001",fname,opt.ramsessnapname);
@@ -293,118 +421,43 @@ Int_t RAMSES_get_nbodies(char *fname, int ptype, Options &opt)
     Finfo.close();
     dmp_mass = 1.0 / (opt.Neff*opt.Neff*opt.Neff) * (OmegaM - OmegaB) / OmegaM;
 
-    //now particle info
-    for (i=0;i<ramses_header_info.num_files;i++)
+    //now particle info. Files are independent so they are indexed and read in parallel, each thread reading
+    //only the mass and birth epoch records needed to determine how many particles of each type are present
+    int nsinktotal=0;
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:totalghost,totalstars,totaldm,alltotal)
+#endif
+    for (int ifile=0;ifile<ramses_header_info.num_files;ifile++)
     {
-        sprintf(buf1,"%s/part_%s.out%05d",fname,opt.ramsessnapname,i+1);
-        sprintf(buf2,"%s/part_%s.out",fname,opt.ramsessnapname);
-        if (FileExists(buf1)) sprintf(buf,"%s",buf1);
-        else if (FileExists(buf2)) sprintf(buf,"%s",buf2);
-        Framses.open(buf, ios::binary|ios::in);
-
-        ramses_header_info.npart[RAMSESDMTYPE]   = 0;
-        ramses_header_info.npart[RAMSESSTARTYPE] = 0;
-        ramses_header_info.npart[RAMSESSINKTYPE] = 0;
-
-        //number of cpus
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        //number of dimensions
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Total number of LOCAL particles
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.read((char*)&ramses_header_info.npartlocal, sizeof(int));
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Random seeds
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Total number of Stars over all processors
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.read((char*)&ramses_header_info.nstarTotal, sizeof(int));
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Total mass of stars
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Total lost mass of stars
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Number of sink particles over the whole simulation (all are included in
-        // all processors)
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.read((char*)&ramses_header_info.npartTotal[RAMSESSINKTYPE], sizeof(int));
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        //to determine how many particles of each type, need to look at the mass
-        // Skip pos, vel, mass
-        for (j = 0; j < 6; j++)
-        {
-            Framses.read((char*)&dummy, sizeof(dummy));
-            Framses.seekg(dummy,ios::cur);
-            Framses.read((char*)&dummy, sizeof(dummy));
-        }
-        //allocate memory to store masses and ages
-        dummy_mass = new double [ramses_header_info.npartlocal];
-        dummy_age  = new double [ramses_header_info.npartlocal];
-
-        // Read Mass
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.read((char*)&dummy_mass[0], dummy);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Skip Id
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Skip level
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.seekg(dummy,ios::cur);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        // Read Birth epoch
+        char partfname[2000];
+        RAMSES_Part_Data partdata;
+        int ndm=0, nstar=0, nghost=0;
+        RAMSES_get_filename(fname, opt.ramsessnapname, "part", ifile, partfname);
+        RAMSES_read_part_file(partfname, partdata, false);
         //necessary to separate ghost star particles with negative ages from real one
-        Framses.read((char*)&dummy, sizeof(dummy));
-        Framses.read((char*)&dummy_age[0], dummy);
-        Framses.read((char*)&dummy, sizeof(dummy));
-
-        ghoststars = 0;
-        for (j = 0; j < ramses_header_info.npartlocal; j++)
+        for (auto jj = 0; jj < partdata.npartlocal; jj++)
         {
-            if (fabs((dummy_mass[j]-dmp_mass)/dmp_mass) < 1e-5)
-                ramses_header_info.npart[RAMSESDMTYPE]++;
-            else
-                if (dummy_age[j] != 0.0)
-                    ramses_header_info.npart[RAMSESSTARTYPE]++;
-                else
-                ghoststars++;
+            if (fabs((partdata.mass[jj]-dmp_mass)/dmp_mass) < 1e-5) ndm++;
+            else if (partdata.age[jj] != 0.0) nstar++;
+            else nghost++;
         }
-        delete [] dummy_age;
-        delete [] dummy_mass;
-        Framses.close();
-
-        totalghost += ghoststars;
-        totalstars += ramses_header_info.npart[RAMSESSTARTYPE];
-        totaldm    += ramses_header_info.npart[RAMSESDMTYPE];
-        alltotal   += ramses_header_info.npartlocal;
-
-        //now with information loaded, set totals
-        ramses_header_info.npartTotal[RAMSESDMTYPE]+=ramses_header_info.npart[RAMSESDMTYPE];
-        ramses_header_info.npartTotal[RAMSESSTARTYPE]+=ramses_header_info.npart[RAMSESSTARTYPE];
-        ramses_header_info.npartTotal[RAMSESSINKTYPE]+=ramses_header_info.npart[RAMSESSINKTYPE];
+        // Number of sink particles over the whole simulation (all are included in
+        // all processors)
+        if (ifile == 0) {
+            RAMSES_Record_Index index;
+            RAMSES_index_records(partfname, index);
+            RAMSES_read_record(index, 7, &nsinktotal, sizeof(int));
+            RAMSES_close_records(index);
+        }
+        totalghost += nghost;
+        totalstars += nstar;
+        totaldm    += ndm;
+        alltotal   += partdata.npartlocal;
     }
+    //now with information loaded, set totals
+    ramses_header_info.npartTotal[RAMSESDMTYPE]+=totaldm;
+    ramses_header_info.npartTotal[RAMSESSTARTYPE]+=totalstars;
+    ramses_header_info.npartTotal[RAMSESSINKTYPE]=nsinktotal;
     for(j=0, nbodies=0; j<nusetypes; j++) {
         k=usetypes[j];
         nbodies+=ramses_header_info.npartTotal[k];
@@ -431,7 +484,7 @@ void ReadRamses(Options &opt, vector<Particle> &Part, const Int_t nbodies, Parti
     fstream Finfo;
     fstream *Famr;
     fstream *Fhydro;
-    fstream *Fpart, *Fpartvel,*Fpartid,*Fpartmass, *Fpartlevel, *Fpartage, *Fpartmet;
+    fstream *Fpart;
     RAMSES_Header *header;
     int i,j,k,idim,ivar,igrid;
     Int_t count2,bcount2;
@@ -472,12 +525,6 @@ void ReadRamses(Options &opt, vector<Particle> &Part, const Int_t nbodies, Parti
     Famr       = new fstream[opt.num_files];
     Fhydro     = new fstream[opt.num_files];
     Fpart      = new fstream[opt.num_files];
-    Fpartvel   = new fstream[opt.num_files];
-    Fpartmass  = new fstream[opt.num_files];
-    Fpartid    = new fstream[opt.num_files];
-    Fpartlevel = new fstream[opt.num_files];
-    Fpartage   = new fstream[opt.num_files];
-    Fpartmet   = new fstream[opt.num_files];
     header     = new RAMSES_Header[opt.num_files];
 
     Particle *Pbuf;
@@ -657,97 +704,38 @@ void ReadRamses(Options &opt, vector<Particle> &Part, const Int_t nbodies, Parti
         inreadsend=0;
 #endif
     //read particle files consists of positions,velocities, mass, id, and level (along with ages and met if some flags set)
-    for (i=0;i<opt.num_files;i++) {
+    //files are read in batches of one file per thread, each file indexed once and its records read directly into
+    //structure of array staging buffers. The particles are then processed serially in file order.
+    int nfilebatch=1;
+#ifdef USEOPENMP
+    nfilebatch=omp_get_max_threads();
+#endif
+    vector<RAMSES_Part_Data> partdata(nfilebatch);
+    for (int ibatch=0;ibatch<opt.num_files;ibatch+=nfilebatch) {
+    int ibatchend=min(ibatch+nfilebatch,opt.num_files);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int ifile=ibatch;ifile<ibatchend;ifile++) {
+        if (!ireadfile[ifile]) continue;
+        char partfname[2000];
+        RAMSES_get_filename(opt.fname, opt.ramsessnapname, "part", ifile, partfname);
+        RAMSES_read_part_file(partfname, partdata[ifile-ibatch]);
+    }
+    for (i=ibatch;i<ibatchend;i++) {
     if (ireadfile[i]) {
-        sprintf(buf1,"%s/part_%s.out%05d",opt.fname,opt.ramsessnapname,i+1);
-        sprintf(buf2,"%s/part_%s.out",opt.fname,opt.ramsessnapname);
-        if (FileExists(buf1)) sprintf(buf,"%s",buf1);
-        else if (FileExists(buf2)) sprintf(buf,"%s",buf2);
-        Fpart[i].open(buf, ios::binary|ios::in);
-        Fpartvel[i].open(buf, ios::binary|ios::in);
-        Fpartmass[i].open(buf, ios::binary|ios::in);
-        Fpartid[i].open(buf, ios::binary|ios::in);
-        Fpartlevel[i].open(buf, ios::binary|ios::in);
-        Fpartage[i].open(buf, ios::binary|ios::in);
-        Fpartmet[i].open(buf, ios::binary|ios::in);
-
-        //skip header information in each file save for number in the file
-        //@{
-        byteoffset=0;
-        // ncpus
-        byteoffset+=RAMSES_fortran_skip(Fpart[i]);
-        // ndims
-        byteoffset+=RAMSES_fortran_skip(Fpart[i]);
-        // store number of particles locally in file
-        byteoffset+=RAMSES_fortran_read(Fpart[i],header[i].npartlocal);
-        // skip local seeds, nstartot, mstartot, mstarlost, nsink
-        byteoffset+=RAMSES_fortran_skip(Fpart[i],5);
-
-        //byteoffset now stores size of header offset for particles
-        Fpartvel[i].seekg(byteoffset,ios::cur);
-        Fpartmass[i].seekg(byteoffset,ios::cur);
-        Fpartid[i].seekg(byteoffset,ios::cur);
-        Fpartlevel[i].seekg(byteoffset,ios::cur);
-        Fpartage[i].seekg(byteoffset,ios::cur);
-        Fpartmet[i].seekg(byteoffset,ios::cur);
-        //skip positions
-        for(idim=0;idim<header[ifirstfile].ndim;idim++)
-        {
-            RAMSES_fortran_skip(Fpartvel[i]);
-            RAMSES_fortran_skip(Fpartmass[i]);
-            RAMSES_fortran_skip(Fpartid[i]);
-            RAMSES_fortran_skip(Fpartlevel[i]);
-            RAMSES_fortran_skip(Fpartage[i]);
-            RAMSES_fortran_skip(Fpartmet[i]);
-        }
-        //skip velocities
-        for(idim=0;idim<header[ifirstfile].ndim;idim++)
-        {
-            RAMSES_fortran_skip(Fpartmass[i]);
-            RAMSES_fortran_skip(Fpartid[i]);
-            RAMSES_fortran_skip(Fpartlevel[i]);
-            RAMSES_fortran_skip(Fpartage[i]);
-            RAMSES_fortran_skip(Fpartmet[i]);
-        }
-        //skip mass
-        RAMSES_fortran_skip(Fpartid[i]);
-        RAMSES_fortran_skip(Fpartlevel[i]);
-        RAMSES_fortran_skip(Fpartage[i]);
-        RAMSES_fortran_skip(Fpartmet[i]);
-        //skip ids;
-        RAMSES_fortran_skip(Fpartlevel[i]);
-        RAMSES_fortran_skip(Fpartage[i]);
-        RAMSES_fortran_skip(Fpartmet[i]);
-        //skip levels
-        RAMSES_fortran_skip(Fpartage[i]);
-        RAMSES_fortran_skip(Fpartmet[i]);
-        //skip ages
-        RAMSES_fortran_skip(Fpartmet[i]);
-        //@}
-
-        //data loaded into memory in chunks
+        RAMSES_Part_Data &pdata=partdata[i-ibatch];
+        header[i].npartlocal = pdata.npartlocal;
         chunksize    = nchunk = header[i].npartlocal;
         ninputoffset = 0;
-        xtempchunk   = new RAMSESFLOAT  [3*chunksize];
-        vtempchunk   = new RAMSESFLOAT  [3*chunksize];
-        mtempchunk   = new RAMSESFLOAT  [chunksize];
-        idvalchunk   = new RAMSESIDTYPE [chunksize];
-        levelchunk   = new RAMSESIDTYPE [chunksize];
-        agetempchunk = new RAMSESFLOAT  [chunksize];
-        mettempchunk = new RAMSESFLOAT  [chunksize];
-
-        for(idim=0;idim<header[ifirstfile].ndim;idim++)
-        {
-            RAMSES_fortran_read(Fpart[i],&xtempchunk[idim*nchunk]);
-            RAMSES_fortran_read(Fpartvel[i],&vtempchunk[idim*nchunk]);
-        }
-        RAMSES_fortran_read(Fpartmass[i],  mtempchunk);
-        RAMSES_fortran_read(Fpartid[i],    idvalchunk);
-        RAMSES_fortran_read(Fpartlevel[i], levelchunk);
-        RAMSES_fortran_read(Fpartage[i],   agetempchunk);
-        RAMSES_fortran_read(Fpartmet[i],   mettempchunk);
+        xtempchunk   = pdata.x.data();
+        vtempchunk   = pdata.v.data();
+        mtempchunk   = pdata.mass.data();
+        idvalchunk   = pdata.id.data();
+        levelchunk   = pdata.level.data();
+        agetempchunk = pdata.age.data();
+        mettempchunk = pdata.met.data();
 
-        RAMSES_fortran_read(Fpartid[i],idvalchunk);
         for (int nn=0;nn<nchunk;nn++)
         {
             if (fabs((mtempchunk[nn]-dmp_mass)/dmp_mass) > 1e-5 && (agetempchunk[nn] == 0.0))
@@ -964,20 +952,8 @@ void ReadRamses(Options &opt, vector<Particle> &Part, const Int_t nbodies, Parti
             }
         }//end of ghost particle check
         }//end of loop over chunk
-        delete[] xtempchunk;
-        delete[] vtempchunk;
-        delete[] mtempchunk;
-        delete[] idvalchunk;
-        delete[] agetempchunk;
-        delete[] levelchunk;
-        delete[] mettempchunk;
-        Fpart[i].close();
-        Fpartvel[i].close();
-        Fpartmass[i].close();
-        Fpartid[i].close();
-        Fpartlevel[i].close();
-        Fpartage[i].close();
-        Fpartmet[i].close();
+        //release staging buffers
+        pdata=RAMSES_Part_Data();
 #ifdef USEMPI
 
         //send information between read threads
@@ -990,6 +966,7 @@ void ReadRamses(Options &opt, vector<Particle> &Part, const Int_t nbodies, Parti
 #endif
     }//end of whether reading a file
     }//end of loop over file
+    }//end of loop over batch of files
 #ifdef USEMPI
     //once finished reading the file if there are any particles left in the buffer broadcast them
     for(ibuf = 0; ibuf < NProcs; ibuf++) if (ireadtask[ibuf]<0)
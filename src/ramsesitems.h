@@ -98,6 +98,30 @@ int RAMSES_fortran_read(fstream &, RAMSESFLOAT *);
 int RAMSES_fortran_read(fstream &, RAMSESIDTYPE *);
 int RAMSES_fortran_skip(fstream &, int nskips=1);
 
+/// \name Indexed access to the Fortran records of a RAMSES file
+/// The record markers of a file are scanned once, after which any record can be read directly into a
+/// caller provided array with pread, so several records (and several files) can be read independently.
+//@{
+///byte offset and size of the payload of every record in a file
+struct RAMSES_Record_Index {
+    int fd;
+    vector<long long> offset;
+    vector<int> size;
+    RAMSES_Record_Index() {fd=-1;}
+};
+///particle data of a single part_ file, stored as structure of arrays with ndim consecutive blocks of npartlocal for positions and velocities
+struct RAMSES_Part_Data {
+    int ndim, npartlocal;
+    vector<RAMSESFLOAT> x, v, mass, age, met;
+    vector<RAMSESIDTYPE> id, level;
+};
+int RAMSES_index_records(const char *fname, RAMSES_Record_Index &index, int nmaxrecords=-1);
+long long RAMSES_read_record(const RAMSES_Record_Index &index, int irecord, void *data, long long maxsize);
+void RAMSES_close_records(RAMSES_Record_Index &index);
+void RAMSES_read_part_file(const char *fname, RAMSES_Part_Data &data, bool ireadall=true);
+void RAMSES_get_filename(const char *dirname, const char *snapname, const char *prefix, int ifile, char *fname);
+//@}
+
 /// \name Get the number of particles in the ramses files
 //@{
 Int_t RAMSES_get_nbodies(char *fname, int ptype, Options &opt);
@@ -3,6 +3,7 @@
  */
 
 #include <assert.h>
+#include <numeric>
 
 //--  Suboutines that search particle list
 
@@ -15,6 +16,63 @@
 /// \name Searches full system
 //@{
 
+#ifdef STRUCDEN
+///calculate the velocity density of particles resident in field structures large enough to be searched for substructure
+static void GetVelocityDensityInFieldStructures(Options &opt, const Int_t Nlocal, vector<Particle> &Part, Int_t numgroups, Int_t *pfof, Double_t *period)
+{
+    Int_t i, *storetype, *numingroup;
+    KDTree *tree;
+    storetype=new Int_t[Nlocal];
+    Int_t numinstrucs=0,numlocalden=0;
+    for (i=0;i<Nlocal;i++) storetype[i]=Part[i].GetType();
+    if (!(opt.iBaryonSearch>=1 && opt.partsearchtype==PSTALL)) {
+// #ifdef HIGHRES
+//             numingroup=BuildNumInGroupTyped(Nlocal,numgroups,pfof,Part.data(),DARKTYPE);
+//             for (i=0;i<Nlocal;i++) {
+//                 if (Part[i].GetType()==DARKTYPE) Part[i].SetType(numingroup[pfof[Part[i].GetID()]]>=MINSUBSIZE);
+//                 else Part[i].SetType(-1);
+//                 numlocalden += (Part[i].GetType()>0);
+//             }
+// #else
+        numingroup=BuildNumInGroup(Nlocal, numgroups, pfof);
+        for (i=0;i<Nlocal;i++) {
+            Part[i].SetType((numingroup[pfof[i]]>=MINSUBSIZE));
+            numlocalden += (Part[i].GetType()>0);
+        }
+// #endif
+        delete[] numingroup;
+        numingroup=NULL;
+    }
+    //otherwise set type to group value for dark matter
+    else {
+        numingroup=BuildNumInGroupTyped(Nlocal,numgroups,pfof,Part.data(),DARKTYPE);
+        for (i=0;i<Nlocal;i++) {
+            if (Part[i].GetType()==DARKTYPE) Part[i].SetType(numingroup[pfof[Part[i].GetID()]]>=MINSUBSIZE);
+            else Part[i].SetType(-1);
+            numlocalden += (Part[i].GetType()>0);
+        }
+        delete[] numingroup;
+        numingroup=NULL;
+    }
+    for (i=0;i<Nlocal;i++) {numinstrucs+=(pfof[i]>0);}
+    Int_t numlocalden_total;
+#ifdef USEMPI
+    MPI_Allreduce(&numlocalden, &numlocalden_total, 1, MPI_Int_t, MPI_SUM, MPI_COMM_WORLD);
+#else
+    numlocalden_total = numlocalden;
+#endif
+    if (numlocalden_total > 0) {
+        LOG(debug) << "Found " << numlocalden << " particles for which density must be calculated";
+        LOG(info) << "Going to build tree";
+        tree=BuildKDTree(Part.data(),Nlocal,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
+        GetVelocityDensity(opt, Nlocal, Part.data(),tree);
+        delete tree;
+    }
+    for (i=0;i<Nlocal;i++) Part[i].SetType(storetype[i]);
+    delete[] storetype;
+}
+#endif
+
 /*!
     Search full system without finding outliers first
     Here search simulation for FOF haloes (either 3d or 6d). Note for 6D search, first 3d FOF halos are found, then velocity scale is set by largest 3DFOF
@@ -90,7 +148,7 @@ Int_t* SearchFullSet(Options &opt, const Int_t nbodies, vector<Particle> &Part,
         vr::Timer t;
         Double_t rdist = sqrt(param[1]);
         //determine the omp regions;
-        tree = new KDTree(Part.data(),nbodies,opt.openmpfofsize,tree->TPHYS,tree->KEPAN,100);
+        tree = BuildKDTree(Part.data(),nbodies,opt.openmpfofsize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,NULL,NULL,false);
         tree->OverWriteInputOrder();
         numompregions=tree->GetNumLeafNodes();
         ompdomain = OpenMPBuildDomains(opt, numompregions, tree, rdist);
@@ -104,7 +162,7 @@ Int_t* SearchFullSet(Options &opt, const Int_t nbodies, vector<Particle> &Part,
 #endif
     {
         vr::Timer t;
-        tree = new KDTree(Part.data(),nbodies,opt.Bsize,tree->TPHYS,tree->KEPAN,1000,0,0,0,period);
+        tree = BuildKDTree(Part.data(),nbodies,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,1000,0,0,0,period);
         tree->OverWriteInputOrder();
         LOG(info) << "Finished building single trees in " << t;
     }
@@ -198,7 +256,7 @@ Int_t* SearchFullSet(Options &opt, const Int_t nbodies, vector<Particle> &Part,
 #if !defined(USEMPI) && defined(STRUCDEN)
         if (numgroups>0 && (opt.iSubSearch==1&&opt.foftype!=FOF6DCORE))
 #endif
-        tree = new KDTree(Part.data(),nbodies,opt.Bsize,tree->TPHYS,tree->KEPAN,1000,0,0,0,period);
+        tree = BuildKDTree(Part.data(),nbodies,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,1000,0,0,0,period);
         //if running MPI then need to pudate the head, next info
 #ifdef USEMPI
         OpenMPHeadNextUpdate(nbodies, Part, numgroups, pfof, Head, Next);
@@ -400,52 +458,7 @@ Int_t* SearchFullSet(Options &opt, const Int_t nbodies, vector<Particle> &Part,
     //if calculating velocity density only of particles resident in field structures large enough for substructure search
 #if defined(STRUCDEN) && defined(USEMPI)
     if (totalgroups>0&&(opt.iSubSearch==1&&opt.foftype!=FOF6DCORE))
-    {
-        storetype=new Int_t[Nlocal];
-        Int_t numinstrucs=0,numlocalden=0;
-        for (i=0;i<Nlocal;i++) storetype[i]=Part[i].GetType();
-        if (!(opt.iBaryonSearch>=1 && opt.partsearchtype==PSTALL)) {
-// #ifdef HIGHRES
-//             numingroup=BuildNumInGroupTyped(Nlocal,numgroups,pfof,Part.data(),DARKTYPE);
-//             for (i=0;i<Nlocal;i++) {
-//                 if (Part[i].GetType()==DARKTYPE) Part[i].SetType(numingroup[pfof[Part[i].GetID()]]>=MINSUBSIZE);
-//                 else Part[i].SetType(-1);
-//                 numlocalden += (Part[i].GetType()>0);
-//             }
-// #else
-            numingroup=BuildNumInGroup(Nlocal, numgroups, pfof);
-            for (i=0;i<Nlocal;i++) {
-                Part[i].SetType((numingroup[pfof[i]]>=MINSUBSIZE));
-                numlocalden += (Part[i].GetType()>0);
-            }
-// #endif
-            delete[] numingroup;
-            numingroup=NULL;
-        }
-        //otherwise set type to group value for dark matter
-        else {
-            numingroup=BuildNumInGroupTyped(Nlocal,numgroups,pfof,Part.data(),DARKTYPE);
-            for (i=0;i<Nlocal;i++) {
-                if (Part[i].GetType()==DARKTYPE) Part[i].SetType(numingroup[pfof[Part[i].GetID()]]>=MINSUBSIZE);
-                else Part[i].SetType(-1);
-                numlocalden += (Part[i].GetType()>0);
-            }
-            delete[] numingroup;
-            numingroup=NULL;
-        }
-        for (i=0;i<Nlocal;i++) {numinstrucs+=(pfof[i]>0);}
-        Int_t numlocalden_total;
-        MPI_Allreduce(&numlocalden, &numlocalden_total, 1, MPI_Int_t, MPI_SUM, MPI_COMM_WORLD);
-        if (numlocalden_total > 0) {
-            LOG(debug) << "Found " << numlocalden << " particles for which density must be calculated";
-            LOG(info) << "Going to build tree";
-            tree=new KDTree(Part.data(),Nlocal,opt.Bsize,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
-            GetVelocityDensity(opt, Nlocal, Part.data(),tree);
-            delete tree;
-        }
-        for (i=0;i<Nlocal;i++) Part[i].SetType(storetype[i]);
-        delete[] storetype;
-    }
+        GetVelocityDensityInFieldStructures(opt, Nlocal, Part, numgroups, pfof, period);
 #endif
 
     //if search was periodic, alter particle positions in structures so substructure search no longer has to be
@@ -638,7 +651,7 @@ private(i,tid,xscaling,vscaling)
                 Part[noffset[i]+j].ScalePhase(xscaling,vscaling);
             }
             xscaling=1.0/xscaling;vscaling=1.0/vscaling;
-            treeomp[tid]=new KDTree(&(Part.data()[noffset[i]]),numingroup[i],opt.Bsize,treeomp[tid]->TPHS,tree->KEPAN,100);
+            treeomp[tid]=BuildKDTree(&(Part.data()[noffset[i]]),numingroup[i],opt.Bsize,KDTree::TPHS,KDTree::KEPAN,100);
             pfofomp[i]=treeomp[tid]->FOF(1.0,ngomp[i],minsize,1,&Head[noffset[i]],&Next[noffset[i]],&Tail[noffset[i]],&Len[noffset[i]]);
             delete treeomp[tid];
             for (Int_t j=0;j<numingroup[i];j++) {
@@ -973,6 +986,107 @@ private(i,j,diff,gid)
 #endif
 }
 
+/*!
+    Rather than searching the full system, load the field structures found by a previous run from the FOF membership
+    files written by \ref WriteFOFMembership, matching on particle ids. Particles and group ids are then prepared as in
+    \ref SearchFullSet, so that substructure and properties can be recalculated with new settings without rerunning the
+    FOF search and the linking across mpi domains. With MPI, groups are moved to a single mpi thread as in the full search.
+*/
+Int_t* SearchFullSetFromFile(Options &opt, const Int_t nbodies, vector<Particle> &Part, Int_t &numgroups)
+{
+    Int_t i, *pfof, *numingroup, totalgroups;
+    Double_t *period=NULL;
+#ifndef USEMPI
+    int ThisTask=0,NProcs=1;
+    Int_t Nlocal=nbodies;
+#endif
+    if (opt.p>0) {
+        period=new Double_t[3];
+        for (int j=0;j<3;j++) period[j]=opt.p;
+    }
+    psldata=new StrucLevelData;
+
+    LOG_RANK0(info) << "Loading field structures from FOF membership files instead of running FOF search";
+    vr::Timer fof_timer;
+    pfof=new Int_t[nbodies];
+#ifdef USEMPI
+    if (NProcs>1) mpi_foftask=MPISetTaskID(nbodies);
+#endif
+    totalgroups=ReadFOFMembership(opt, nbodies, Part.data(), pfof);
+
+#ifdef USEMPI
+    if (NProcs>1) {
+    //Now redistribute groups so that they are local to a processor (also orders the group ids according to size
+    //no particles have been exported to search across domains
+    NExport=0;
+    Int_t newnbodies=MPIGroupExchange(opt, nbodies, Part.data(), pfof);
+    if (Nmemlocal<Nlocal) {
+        Part.resize(Nlocal);
+        Nmemlocal=Nlocal;
+    }
+    delete[] mpi_foftask;
+    delete[] pfof;
+    pfof=new Int_t[newnbodies];
+    numgroups=MPICompileGroups(opt, newnbodies, Part.data(), pfof, opt.HaloMinSize);
+    if (Nmemlocal>Nlocal) {Part.resize(Nlocal);Nmemlocal=Nlocal;}
+    LOG(info) << "MPI thread " << ThisTask << " has loaded " << numgroups<< " in "<<Nlocal<<" particles";
+    totalgroups=0;
+    for (int j=0;j<NProcs;j++) totalgroups+=mpi_ngroups[j];
+    Nlocal=newnbodies;
+    }
+    else
+#endif
+    {
+    //remove groups that are now below the minimum size and order group ids by size
+    numingroup=BuildNumInGroup(Nlocal, totalgroups, pfof);
+    numgroups=0;
+    for (i=1;i<=totalgroups;i++) {
+        if (numingroup[i]<opt.HaloMinSize) numingroup[i]=0;
+        else numgroups++;
+    }
+    for (i=0;i<Nlocal;i++) if (pfof[i]>0 && numingroup[pfof[i]]==0) pfof[i]=0;
+    if (numgroups>0) {
+        Int_t **pglist=BuildPGList(Nlocal, totalgroups, numingroup, pfof);
+        ReorderGroupIDs(totalgroups, numgroups, numingroup, pfof, pglist);
+        for (i=1;i<=totalgroups;i++) if (pglist[i]!=NULL) delete[] pglist[i];
+        delete[] pglist;
+    }
+    delete[] numingroup;
+    totalgroups=numgroups;
+    }
+    LOG_RANK0(info) << "Total number of groups loaded is " << totalgroups << " in " << fof_timer;
+
+#ifdef STRUCDEN
+    if (totalgroups>0&&(opt.iSubSearch==1&&opt.foftype!=FOF6DCORE))
+        GetVelocityDensityInFieldStructures(opt, Nlocal, Part, numgroups, pfof, period);
+#endif
+    //alter particle positions in structures so substructure search no longer has to be periodic
+    if (opt.p>0&&numgroups>0) AdjustStructureForPeriod(opt,Nlocal,Part,numgroups,pfof);
+    delete[] period;
+
+#ifdef USEMPI
+    MPI_Allgather(&numgroups, 1, MPI_Int_t, mpi_ngroups, 1, MPI_Int_t, MPI_COMM_WORLD);
+    MPI_Allgather(&numgroups, 1, MPI_Int_t, mpi_nhalos, 1, MPI_Int_t, MPI_COMM_WORLD);
+#endif
+
+    //allocate memory for lowest level in the substructure hierarchy, corresponding to field objects
+    psldata->Allocate(numgroups);
+    psldata->Initialize();
+    for (i=0;i<Nlocal;i++) {
+        if (pfof[i]>0) {
+        if (psldata->gidhead[pfof[i]]==NULL) {
+            psldata->gidhead[pfof[i]]=&pfof[i];
+            psldata->Phead[pfof[i]]=&Part[i];
+            psldata->gidparenthead[pfof[i]]=&pfof[i];
+            psldata->giduberparenthead[pfof[i]]=&pfof[i];
+            psldata->stypeinlevel[pfof[i]]=HALOSTYPE;
+        }
+        }
+    }
+    psldata->stype=HALOSTYPE;
+    return pfof;
+}
+
 //@}
 
 ///\name Search using outliers from background velocity distribution.
@@ -1108,7 +1222,7 @@ Int_t* SearchSubset(Options &opt, const Int_t nbodies, const Int_t nsubset, Part
     else if (opt.foftype==FOF6DCORE) {
         LOG(trace) << "FOF6DCORE which identifies phase-space dense regions and assigns particles, ie core identification and growth";
         //just build tree and initialize the pfof array
-        tree=new KDTree(Partsubset,nsubset,opt.Bsize,tree->TPHYS);
+        tree=BuildKDTree(Partsubset,nsubset,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,1000,0,0,0,NULL,NULL,false);
         numgroups=0;
         pfof=new Int_t[nsubset];
         for (i=0;i<nsubset;i++) pfof[i]=0;
@@ -1118,7 +1232,7 @@ Int_t* SearchSubset(Options &opt, const Int_t nbodies, const Int_t nsubset, Part
     //@{
     if (!(opt.foftype==FOFSTPROBNN||opt.foftype==FOFSTPROBNNLX||opt.foftype==FOFSTPROBNNNODIST||opt.foftype==FOF6DCORE)) {
         LOG(trace) << "Building tree ...";
-        tree=new KDTree(Partsubset,nsubset,opt.Bsize,tree->TPHYS);
+        tree=BuildKDTree(Partsubset,nsubset,opt.Bsize,KDTree::TPHYS);
         param[0]=tree->GetTreeType();
         //if large enough for statistically significant structures to be found then search. This is a robust search
         if (nsubset>=MINSUBSIZE) {
@@ -1137,7 +1251,7 @@ Int_t* SearchSubset(Options &opt, const Int_t nbodies, const Int_t nsubset, Part
         //then examine first tagged particle that meets critera by examining its NN and so on till reach particle where all NN are either already tagged or do not meet criteria
         //delete tree;
         LOG(trace) << "Building tree ...";
-        tree=new KDTree(Partsubset,nsubset,opt.Bsize,tree->TPHYS,tree->KEPAN,1000,1);
+        tree=BuildKDTree(Partsubset,nsubset,opt.Bsize,KDTree::TPHYS,KDTree::KEPAN,1000,1);
         LOG(trace) << "Finding nearest neighbours";
         nnID=new Int_t*[nsubset];
         for (i=0;i<nsubset;i++) nnID[i]=new Int_t[nsearch];
@@ -1425,7 +1539,7 @@ private(i,tid)
             GetOutliersValues(opt,nsubset,Partsubset,-1);
         }
         ///produce tree to search for 6d phase space structures
-        tree=new KDTree(Partsubset,nsubset,opt.Bsize,tree->TPHYS);
+        tree=BuildKDTree(Partsubset,nsubset,opt.Bsize,KDTree::TPHYS);
 
         //now begin fof6d search for large background objects that are missed using smaller grid cells ONLY IF substructures have been found
         //this search can identify merger excited radial shells so for the moment, disabled
@@ -2127,7 +2241,7 @@ private(i,tid,Pval,D2,dval,mval,pid,weight)
                 Pcore[nincore].SetType(pfofbg[Partsubset[i].GetID()]);
                 nincore++;
             }
-            tcore=new KDTree(Pcore,nincore,opt.Bsize,tcore->TPHYS);
+            tcore=BuildKDTree(Pcore,nincore,opt.Bsize,KDTree::TPHYS);
             nnID=new Int_t*[nthreads];
             dist2=new Double_t*[nthreads];
             for (i=0;i<nthreads;i++) {
@@ -2253,147 +2367,141 @@ private(i,tid,Pval,x1,D2,dval,mval,pid,pidcore)
 }
 
 
+/*!
+    Segmented reduction of the mass weighted phase-space centres and the position and velocity dispersions about them
+    of groups 0..ngroups. Particles are ordered by group with a counting sort (index, with group offsets in noffset)
+    and each group is reduced independently, in parallel. Large groups are split into fixed-size chunks whose partial
+    sums are combined in order so that the results do not depend on the number of threads.
+*/
+static void GetGroupPhaseCentres(const Int_t nsubset, Particle *Partsubset, Int_t *pfof, const Int_t ngroups,
+    vector<Int_t> &numingroup, vector<Int_t> &noffset, vector<Int_t> &index,
+    vector<Double_t> &phase, vector<Double_t> &sigX, vector<Double_t> &sigV)
+{
+    const Int_t chunksize=ompsearchnum;
+    numingroup.assign(ngroups+1,0);
+    noffset.assign(ngroups+1,0);
+    index.resize(nsubset);
+    phase.assign(6*(ngroups+1),0);
+    sigX.assign(ngroups+1,0);
+    sigV.assign(ngroups+1,0);
+    for (Int_t i=0;i<nsubset;i++) numingroup[pfof[Partsubset[i].GetID()]]++;
+    for (Int_t i=1;i<=ngroups;i++) noffset[i]=noffset[i-1]+numingroup[i-1];
+    vector<Int_t> count(noffset);
+    for (Int_t i=0;i<nsubset;i++) index[count[pfof[Partsubset[i].GetID()]]++]=i;
+    vector<Int_t>().swap(count);
+
+    //sums of mass and mass weighted phase (or dispersions about centre c when c!=NULL) over index[start,end)
+    auto sumrange = [&](Int_t start, Int_t end, const Double_t *c, Double_t *sums) {
+        for (auto k=0;k<7;k++) sums[k]=0;
+        for (auto j=start;j<end;j++) {
+            Particle &p=Partsubset[index[j]];
+            Double_t m=p.GetMass();
+            if (c==NULL) {
+                sums[6]+=m;
+                for (auto k=0;k<6;k++) sums[k]+=p.GetPhase(k)*m;
+            }
+            else {
+                Double_t dx=0, dv=0;
+                for (auto k=0;k<3;k++) {
+                    dx+=pow(p.GetPosition(k)-c[k],2.0);
+                    dv+=pow(p.GetVelocity(k)-c[k+3],2.0);
+                }
+                sums[0]+=dx*m;
+                sums[1]+=dv*m;
+            }
+        }
+    };
+    auto reducegroup = [&](Int_t g, bool isplit) {
+        Double_t sums[7], mass;
+        Int_t nchunks=(isplit)?(numingroup[g]+chunksize-1)/chunksize:1;
+        vector<Double_t> partial(7*nchunks);
+        for (int pass=0;pass<2;pass++) {
+            const Double_t *c=(pass==0)?NULL:&phase[6*g];
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (isplit)
+#endif
+            for (Int_t ichunk=0;ichunk<nchunks;ichunk++) {
+                Int_t start=noffset[g]+ichunk*chunksize;
+                Int_t end=(isplit)?min(start+chunksize,noffset[g]+numingroup[g]):noffset[g]+numingroup[g];
+                sumrange(start, end, c, &partial[7*ichunk]);
+            }
+            for (auto k=0;k<7;k++) sums[k]=0;
+            for (Int_t ichunk=0;ichunk<nchunks;ichunk++) for (auto k=0;k<7;k++) sums[k]+=partial[7*ichunk+k];
+            if (pass==0) {
+                mass=sums[6];
+                if (mass>0) for (auto k=0;k<6;k++) phase[6*g+k]=sums[k]/mass;
+            }
+            else if (mass>0) {
+                sigX[g]=sums[0]/mass;
+                sigV[g]=sums[1]/mass;
+            }
+        }
+    };
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (nsubset > ompsearchnum)
+#endif
+    for (Int_t g=0;g<=ngroups;g++) if (numingroup[g]<chunksize) reducegroup(g, false);
+    for (Int_t g=0;g<=ngroups;g++) if (numingroup[g]>=chunksize) reducegroup(g, true);
+}
+
 //Merge any groups that overlap in phase-space
 void MergeSubstructuresCoresPhase(Options &opt, const Int_t nsubset, Particle *&Partsubset, Int_t *&pfof, Int_t &numsubs, Int_t &numcores)
 {
     //get the phase centres of objects and see if they overlap
-    Int_t pfofval, imerge, newnumcores=numcores;
-    Double_t disp, dist2, mindist2, fdist2=pow(opt.coresubmergemindist,2.0);
-    Coordinate pos;
-    vector<Int_t> numingroup, noffset, taggedsubs;
-    vector<Particle> subs, cores;
+    Int_t newnumcores, ngroups=numsubs+numcores;
+    Double_t fdist2=pow(opt.coresubmergemindist,2.0);
+    vector<Int_t> numingroup, noffset, indexing, imerge(numcores,-1), newid(numcores);
+    vector<Double_t> phase, sigX, sigV;
+    vector<Particle> subs;
     KDTree *tree;
-    //vector<GMatrix> phasetensorsubs(numsubs,GMatrix(6,6)), phasetensorcores(numcores,GMatrix(6,6));
-    vector<Double_t> sigXsubs(numsubs), sigVsubs(numsubs), sigXcores(numcores), sigVcores(numcores);
-    struct indexfof {
-        Int_t fofval;
-        Int_t index;
-    };
-    vector<indexfof> indexing;
+    if (numsubs==0 || numcores==0) return;
+    GetGroupPhaseCentres(nsubset, Partsubset, pfof, ngroups, numingroup, noffset, indexing, phase, sigX, sigV);
     subs.resize(numsubs);
-    cores.resize(numcores);
-    numingroup.resize(numsubs+numcores+1);
-    noffset.resize(numsubs+numcores+1);
-    indexing.resize(nsubset);
-    for (auto &x:sigXsubs) x=0;
-    for (auto &x:sigVsubs) x=0;
-    for (auto &x:sigXcores) x=0;
-    for (auto &x:sigVcores) x=0;
-    //get center of mass in phase-space
-    for (auto i=0;i<nsubset;i++) {
-        pfofval = pfof[Partsubset[i].GetID()];
-        indexing[i].fofval = pfofval;
-        indexing[i].index = i;
-        numingroup[pfofval]++;
-        //if ignoring background halo when determing whether to merge substructures,
-        if (pfofval==0 && opt.icoresubmergewithbg) continue;
-        if (pfofval<=numsubs) {
-            pfofval-=1;
-            //store total mass in potential (to ensure compatability with NOMASS option)
-            subs[pfofval].SetPotential(subs[pfofval].GetPotential()+Partsubset[i].GetMass());
-            for (auto k=0;k<6;k++) subs[pfofval].SetPhase(k,subs[pfofval].GetPhase(k)+Partsubset[i].GetPhase(k)*Partsubset[i].GetMass());
-        }
-        else {
-            pfofval-=numsubs+1;
-            cores[pfofval].SetPotential(cores[pfofval].GetPotential()+Partsubset[i].GetMass());
-            for (auto k=0;k<6;k++) cores[pfofval].SetPhase(k,cores[pfofval].GetPhase(k)+Partsubset[i].GetPhase(k)*Partsubset[i].GetMass());
-        }
-    }
-    noffset[0]=0; for (auto i=1;i<=numsubs+numcores;i++) noffset[i]=numingroup[i-1]+noffset[i-1];
-    pfofval=1;
-    for (auto &x:subs) {
-        x.SetPID(pfofval);
-        x.SetID(pfofval);
-        pfofval++;
-        for (auto k=0;k<6;k++) x.SetPhase(k,x.GetPhase(k)/x.GetPotential());
-    }
-    for (auto &x:cores) {
-        x.SetPID(pfofval);
-        x.SetID(pfofval);
-        pfofval++;
-        for (auto k=0;k<6;k++) x.SetPhase(k,x.GetPhase(k)/x.GetPotential());
-    }
-    //sort indices by fof value
-    sort(indexing.begin(), indexing.end(), [](const indexfof &a, const indexfof &b){
-    return a.fofval < b.fofval;
-    });
-    //get the dispersions
-    for (auto i=0;i<nsubset;i++) {
-        pfofval = pfof[Partsubset[i].GetID()];
-        if (pfofval==0) continue;
-        if (pfofval<=numsubs) {
-            pfofval-=1;
-            disp=0; for (auto k=0;k<3;k++) disp+=pow(Partsubset[i].GetPosition(k)-subs[pfofval].GetPosition(k),2.0);
-            sigXsubs[pfofval]+=disp*Partsubset[i].GetMass();
-            disp=0; for (auto k=0;k<3;k++) disp+=pow(Partsubset[i].GetVelocity(k)-subs[pfofval].GetVelocity(k),2.0);
-            sigVsubs[pfofval]+=disp*Partsubset[i].GetMass();
-        }
-        else {
-            pfofval-=numsubs+1;
-            disp=0; for (auto k=0;k<3;k++) disp+=pow(Partsubset[i].GetPosition(k)-cores[pfofval].GetPosition(k),2.0);
-            sigXcores[pfofval]+=disp*Partsubset[i].GetMass();
-            disp=0; for (auto k=0;k<3;k++) disp+=pow(Partsubset[i].GetVelocity(k)-cores[pfofval].GetVelocity(k),2.0);
-            sigVcores[pfofval]+=disp*Partsubset[i].GetMass();
-        }
-    }
     for (auto i=0;i<numsubs;i++) {
-        sigXsubs[i]*=1.0/subs[i].GetPotential();
-        sigVsubs[i]*=1.0/subs[i].GetPotential();
-    }
-    for (auto i=0;i<numcores;i++) {
-        sigXcores[i]*=1.0/cores[i].GetPotential();
-        sigVcores[i]*=1.0/cores[i].GetPotential();
+        subs[i].SetPID(i+1);
+        subs[i].SetID(i+1);
+        for (auto k=0;k<6;k++) subs[i].SetPhase(k,phase[6*(i+1)+k]);
     }
     //now built tree on substructures
-    tree = new KDTree(subs.data(),numsubs,1,tree->TPHYS,tree->KEPAN,100,0,0,0);
-    //tree = new KDTree(subs.data(),numlargesubs,1,tree->TPHYS,tree->KEPAN,100,0,0,0);
-    //check all cores to see if they overlap significantly with substructures
-    newnumcores=0;
-    for (auto i=0;i<numcores;i++) {
-        for (auto k=0;k<3;k++) pos[k]=cores[i].GetPosition(k);
-        taggedsubs = tree->SearchBallPosTagged(pos, sigXcores[i]*fdist2);
-        if (taggedsubs.size()==0) {
-            newnumcores++;
-            cores[i].SetID(newnumcores+numsubs);
-            continue;
-        }
-        //if objects are within search window of core, get min phase distance
-        imerge=-1;
-        mindist2=MAXVALUE;
-        for (auto j=0;j<taggedsubs.size();j++) {
-            disp = 0; for (auto k=0;k<3;k++) disp+=pow(subs[taggedsubs[j]].GetPosition(k)-cores[i].GetPosition(k),2.0);
-            dist2 = disp/sigXcores[i];
-            disp = 0; for (auto k=0;k<3;k++) disp+=pow(subs[taggedsubs[j]].GetVelocity(k)-cores[i].GetVelocity(k),2.0);
-            dist2 += disp/sigVcores[i];
+    tree = BuildKDTree(subs.data(),numsubs,1,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0);
+    //check all cores to see if they overlap significantly with substructures. Cores are independent of one another
+    //so the substructure with the minimum phase distance is found for all cores in parallel
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (numcores > ompunbindnum)
+#endif
+    for (Int_t i=0;i<numcores;i++) {
+        Int_t icore=i+numsubs+1, isub;
+        Double_t disp, dist2, mindist2=MAXVALUE;
+        Coordinate pos;
+        for (auto k=0;k<3;k++) pos[k]=phase[6*icore+k];
+        vector<Int_t> taggedsubs = tree->SearchBallPosTagged(pos, sigX[icore]*fdist2);
+        for (auto j:taggedsubs) {
+            isub=subs[j].GetPID();
+            disp = 0; for (auto k=0;k<3;k++) disp+=pow(phase[6*isub+k]-phase[6*icore+k],2.0);
+            dist2 = disp/sigX[icore];
+            disp = 0; for (auto k=3;k<6;k++) disp+=pow(phase[6*isub+k]-phase[6*icore+k],2.0);
+            dist2 += disp/sigV[icore];
             if (dist2<fdist2 && dist2<mindist2){
-                imerge=subs[taggedsubs[j]].GetPID();
+                imerge[i]=isub;
                 mindist2=dist2;
             }
         }
-        //merging core with sub if one is found
-        if (imerge!=-1) {
-            pfofval=i+numsubs+1;
-            for (auto j=noffset[pfofval];j<noffset[pfofval]+numingroup[pfofval];j++) {
-                pfof[Partsubset[indexing[j].index].GetID()]=imerge;
-            }
-            cores[i].SetID(imerge);
-            cores[i].SetPID(0);
-        }
-        else {
-            newnumcores++;
-            cores[i].SetID(newnumcores+numsubs);
-        }
     }
     delete tree;
-    //if object has been mergerged then must update the pfof values of cores
-    if (newnumcores!=numcores && newnumcores>0) {
-        for (auto i=0;i<numcores;i++) {
-            pfofval=i+numsubs+1;
-            if (cores[i].GetPID()==0) continue;
-            if (cores[i].GetPID()==cores[i].GetID()) continue;
-            for (auto j=noffset[pfofval];j<noffset[pfofval]+numingroup[pfofval];j++) {
-                pfof[Partsubset[indexing[j].index].GetID()]=cores[i].GetID();
-            }
+    //cores merged with a substructure take its id, remaining cores are renumbered in order
+    newnumcores=0;
+    for (auto i=0;i<numcores;i++) {
+        if (imerge[i]!=-1) newid[i]=imerge[i];
+        else newid[i]=(++newnumcores)+numsubs;
+    }
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (numcores > ompunbindnum)
+#endif
+    for (Int_t i=0;i<numcores;i++) {
+        Int_t icore=i+numsubs+1;
+        if (newid[i]==icore) continue;
+        for (auto j=noffset[icore];j<noffset[icore]+numingroup[icore];j++) {
+            pfof[Partsubset[indexing[j]].GetID()]=newid[i];
         }
     }
     numcores=newnumcores;
@@ -2412,234 +2520,125 @@ void MergeSubstructuresPhase(Options &opt, const Int_t nsubset, Particle *&Parts
     else if (opt.icoresubmergewithbg == 0 && (numcores == 0 || numsubs == 0)) return;
 
     //get the phase centres of objects and see if they overlap
-    Int_t pfofval, imerge, newnumgroups, newnumcores, nummerged=0, index1, index2;
-    Double_t disp, dist2, dist2sub1,dist2sub2, mindist2, fdist2=pow(opt.coresubmergemindist,2.0);
-    Double_t xsub1, xsub2, vsub1, vsub2;
-    Coordinate pos;
-    vector<Int_t> numingroup, noffset, taggedsubs;
-    struct mergeinfo {
-        Int_t originalpfofval;
-        Int_t pfofval;
-        Int_t numingroup;
-        int type;
-        int nummerged;
-        bool ismerged;
-        int mergeindex;
-        vector<Int_t> mergedlist;
-        mergeinfo(){
-            nummerged = 0;
-            ismerged = false;
-            mergeindex = -1;
-        };
-    };
+    Int_t newnumgroups, newnumcores, nummerged=0;
+    Double_t fdist2=pow(opt.coresubmergemindist,2.0);
+    vector<Int_t> numingroup, noffset, indexing;
+    vector<Double_t> phase, sigX, sigV;
     vector<Particle> subs;
-    vector<mergeinfo> minfo;
+    vector<vector<Int_t>> candidates;
     KDTree *tree;
-    //vector<GMatrix> phasetensorsubs(numgroups+1,GMatrix(6,6));
-    vector<Double_t> sigXsubs(numgroups+1), sigVsubs(numgroups+1);
-    Double_t searchdist;
-    struct indexfof {
-        Int_t fofval;
-        Int_t index;
-    };
-    vector<indexfof> indexing;
-    int idoffset, idtagged;
 
+    GetGroupPhaseCentres(nsubset, Partsubset, pfof, numgroups, numingroup, noffset, indexing, phase, sigX, sigV);
+    //if ignoring background host when checking whether to merge, then leave it as zero dispersion
+    if (opt.icoresubmergewithbg == 0) sigX[0]=sigV[0]=0;
+
+    //set sub properties, type -1 is background, 0 substructure and 1 core
     subs.resize(numgroups+1);
-    minfo.resize(numgroups+1);
-    idoffset = 0;
-    idtagged = -1;
-    numingroup.resize(numgroups+1);
-    noffset.resize(numgroups+1);
-    indexing.resize(nsubset);
-
-    for (auto &x:sigXsubs) x=0;
-    for (auto &x:sigVsubs) x=0;
-    for (auto &x:numingroup) x=0;
-
-    //get center of mass in phase-space
-    for (auto i=0;i<nsubset;i++) {
-        pfofval = pfof[Partsubset[i].GetID()];
-        indexing[i].fofval = pfofval;
-        indexing[i].index = i;
-        numingroup[pfofval]++;
-        //if (opt.icoresubmergewithbg == 0 && pfofval==0) continue;
-        //store total mass in potential (to ensure compatability with NOMASS option)
-        subs[pfofval].SetPotential(subs[pfofval].GetPotential()+Partsubset[i].GetMass());
-        for (auto k=0;k<6;k++) subs[pfofval].SetPhase(k,subs[pfofval].GetPhase(k)+Partsubset[i].GetPhase(k)*Partsubset[i].GetMass());
-    }
-    noffset[0]=0; for (auto i=1;i<=numgroups;i++) noffset[i]=numingroup[i-1]+noffset[i-1];
-
-    //set sub properties.
-    for (auto i=0;i<subs.size();i++)
+    vector<int> type(numgroups+1);
+    for (auto i=0;i<=numgroups;i++)
     {
-        if (i == 0) subs[i].SetType(-1);
-        else subs[i].SetType((i>numsubs));
+        if (i == 0) type[i]=-1;
+        else type[i]=(i>numsubs);
+        subs[i].SetType(type[i]);
         subs[i].SetPID(i);
         subs[i].SetID(i);
-        minfo[i].originalpfofval = i;
-        minfo[i].pfofval = i;
-        minfo[i].type = subs[i].GetType();
-        minfo[i].numingroup = numingroup[i];
-        for (auto k=0;k<6;k++) subs[i].SetPhase(k,subs[i].GetPhase(k)/subs[i].GetPotential());
-    }
-
-    //sort indices by original fof value
-    sort(indexing.begin(), indexing.end(), [](const indexfof &a, const indexfof &b){
-    return a.fofval < b.fofval;
-    });
-
-    //get the dispersions
-    for (auto i=0;i<nsubset;i++) {
-        pfofval = pfof[Partsubset[i].GetID()];
-        //if ignoring background host when checking whether to merge, then leave it as zero dispersion
-        if (pfofval == 0 && opt.icoresubmergewithbg == 0) continue;
-        disp=0; for (auto k=0;k<3;k++) disp+=pow(Partsubset[i].GetPosition(k)-subs[pfofval].GetPosition(k),2.0);
-        sigXsubs[pfofval]+=disp*Partsubset[i].GetMass();
-        disp=0; for (auto k=0;k<3;k++) disp+=pow(Partsubset[i].GetVelocity(k)-subs[pfofval].GetVelocity(k),2.0);
-        sigVsubs[pfofval]+=disp*Partsubset[i].GetMass();
-    }
-
-    if (opt.icoresubmergewithbg == 0) index1 = 1;
-    else index1 = 0;
-    for (auto i=index1;i<subs.size();i++) {
-        sigXsubs[i]*=1.0/subs[i].GetPotential();
-        sigVsubs[i]*=1.0/subs[i].GetPotential();
+        for (auto k=0;k<6;k++) subs[i].SetPhase(k,phase[6*i+k]);
     }
 
     //now built tree on substructures
-    tree = new KDTree(subs.data(),subs.size(),1,tree->TPHYS,tree->KEPAN,100,0,0,0);
+    tree = BuildKDTree(subs.data(),subs.size(),1,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0);
 
-    //first check all cores to see if they overlap significantly with dynamically distince
-    //substructures. Since cores are after subs in id value, this removes a core
-    //and adds particles to a substructure
-    for (auto i=0;i<numgroups;i++) {
+    //find all pairs that overlap significantly in phase-space. Whether a pair should merge only depends on the
+    //centres and dispersions of the original objects so candidates of all objects are found in parallel.
+    //Cores, which have type 1, are not searched to see if objects should merge with them.
+    candidates.resize(subs.size());
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (numgroups > ompunbindnum)
+#endif
+    for (Int_t i=0;i<(Int_t)subs.size();i++) {
         //if only looking at core
         if (opt.icoresubmergewithbg == 2 && subs[i].GetType() != -1) continue;
-        //ignore if already merged
-        if (subs[i].GetPID()==idtagged) continue;
-        //don't search cores, which have type 1, to see if objects should merge with them
         if (subs[i].GetType()==1) continue;
         //if not searching background, ignore;
         if (opt.icoresubmergewithbg == 0 && subs[i].GetType() == -1) continue;
-        index1 = subs[i].GetID();
-        searchdist = sigXsubs[index1]*fdist2;
-        ////if object is background halo of type -1, decrease search distance^2 by 1/2^2
-        //if (subs[i].GetType() == -1) searchdist *= 0.25;
-        taggedsubs = tree->SearchBallPosTagged(i, searchdist);
-        if (taggedsubs.size()<=1) continue;
-        //if objects are within search window of core, get min phase distance
-        imerge=-1;
-        mindist2=MAXVALUE;
-        for (auto j=0;j<taggedsubs.size();j++)
+        Int_t index1 = subs[i].GetID(), index2;
+        Double_t disp, dist2sub1, dist2sub2, xsub1, xsub2, vsub1, vsub2;
+        vector<Int_t> taggedsubs = tree->SearchBallPosTagged(i, sigX[index1]*fdist2);
+        for (auto j:taggedsubs)
         {
-            //object skips itself
-            if (i==taggedsubs[j]) continue;
-            //object skips any tagged substructure objects
-            if (subs[taggedsubs[j]].GetPID() == idtagged) continue;
-            //skip background
-            if (subs[taggedsubs[j]].GetType() == -1) continue;
-            index2=subs[taggedsubs[j]].GetID();
-            disp = 0; for (auto k=0;k<3;k++) disp+=pow(subs[taggedsubs[j]].GetPosition(k)-subs[i].GetPosition(k),2.0);
-            xsub1=disp/sigXsubs[index1];
-            xsub2=disp/sigXsubs[index2];
-            dist2sub1 = xsub1;
-            dist2sub2 = xsub2;
-
-            disp = 0; for (auto k=0;k<3;k++) disp+=pow(subs[taggedsubs[j]].GetVelocity(k)-subs[i].GetVelocity(k),2.0);
-            vsub1=disp/sigVsubs[index1];
-            vsub2=disp/sigVsubs[index2];
-            dist2sub1 += vsub1;
-            dist2sub2 += vsub2;
-            dist2 = 0.5*(dist2sub1+dist2sub2);
-
-            if ((dist2sub1<fdist2 && dist2sub2<fdist2) || (xsub1<0.05 && vsub1<0.1 && vsub2<0.1 && index1 ==0)){
-                imerge=taggedsubs[j];
-                mindist2=dist2;
-                nummerged++;
-                minfo[index2].ismerged = true;
-                minfo[index2].mergeindex = index1;
-                subs[imerge].SetPID(idtagged);
-                minfo[index1].numingroup += minfo[index2].numingroup;
-                minfo[index1].nummerged = minfo[index2].nummerged+1;
-                minfo[index1].mergedlist.push_back(index2);
-                for (auto j=0;j<minfo[index2].nummerged;j++) {
-                    minfo[index1].mergedlist.push_back(minfo[index2].mergedlist[j]);
-                    minfo[minfo[index2].mergedlist[j]].ismerged = true;
-                    minfo[minfo[index2].mergedlist[j]].mergeindex = index1;
-                }
+            //object skips itself and the background
+            if (i==j) continue;
+            if (subs[j].GetType() == -1) continue;
+            index2=subs[j].GetID();
+            disp = 0; for (auto k=0;k<3;k++) disp+=pow(phase[6*index2+k]-phase[6*index1+k],2.0);
+            xsub1=disp/sigX[index1];
+            xsub2=disp/sigX[index2];
+            disp = 0; for (auto k=3;k<6;k++) disp+=pow(phase[6*index2+k]-phase[6*index1+k],2.0);
+            vsub1=disp/sigV[index1];
+            vsub2=disp/sigV[index2];
+            dist2sub1 = xsub1 + vsub1;
+            dist2sub2 = xsub2 + vsub2;
+            if ((dist2sub1<fdist2 && dist2sub2<fdist2) || (xsub1<0.05 && vsub1<0.1 && vsub2<0.1 && index1 ==0)) {
+                candidates[i].push_back(index2);
             }
         }
     }
+
+    //apply mergers in search order with a union-find over the candidates: an object that has been merged
+    //cannot absorb others or be merged again, and merging an object also merges everything it absorbed
+    vector<Int_t> parent(numgroups+1);
+    vector<bool> ismerged(numgroups+1,false);
+    iota(parent.begin(), parent.end(), 0);
+    for (Int_t i=0;i<(Int_t)subs.size();i++) {
+        Int_t index1 = subs[i].GetID();
+        if (ismerged[index1]) continue;
+        for (auto index2:candidates[i]) {
+            if (ismerged[index2]) continue;
+            ismerged[index2]=true;
+            parent[index2]=index1;
+            nummerged++;
+        }
+    }
     delete tree;
+    vector<vector<Int_t>>().swap(candidates);
 
     //if nothing has changed, do nothing
     if (nummerged==0) return;
     //otherwise start merging groups
     LOG(trace) << "Merging phase-space structures which overlap significantly. Number of mergers " << nummerged << " of " << numgroups;
-    //sort merger info by type, which would be (background if present), subs, cores, individually arranged by size, keeping original order if possible
-    sort(minfo.begin(), minfo.end(), [](const mergeinfo &a, const mergeinfo &b){
-        if (a.type<b.type) return true;
-        else if (a.type==b.type) {
-            if (a.numingroup > b.numingroup) return true;
-            else if (a.numingroup < b.numingroup) return false;
-            else {
-                return (a.originalpfofval < b.originalpfofval);
-            }
-        }
-        else return false;
+    auto findroot = [&](Int_t g) {
+        Int_t root=g;
+        while (parent[root]!=root) root=parent[root];
+        while (parent[g]!=root) {Int_t next=parent[g]; parent[g]=root; g=next;}
+        return root;
+    };
+    vector<Int_t> mergedsize(numgroups+1,0), order, newid(numgroups+1);
+    for (auto i=0;i<=numgroups;i++) mergedsize[findroot(i)]+=numingroup[i];
+    //order remaining objects by type, which would be (background if present), subs, cores, individually arranged by size, keeping original order if possible
+    for (auto i=0;i<=numgroups;i++) if (!ismerged[i]) order.push_back(i);
+    sort(order.begin(), order.end(), [&](Int_t a, Int_t b){
+        if (type[a]!=type[b]) return type[a]<type[b];
+        if (mergedsize[a]!=mergedsize[b]) return mergedsize[a]>mergedsize[b];
+        return a<b;
     });
-    //store old to new pfof values
-    map<Int_t, Int_t> oldtonewindex;
-    for (auto i=0;i<minfo.size();i++)
-    {
-        oldtonewindex[minfo[i].originalpfofval] = i;
-    }
-
     newnumgroups=0;
     newnumcores=0;
-    //having sorted groups based on type and size, update the pfof values;
-    for (auto i=0;i<minfo.size();i++)
-    {
-        //if object has mergered, leave its pfofval unchanged.
-        if (minfo[i].ismerged == true) continue;
-        if (minfo[i].type >= 0) newnumgroups++;
-        minfo[i].pfofval = newnumgroups;
-        if (minfo[i].type == 1) newnumcores++;
-    }
-    //update the values to new pfof values
-    for (auto i=0;i<minfo.size();i++)
+    for (auto i:order)
     {
-        if (minfo[i].ismerged == true) {
-            minfo[i].mergeindex = oldtonewindex[minfo[i].mergeindex];
-        }
-        else if (minfo[i].nummerged > 0) {
-            for (auto &mergedgroup:minfo[i].mergedlist) mergedgroup = oldtonewindex[mergedgroup];
-        }
+        if (type[i] >= 0) newnumgroups++;
+        newid[i] = newnumgroups;
+        if (type[i] == 1) newnumcores++;
     }
+    for (auto i=0;i<=numgroups;i++) if (ismerged[i]) newid[i]=newid[findroot(i)];
 
-    //now update the pfof array as necessary
-    for (auto i=0;i<minfo.size();i++) {
-        //if object is still in same order and has not mergered with anything, do nothing
-        if (minfo[i].ismerged == true) continue;
-        //if object is in order and has no mergers, nothing to update
-        if (minfo[i].pfofval == minfo[i].originalpfofval && minfo[i].nummerged==0) continue;
-        //if object has things that merged with it, update the list
-        if (minfo[i].nummerged>0) {
-            pfofval = minfo[i].pfofval;
-            for (auto &mergedgroup:minfo[i].mergedlist) {
-                index1 = minfo[mergedgroup].originalpfofval;
-                for (auto j=noffset[index1];j<noffset[index1]+numingroup[index1];j++) {
-                    pfof[Partsubset[indexing[j].index].GetID()] = pfofval;
-                }
-            }
-        }
-        if (minfo[i].pfofval != minfo[i].originalpfofval) {
-            index1 = minfo[i].originalpfofval;
-            pfofval = minfo[i].pfofval;
-            for (auto j=noffset[index1];j<noffset[index1]+numingroup[index1];j++) {
-                pfof[Partsubset[indexing[j].index].GetID()]=pfofval;
-            }
+    //now update the pfof array of objects whose id has changed, each object independently
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (nsubset > ompsearchnum)
+#endif
+    for (Int_t i=0;i<=numgroups;i++) {
+        if (newid[i]==i) continue;
+        for (auto j=noffset[i];j<noffset[i]+numingroup[i];j++) {
+            pfof[Partsubset[indexing[j]].GetID()]=newid[i];
         }
     }
 
@@ -3309,14 +3308,13 @@ void SearchSubSub(Options &opt, const Int_t nsubset, vector<Particle> &Partsubse
 */
 int CheckSignificance(Options &opt, const Int_t nsubset, Particle *Partsubset, Int_t &numgroups, Int_t *numingroup, Int_t *pfof, Int_t **pglist)
 {
-    Int_t i;
     Double_t ellaveexp, ellvallim;
-    Double_t *aveell, *maxell,*minell, *betaave;
+    Double_t *aveell, *betaave;
     Int_t iflag=0,ng=numgroups;
+    //size of the fixed chunks used to split the reduction of large groups across threads. Chunks do not depend
+    //on the number of threads and their partial sums are combined in order so results are reproducible
+    const Int_t chunksize=ompsearchnum;
     aveell=new Double_t[numgroups+1];
-    maxell=new Double_t[numgroups+1];
-    minell=new Double_t[numgroups+1];
-    //varell=new Double_t[numgroups+1];
     betaave=new Double_t[numgroups+1];
 
     /*
@@ -3326,19 +3324,33 @@ int CheckSignificance(Options &opt, const Int_t nsubset, Particle *Partsubset, I
     ellvallim=opt.ellthreshold;
     ellaveexp=sqrt(2.0/M_PI)*exp(-ellvallim*ellvallim)*exp(0.5*ellvallim*ellvallim)/(1.0-gsl_sf_erf(ellvallim/sqrt(2.0)));
 
-    //first adjust system and store pList for each group so one can access pfof appropriately
+    //average ell of each group, reduced over the group member lists so that each group is independent
     LOG(debug) << "Checking that groups have a significance level of " << opt.siglevel << " and contain more than " << opt.MinSize << " members";
-    for (i=0;i<=numgroups;i++) {aveell[i]=0.;maxell[i]=-MAXVALUE;minell[i]=MAXVALUE;//numingroup[i]=0;
+    aveell[0]=betaave[0]=0;
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) if (nsubset > ompsearchnum)
+#endif
+    for (Int_t i=1;i<=numgroups;i++) {
+        if (numingroup[i]<chunksize) {
+            Double_t sum=0;
+            for (Int_t j=0;j<numingroup[i];j++) sum+=Partsubset[pglist[i][j]].GetPotential();
+            aveell[i]=sum;
+        }
+        else aveell[i]=0;
     }
-    for (i=0;i<nsubset;i++)
-    {
-        Int_t gid=pfof[Partsubset[i].GetID()];
-        Double_t ellvalue=Partsubset[i].GetPotential();
-        aveell[gid]+=ellvalue;
-        if(maxell[gid]<ellvalue)maxell[gid]=ellvalue;
-        if(minell[gid]>ellvalue)minell[gid]=ellvalue;
+    for (Int_t i=1;i<=numgroups;i++) if (numingroup[i]>=chunksize) {
+        Int_t nchunks=(numingroup[i]+chunksize-1)/chunksize;
+        vector<Double_t> partial(nchunks,0);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (Int_t ichunk=0;ichunk<nchunks;ichunk++) {
+            Int_t jend=min((ichunk+1)*chunksize,numingroup[i]);
+            for (Int_t j=ichunk*chunksize;j<jend;j++) partial[ichunk]+=Partsubset[pglist[i][j]].GetPotential();
+        }
+        for (auto &p:partial) aveell[i]+=p;
     }
-    for (i=1;i<=numgroups;i++) {
+    for (Int_t i=1;i<=numgroups;i++) {
         aveell[i]/=(Double_t)numingroup[i];
         betaave[i]=(aveell[i]/ellaveexp-1.0)*sqrt((Double_t)numingroup[i]);
         //flag indicating that group ids need to be adjusted
@@ -3347,29 +3359,22 @@ int CheckSignificance(Options &opt, const Int_t nsubset, Particle *Partsubset, I
     LOG(debug) << "Done";
     if (iflag){
         LOG(debug) << "Remove groups below significance level";
+        //groups below the significance level have their lowest ell members removed until they are significant.
+        //Members are sorted by decreasing ell (ties by index) once so removal proceeds from the end of the list
 #ifdef USEOPENMP
-#pragma omp parallel default(shared) \
-private(i)
-{
-#pragma omp for
+#pragma omp parallel for schedule(dynamic) if (numgroups > ompunbindnum)
 #endif
-        for (i=1;i<=numgroups;i++) {
-            if(betaave[i]<opt.siglevel) {
+        for (Int_t i=1;i<=numgroups;i++) {
+            if(betaave[i]<opt.siglevel && numingroup[i]>=opt.MinSize) {
+                std::sort(pglist[i], pglist[i]+numingroup[i], [&](Int_t a, Int_t b) {
+                    Double_t ella=Partsubset[a].GetPotential(), ellb=Partsubset[b].GetPotential();
+                    return (ella>ellb) || (ella==ellb && a<b);
+                });
                 do {
-                    if ((numingroup[i])<opt.MinSize) {
-                        for (Int_t j=0;j<numingroup[i];j++) pfof[Partsubset[pglist[i][j]].GetID()]=0;
-                        numingroup[i]=-1;
-                        break;
-                    }
-                    Int_t iminell;
-                    Double_t vminell=minell[i];
-                    aveell[i]=(aveell[i]*(Double_t)numingroup[i]-minell[i])/(Double_t)(numingroup[i]-1.0);
-                    minell[i]=maxell[i];
-                    for (Int_t j=0;j<numingroup[i];j++)
-                        if(Partsubset[pglist[i][j]].GetPotential()>vminell&&Partsubset[pglist[i][j]].GetPotential()<minell[i])minell[i]=Partsubset[pglist[i][j]].GetPotential();
-                        else if (Partsubset[pglist[i][j]].GetPotential()==vminell) iminell=j;
-                    pfof[Partsubset[pglist[i][iminell]].GetID()]=0;
-                    if (iminell!=numingroup[i]-1)pglist[i][iminell]=pglist[i][numingroup[i]-1];
+                    if ((numingroup[i])<opt.MinSize) break;
+                    Int_t iminell=pglist[i][numingroup[i]-1];
+                    aveell[i]=(aveell[i]*(Double_t)numingroup[i]-Partsubset[iminell].GetPotential())/(Double_t)(numingroup[i]-1.0);
+                    pfof[Partsubset[iminell].GetID()]=0;
                     numingroup[i]--;
                     betaave[i]=(aveell[i]/ellaveexp-1.0)*sqrt((Double_t)numingroup[i]);
                 } while(betaave[i]<opt.siglevel);
@@ -3379,11 +3384,8 @@ private(i)
                 numingroup[i]=-1;
             }
         }
-#ifdef USEOPENMP
-}
-#endif
         LOG(debug) << "Done";
-        for (i=1;i<=numgroups;i++) if (numingroup[i]==-1) ng--;
+        for (Int_t i=1;i<=numgroups;i++) if (numingroup[i]==-1) ng--;
         if (ng) ReorderGroupIDs(numgroups, ng, numingroup, pfof, pglist, Partsubset);
         else {
             LOG(debug) << "No groups of significance found";
@@ -3392,8 +3394,6 @@ private(i)
 
     //free memory
     delete[] aveell;
-    delete[] maxell;
-    delete[] minell;
     delete[] betaave;
 
     numgroups=ng;
@@ -3404,6 +3404,206 @@ private(i)
 
 /// \name Routines searches baryonic or other components separately based on initial dark matter (or other) search
 //@{
+///periodic aware distance along one dimension from x to the interval bnd
+inline Double_t GroupMemberBoxDist(Double_t x, const Double_t bnd[2], Double_t p)
+{
+    Double_t d;
+    if (x < bnd[0]) {
+        d = bnd[0] - x;
+        if (p > 0) d = min(d, max(x + p - bnd[1], (Double_t)0.0));
+    }
+    else if (x > bnd[1]) {
+        d = x - bnd[1];
+        if (p > 0) d = min(d, max(bnd[0] - x + p, (Double_t)0.0));
+    }
+    else d = 0;
+    return d;
+}
+
+///periodic aware separation along one dimension
+inline Double_t GroupMemberSep(Double_t dx, Double_t p)
+{
+    if (p > 0) {
+        if (dx > 0.5*p) dx -= p;
+        else if (dx < -0.5*p) dx += p;
+    }
+    return dx;
+}
+
+/*!
+    Build a \ref GroupMemberIndex over the particles P[members[k]], which belong to group gid[k] of length glen[k].
+    The tree is built on an index permutation so the particle array is left untouched and only the
+    phase-space coordinates of the members are copied, in index order.
+*/
+void BuildGroupMemberIndex(GroupMemberIndex &gmi, Particle *P, const vector<Int_t> &members,
+    const vector<Int_t> &gid, const vector<Int_t> &glen, Int_t bucketsize)
+{
+    Int_t n = members.size();
+    vector<Int_t> order(n);
+    iota(order.begin(), order.end(), 0);
+    gmi.nodes.clear();
+    if (bucketsize < 1) bucketsize = 1;
+    if (n > 0) {
+        gmi.nodes.reserve(4*(n/bucketsize+1));
+        vector<Int_t> stack(1, 0);
+        gmi.nodes.push_back(groupmember_node{0, n, -1, -1});
+        while (stack.size() > 0) {
+            Int_t inode = stack.back();
+            stack.pop_back();
+            Int_t start = gmi.nodes[inode].start, end = gmi.nodes[inode].end;
+            Double_t xbnd[3][2], vbnd[3][2];
+            for (int j = 0; j < 3; j++) {
+                xbnd[j][0] = vbnd[j][0] = MAXVALUE;
+                xbnd[j][1] = vbnd[j][1] = -MAXVALUE;
+            }
+            for (Int_t k = start; k < end; k++) {
+                Particle &p = P[members[order[k]]];
+                for (int j = 0; j < 3; j++) {
+                    xbnd[j][0] = min(xbnd[j][0], p.GetPosition(j));
+                    xbnd[j][1] = max(xbnd[j][1], p.GetPosition(j));
+                    vbnd[j][0] = min(vbnd[j][0], p.GetVelocity(j));
+                    vbnd[j][1] = max(vbnd[j][1], p.GetVelocity(j));
+                }
+            }
+            for (int j = 0; j < 3; j++) for (int l = 0; l < 2; l++) {
+                gmi.nodes[inode].xbnd[j][l] = xbnd[j][l];
+                gmi.nodes[inode].vbnd[j][l] = vbnd[j][l];
+            }
+            if (end - start <= bucketsize) continue;
+            //split along the widest spatial dimension at the median
+            int splitdim = 0;
+            for (int j = 1; j < 3; j++)
+                if (xbnd[j][1] - xbnd[j][0] > xbnd[splitdim][1] - xbnd[splitdim][0]) splitdim = j;
+            Int_t mid = (start + end) / 2;
+            nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                [&](Int_t a, Int_t b) {
+                    return P[members[a]].GetPosition(splitdim) < P[members[b]].GetPosition(splitdim);
+                });
+            Int_t ileft = gmi.nodes.size();
+            gmi.nodes.push_back(groupmember_node{start, mid, -1, -1});
+            gmi.nodes.push_back(groupmember_node{mid, end, -1, -1});
+            gmi.nodes[inode].left = ileft;
+            gmi.nodes[inode].right = ileft + 1;
+            stack.push_back(ileft);
+            stack.push_back(ileft + 1);
+        }
+    }
+    gmi.member.resize(n);
+    gmi.gid.resize(n);
+    gmi.glen.resize(n);
+    gmi.x.resize(3*n);
+    gmi.v.resize(3*n);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (n > ompsearchnum)
+#endif
+    for (Int_t k = 0; k < n; k++) {
+        Particle &p = P[members[order[k]]];
+        gmi.member[k] = members[order[k]];
+        gmi.gid[k] = gid[order[k]];
+        gmi.glen[k] = glen[order[k]];
+        for (int j = 0; j < 3; j++) {
+            gmi.x[3*k+j] = p.GetPosition(j);
+            gmi.v[3*k+j] = p.GetVelocity(j);
+        }
+    }
+}
+
+/*!
+    Find the member of a \ref GroupMemberIndex closest in phase-space to particle p, where the phase-space distance is
+    \f$ \sum_j (\Delta x_j^2/param[6] + \Delta v_j^2/param[7]) \f$ and must be < 1 (the 6D FOF window).
+    Only members with glen > minlen or with gid == samegroup are candidates.
+    Nodes are visited nearest first and pruned when their phase-space bound exceeds the current best, so the search
+    terminates as soon as no unvisited node could contain a closer candidate.
+    On input dval is the distance to beat, on output it is the distance of the returned member.
+    \return index of the member within the index or -1 if no candidate is closer than dval
+*/
+Int_t SearchGroupMemberIndex(const GroupMemberIndex &gmi, Particle &p, Double_t *param, Double_t *period,
+    Int_t minlen, Int_t samegroup, Double_t &dval)
+{
+    if (gmi.nodes.size() == 0) return -1;
+    Double_t xp[3], vp[3], per[3];
+    for (int j = 0; j < 3; j++) {
+        xp[j] = p.GetPosition(j);
+        vp[j] = p.GetVelocity(j);
+        per[j] = (period == NULL) ? 0 : period[j];
+    }
+    auto nodebound = [&](const groupmember_node &node) {
+        Double_t d = 0, dx, dv;
+        for (int j = 0; j < 3; j++) {
+            dx = GroupMemberBoxDist(xp[j], node.xbnd[j], per[j]);
+            dv = GroupMemberBoxDist(vp[j], node.vbnd[j], 0);
+            d += dx*dx/param[6] + dv*dv/param[7];
+        }
+        return d;
+    };
+    Double_t best = min(dval, (Double_t)1.0), D2, dx, dv;
+    Int_t ibest = -1;
+    vector<Int_t> stack;
+    stack.reserve(128);
+    stack.push_back(0);
+    while (stack.size() > 0) {
+        const groupmember_node &node = gmi.nodes[stack.back()];
+        stack.pop_back();
+        if (nodebound(node) >= best) continue;
+        if (node.left == -1) {
+            for (Int_t k = node.start; k < node.end; k++) {
+                if (gmi.glen[k] <= minlen && gmi.gid[k] != samegroup) continue;
+                D2 = 0;
+                for (int j = 0; j < 3; j++) {
+                    dx = GroupMemberSep(xp[j] - gmi.x[3*k+j], per[j]);
+                    dv = vp[j] - gmi.v[3*k+j];
+                    D2 += dx*dx/param[6] + dv*dv/param[7];
+                }
+                if (D2 < best) {
+                    best = D2;
+                    ibest = k;
+                }
+            }
+            continue;
+        }
+        //push the further child first so the nearer one is searched first
+        Double_t dleft = nodebound(gmi.nodes[node.left]), dright = nodebound(gmi.nodes[node.right]);
+        Int_t inear = node.left, ifar = node.right;
+        if (dright < dleft) {
+            swap(inear, ifar);
+            swap(dleft, dright);
+        }
+        if (dright < best) stack.push_back(ifar);
+        if (dleft < best) stack.push_back(inear);
+    }
+    if (ibest >= 0) dval = best;
+    return ibest;
+}
+
+///Return the order in which to process particles so that consecutive particles are close in space (Morton order)
+vector<Int_t> SpatiallySortedOrder(const Int_t n, Particle *P)
+{
+    vector<Int_t> order(n);
+    if (n == 0) return order;
+    Double_t xmin[3], xmax[3], scale[3];
+    for (int j = 0; j < 3; j++) xmin[j] = xmax[j] = P[0].GetPosition(j);
+    for (Int_t i = 1; i < n; i++) for (int j = 0; j < 3; j++) {
+        xmin[j] = min(xmin[j], P[i].GetPosition(j));
+        xmax[j] = max(xmax[j], P[i].GetPosition(j));
+    }
+    for (int j = 0; j < 3; j++) scale[j] = (xmax[j] > xmin[j]) ? 2097151.0 / (xmax[j] - xmin[j]) : 0;
+    vector<pair<unsigned long long, Int_t>> keys(n);
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (n > ompsearchnum)
+#endif
+    for (Int_t i = 0; i < n; i++) {
+        unsigned long long key = 0;
+        for (int j = 0; j < 3; j++) {
+            unsigned long long c = (P[i].GetPosition(j) - xmin[j]) * scale[j];
+            for (int b = 0; b < 21; b++) key |= ((c >> b) & 1ULL) << (3*b + j);
+        }
+        keys[i] = make_pair(key, i);
+    }
+    OMPSort(keys.begin(), keys.end());
+    for (Int_t i = 0; i < n; i++) order[i] = keys[i].second;
+    return order;
+}
+
 /*!
  * Searches star and gas particles separately to see if they are associated with any dark matter particles belonging to a substructure
  *
@@ -3416,21 +3616,17 @@ private(i)
 */
 Int_t* SearchBaryons(Options &opt, Int_t &nbaryons, Particle *&Pbaryons, const Int_t ndark, vector<Particle> &Part, Int_t *&pfofdark, Int_t &ngroupdark, Int_t &nhalos, int ihaloflag, int iinclusive, PropData *pdata)
 {
-    KDTree *tree;
+    GroupMemberIndex gmi;
+    vector<Int_t> members, membergid, memberglen;
     std::vector<Double_t> period;
+    Double_t *pperiod=NULL;
     Int_t *pfofbaryons, *pfofall, *pfofold;
-    Int_t i,pindex,npartingroups,ng, baryonfofold;
-    Int_t *ids, *storeval,*storeval2;
-    Double_t D2,dval,rval;
-    Coordinate x1;
-    Particle p1;
-    int icheck;
-    FOFcompfunc fofcmp;
+    Int_t i,npartingroups,ng;
+    Int_t *storeval,*storeval2;
     Double_t param[20];
-    int nsearch=opt.Nvel;
-    Int_t *nnID=NULL,*numingroup;
-    Double_t *dist2=NULL, *localdist;
-    int nthreads=1,maxnthreads,tid;
+    Int_t *numingroup;
+    Double_t *localdist;
+    int nthreads=1,maxnthreads;
     Int_t nparts=ndark+nbaryons;
     Int_t nhierarchy=1,gidval;
     StrucLevelData *ppsldata,**papsldata;
@@ -3534,45 +3730,46 @@ Int_t* SearchBaryons(Options &opt, Int_t &nbaryons, Particle *&Pbaryons, const I
     //build a particle list containing only dark matter particles
     numingroup=BuildNumInGroup(ndark, ngroupdark, pfofdark);
 
-    //determine total number of particles in groups and set search appropriately
-    npartingroups=0;
-    for (i=1;i<=ngroupdark;i++) npartingroups+=numingroup[i];
-    if (npartingroups<=2*opt.MinSize) nsearch=npartingroups-1;
-    else nsearch=2*opt.MinSize;
+    //index the dark matter particles belonging to groups in place rather than sorting them to the front of the particle array.
+    //If all particles have been searched, baryons can only move to substructures or stay in their own fof group
+    //so only substructure members are given a group length
+    for (i=0;i<ndark;i++) if (pfofdark[i]>0) members.push_back(i);
+    npartingroups=members.size();
+    membergid.resize(npartingroups);
+    memberglen.resize(npartingroups);
+    for (i=0;i<npartingroups;i++) {
+        gidval=pfofdark[members[i]];
+        membergid[i]=gidval;
+        if (opt.partsearchtype==PSTALL) memberglen[i]=(gidval>nhalos)*numingroup[gidval];
+        else memberglen[i]=numingroup[gidval];
+    }
     if (opt.p>0) {
         period = std::vector<Double_t>(3, opt.p);
+        pperiod = period.data();
     }
+    LOG(info) << "Index dark matter particles in groups " << npartingroups;
 
-    //sort dark matter particles so that particles belonging to a group are first, then all other dm particles
-    LOG(info) << "Sort particles so that tree only uses particles in groups " << npartingroups;
-
-    //search all dm particles in structures
-    for (i=0;i<ndark;i++) Part[i].SetPotential(2*(pfofdark[i]==0)+(pfofdark[i]>1));
-    // qsort(Part.data(), ndark, sizeof(Particle), PotCompare);
-    std::sort(Part.data(), Part.data() + ndark, PotCompareVec);
-    ids=new Int_t[ndark+1];
-    //store the original order of the dark matter particles
-    for (i=0;i<ndark;i++) ids[i]=Part[i].GetID();
-
-    if (npartingroups>0) {
     //set parameters, first to some fraction of halo linking length
     param[1]=(opt.ellxscale*opt.ellxscale)*(opt.ellphys*opt.ellphys)*(opt.ellhalophysfac*opt.ellhalophysfac);
     param[6]=param[1];
+    if (npartingroups>0) {
     //also check to see if velocity scale still zero find dispersion of largest halo
     //otherwise search uses the largest average "local" velocity dispersion of halo identified in the mpi domain.
     if (opt.HaloVelDispScale==0) {
         Double_t mtotregion,vx,vy,vz;
         Coordinate vmean;
         mtotregion=vx=vy=vz=0;
-        for (i=0;i<numingroup[1];i++) {
-            vx+=Part[i].GetVelocity(0)*Part[i].GetMass();
-            vy+=Part[i].GetVelocity(1)*Part[i].GetMass();
-            vz+=Part[i].GetVelocity(2)*Part[i].GetMass();
-            mtotregion+=Part[i].GetMass();
+        for (auto index:members) {
+            if (pfofdark[index]!=1) continue;
+            vx+=Part[index].GetVelocity(0)*Part[index].GetMass();
+            vy+=Part[index].GetVelocity(1)*Part[index].GetMass();
+            vz+=Part[index].GetVelocity(2)*Part[index].GetMass();
+            mtotregion+=Part[index].GetMass();
         }
         vmean[0]=vx/mtotregion;vmean[1]=vy/mtotregion;vmean[2]=vz/mtotregion;
-        for (i=0;i<numingroup[1];i++) {
-            for (int j=0;j<3;j++) opt.HaloVelDispScale+=pow(Part[i].GetVelocity(j)-vmean[j],2.0)*Part[i].GetMass();
+        for (auto index:members) {
+            if (pfofdark[index]!=1) continue;
+            for (int j=0;j<3;j++) opt.HaloVelDispScale+=pow(Part[index].GetVelocity(j)-vmean[j],2.0)*Part[index].GetMass();
         }
         opt.HaloVelDispScale/=mtotregion;
         param[2]=opt.HaloVelDispScale;
@@ -3580,84 +3777,47 @@ Int_t* SearchBaryons(Options &opt, Int_t &nbaryons, Particle *&Pbaryons, const I
     else param[2]=opt.HaloVelDispScale*16.0;//here use factor of 4 in local dispersion //could remove entirely and just use global dispersion but this will over compensate.
     param[7]=param[2];
 
-    //Set fof type
-    fofcmp=&FOF6d;
     if (LOG_ENABLED(debug)) {
         LOG(debug) << "Baryon search " << nbaryons;
         LOG(debug) << "FOF6D uses ellphys and ellvel";
         LOG(debug) << "Parameters used are: ellphys=" << std::sqrt(param[6])
                    <<" Lunits, ellvel=" << std::sqrt(param[7]) << " Vunits.";
-        LOG(debug) << "Building tree to search dm containing " << npartingroups;
+        LOG(debug) << "Building index to search dm containing " << npartingroups;
     }
-    //build tree of baryon particles (in groups if a full particle search was done, otherwise npartingroups=nbaryons
-    tree=new KDTree(Part.data(),npartingroups,nsearch/2,tree->TPHYS,tree->KEPAN,100,0,0,0,period.data());
-    //allocate memory for search
-    //find the closest dm particle that belongs to the largest dm group and associate the baryon with that group (including phase-space window)
+    //build phase-space index of dark matter particles in groups
+    BuildGroupMemberIndex(gmi, Part.data(), members, membergid, memberglen, opt.Bsize);
+    //find the dm particle closest in phase-space (within the 6D linking window) that belongs to a group the baryon can join
+    //and associate the baryon with that group. Baryons are processed in spatially sorted batches to reuse the index nodes
     LOG(debug) << "Searching ...";
+    vector<Int_t> baryonorder=SpatiallySortedOrder(nbaryons, Pbaryons);
 #ifdef USEOPENMP
-#pragma omp parallel default(shared) \
-private(i,tid,p1,pindex,x1,D2,dval,rval,icheck,nnID,dist2,baryonfofold)
-{
-    nnID=new Int_t[nsearch];
-    dist2=new Double_t[nsearch];
-#pragma omp for
-#else
-    nnID=new Int_t[nsearch];
-    dist2=new Double_t[nsearch];
+#pragma omp parallel for schedule(dynamic,ompbaryonbatchsize) if (nbaryons>ompsearchnum)
 #endif
-    for (i=0;i<nbaryons;i++)
+    for (Int_t ii=0;ii<nbaryons;ii++)
     {
-#ifdef USEOPENMP
-        tid=omp_get_thread_num();
-#else
-        tid=0;
-#endif
-
+        Int_t ib=baryonorder[ii], ibest, minlen, samegroup;
+        Double_t dval=MAXVALUE;
         //if all particles have been searched for field objects then ignore baryons not associated with a group
-        if (opt.partsearchtype==PSTALL && pfofbaryons[i]==0) continue;
-        p1=Pbaryons[i];
-        x1=Coordinate(p1.GetPosition());
-        rval=dval=MAXVALUE;
-        baryonfofold=pfofbaryons[i];
-        tree->FindNearestPos(x1, nnID, dist2,nsearch);
-        if (dist2[0]<param[6]) {
-        for (int j=0;j<nsearch;j++) {
-            D2=0;
-            pindex=ids[Part[nnID[j]].GetID()];
-            //determine if baryonic particle needs to be searched. Note that if all particles have been searched during FOF
-            //then particle is checked regardless. If that is not the case, particle is searched only if its current group
-            //is smaller than the group of the dm particle being examined.
-            //But do not allow baryons to switch between fof structures
-            if (opt.partsearchtype==PSTALL) icheck=((pfofdark[pindex]>nhalos)||(pfofdark[pindex]==baryonfofold));
-            else icheck=(numingroup[pfofbaryons[i]]<numingroup[pfofdark[pindex]]);
-            if (icheck) {
-                if (fofcmp(p1,Part[nnID[j]],param)) {
-                    for (int k=0;k<3;k++) {
-                        D2+=(p1.GetPosition(k)-Part[nnID[j]].GetPosition(k))*(p1.GetPosition(k)-Part[nnID[j]].GetPosition(k))/param[6]+(p1.GetVelocity(k)-Part[nnID[j]].GetVelocity(k))*(p1.GetVelocity(k)-Part[nnID[j]].GetVelocity(k))/param[7];
-                    }
-                    //if gas thermal properties stored then also add self-energy to distance measure
+        if (opt.partsearchtype==PSTALL && pfofbaryons[ib]==0) continue;
+        //Note that if all particles have been searched during FOF then particle is checked regardless but
+        //baryons are not allowed to switch between fof structures. If that is not the case, a dm particle is
+        //only a candidate if its group is larger than the current group of the baryon.
+        if (opt.partsearchtype==PSTALL) {minlen=0;samegroup=pfofbaryons[ib];}
+        else {minlen=numingroup[pfofbaryons[ib]];samegroup=-1;}
+        ibest=SearchGroupMemberIndex(gmi, Pbaryons[ib], param, pperiod, minlen, samegroup, dval);
+        if (ibest<0) continue;
+        pfofbaryons[ib]=gmi.gid[ibest];
+#ifdef USEMPI
+        //if gas thermal properties stored then also add self-energy to distance measure
 #ifdef GASON
-                    D2+=p1.GetU()/param[7];
+        dval+=Pbaryons[ib].GetU()/param[7];
 #endif
-                    //check to see if phase-space distance is small
-                    if (dval>D2) {
-                        dval=D2;pfofbaryons[i]=pfofdark[pindex];
-                        rval=dist2[j];
-#ifdef USEMPI
-                        if (opt.partsearchtype!=PSTALL) localdist[i]=dval;
+        if (opt.partsearchtype!=PSTALL) localdist[ib]=dval;
 #endif
-                    }
-                }
-            }
-        }
-        }
     }
-    delete[] nnID;
-    delete[] dist2;
-#ifdef USEOPENMP
-}
-#endif
     }
+    //free the index, only the member list is still needed
+    gmi=GroupMemberIndex();
 
 #ifdef USEMPI
     //if mpi then baryons are not necessarily local if opt.partsearchtype!=PSTALL
@@ -3667,29 +3827,13 @@ private(i,tid,p1,pindex,x1,D2,dval,rval,icheck,nnID,dist2,baryonfofold)
     if (opt.partsearchtype!=PSTALL) {
         LOG(debug) << "Finished local search";
         MPI_Barrier(MPI_COMM_WORLD);
-        //determine all tagged dark matter particles that have search areas that overlap another mpi domain
-        if (opt.impiusemesh) MPIGetExportNumUsingMesh(opt, npartingroups, Part.data(), sqrt(param[1]));
-        else MPIGetExportNum(npartingroups, Part.data(), sqrt(param[1]));
         //to store local mpi task
         mpi_foftask=MPISetTaskID(nbaryons);
-        //then determine export particles, declare arrays used to export data
-        PartDataIn = new Particle[NExport+1];
-        PartDataGet = new Particle[NImport+1];
-        FoFDataIn = new fofdata_in[NExport+1];
-        FoFDataGet = new fofdata_in[NImport+1];
-        //exchange particles
-
-        MPIBuildParticleExportBaryonSearchList(opt, npartingroups, Part.data(), pfofdark, ids, numingroup, sqrt(param[1]));
+        //determine all tagged dark matter particles that have search areas that overlap another mpi domain and exchange them
+        MPIBuildParticleExportBaryonSearchList(opt, members, Part.data(), pfofdark, numingroup, sqrt(param[1]));
 
         //now dark matter particles associated with a group existing on another mpi domain are local and can be searched.
-        NExport=MPISearchBaryons(nbaryons, Pbaryons, pfofbaryons, numingroup, localdist, nsearch, param, period.data());
-
-        //reset order
-        delete tree;
-        for (i=0;i<ndark;i++) Part[i].SetID(ids[i]);
-        // qsort(Part.data(), ndark, sizeof(Particle), IDCompare);
-        std::sort(Part.data(), Part.data() + ndark, IDCompareVec);
-        delete[] ids;
+        NExport=MPISearchBaryons(nbaryons, Pbaryons, pfofbaryons, numingroup, localdist, opt.Bsize, param, pperiod);
 
         //reorder local particle array and delete memory associated with Head arrays, only need to keep Particles, pfof and some id and idexing information
         delete[] FoFDataIn;
@@ -3732,11 +3876,6 @@ private(i,tid,p1,pindex,x1,D2,dval,rval,icheck,nnID,dist2,baryonfofold)
     } // end of if preliminary search is NOT all particles
     else {
         //reset order
-        if (npartingroups>0) delete tree;
-        for (i=0;i<ndark;i++) Part[i].SetID(ids[i]);
-        // qsort(Part.data(), ndark, sizeof(Particle), IDCompare);
-        std::sort(Part.data(), Part.data()+ ndark, IDCompareVec);
-        delete[] ids;
         for (i=0;i<nparts;i++) {Part[i].SetPID(pfofall[Part[i].GetID()]);Part[i].SetID(storeval[i]);}
         // qsort(Part.data(), nparts, sizeof(Particle), IDCompare);
         std::sort(Part.begin(), Part.end(), IDCompareVec);
@@ -3749,15 +3888,10 @@ private(i,tid,p1,pindex,x1,D2,dval,rval,icheck,nnID,dist2,baryonfofold)
     }
 //if NOT mpi
 #else
-    //now that search has finished, reset dark matter particles back to prior to search order
-    //extra sorts are needed to reset the particles back to input order if all particles were searched initially
+    //now that search has finished, reset particles back to input order if all particles were searched initially,
+    //dark matter particles were not reordered by the search itself
     if (opt.partsearchtype==PSTALL) {
         //reset order
-        if (npartingroups>0) delete tree;
-        for (i=0;i<ndark;i++) Part[i].SetID(ids[i]);
-        // qsort(Part.data(), ndark, sizeof(Particle), IDCompare);
-        std::sort(Part.data(), Part.data()+ndark, IDCompareVec);
-        delete[] ids;
         for (i=0;i<nparts;i++) {Part[i].SetPID(pfofall[Part[i].GetID()]);Part[i].SetID(storeval[i]);}
         // qsort(Part.data(), nparts, sizeof(Particle), IDCompare);
         std::sort(Part.begin(), Part.end(), IDCompareVec);
@@ -3769,11 +3903,6 @@ private(i,tid,p1,pindex,x1,D2,dval,rval,icheck,nnID,dist2,baryonfofold)
         delete[] storeval2;
     }
     else {
-        delete tree;
-        for (i=0;i<ndark;i++) Part[i].SetID(ids[i]);
-        // qsort(Part.data(), ndark, sizeof(Particle), IDCompare);
-        std::sort(Part.data(), Part.data() + ndark, IDCompareVec);
-        delete[] ids;
         for (i=0;i<nbaryons;i++) Pbaryons[i].SetID(i+ndark);
     }
 #endif
@@ -3,6 +3,7 @@
  */
 
 #include <algorithm>
+#include <deque>
 
 #include "logging.h"
 #include "stf.h"
@@ -28,6 +29,332 @@ inline bool CheckForSOInclCalc(Options &opt, PropData &pdata) {
         pdata.stype <= opt.SphericalOverdensitySeachMaxStructLevel);
 }
 
+///Seed the SO search of each group with the previous snapshot's SO radius of the structure it is matched to
+///(see \ref ReadWarmStart), grown by opt.warmstartsoradiusfac and no smaller than the group size. The result is
+///stored in startrdist and used as the first shell of \ref GatherSOBatch, so the search still widens up to
+///maxrdist if the thresholds are not crossed within it (the halo has grown or was matched to a smaller
+///progenitor). prevradius(i) returns the previous radius matched to group i, or zero if it has none
+template<typename PrevRadius> void WarmStartSOSearchRadii(Options &opt, Int_t ngroup, PropData *pdata,
+    const vector<Double_t> &maxrdist, vector<Double_t> &startrdist, PrevRadius prevradius)
+{
+    startrdist.assign(ngroup+1, 0);
+    if (opt.warmstart.soradius.size() == 0) return;
+    Int_t nseeded = 0;
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:nseeded) if (ngroup > omppropnum)
+#endif
+    for (Int_t i=1;i<=ngroup;i++) {
+        if (maxrdist[i] == 0) continue;
+        Double_t r = prevradius(i);
+        if (r <= 0) continue;
+        r = max(r*opt.warmstartsoradiusfac, pdata[i].gsize);
+        if (r < maxrdist[i]) {
+            startrdist[i] = r;
+            nseeded++;
+        }
+    }
+    LOG(debug) << "Warm start seeded the SO search radius of " << nseeded << " of " << ngroup << " groups";
+}
+
+///Return the reference position about which the properties of a structure are calculated
+inline Coordinate GetPropertyReferencePosition(Options &opt, PropData &pdata) {
+    if (opt.iPropertyReferencePosition == PROPREFMBP) return pdata.gposmbp;
+    else if (opt.iPropertyReferencePosition == PROPREFMINPOT) return pdata.gposminpot;
+    return pdata.gcm;
+}
+
+///Key ordering particles by their distance from the origin of the current reference frame, see \ref SortParticlesByKey
+inline Double_t RadiusKey(Particle &p) {
+    return p.GetPosition(0)*p.GetPosition(0)+p.GetPosition(1)*p.GetPosition(1)+p.GetPosition(2)*p.GetPosition(2);
+}
+
+///Shift the positions of the particles of a structure by sign*cmref, splitting large structures across threads
+inline void ShiftGroupPositions(const Int_t n, Particle *P, const Coordinate &cmref, const Double_t sign) {
+#ifdef USEOPENMP
+#pragma omp parallel for schedule(static) if (n>=omppropnum && !omp_in_parallel())
+#endif
+    for (Int_t j=0;j<n;j++) for (int k=0;k<3;k++) P[j].SetPosition(k, P[j].GetPosition(k) + sign*cmref[k]);
+}
+
+///Distance along one dimension from x to the interval [lo,hi], using the nearest periodic image if period>0
+inline Double_t PeriodicIntervalDist(Double_t x, Double_t lo, Double_t hi, Double_t period) {
+    auto dist = [lo,hi](Double_t y) {return (y < lo) ? lo - y : ((y > hi) ? y - hi : 0);};
+    Double_t d = dist(x);
+    if (period > 0 && d > 0) d = min({d, dist(x + period), dist(x - period)});
+    return d;
+}
+
+///Largest distance along one dimension from x to a point of the interval [lo,hi], using the nearest periodic
+///image of each point if period>0
+inline Double_t PeriodicIntervalMaxDist(Double_t x, Double_t lo, Double_t hi, Double_t period) {
+    if (period <= 0) return max(fabs(x - lo), fabs(x - hi));
+    //the farthest a point can be is half a period, reached if an image of x+period/2 lies in the interval
+    Double_t xfar = x + 0.5*period;
+    xfar -= floor((xfar - lo)/period)*period;
+    if (xfar <= hi) return 0.5*period;
+    auto wrap = [period](Double_t d) {d = fabs(d); d -= floor(d/period)*period; return min(d, period - d);};
+    return max(wrap(x - lo), wrap(x - hi));
+}
+
+///Fixed radius searches about a batch of centres made with a single walk of a tree. The nodes are culled
+///against the balls still overlapping their parent, so nodes shared by the overlapping spheres of nearby
+///(sub)structures are visited once per batch. The particles found are stored in compressed rows (one row per
+///centre) holding the particle's index in the tree's particle array and its (periodic) distance to the
+///centre. The buffers are kept between batches so a thread reuses the same storage for every batch.
+///Searches can also be made in successive radial shells (\ref Begin, \ref SearchShells, \ref Finish),
+///keeping the mass enclosed by the shells searched so far about each centre
+class BallSearchBatch
+{
+public:
+    ///Search the tree (built over Part) about the centres of the groups in batch, each with radius
+    ///rdist[group]. Groups with overlap[group] false (if given) are not searched
+    void Search(KDTree *tree, Particle *Part, Double_t period, const vector<Int_t> &batch,
+        const vector<Coordinate> &centres, const vector<Double_t> &rdist, const vector<bool> *overlap = NULL)
+    {
+        Begin(batch, centres);
+        ballin.assign(batch.size(), 0);
+        ballout.resize(batch.size());
+        for (size_t c=0;c<batch.size();c++) ballout[c] = rdist[batch[c]];
+        SearchShells(tree, Part, period, ballin, ballout, overlap);
+        Finish();
+    }
+    ///Start a shell search about the centres of the groups in batch
+    void Begin(const vector<Int_t> &batch, const vector<Coordinate> &centres)
+    {
+        int ncentres = batch.size();
+        hits.clear();
+        groups.assign(batch.begin(), batch.end());
+        pos.resize(ncentres);
+        for (auto c=0;c<ncentres;c++) pos[c] = centres[batch[c]];
+        r2in.resize(ncentres);
+        r2.resize(ncentres);
+        mass.assign(ncentres, 0);
+    }
+    ///Add the particles in the shell rin[c] <= r < rout[c] about the c-th centre of the batch. Centres with
+    ///rout[c] <= rin[c] or with overlap[group] false (if given) are not searched
+    void SearchShells(KDTree *tree, Particle *Part, Double_t period,
+        const vector<Double_t> &rin, const vector<Double_t> &rout, const vector<bool> *overlap = NULL)
+    {
+        if (activelevels.size() == 0) activelevels.resize(1);
+        auto &active = activelevels[0];
+        active.clear();
+        for (size_t c=0;c<groups.size();c++) {
+            r2in[c] = rin[c]*rin[c];
+            r2[c] = rout[c]*rout[c];
+            if (rout[c] > rin[c] && (overlap == NULL || (*overlap)[groups[c]])) active.push_back(c);
+        }
+        if (tree != NULL && active.size() > 0) Walk(tree->GetRoot(), 0, Part, period);
+    }
+    ///Place the particles found in rows ordered by centre
+    void Finish()
+    {
+        int ncentres = groups.size();
+        offset.assign(ncentres+1, 0);
+        for (auto &h:hits) offset[h.centre+1]++;
+        for (auto c=0;c<ncentres;c++) offset[c+1] += offset[c];
+        index.resize(hits.size());
+        radius.resize(hits.size());
+        fill.assign(offset.begin(), offset.end()-1);
+        for (auto &h:hits) {
+            auto j = fill[h.centre]++;
+            index[j] = h.index;
+            radius[j] = h.radius;
+        }
+    }
+    ///number of particles found about the c-th centre of the batch
+    Int_t Size(int c) const {return offset[c+1] - offset[c];}
+    ///indices (in the tree's particle array) of the particles found about the c-th centre of the batch
+    const Int_t *Index(int c) const {return index.data() + offset[c];}
+    ///distances to the c-th centre of the batch of the particles found about it
+    const Double_t *Radius(int c) const {return radius.data() + offset[c];}
+    ///mass of the particles found so far about the c-th centre of the batch (number of particles if NOMASS)
+    Double_t Mass(int c) const {return mass[c];}
+
+private:
+    struct hit {
+        int centre;
+        Int_t index;
+        Double_t radius;
+    };
+    vector<Int_t> groups;
+    vector<Coordinate> pos;
+    vector<Double_t> r2in, r2, mass, ballin, ballout;
+    vector<hit> hits;
+    vector<Int_t> offset, fill, index;
+    vector<Double_t> radius;
+    ///centres whose shells overlap the node at each depth of the walk
+    deque<vector<int>> activelevels;
+
+    void Walk(Node *np, int depth, Particle *Part, Double_t period)
+    {
+        //leaves are told apart by the node's type rather than its count, so the walk does not depend on
+        //the bucket size the tree was built with
+        //growing a deque keeps references to the existing levels valid
+        if (activelevels.size() < (size_t)depth+2) activelevels.resize(depth+2);
+        auto &active = activelevels[depth];
+        if (auto split = dynamic_cast<SplitNode*>(np)) {
+            auto &childactive = activelevels[depth+1];
+            for (auto child : {split->GetLeft(), split->GetRight()}) {
+                childactive.clear();
+                for (auto c:active) {
+                    Double_t d2 = 0, dmax2 = 0;
+                    for (auto k=0;k<3;k++) {
+                        Double_t d = PeriodicIntervalDist(pos[c][k], child->GetBoundary(k,0), child->GetBoundary(k,1), period);
+                        d2 += d*d;
+                    }
+                    if (d2 >= r2[c]) continue;
+                    //skip nodes lying entirely within the inner edge of the shell
+                    if (r2in[c] > 0) {
+                        for (auto k=0;k<3;k++) {
+                            Double_t d = PeriodicIntervalMaxDist(pos[c][k], child->GetBoundary(k,0), child->GetBoundary(k,1), period);
+                            dmax2 += d*d;
+                        }
+                        if (dmax2 < r2in[c]) continue;
+                    }
+                    childactive.push_back(c);
+                }
+                if (childactive.size() > 0) Walk(child, depth+1, Part, period);
+            }
+            return;
+        }
+        for (auto j=np->GetStart();j<np->GetEnd();j++) {
+            for (auto c:active) {
+                Double_t d2 = 0;
+                for (auto k=0;k<3;k++) {
+                    Double_t dx = Part[j].GetPosition(k) - pos[c][k];
+                    if (period > 0) {
+                        if (dx > period*0.5) dx -= period;
+                        else if (dx < -period*0.5) dx += period;
+                    }
+                    d2 += dx*dx;
+                }
+                if (d2 < r2[c] && d2 >= r2in[c]) {
+                    hits.push_back({c, j, sqrt(d2)});
+#ifndef NOMASS
+                    mass[c] += Part[j].GetMass();
+#else
+                    mass[c] += 1.0;
+#endif
+                }
+            }
+        }
+    }
+};
+
+///Order the groups along a Morton curve of their search centres and split them into batches of
+///\ref ompgroupbatchsize searched together with \ref BallSearchBatch. Groups with more than
+///\ref omppropnum particles are searched on their own to bound the memory held by a batch. Groups without
+///a search radius are kept in the batches, finding no particles, so their properties are still set
+vector<vector<Int_t>> BuildBallSearchBatches(Int_t ngroup, Int_t *numingroup,
+    const vector<Coordinate> &centres, const vector<Double_t> &rdist)
+{
+    vector<vector<Int_t>> batches;
+    vector<pair<unsigned long long,Int_t>> keys;
+    Coordinate xmin(MAXVALUE), xmax(-MAXVALUE);
+    for (Int_t i=1;i<=ngroup;i++) {
+        if (numingroup[i] > omppropnum) {
+            batches.push_back(vector<Int_t>(1,i));
+            continue;
+        }
+        keys.push_back(make_pair(0ULL,i));
+        for (auto k=0;k<3;k++) {
+            xmin[k] = min(xmin[k], centres[i][k]);
+            xmax[k] = max(xmax[k], centres[i][k]);
+        }
+    }
+    //interleave 21 bits of each normalised coordinate
+    for (auto &key:keys) {
+        for (auto k=0;k<3;k++) {
+            Double_t width = max(xmax[k] - xmin[k], (Double_t)1e-30);
+            unsigned long long ix = (unsigned long long)min((centres[key.second][k] - xmin[k]) / width * 2097151.0, 2097151.0);
+            for (auto b=0;b<21;b++) key.first |= ((ix >> b) & 1ULL) << (3*b + k);
+        }
+    }
+    sort(keys.begin(), keys.end());
+    for (size_t start=0;start<keys.size();start+=ompgroupbatchsize) {
+        batches.emplace_back();
+        for (size_t j=start;j<min(keys.size(), start+ompgroupbatchsize);j++) batches.back().push_back(keys[j].second);
+    }
+    return batches;
+}
+
+///Gather the particles about the centres of a batch of groups for the SO calculation. If ishell, successive
+///radial shells are searched, starting at rstart[group] if that is positive (see \ref WarmStartSOSearchRadii),
+///otherwise at rdist/\ref Options::SphericalOverdensitySeachFac, and growing by
+///\ref Options::SphericalOverdensityShellFac. A group stops once the (log10) mean density enclosed by its
+///outermost shell is below lgrhothreshold, which lies below every overdensity threshold, or once the shell
+///reaches rdist. Otherwise the whole ball of radius rdist is searched. The imported particles in treeimport
+///(if any) of groups with overlap[group] true are gathered in the same shells so the enclosed mass is complete.
+///Returns the number of groups whose search had to widen beyond a positive rstart
+Int_t GatherSOBatch(Options &opt, bool ishell, Double_t lgrhothreshold,
+    const vector<Int_t> &batch, const vector<Coordinate> &centres, const vector<Double_t> &rdist,
+    const vector<Double_t> &rstart,
+    BallSearchBatch &balls, KDTree *tree, Particle *Part,
+    BallSearchBatch &ballsimport, KDTree *treeimport, Particle *PartImport, const vector<bool> *overlap)
+{
+    if (!ishell) {
+        balls.Search(tree, Part, opt.p, batch, centres, rdist);
+        if (treeimport != NULL) ballsimport.Search(treeimport, PartImport, opt.p, batch, centres, rdist, overlap);
+        return 0;
+    }
+    int ncentres = batch.size(), nopen = 0;
+    Int_t nwidened = 0;
+    vector<Double_t> rin(ncentres, 0), rout(ncentres, 0);
+    for (auto c=0;c<ncentres;c++) {
+        if (rdist[batch[c]] <= 0) continue;
+        if (rstart[batch[c]] > 0) rout[c] = min(rstart[batch[c]], rdist[batch[c]]);
+        else rout[c] = rdist[batch[c]]/max(opt.SphericalOverdensitySeachFac, (Double_t)1.0);
+        nopen++;
+    }
+    balls.Begin(batch, centres);
+    ballsimport.Begin(batch, centres);
+    const Double_t fac = 3.0/(4.0*M_PI);
+    while (nopen > 0) {
+        balls.SearchShells(tree, Part, opt.p, rin, rout);
+        if (treeimport != NULL) ballsimport.SearchShells(treeimport, PartImport, opt.p, rin, rout, overlap);
+        nopen = 0;
+        for (auto c=0;c<ncentres;c++) {
+            if (rout[c] <= rin[c]) continue;
+            Double_t encmass = balls.Mass(c);
+            if (treeimport != NULL) encmass += ballsimport.Mass(c);
+#ifdef NOMASS
+            encmass *= opt.MassValue;
+#endif
+            rin[c] = rout[c];
+            if (rout[c] >= rdist[batch[c]]) continue;
+            if (encmass > 0 && std::log10(fac*encmass*std::pow(rout[c],-3.0)) < lgrhothreshold) continue;
+            rout[c] = min(rout[c]*opt.SphericalOverdensityShellFac, rdist[batch[c]]);
+            nopen++;
+        }
+    }
+    for (auto c=0;c<ncentres;c++) if (rstart[batch[c]] > 0 && rin[c] > rstart[batch[c]]) nwidened++;
+    balls.Finish();
+    ballsimport.Finish();
+    return nwidened;
+}
+
+///check whether halo spherical overdensity regions overlapping other mpi domains can be evaluated with partial
+///radial profiles from those domains rather than importing particles. Not possible if per particle information
+///(ids, extra fields, hot gas temperatures) is needed
+inline bool CheckForSORemoteProfileCalc(Options &opt) {
+#ifdef NOMASS
+    return false;
+#endif
+    if (!opt.iSphericalOverdensityRemoteProfile) return false;
+    if (opt.iSphericalOverdensityPartList || opt.iSphericalOverdensityExtraFieldCalculations) return false;
+    if (opt.aperture_hotgas_normalised_to_overdensity.size() > 0) return false;
+    return true;
+}
+
+///check whether the particles about SO centres can be gathered in expanding shells that stop once all overdensity
+///thresholds are crossed. Not possible if particles beyond the outermost SO radius are needed (radial profiles,
+///hot gas apertures scaled by an SO radius)
+inline bool CheckForSOShellGather(Options &opt) {
+    if (opt.iprofilecalc) return false;
+    if (opt.aperture_hotgas_normalised_to_overdensity.size() > 0) return false;
+    return true;
+}
+
 /*!
     The routine is used to calculate CM of groups.
  */
@@ -359,41 +686,35 @@ void GetProperties(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngro
         }
     }
 
-    //for all groups, move particles to their appropriate reference frame
-#ifdef USEOPENMP
-#pragma omp parallel default(shared)  \
-private(i,j,k,Pval,cmref)
-{
-    #pragma omp for schedule(dynamic) nowait
-#endif
-    for (i=1;i<=ngroup;i++)
-    {
-        if (opt.iPropertyReferencePosition == PROPREFCM) cmref=pdata[i].gcm;
-        else if (opt.iPropertyReferencePosition == PROPREFMBP) cmref=pdata[i].gposmbp;
-        else if (opt.iPropertyReferencePosition == PROPREFMINPOT) cmref=pdata[i].gposminpot;
-        for (j=0;j<numingroup[i];j++)
-        {
-            Pval=&Part[j+noffset[i]];
-            for (k=0;k<3;k++) Pval->SetPosition(k, Pval->GetPosition(k) - cmref[k]);
-        }
-        //sort by radius (here use gsl_heapsort as no need to allocate more memory
-        gsl_heapsort(&Part[noffset[i]], numingroup[i], sizeof(Particle), RadCompare);
+    //Each small group is processed by a single task that moves its particles to the reference frame,
+    //sorts them radially, calculates all enabled properties (bulk, SO, extra properties, apertures,
+    //profiles and morphology) while the particles of the group are still in cache and then resets
+    //their positions. Tasks are scheduled largest group first to balance their cost. Large groups are
+    //processed one at a time with each step split across threads.
+    vector<Int_t> smallgroups, largegroups;
+    for (i=1;i<=ngroup;i++) {
+        if (numingroup[i]<omppropnum) smallgroups.push_back(i);
+        else largegroups.push_back(i);
     }
-#ifdef USEOPENMP
-}
-#endif
+    std::stable_sort(smallgroups.begin(), smallgroups.end(), [&](Int_t a, Int_t b) {return numingroup[a]>numingroup[b];});
 
     //for small groups loop over groups
 #ifdef USEOPENMP
 #pragma omp parallel default(shared)  \
-private(i,j,k,Pval,ri,rcmv,r2,cmx,cmy,cmz,EncMass,Ninside,cmold,change,tol)\
+private(i,j,k,Pval,ri,rcmv,r2,cmx,cmy,cmz,EncMass,Ninside,cmold,cmref,change,tol)\
 private(x,y,z,vx,vy,vz,vc,rc,jval,jzval,Rdist,zdist,Ekin,Krot,mval,RV_Ekin,RV_Krot,RV_num,SFR)\
 private(EncMassSF,EncMassNSF,Krot_sf,Krot_nsf,Ekin_sf,Ekin_nsf)
 {
-    #pragma omp for schedule(dynamic) nowait
+    #pragma omp for schedule(dynamic,1) nowait
 #endif
-    for (i=1;i<=ngroup;i++) if (numingroup[i]<omppropnum)
+    for (Int_t igroup=0;igroup<(Int_t)smallgroups.size();igroup++)
     {
+        i=smallgroups[igroup];
+        //move particles to their appropriate reference frame and sort by radius
+        cmref=GetPropertyReferencePosition(opt, pdata[i]);
+        ShiftGroupPositions(numingroup[i], &Part[noffset[i]], cmref, -1.0);
+        SortParticlesByKey(&Part[noffset[i]], numingroup[i], RadiusKey);
+
         //if (opt.iInclusiveHalo == 0 && pdata[i].hostid==-1) pdata[i].gMFOF=pdata[i].gmass;
         pdata[i].gsize=Part[noffset[i]+numingroup[i]-1].Radius();
         RV_num = 0;
@@ -1170,14 +1491,22 @@ private(EncMassSF,EncMassNSF,Krot_sf,Krot_nsf,Ekin_sf,Ekin_nsf)
         GetGlobalSpatialMorphology(numingroup[i], &Part[noffset[i]], pdata[i].gq, pdata[i].gs, 1e-2, pdata[i].geigvec,1);
         if (RV_num>=PROPMORPHMINNUM) GetGlobalSpatialMorphology(RV_num, &Part[noffset[i]], pdata[i].RV_q, pdata[i].RV_s, 1e-2, pdata[i].RV_eigvec,1);
 #endif
+        //reset particle positions
+        ShiftGroupPositions(numingroup[i], &Part[noffset[i]], cmref, 1.0);
     }
 #ifdef USEOPENMP
 }
 #endif
 
     //large groups
-    for (i=1;i<=ngroup;i++) if (numingroup[i]>=omppropnum)
+    for (Int_t igroup=0;igroup<(Int_t)largegroups.size();igroup++)
     {
+        i=largegroups[igroup];
+        //move particles to their appropriate reference frame and sort by radius
+        cmref=GetPropertyReferencePosition(opt, pdata[i]);
+        ShiftGroupPositions(numingroup[i], &Part[noffset[i]], cmref, -1.0);
+        SortParticlesByKey(&Part[noffset[i]], numingroup[i], RadiusKey);
+
         pdata[i].gsize=Part[noffset[i]+numingroup[i]-1].Radius();
         RV_num = 0;
         //determine overdensity mass and radii. AGAIN REMEMBER THAT THESE ARE NOT MEANINGFUL FOR TIDAL DEBRIS
@@ -2098,85 +2427,37 @@ private(j,Pval,x,y,z,vx,vy,vz,jval,jzval,zdist,Rdist)
         GetGlobalSpatialMorphology(numingroup[i], &Part[noffset[i]], pdata[i].gq, pdata[i].gs, 1e-2, pdata[i].geigvec,1);
         if (RV_num>=PROPMORPHMINNUM) GetGlobalSpatialMorphology(RV_num, &Part[noffset[i]], pdata[i].RV_q, pdata[i].RV_s, 1e-2, pdata[i].RV_eigvec,1);
 #endif
+        //if calculating profiles
+        if (opt.iprofilecalc) {
+            double irnorm;
+            //as particles are radially sorted, init the radial bin at zero
+            int ibin=0;
+            if (opt.iprofilenorm == PROFILERNORMR200CRIT) irnorm = 1.0/pdata[i].gR200c;
+            else irnorm = 1.0;
+            for (j=0;j<numingroup[i];j++) {
+                Pval = &Part[noffset[i] + j];
+                AddParticleToRadialBin(opt, Pval, irnorm, ibin, pdata[i]);
+            }
+        }
     }
 
-    //large groups aperture calculation
+    //large groups aperture calculation, which is serial within a group so is split across groups
     if (opt.iaperturecalc) {
 #ifdef USEOPENMP
-#pragma omp parallel default(shared)  \
-private(i)
-{
-    #pragma omp for schedule(dynamic) nowait
+#pragma omp parallel for schedule(dynamic,1) default(shared)
 #endif
-        for (i=1;i<=ngroup;i++) if (numingroup[i]>=omppropnum)
+        for (Int_t igroup=0;igroup<(Int_t)largegroups.size();igroup++)
         {
-            CalculateApertureQuantities(opt, numingroup[i], &Part[noffset[i]], pdata[i]);
-        }
-#ifdef USEOPENMP
-}
-#endif
-    }
-
-    //if calculating profiles
-    if (opt.iprofilecalc) {
-#ifdef USEOPENMP
-#pragma omp parallel default(shared)  \
-private(i,j,k,Pval,x,y,z)
-{
-    #pragma omp for schedule(dynamic) nowait
-#endif
-    for (i=1;i<=ngroup;i++) if (numingroup[i]>=omppropnum)
-    {
-        double irnorm;
-        //as particles are radially sorted, init the radial bin at zero
-        int ibin=0;
-        if (opt.iprofilenorm == PROFILERNORMR200CRIT) irnorm = 1.0/pdata[i].gR200c;
-        else irnorm = 1.0;
-        for (j=0;j<numingroup[i];j++) {
-            Pval = &Part[noffset[i] + j];
-            AddParticleToRadialBin(opt, Pval, irnorm, ibin, pdata[i]);
+            CalculateApertureQuantities(opt, numingroup[largegroups[igroup]], &Part[noffset[largegroups[igroup]]], pdata[largegroups[igroup]]);
         }
     }
-#ifdef USEOPENMP
-}
-#endif
-    }
 
-    //loop over groups for black hole properties
-#ifdef USEOPENMP
-#pragma omp parallel default(shared)  \
-private(i,j,k,Pval)
-{
-    #pragma omp for schedule(dynamic) nowait
-#endif
-    for (i=1;i<=ngroup;i++) if (numingroup[i]<omppropnum)
+    //reset particle positions of large groups
+    for (auto gid:largegroups)
     {
+        cmref=GetPropertyReferencePosition(opt, pdata[gid]);
+        ShiftGroupPositions(numingroup[gid], &Part[noffset[gid]], cmref, 1.0);
     }
-#ifdef USEOPENMP
-}
-#endif
-
-    //reset particle positions
-#ifdef USEOPENMP
-#pragma omp parallel default(shared)  \
-private(i,j,k,Pval,cmref)
-{
-    #pragma omp for schedule(dynamic) nowait
-#endif
-    for (i=1;i<=ngroup;i++)
-    {
-        if (opt.iPropertyReferencePosition == PROPREFCM) cmref=pdata[i].gcm;
-        else if (opt.iPropertyReferencePosition == PROPREFMBP) cmref=pdata[i].gposmbp;
-        else if (opt.iPropertyReferencePosition == PROPREFMINPOT) cmref=pdata[i].gposminpot;
-        for (j=0;j<numingroup[i];j++)
-        {
-            Pval=&Part[j+noffset[i]];
-            for (k=0;k<3;k++) Pval->SetPosition(k, Pval->GetPosition(k) + cmref[k]);
-        }
-    }
-#ifdef USEOPENMP
-}
-#endif
 
     LOG(debug) << "Done getting properties in " << timer;
 }
@@ -2466,7 +2747,7 @@ private(i,j,k,Pval,ri,rcmv,ri2,r2,cmx,cmy,cmz,EncMass,Ninside,icmv,cmold,x,y,z,v
             }
         }
         //sort by radius
-        gsl_heapsort(&Part[noffset[i]], numingroup[i], sizeof(Particle), RadCompare);
+        SortParticlesByKey(&Part[noffset[i]], numingroup[i], RadiusKey);
         pdata[i].gsize=Part[noffset[i]+numingroup[i]-1].Radius();
         pdata[i].gRhalfmass=Part[noffset[i]+(numingroup[i]/2)].Radius();
         //then get cmvel if extra output is desired as will need angular momentum
@@ -2582,8 +2863,7 @@ private(j,Pval,x,y,z,massval)
                 Pval->SetPosition(k,(*Pval).GetPosition(k)-pdata[i].gcm[k]);
             }
         }
-        // qsort(&Part[noffset[i]], numingroup[i], sizeof(Particle), RadCompare);
-        std::sort(&Part[noffset[i]], &Part[noffset[i]] + numingroup[i], RadCompareVec);
+        SortParticlesByKey(&Part[noffset[i]], numingroup[i], RadiusKey);
         pdata[i].gsize=Part[noffset[i]+numingroup[i]-1].Radius();
         pdata[i].gRhalfmass=Part[noffset[i]+(numingroup[i]/2)].Radius();
         //then get cmvel if extra output is desired as will need angular momentum
@@ -2745,7 +3025,10 @@ private(i,j,k,x,y,z,Pval)
         vector<Int_t> ids(nbodies);
         for (i=0;i<nbodies;i++) ids[i]=Part[i].GetID();
 
-        vector<Int_t> taggedparts;
+        const Int_t *taggedparts;
+        const Double_t *taggedradii;
+        Int_t ntagged;
+        BallSearchBatch balls, ballsimport;
         vector<Double_t> radii;
         vector<Double_t> masses;
         vector<Int_t> indices;
@@ -2754,7 +3037,8 @@ private(i,j,k,x,y,z,Pval)
         vector<int> typeparts;
         size_t n;
         Double_t dx;
-        vector<Double_t> maxrdist(ngroup+1);
+        vector<Double_t> maxrdist(ngroup+1), startrdist;
+        Int_t nwidened = 0;
         //to store particle ids of those in SO volume.
         vector<Int_t> SOpids;
         std::vector<std::vector<Int_t>> SOpartlist(ngroup);
@@ -2794,11 +3078,6 @@ private(i,j,k,x,y,z,Pval)
 }
 #endif
         //
-        LOG(trace) << "Building trees for SO search ";
-        //build tree optimised to search for more than min group size
-        //this is the bottle neck for the SO calculation. Wonder if there is an easy
-        //way of speeding it up
-        tree=new KDTree(Part,nbodies,opt.HaloMinSize,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
         //store the radii that will be used to search for each group
         //this is based on maximum radius and the enclosed density within the FOF so that if
         //this density is larger than desired overdensity then we must increase the radius
@@ -2809,6 +3088,21 @@ private(i,j,k,x,y,z,Pval)
             radfac=max(1.0,exp(1.0/3.0*(log(pdata[i].gMFOF)-3.0*log(pdata[i].gsize)+fac)));
             maxrdist[i]=pdata[i].gsize*opt.SphericalOverdensitySeachFac*radfac;
         }
+        //most bound particles are not yet known, so match groups through any member that was the most bound
+        //particle of a previous structure
+        WarmStartSOSearchRadii(opt, ngroup, pdata, maxrdist, startrdist, [&](Int_t i) {
+            Double_t r = 0;
+            for (Int_t j=0;j<numingroup[i];j++) {
+                auto it = opt.warmstart.soradius.find(Part[noffset[i]+j].GetPID());
+                if (it != opt.warmstart.soradius.end()) r = max(r, it->second);
+            }
+            return r;
+        });
+        LOG(trace) << "Building trees for SO search ";
+        //build tree optimised to search for more than min group size
+        //this is the bottle neck for the SO calculation. Wonder if there is an easy
+        //way of speeding it up. Built once group members have been matched as it reorders the particles
+        tree=BuildKDTree(Part,nbodies,opt.HaloMinSize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
         if (LOG_ENABLED(trace)) {
             for (i=1;i<=ngroup;i++) if (maxsearchdist < maxrdist[i]) maxsearchdist = maxrdist[i];
             LOG(trace) << "Max search distance is " << maxsearchdist << " in period fraction " << maxsearchdist / opt.p;
@@ -2831,95 +3125,113 @@ private(i,j,k,x,y,z,Pval)
         PartDataGet = new Particle[NImport+1];
         //run search on exported particles and determine which local particles need to be exported back (or imported)
         nimport=MPIBuildParticleNNImportList(opt, nbodies, tree, Part);
-        if (nimport>0) treeimport=new KDTree(PartDataGet,nimport,opt.HaloMinSize,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
+        if (nimport>0) treeimport=BuildKDTree(PartDataGet,nimport,opt.HaloMinSize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
         }
 #endif
         //now loop over groups and search for particles. This is probably fast if we build a tree
         fac=-log(4.0*M_PI/3.0);
+        //spatially close groups are searched together in batches, each thread reusing its own search buffers
+        vector<Coordinate> centres(ngroup+1);
+        for (i=1;i<=ngroup;i++) centres[i]=pdata[i].gcm;
+        vector<vector<Int_t>> batches = BuildBallSearchBatches(ngroup, numingroup, centres, maxrdist);
+        //unless particles beyond the SO radii are needed, gather particles in expanding shells until the lowest
+        //overdensity threshold has been crossed rather than over the whole search radius
+        bool ishell = CheckForSOShellGather(opt);
+        KDTree *sotreeimport = NULL;
+        Particle *sopartimport = NULL;
+        vector<bool> *sooverlap = NULL;
+#ifdef USEMPI
+        sotreeimport = treeimport;
+        sopartimport = PartDataGet;
+        sooverlap = &halooverlap;
+#endif
 #ifdef USEOPENMP
 #pragma omp parallel default(shared)  \
-private(i,j,k,taggedparts,radii,masses,indices,posparts,velparts,typeparts,n,dx,EncMass,J,rc,rhoval,rhoval2,tid,SOpids,iSOfound)
+private(i,j,k,taggedparts,taggedradii,ntagged,balls,ballsimport,radii,masses,indices,posparts,velparts,typeparts,n,dx,EncMass,J,rc,rhoval,rhoval2,tid,SOpids,iSOfound)
 {
-    #pragma omp for schedule(dynamic) nowait
+    #pragma omp for schedule(dynamic) nowait reduction(+:nwidened)
 #endif
-        for (i=1;i<=ngroup;i++)
+        for (size_t ib=0;ib<batches.size();ib++)
+        {
+        nwidened += GatherSOBatch(opt, ishell, minlgrhoval, batches[ib], centres, maxrdist, startrdist,
+            balls, tree, Part, ballsimport, sotreeimport, sopartimport, sooverlap);
+        for (size_t ic=0;ic<batches[ib].size();ic++)
         {
+            i=batches[ib][ic];
             iSOfound = 0;
-            taggedparts=tree->SearchBallPosTagged(pdata[i].gcm,pow(maxrdist[i],2.0));
-            radii.resize(taggedparts.size());
-            masses.resize(taggedparts.size());
+            ntagged=balls.Size(ic);
+            taggedparts=balls.Index(ic);
+            taggedradii=balls.Radius(ic);
+            radii.resize(ntagged);
+            masses.resize(ntagged);
             if (opt.iextrahalooutput) {
-                posparts.resize(taggedparts.size());
-                velparts.resize(taggedparts.size());
+                posparts.resize(ntagged);
+                velparts.resize(ntagged);
             }
 #if defined(GASON) || defined(STARON) || defined(BHON)
-            if (opt.iextragasoutput || opt.iextrastaroutput || opt.iSphericalOverdensityPartList) typeparts.resize(taggedparts.size());
+            if (opt.iextragasoutput || opt.iextrastaroutput || opt.iSphericalOverdensityPartList) typeparts.resize(ntagged);
 #endif
-            if (opt.iSphericalOverdensityPartList) SOpids.resize(taggedparts.size());
-            for (j=0;j<taggedparts.size();j++) {
+            if (opt.iSphericalOverdensityPartList) SOpids.resize(ntagged);
+            for (j=0;j<ntagged;j++) {
                 masses[j]=Part[taggedparts[j]].GetMass();
                 if (opt.iSphericalOverdensityPartList) SOpids[j]=Part[taggedparts[j]].GetPID();
-                radii[j]=0;
+                radii[j]=taggedradii[j];
 #if defined(GASON) || defined(STARON) || defined(BHON)
                 if (opt.iextragasoutput || opt.iextrastaroutput || opt.iSphericalOverdensityPartList) typeparts[j]=Part[taggedparts[j]].GetType();
 #endif
-                for (k=0;k<3;k++) {
-                    dx=Part[taggedparts[j]].GetPosition(k)-pdata[i].gcm[k];
-                    //correct for period
-                    if (opt.p>0) {
-                        if (dx>opt.p*0.5) dx-=opt.p;
-                        else if (dx<-opt.p*0.5) dx+=opt.p;
-                    }
-                    if (opt.iextrahalooutput) {
+                if (opt.iextrahalooutput) {
+                    for (k=0;k<3;k++) {
+                        dx=Part[taggedparts[j]].GetPosition(k)-pdata[i].gcm[k];
+                        //correct for period
+                        if (opt.p>0) {
+                            if (dx>opt.p*0.5) dx-=opt.p;
+                            else if (dx<-opt.p*0.5) dx+=opt.p;
+                        }
                         posparts[j][k]=dx;
                         velparts[j][k]=Part[taggedparts[j]].GetVelocity(k)-pdata[i].gcmvel[k];
                     }
-                    radii[j]+=dx*dx;
                 }
-                radii[j]=sqrt(radii[j]);
             }
-            taggedparts.clear();
 #ifdef USEMPI
             if (NProcs>1) {
                 //if halo has overlap then search the imported particles as well, add them to the radii and mass vectors
                 if (halooverlap[i]&&nimport>0) {
-                    taggedparts=treeimport->SearchBallPosTagged(pdata[i].gcm,pow(maxrdist[i],2.0));
-                    if (taggedparts.size() > 0) {
+                    ntagged=ballsimport.Size(ic);
+                    taggedparts=ballsimport.Index(ic);
+                    taggedradii=ballsimport.Radius(ic);
+                    if (ntagged > 0) {
                         Int_t offset=radii.size();
-                        radii.resize(radii.size()+taggedparts.size());
-                        masses.resize(masses.size()+taggedparts.size());
+                        radii.resize(radii.size()+ntagged);
+                        masses.resize(masses.size()+ntagged);
                         if (opt.iextrahalooutput) {
-                            posparts.resize(posparts.size()+taggedparts.size());
-                            velparts.resize(velparts.size()+taggedparts.size());
+                            posparts.resize(posparts.size()+ntagged);
+                            velparts.resize(velparts.size()+ntagged);
                         }
 #if defined(GASON) || defined(STARON) || defined(BHON)
-                        if (opt.iextragasoutput || opt.iextrastaroutput || opt.iSphericalOverdensityPartList) typeparts.resize(typeparts.size()+taggedparts.size());
+                        if (opt.iextragasoutput || opt.iextrastaroutput || opt.iSphericalOverdensityPartList) typeparts.resize(typeparts.size()+ntagged);
 #endif
-                        if (opt.iSphericalOverdensityPartList) SOpids.resize(SOpids.size()+taggedparts.size());
-                        for (j=0;j<taggedparts.size();j++) {
+                        if (opt.iSphericalOverdensityPartList) SOpids.resize(SOpids.size()+ntagged);
+                        for (j=0;j<ntagged;j++) {
                             masses[offset+j]=PartDataGet[taggedparts[j]].GetMass();
                             if (opt.iSphericalOverdensityPartList) SOpids[j+offset]=PartDataGet[taggedparts[j]].GetPID();
 #if defined(GASON) || defined(STARON) || defined(BHON)
                             if (opt.iextragasoutput || opt.iextrastaroutput || opt.iSphericalOverdensityPartList) typeparts[offset+j]=PartDataGet[taggedparts[j]].GetType();
 #endif
-                            radii[offset+j]=0;
-                            for (k=0;k<3;k++) {
-                                dx=PartDataGet[taggedparts[j]].GetPosition(k)-pdata[i].gcm[k];
-                                //correct for period
-                                if (opt.p>0) {
-                                    if (dx>opt.p*0.5) dx-=opt.p;
-                                    else if (dx<-opt.p*0.5) dx+=opt.p;
-                                }
-                                if (opt.iextrahalooutput) {
+                            radii[offset+j]=taggedradii[j];
+                            if (opt.iextrahalooutput) {
+                                for (k=0;k<3;k++) {
+                                    dx=PartDataGet[taggedparts[j]].GetPosition(k)-pdata[i].gcm[k];
+                                    //correct for period
+                                    if (opt.p>0) {
+                                        if (dx>opt.p*0.5) dx-=opt.p;
+                                        else if (dx<-opt.p*0.5) dx+=opt.p;
+                                    }
                                     posparts[j+offset][k]=dx;
                                     velparts[j+offset][k]=PartDataGet[taggedparts[j]].GetVelocity(k)-pdata[i].gcmvel[k];
                                 }
-                                radii[offset+j]+=dx*dx;
                             }
-                            radii[offset+j]=sqrt(radii[offset+j]);
                         }
                     }
-                    taggedparts.clear();
                 }
             }
 #endif
@@ -3024,9 +3336,11 @@ private(i,j,k,taggedparts,radii,masses,indices,posparts,velparts,typeparts,n,dx,
 #endif
 
         }
+        }
 #ifdef USEOPENMP
     }
 #endif
+        if (nwidened > 0) LOG(debug) << "SO search of " << nwidened << " groups widened beyond their warm start radius";
         delete tree;
         //reset its after putting particles back in input order
         for (i=0;i<nbodies;i++) Part[i].SetID(ids[i]);
@@ -3263,17 +3577,20 @@ void GetSOMasses(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngroup
     vector<Int_t> ids(nbodies);
     for (i=0;i<nbodies;i++) ids[i]=Part[i].GetID();
 
-    vector<Int_t> taggedparts;
+    const Int_t *taggedparts;
+    const Double_t *taggedradii;
+    Int_t ntagged;
+    BallSearchBatch balls, ballsimport;
     vector<Double_t> radii;
     vector<Double_t> masses;
     vector<Int_t> indices;
-    Coordinate posref;
-    vector<Coordinate> velparts;
-    vector<Coordinate> posparts;
+    Coordinate posref, dxpart, dvpart;
+    vector<Coordinate> angmomparts;
     vector<int> typeparts;
     size_t n;
     Double_t dx;
-    vector<Double_t> maxrdist(ngroup+1);
+    vector<Double_t> maxrdist(ngroup+1), startrdist;
+    Int_t nwidened = 0;
     //to store particle ids of those in SO volume.
     vector<Int_t> SOpids;
 
@@ -3289,7 +3606,7 @@ void GetSOMasses(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngroup
     //build tree optimised to search for more than min group size
     //this is the bottle neck for the SO calculation. Wonder if there is an easy
     //way of speeding it up
-    tree=new KDTree(Part,nbodies,opt.HaloMinSize,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
+    tree=BuildKDTree(Part,nbodies,opt.HaloMinSize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
     //store the radii that will be used to search for each group
     //this is based on maximum radius and the enclosed density within the FOF so that if
     //this density is larger than desired overdensity then we must increase the radius
@@ -3302,6 +3619,10 @@ void GetSOMasses(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngroup
         radfac=max(1.0,exp(1.0/3.0*(log(pdata[i].gmass)-3.0*log(pdata[i].gsize)+fac)));
         maxrdist[i]=pdata[i].gsize*opt.SphericalOverdensitySeachFac*radfac;
     }
+    WarmStartSOSearchRadii(opt, ngroup, pdata, maxrdist, startrdist, [&](Int_t i) {
+        auto it = opt.warmstart.soradius.find(pdata[i].ibound);
+        return (it != opt.warmstart.soradius.end()) ? it->second : 0;
+    });
 
     std::vector<vector<Int_t>> SOpartlist(nhalos);
     std::vector<vector<int>> SOparttypelist;
@@ -3320,7 +3641,27 @@ void GetSOMasses(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngroup
     vector<bool> halooverlap;
     KDTree *treeimport=NULL;
     Int_t nimport = 0;
-    if (NProcs>1) {
+    //if possible, other mpi domains evaluate partial radial profiles about exported halo centres
+    //instead of particles being imported
+    bool iremoteprofile = (NProcs>1 && CheckForSORemoteProfileCalc(opt));
+    vector<soprofiledata_out> remoteprofiles;
+    vector<Int_t> remoteprofileoffset;
+    if (iremoteprofile) {
+        vector<Coordinate> posrefs(ngroup+1);
+        for (i=1;i<=ngroup;i++) {
+            if (opt.iPropertyReferencePosition == PROPREFCM) posrefs[i]=pdata[i].gcm;
+            else if (opt.iPropertyReferencePosition == PROPREFMBP) posrefs[i]=pdata[i].gposmbp;
+            else if (opt.iPropertyReferencePosition == PROPREFMINPOT) posrefs[i]=pdata[i].gposminpot;
+        }
+        vector<sohalodata_in> haloimport = MPIBuildHaloSOProfileExportList(opt, ngroup, pdata, posrefs, maxrdist, halooverlap);
+        remoteprofiles = MPIGetHaloSOProfiles(opt, tree, Part, haloimport);
+        //profiles are sorted by halo index so store where a halo's profile begins
+        remoteprofileoffset.assign(ngroup+2,0);
+        for (auto &profile:remoteprofiles) remoteprofileoffset[profile.Index+1]++;
+        for (i=1;i<=ngroup+1;i++) remoteprofileoffset[i]+=remoteprofileoffset[i-1];
+        LOG(debug) << "Received " << remoteprofiles.size() << " remote SO profile bins";
+    }
+    else if (NProcs>1) {
         if (opt.impiusemesh) halooverlap = MPIGetHaloSearchExportNumUsingMesh(opt, ngroup, pdata, maxrdist);
         else halooverlap= MPIGetHaloSearchExportNum(ngroup, pdata, maxrdist);
         NNDataIn = new nndata_in[NExport];
@@ -3333,38 +3674,59 @@ void GetSOMasses(Options &opt, const Int_t nbodies, Particle *Part, Int_t ngroup
         PartDataGet = new Particle[NImport+1];
         //run search on exported particles and determine which local particles need to be exported back (or imported)
         nimport = MPIBuildParticleNNImportList(opt, nbodies, tree, Part, 1, opt.iSphericalOverdensityExtraFieldCalculations);
-        if (nimport>0) treeimport=new KDTree(PartDataGet,nimport,opt.HaloMinSize,tree->TPHYS,tree->KEPAN,100,0,0,0,period);
+        if (nimport>0) treeimport=BuildKDTree(PartDataGet,nimport,opt.HaloMinSize,KDTree::TPHYS,KDTree::KEPAN,100,0,0,0,period);
     }
 #endif
     //now loop over groups and search for particles. This is probably fast if we build a tree
     fac=-log(4.0*M_PI/3.0);
+    //spatially close groups (only those with a search radius) are searched together in batches, each thread
+    //reusing its own search buffers
+    vector<Coordinate> centres(ngroup+1);
+    for (i=1;i<=ngroup;i++) centres[i]=GetPropertyReferencePosition(opt, pdata[i]);
+    vector<vector<Int_t>> batches = BuildBallSearchBatches(ngroup, numingroup, centres, maxrdist);
+    //unless particles beyond the SO radii are needed, gather particles in expanding shells until the lowest
+    //overdensity threshold has been crossed rather than over the whole search radius
+    bool ishell = CheckForSOShellGather(opt);
+    KDTree *sotreeimport = NULL;
+    Particle *sopartimport = NULL;
+    vector<bool> *sooverlap = NULL;
+#ifdef USEMPI
+    //remote profiles are evaluated out to the full search radius
+    ishell = ishell && !iremoteprofile;
+    sotreeimport = treeimport;
+    sopartimport = PartDataGet;
+    sooverlap = &halooverlap;
+#endif
 
 #ifdef USEOPENMP
 #pragma omp parallel default(shared)  \
-private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typeparts,n,dx,EncMass,J,rc,rhoval,rhoval2,tid,SOpids,iSOfound, massval)
+private(i,j,k,taggedparts,taggedradii,ntagged,balls,ballsimport,radii,masses,indices,posref,dxpart,dvpart,angmomparts,typeparts,n,dx,EncMass,J,rc,rhoval,rhoval2,tid,SOpids,iSOfound, massval)
 {
-#pragma omp for schedule(dynamic) nowait
+#pragma omp for schedule(dynamic) nowait reduction(+:nwidened)
 #endif
-    for (i=1;i<=ngroup;i++)
+    for (size_t ib=0;ib<batches.size();ib++)
     {
-        if (!CheckForSOInclCalc(opt,pdata[i])) continue;
-        if (opt.iPropertyReferencePosition == PROPREFCM) posref=pdata[i].gcm;
-        else if (opt.iPropertyReferencePosition == PROPREFMBP) posref=pdata[i].gposmbp;
-        else if (opt.iPropertyReferencePosition == PROPREFMINPOT) posref=pdata[i].gposminpot;
+    nwidened += GatherSOBatch(opt, ishell, minlgrhoval, batches[ib], centres, maxrdist, startrdist,
+        balls, tree, Part, ballsimport, sotreeimport, sopartimport, sooverlap);
+    for (size_t ic=0;ic<batches[ib].size();ic++)
+    {
+        i=batches[ib][ic];
+        posref=centres[i];
         iSOfound = 0;
 
-        taggedparts=tree->SearchBallPosTagged(posref,pow(maxrdist[i],2.0));
-        radii.resize(taggedparts.size());
+        ntagged=balls.Size(ic);
+        taggedparts=balls.Index(ic);
+        taggedradii=balls.Radius(ic);
+        radii.resize(ntagged);
 #ifndef NOMASS
-        masses.resize(taggedparts.size());
+        masses.resize(ntagged);
 #endif
         if (opt.iextrahalooutput) {
-            posparts.resize(taggedparts.size());
-            velparts.resize(taggedparts.size());
+            angmomparts.resize(ntagged);
         }
 #if defined(GASON) || defined(STARON) || defined(BHON) || defined(HIGHRES)
         if (opt.iextragasoutput || opt.iextrastaroutput || opt.iextrainterloperoutput || opt.iSphericalOverdensityPartList) {
-            typeparts.resize(taggedparts.size());
+            typeparts.resize(ntagged);
     }
 #endif
 
@@ -3375,17 +3737,17 @@ private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typepart
         vector<Double_t> Zgas;
 #endif
         if (sonum_hotgas > 0) {
-            temp.resize(taggedparts.size());
+            temp.resize(ntagged);
 #ifdef STARON
-            sfr.resize(taggedparts.size());
-            Zgas.resize(taggedparts.size());
+            sfr.resize(ntagged);
+            Zgas.resize(ntagged);
 #endif
         }
 #endif
         if (opt.iSphericalOverdensityPartList) {
-            SOpids.resize(taggedparts.size());
+            SOpids.resize(ntagged);
         }
-        for (j=0;j<taggedparts.size();j++) {
+        for (j=0;j<ntagged;j++) {
 #ifndef NOMASS
             masses[j]=Part[taggedparts[j]].GetMass();
 #endif
@@ -3409,56 +3771,83 @@ private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typepart
            }
 #endif
 
-            for (k=0;k<3;k++) {
-                dx=Part[taggedparts[j]].GetPosition(k)-posref[k];
-                //correct for period
-                if (opt.p>0) {
-                    if (dx>opt.p*0.5) dx-=opt.p;
-                    else if (dx<-opt.p*0.5) dx+=opt.p;
-                }
-                if (opt.iextrahalooutput) {
-                    posparts[j][k]=dx;
-                    velparts[j][k]=Part[taggedparts[j]].GetVelocity(k)-pdata[i].gcmvel[k];//??? i think this should be okay
+            radii[j]=taggedradii[j];
+            if (opt.iextrahalooutput) {
+                for (k=0;k<3;k++) {
+                    dx=Part[taggedparts[j]].GetPosition(k)-posref[k];
+                    //correct for period
+                    if (opt.p>0) {
+                        if (dx>opt.p*0.5) dx-=opt.p;
+                        else if (dx<-opt.p*0.5) dx+=opt.p;
+                    }
+                    dxpart[k]=dx;
+                    dvpart[k]=Part[taggedparts[j]].GetVelocity(k)-pdata[i].gcmvel[k];
                 }
-                radii[j]+=dx*dx;
+                angmomparts[j]=dxpart.Cross(dvpart);
             }
-            radii[j]=sqrt(radii[j]);
         }
-        taggedparts.clear();
 #ifdef USEMPI
-        if (NProcs>1) {
+        //if halo has overlap then add the partial profiles evaluated by other mpi domains
+        if (iremoteprofile && halooverlap[i]) {
+            Int_t offset=radii.size(), nremote=remoteprofileoffset[i+1]-remoteprofileoffset[i];
+            radii.resize(offset+nremote);
+#ifndef NOMASS
+            masses.resize(offset+nremote);
+#endif
+            if (opt.iextrahalooutput) angmomparts.resize(offset+nremote);
+#if defined(GASON) || defined(STARON) || defined(BHON) || defined(HIGHRES)
+            if (opt.iextragasoutput || opt.iextrastaroutput || opt.iextrainterloperoutput || opt.iSphericalOverdensityPartList) {
+                typeparts.resize(offset+nremote);
+            }
+#endif
+            for (j=0;j<nremote;j++) {
+                auto &profile = remoteprofiles[remoteprofileoffset[i]+j];
+                radii[offset+j]=profile.R;
+#ifndef NOMASS
+                masses[offset+j]=profile.Mass;
+#endif
+                if (opt.iextrahalooutput) angmomparts[offset+j]=profile.J*(1.0/profile.Mass);
+#if defined(GASON) || defined(STARON) || defined(BHON) || defined(HIGHRES)
+                if (opt.iextragasoutput || opt.iextrastaroutput || opt.iextrainterloperoutput || opt.iSphericalOverdensityPartList) {
+                    typeparts[offset+j]=profile.Type;
+                }
+#endif
+            }
+        }
+        else if (NProcs>1) {
             //if halo has overlap then search the imported particles as well, add them to the radii and mass vectors
             if (halooverlap[i]&&nimport>0) {
-                taggedparts=treeimport->SearchBallPosTagged(posref,pow(maxrdist[i],2.0));
-                if (taggedparts.size() > 0) {
+                ntagged=ballsimport.Size(ic);
+                taggedparts=ballsimport.Index(ic);
+                taggedradii=ballsimport.Radius(ic);
+                if (ntagged > 0) {
                     Int_t offset=radii.size();
-                    radii.resize(radii.size()+taggedparts.size());
+                    radii.resize(radii.size()+ntagged);
 #ifndef NOMASS
-                    masses.resize(masses.size()+taggedparts.size());
+                    masses.resize(masses.size()+ntagged);
 #endif
                     if (opt.iextrahalooutput) {
-                        posparts.resize(posparts.size()+taggedparts.size());
-                        velparts.resize(velparts.size()+taggedparts.size());
+                        angmomparts.resize(angmomparts.size()+ntagged);
                     }
 #if defined(GASON) || defined(STARON) || defined(BHON) || defined(HIGHRES)
                     if (opt.iextragasoutput || opt.iextrastaroutput || opt.iextrainterloperoutput || opt.iSphericalOverdensityPartList) {
-                        typeparts.resize(typeparts.size()+taggedparts.size());
+                        typeparts.resize(typeparts.size()+ntagged);
                     }
 #endif
 #if (defined(GASON)) || (defined(GASON) && defined(SWIFTINTERFACE))
                    if (sonum_hotgas > 0) {
-                       temp.resize(typeparts.size()+taggedparts.size());
+                       temp.resize(typeparts.size()+ntagged);
 #ifdef STARON
-                       sfr.resize(typeparts.size()+taggedparts.size());
-                       Zgas.resize(typeparts.size()+taggedparts.size());
+                       sfr.resize(typeparts.size()+ntagged);
+                       Zgas.resize(typeparts.size()+ntagged);
 #endif
                    }
 #endif
 
                     if (opt.iSphericalOverdensityPartList) {
-                        SOpids.resize(SOpids.size()+taggedparts.size());
+                        SOpids.resize(SOpids.size()+ntagged);
                     }
-                    for (j=0;j<taggedparts.size();j++) {
+                    for (j=0;j<ntagged;j++) {
 #ifndef NOMASS
                         masses[offset+j]=PartDataGet[taggedparts[j]].GetMass();
 #endif
@@ -3481,28 +3870,25 @@ private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typepart
                         }
 #endif
 
-                        radii[offset+j]=0;
-                        for (k=0;k<3;k++) {
-                            dx=PartDataGet[taggedparts[j]].GetPosition(k)-posref[k];
-                            //correct for period
-                            if (opt.p>0) {
-                                if (dx>opt.p*0.5) dx-=opt.p;
-                                else if (dx<-opt.p*0.5) dx+=opt.p;
-                            }
-                            if (opt.iextrahalooutput) {
-                                posparts[j+offset][k]=dx;
-                                velparts[j+offset][k]=PartDataGet[taggedparts[j]].GetVelocity(k)-pdata[i].gcmvel[k];
+                        radii[offset+j]=taggedradii[j];
+                        if (opt.iextrahalooutput) {
+                            for (k=0;k<3;k++) {
+                                dx=PartDataGet[taggedparts[j]].GetPosition(k)-posref[k];
+                                //correct for period
+                                if (opt.p>0) {
+                                    if (dx>opt.p*0.5) dx-=opt.p;
+                                    else if (dx<-opt.p*0.5) dx+=opt.p;
+                                }
+                                dxpart[k]=dx;
+                                dvpart[k]=PartDataGet[taggedparts[j]].GetVelocity(k)-pdata[i].gcmvel[k];
                             }
-                            radii[offset+j]+=dx*dx;
+                            angmomparts[offset+j]=dxpart.Cross(dvpart);
                         }
-                        radii[offset+j]=sqrt(radii[offset+j]);
                     }
                 }
-                taggedparts.clear();
             }
         }
 #endif
-        taggedparts.shrink_to_fit();
         //get incides
         indices.resize(radii.size());
         n=0;generate(indices.begin(), indices.end(), [&]{ return n++; });
@@ -3513,7 +3899,7 @@ private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typepart
         SetSphericalOverdensityMasstoFlagValue(opt, pdata[i]);
         //calculate other extra SO related properties
         CalculateExtraSphericalOverdensityProperties(opt, pdata[i], 
-        radii, masses, indices, posparts, velparts, 
+        radii, masses, indices, angmomparts,
 #if (defined(GASON)) || (defined(GASON) && defined(SWIFTINTERFACE))
         typeparts, sonum_hotgas, SOthreshNorm, temp, sfr, Zgas);
 #else
@@ -3572,19 +3958,19 @@ private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typepart
         radii.shrink_to_fit();
         masses.shrink_to_fit();
         if (opt.iextrahalooutput) {
-            posparts.clear();
-            velparts.clear();
-            posparts.shrink_to_fit();
-            velparts.shrink_to_fit();
+            angmomparts.clear();
+            angmomparts.shrink_to_fit();
         }
 #if defined(GASON) || defined(STARON) || defined(BHON) || defined(HIGHRES)
         if (opt.iextragasoutput || opt.iextrastaroutput || opt.iextrainterloperoutput) typeparts.clear();
 #endif
 
     }
+    }
 #ifdef USEOPENMP
 }
 #endif
+    if (nwidened > 0) LOG(debug) << "SO search of " << nwidened << " groups widened beyond their warm start radius";
     delete tree;
     //reset its after putting particles back in input order
     for (i=0;i<nbodies;i++) Part[i].SetID(ids[i]);
@@ -3595,7 +3981,7 @@ private(i,j,k,taggedparts,radii,masses,indices,posref,posparts,velparts,typepart
     }
 #ifdef USEMPI
     mpi_period=0;
-    if (NProcs>1) {
+    if (NProcs>1 && !iremoteprofile) {
         if (treeimport!=NULL) delete treeimport;
         delete[] PartDataGet;
         delete[] PartDataIn;
@@ -3615,33 +4001,29 @@ void GetGlobalSpatialMorphology(const Int_t nbodies, Particle *p, Double_t& q, D
     int MAXIT=10;
     Double_t oldq,olds;
     Coordinate e;
-    Matrix R(0.),M(0.0),eigenvecp(0.);
+    Matrix M(0.0),eigenvecp(0.);
     eigenvec=Matrix(0.);
     eigenvec(0,0)=eigenvec(1,1)=eigenvec(2,2)=1.0;
+    //pack the positions and weights of the relevant particles once. Particles are never rotated,
+    //instead positions are projected onto the current eigenframe when the tensor is evaluated
+    vector<Double_t> x, y, z, w;
+    Int_t n = PackMorphologyData(nbodies, p, x, y, z, w, imflag, itype);
     // Iterative procedure.  See Dubinski and Carlberg (1991).
     int i=0;
     if (iiterate) {
     do
     {
-        M = Matrix(0.0);
-        eigenvecp=Matrix(0.);
-        if (imflag==1)CalcMTensorWithMass(M, q, s, nbodies, p,itype);
-        else CalcMTensor(M, q, s, nbodies, p,itype);
+        CalcMTensor(M, q, s, n, x.data(), y.data(), z.data(), w.data(), eigenvec);
         e = M.Eigenvalues();
         oldq = q;olds = s;
         q = sqrt(e[1] / e[0]);s = sqrt(e[2] / e[0]);
         eigenvecp=M.Eigenvectors(e);
         eigenvec=eigenvecp*eigenvec;
-        RotParticles(nbodies, p, eigenvecp);
         i++;
     } while ((fabs(olds - s) > Error || fabs(oldq - q) > Error) && i<MAXIT);
-    //rotate system back to original coordinate frame
-    R=eigenvec.Transpose();
-    RotParticles(nbodies, p, R);
     }
     else {
-        if (imflag==1)CalcMTensorWithMass(M, q, s, nbodies, p,itype);
-        else CalcMTensor(M, q, s, nbodies, p,itype);
+        CalcMTensor(M, q, s, n, x.data(), y.data(), z.data(), w.data(), eigenvec);
         e = M.Eigenvalues();
         oldq = q;olds = s;
         q = sqrt(e[1] / e[0]);s = sqrt(e[2] / e[0]);
@@ -3650,6 +4032,64 @@ void GetGlobalSpatialMorphology(const Int_t nbodies, Particle *p, Double_t& q, D
     }
 }
 
+///pack positions and weights (mass if imflag==1, otherwise unity) of particles of type itype (all if itype==-1)
+///into contiguous arrays and return the number of particles packed
+Int_t PackMorphologyData(const Int_t n, Particle *p, vector<Double_t> &x, vector<Double_t> &y, vector<Double_t> &z, vector<Double_t> &w, int imflag, int itype)
+{
+    Int_t npack=0;
+    x.resize(n); y.resize(n); z.resize(n); w.resize(n);
+    for (Int_t i=0; i<n; i++)
+    {
+        if (itype!=-1 && p[i].GetType()!=itype) continue;
+        x[npack]=p[i].X();
+        y[npack]=p[i].Y();
+        z[npack]=p[i].Z();
+        w[npack]=(imflag==1)?p[i].GetMass():1.0;
+        npack++;
+    }
+    x.resize(npack); y.resize(npack); z.resize(npack); w.resize(npack);
+    return npack;
+}
+
+///calculate the weighted reduced inertia tensor of packed positions in the frame given by rotation matrix R
+///without modifying the positions. Each position is rotated on the fly and the six independent components
+///are accumulated in a flat loop over contiguous arrays, marked as a simd reduction (when compiled with
+///OpenMP) so it is vectorised without needing the compiler to reassociate the sums.
+void CalcMTensor(Matrix& M, const Double_t q, const Double_t s, const Int_t n,
+    const Double_t *x, const Double_t *y, const Double_t *z, const Double_t *w, Matrix &R)
+{
+    Double_t Mxx,Myy,Mzz,Mxy,Mxz,Myz;
+    Double_t r00=R(0,0), r01=R(0,1), r02=R(0,2);
+    Double_t r10=R(1,0), r11=R(1,1), r12=R(1,2);
+    Double_t r20=R(2,0), r21=R(2,1), r22=R(2,2);
+    Double_t iq2=1.0/(q*q), is2=1.0/(s*s);
+    Mxx=Myy=Mzz=Mxy=Mxz=Myz=0.;
+#ifdef USEOPENMP
+    bool runomp = (n>=ompunbindnum);
+#pragma omp parallel for simd schedule(static) default(shared) if (parallel: runomp) \
+reduction(+:Mxx,Myy,Mzz,Mxy,Mxz,Myz)
+#endif
+    for (Int_t i = 0; i < n; i++)
+    {
+        Double_t xr = r00*x[i]+r01*y[i]+r02*z[i];
+        Double_t yr = r10*x[i]+r11*y[i]+r12*z[i];
+        Double_t zr = r20*x[i]+r21*y[i]+r22*z[i];
+        Double_t a2 = xr*xr+yr*yr*iq2+zr*zr*is2;
+        //particles at the centre (a2=0) add nothing, dividing by one keeps the loop free of branches
+        Double_t wa = w[i]/(a2+(a2==0));
+        Mxx+=xr*xr*wa;
+        Myy+=yr*yr*wa;
+        Mzz+=zr*zr*wa;
+        Mxy+=xr*yr*wa;
+        Mxz+=xr*zr*wa;
+        Myz+=yr*zr*wa;
+    }
+    M(0,0)=Mxx;M(1,1)=Myy;M(2,2)=Mzz;
+    M(0,1)=M(1,0)=Mxy;
+    M(0,2)=M(2,0)=Mxz;
+    M(1,2)=M(2,1)=Myz;
+}
+
 ///calculate the inertia tensor and return the dispersions (weight by 1/mtot)
 void CalcITensor(const Int_t n, Particle *p, Double_t &a, Double_t &b, Double_t &c, Matrix& eigenvec, Matrix &I, int itype)
 {
@@ -4581,7 +5021,7 @@ private(i,j,k,r2,v2,poti,Ti,pot,Eval,npot,storepid,menc,potmin,ipotmin,cmpotmin)
             for (j=0;j<numingroup[i];j++) {
                 for (k=0;k<3;k++) Part[j+noffset[i]].SetPosition(k,Part[j+noffset[i]].GetPosition(k)-cmpotmin[k]);
             }
-            gsl_heapsort(&Part[noffset[i]],numingroup[i],sizeof(Particle),RadCompare);
+            SortParticlesByKey(&Part[noffset[i]], numingroup[i], RadiusKey);
             //now determine kinetic frame
             pdata[i].gcmvel[0]=pdata[i].gcmvel[1]=pdata[i].gcmvel[2]=menc=0.;
             for (j=0;j<npot;j++) {
@@ -4685,7 +5125,7 @@ private(i,j,k,r2,v2,poti,Ti,pot,Eval,npot,storepid,menc,potmin,ipotmin,cmpotmin)
             for (j=0;j<numingroup[i];j++) {
                 for (k=0;k<3;k++) Part[j+noffset[i]].SetPosition(k,Part[j+noffset[i]].GetPosition(k)-cmpotmin[k]);
             }
-            gsl_heapsort(&Part[noffset[i]],numingroup[i],sizeof(Particle),RadCompare);
+            SortParticlesByKey(&Part[noffset[i]], numingroup[i], RadiusKey);
             //now determine kinetic frame
             pdata[i].gcmvel[0]=pdata[i].gcmvel[1]=pdata[i].gcmvel[2]=menc=0.;
             for (j=0;j<npot;j++) {
@@ -4943,22 +5383,17 @@ Int_t **SortAccordingtoBindingEnergy(Options &opt, const Int_t nbodies, Particle
     }
     GetFOFMass(opt, ngroup, numingroup, pdata);
 
+    //sort small groups in batches over threads and the largest ones with all threads
+    if (opt.iSortByBindingEnergy) SortGroupsByKey(ngroup, numingroup, noffset, Part, [](Particle &p){return p.GetDensity();});
+    else SortGroupsByKey(ngroup, numingroup, noffset, Part, [](Particle &p){return p.GetPotential();});
 #ifdef USEOPENMP
 #pragma omp parallel default(shared)  \
 private(i,j)
 {
-    #pragma omp for nowait
+    #pragma omp for schedule(dynamic,ompgroupbatchsize) nowait
 #endif
     for (i=1;i<=ngroup;i++)
     {
-        if (opt.iSortByBindingEnergy) {
-            // qsort(&Part[noffset[i]], numingroup[i], sizeof(Particle), DenCompare);
-            std::sort(&Part[noffset[i]], &Part[noffset[i]] + numingroup[i], DenCompareVec);
-        }
-        else {
-            // qsort(&Part[noffset[i]], numingroup[i], sizeof(Particle), PotCompare);
-            std::sort(&Part[noffset[i]], &Part[noffset[i]] + numingroup[i], PotCompareVec);
-        }
         //having sorted particles get most bound, first unbound
         pdata[i].iunbound=numingroup[i];
         for (j=0;j<numingroup[i];j++) if(Part[noffset[i]+j].GetDensity()>0) {pdata[i].iunbound=j;break;}
@@ -6306,148 +6741,93 @@ inline ExtraPropFunc ExtraPropSetCalc(unsigned int calctype){
     return f;
 }
 
-///Calculate the average mass weighted value of a chemical and how it was produced
-///based on gas particles of an object
-void GetExtraHydroProperties(Options &opt, PropData &pdata, Int_t n, Particle *Pval)
+///Extra properties of the particles of one type in an object, gathered into a dense column per field.
+///Each distinct field is read once per particle straight from the particle's property object (no copy
+///of the object is made) and every reduction requested for that field then streams through the column.
+struct ExtraPropColumns
 {
-#ifdef GASON
-    if (opt.gas_internalprop_names.size() + opt.gas_chem_names.size() + opt.gas_chemproduction_names.size() == 0) return;
-    HydroProperties x;
-    map<string, double> value, weightsum;
-    string extrafield, outputfield, outputfield2;
-    double oldweight, weight, curvalue, result;
-    map<string, ExtraPropFunc> funcs;
+    ///particles of the type in the object and their masses
+    vector<Int_t> index;
+    vector<double> mass;
+    vector<double> column;
 
-    //initialize map stored in the properties data
-    for (auto iextra=0;iextra<opt.gas_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.gas_internalprop_names[iextra];
-        outputfield = opt.gas_internalprop_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.gas_internalprop_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.gas_internalprop_function[iextra]);
-        pdata.hydroprop.SetInternalProperties(outputfield, 0);
-    }
-    for (auto iextra=0;iextra<opt.gas_chem_names.size();iextra++)
-    {
-        extrafield = opt.gas_chem_names[iextra];
-        outputfield = opt.gas_chem_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.gas_chem_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.gas_chem_function[iextra]);
-        pdata.hydroprop.SetChemistry(outputfield, 0);
-    }
-    for (auto iextra=0;iextra<opt.gas_chemproduction_names.size();iextra++)
+    template<typename Select> void SelectParticles(Int_t n, Particle *Pval, Select select)
     {
-        extrafield = opt.gas_chemproduction_names[iextra];
-        outputfield = opt.gas_chemproduction_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.gas_chemproduction_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.gas_chemproduction_function[iextra]);
-        pdata.hydroprop.SetChemistryProduction(outputfield, 0);
+        index.clear();
+        mass.clear();
+        for (auto i=0;i<n;i++) {
+            if (!select(Pval[i])) continue;
+            index.push_back(i);
+            mass.push_back(Pval[i].GetMass());
+        }
+        column.resize(index.size());
     }
-    if (pdata.n_gas == 0 ) return;
-    for (auto i=0;i<n;i++)
+
+    ///returns the reduced value of every requested entry of one category of extra properties, with
+    ///getvalue(i, field) the value of the field for the i-th particle of the object
+    template<typename GetValue> vector<double> Reduce(vector<string> &names, vector<int> &functions,
+        vector<int> &paired, GetValue getvalue)
     {
-        if (Pval[i].GetType()!=GASTYPE) continue;
-        x = Pval[i].GetHydroProperties();
-        oldweight = Pval[i].GetMass();
-        for (auto iextra=0;iextra<opt.gas_internalprop_names.size();iextra++)
+        auto nextra = names.size();
+        vector<double> value(nextra);
+        vector<bool> done(nextra, false);
+        for (auto iextra=0;iextra<nextra;iextra++)
         {
-            extrafield = opt.gas_internalprop_names[iextra];
-            outputfield = opt.gas_internalprop_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.gas_internalprop_function[iextra], oldweight);
-            curvalue = x.GetInternalProperties(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-        for (auto iextra=0;iextra<opt.gas_chem_names.size();iextra++)
-        {
-            extrafield = opt.gas_chem_names[iextra];
-            outputfield = opt.gas_chem_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.gas_chem_function[iextra], oldweight);
-            curvalue = x.GetChemistry(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-        for (auto iextra=0;iextra<opt.gas_chemproduction_names.size();iextra++)
+            if (done[iextra]) continue;
+            for (auto k=0;k<index.size();k++) column[k] = getvalue(index[k], names[iextra]);
+            for (auto jextra=iextra;jextra<nextra;jextra++)
+            {
+                if (done[jextra] || names[jextra] != names[iextra]) continue;
+                auto calctype = functions[jextra];
+                auto func = ExtraPropSetCalc(calctype);
+                double result = ExtraPropInitValue(calctype), weightsum = 0, weight;
+                for (auto k=0;k<index.size();k++)
+                {
+                    weight = ExtraPropGetWeight(calctype, mass[k]);
+                    weightsum += weight;
+                    func(weight, column[k], result);
+                }
+                value[jextra] = ExtraPropNormalizeValue(calctype, result, weightsum);
+                done[jextra] = true;
+            }
+        }
+        //for calculations that depend on other values
+        for (auto iextra=0;iextra<nextra;iextra++)
         {
-            extrafield = opt.gas_chemproduction_names[iextra];
-            outputfield = opt.gas_chemproduction_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.gas_chemproduction_function[iextra], oldweight);
-            curvalue = x.GetChemistryProduction(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
+            if (paired[iextra] == iextra) continue;
+            value[iextra] = ExtraPropAdjustForPairedValue(functions[iextra], value[iextra], value[paired[iextra]]);
         }
+        return value;
     }
+};
 
-    //normalize as necessary
-    for (auto iextra=0;iextra<opt.gas_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.gas_internalprop_names[iextra];
-        outputfield = opt.gas_internalprop_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.gas_internalprop_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.gas_chem_names.size();iextra++)
-    {
-        extrafield = opt.gas_chem_names[iextra];
-        outputfield = opt.gas_chem_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.gas_chem_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.gas_chemproduction_names.size();iextra++)
-    {
-        extrafield = opt.gas_chemproduction_names[iextra];
-        outputfield = opt.gas_chemproduction_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.gas_chemproduction_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
+///Calculate the average mass weighted value of a chemical and how it was produced
+///based on gas particles of an object
+void GetExtraHydroProperties(Options &opt, PropData &pdata, Int_t n, Particle *Pval)
+{
+#ifdef GASON
+    if (opt.gas_internalprop_names.size() + opt.gas_chem_names.size() + opt.gas_chemproduction_names.size() == 0) return;
+    //initialize map stored in the properties data
+    for (auto &outputfield:opt.gas_internalprop_output_names) pdata.hydroprop.SetInternalProperties(outputfield, 0);
+    for (auto &outputfield:opt.gas_chem_output_names) pdata.hydroprop.SetChemistry(outputfield, 0);
+    for (auto &outputfield:opt.gas_chemproduction_output_names) pdata.hydroprop.SetChemistryProduction(outputfield, 0);
+    if (pdata.n_gas == 0 ) return;
 
-    //for calculations that depend on other values
-    for (auto iextra=0;iextra<opt.gas_internalprop_names.size();iextra++)
-    {
-        if (opt.gas_internalprop_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.gas_internalprop_index_paired_calc[iextra];
-        outputfield = opt.gas_internalprop_output_names[iextra];
-        outputfield2 = opt.gas_internalprop_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.gas_internalprop_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.gas_chem_names.size();iextra++)
-    {
-        if (opt.gas_chem_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.gas_chem_index_paired_calc[iextra];
-        outputfield = opt.gas_chem_output_names[iextra];
-        outputfield2 = opt.gas_chem_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.gas_chem_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.gas_chemproduction_names.size();iextra++)
-    {
-        if (opt.gas_chemproduction_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.gas_chemproduction_index_paired_calc[iextra];
-        outputfield = opt.gas_chemproduction_output_names[iextra];
-        outputfield2 = opt.gas_chemproduction_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.gas_chemproduction_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
+    ExtraPropColumns columns;
+    columns.SelectParticles(n, Pval, [](Particle &p){return p.GetType()==GASTYPE;});
+    auto internal = columns.Reduce(opt.gas_internalprop_names, opt.gas_internalprop_function, opt.gas_internalprop_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetHydroProperties().GetInternalProperties(field);});
+    auto chem = columns.Reduce(opt.gas_chem_names, opt.gas_chem_function, opt.gas_chem_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetHydroProperties().GetChemistry(field);});
+    auto chemproduction = columns.Reduce(opt.gas_chemproduction_names, opt.gas_chemproduction_function, opt.gas_chemproduction_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetHydroProperties().GetChemistryProduction(field);});
 
     for (auto iextra=0;iextra<opt.gas_internalprop_names.size();iextra++)
-    {
-        outputfield = opt.gas_internalprop_output_names[iextra];
-        pdata.hydroprop.SetInternalProperties(outputfield, value[outputfield]);
-    }
+        pdata.hydroprop.SetInternalProperties(opt.gas_internalprop_output_names[iextra], internal[iextra]);
     for (auto iextra=0;iextra<opt.gas_chem_names.size();iextra++)
-    {
-        outputfield = opt.gas_chem_output_names[iextra];
-        pdata.hydroprop.SetChemistry(outputfield, value[outputfield]);
-    }
+        pdata.hydroprop.SetChemistry(opt.gas_chem_output_names[iextra], chem[iextra]);
     for (auto iextra=0;iextra<opt.gas_chemproduction_names.size();iextra++)
-    {
-        outputfield = opt.gas_chemproduction_output_names[iextra];
-        pdata.hydroprop.SetChemistryProduction(outputfield, value[outputfield]);
-    }
+        pdata.hydroprop.SetChemistryProduction(opt.gas_chemproduction_output_names[iextra], chemproduction[iextra]);
 #endif
 }
 
@@ -6457,142 +6837,27 @@ void GetExtraStarProperties(Options &opt, PropData &pdata, Int_t n, Particle *Pv
 {
 #ifdef STARON
     if (opt.star_internalprop_names.size() + opt.star_chem_names.size() + opt.star_chemproduction_names.size() == 0) return;
-    StarProperties x;
-    map<string, double> value, weightsum;
-    string extrafield, outputfield, outputfield2;
-    double oldweight, weight, curvalue, result;
-    map<string, ExtraPropFunc> funcs;
-
     //initialize map stored in the properties data
-    for (auto iextra=0;iextra<opt.star_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.star_internalprop_names[iextra];
-        outputfield = opt.star_internalprop_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.star_internalprop_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.star_internalprop_function[iextra]);
-        pdata.starprop.SetInternalProperties(outputfield, 0);
-    }
-    for (auto iextra=0;iextra<opt.star_chem_names.size();iextra++)
-    {
-        extrafield = opt.star_chem_names[iextra];
-        outputfield = opt.star_chem_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.star_chem_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.star_chem_function[iextra]);
-        pdata.starprop.SetChemistry(outputfield, 0);
-    }
-    for (auto iextra=0;iextra<opt.star_chemproduction_names.size();iextra++)
-    {
-        extrafield = opt.star_chemproduction_names[iextra];
-        outputfield = opt.star_chemproduction_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.star_chemproduction_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.star_chemproduction_function[iextra]);
-        pdata.starprop.SetChemistryProduction(outputfield, 0);
-    }
+    for (auto &outputfield:opt.star_internalprop_output_names) pdata.starprop.SetInternalProperties(outputfield, 0);
+    for (auto &outputfield:opt.star_chem_output_names) pdata.starprop.SetChemistry(outputfield, 0);
+    for (auto &outputfield:opt.star_chemproduction_output_names) pdata.starprop.SetChemistryProduction(outputfield, 0);
     if (pdata.n_star == 0 ) return;
-    for (auto i=0;i<n;i++)
-    {
-        if (Pval[i].GetType()!=STARTYPE) continue;
-        x = Pval[i].GetStarProperties();
-        oldweight = Pval[i].GetMass();
-        for (auto iextra=0;iextra<opt.star_internalprop_names.size();iextra++)
-        {
-            extrafield = opt.star_internalprop_names[iextra];
-            outputfield = opt.star_internalprop_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.star_internalprop_function[iextra], oldweight);
-            curvalue = x.GetInternalProperties(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-        for (auto iextra=0;iextra<opt.star_chem_names.size();iextra++)
-        {
-            extrafield = opt.star_chem_names[iextra];
-            outputfield = opt.star_chem_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.star_chem_function[iextra], oldweight);
-            curvalue = x.GetChemistry(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-        for (auto iextra=0;iextra<opt.star_chemproduction_names.size();iextra++)
-        {
-            extrafield = opt.star_chemproduction_names[iextra];
-            outputfield = opt.star_chemproduction_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.star_chemproduction_function[iextra], oldweight);
-            curvalue = x.GetChemistryProduction(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-    }
 
-    //normalize as necessary
-    for (auto iextra=0;iextra<opt.star_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.star_internalprop_names[iextra];
-        outputfield = opt.star_internalprop_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.star_internalprop_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.star_chem_names.size();iextra++)
-    {
-        extrafield = opt.star_chem_names[iextra];
-        outputfield = opt.star_chem_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.star_chem_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.star_chemproduction_names.size();iextra++)
-    {
-        extrafield = opt.star_chemproduction_names[iextra];
-        outputfield = opt.star_chemproduction_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.star_chemproduction_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
+    ExtraPropColumns columns;
+    columns.SelectParticles(n, Pval, [](Particle &p){return p.GetType()==STARTYPE;});
+    auto internal = columns.Reduce(opt.star_internalprop_names, opt.star_internalprop_function, opt.star_internalprop_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetStarProperties().GetInternalProperties(field);});
+    auto chem = columns.Reduce(opt.star_chem_names, opt.star_chem_function, opt.star_chem_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetStarProperties().GetChemistry(field);});
+    auto chemproduction = columns.Reduce(opt.star_chemproduction_names, opt.star_chemproduction_function, opt.star_chemproduction_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetStarProperties().GetChemistryProduction(field);});
 
-    //for calculations that depend on other values
     for (auto iextra=0;iextra<opt.star_internalprop_names.size();iextra++)
-    {
-        if (opt.star_internalprop_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.star_internalprop_index_paired_calc[iextra];
-        outputfield = opt.star_internalprop_output_names[iextra];
-        outputfield2 = opt.star_internalprop_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.star_internalprop_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
+        pdata.starprop.SetInternalProperties(opt.star_internalprop_output_names[iextra], internal[iextra]);
     for (auto iextra=0;iextra<opt.star_chem_names.size();iextra++)
-    {
-        if (opt.star_chem_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.star_chem_index_paired_calc[iextra];
-        outputfield = opt.star_chem_output_names[iextra];
-        outputfield2 = opt.star_chem_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.star_chem_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
+        pdata.starprop.SetChemistry(opt.star_chem_output_names[iextra], chem[iextra]);
     for (auto iextra=0;iextra<opt.star_chemproduction_names.size();iextra++)
-    {
-        if (opt.star_chemproduction_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.star_chemproduction_index_paired_calc[iextra];
-        outputfield = opt.star_chemproduction_output_names[iextra];
-        outputfield2 = opt.star_chemproduction_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.star_chemproduction_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
-
-    for (auto iextra=0;iextra<opt.star_internalprop_names.size();iextra++)
-    {
-        outputfield = opt.star_internalprop_output_names[iextra];
-        pdata.starprop.SetInternalProperties(outputfield, value[outputfield]);
-    }
-    for (auto iextra=0;iextra<opt.star_chem_names.size();iextra++)
-    {
-        outputfield = opt.star_chem_output_names[iextra];
-        pdata.starprop.SetChemistry(outputfield, value[outputfield]);
-    }
-    for (auto iextra=0;iextra<opt.star_chemproduction_names.size();iextra++)
-    {
-        outputfield = opt.star_chemproduction_output_names[iextra];
-        pdata.starprop.SetChemistryProduction(outputfield, value[outputfield]);
-    }
+        pdata.starprop.SetChemistryProduction(opt.star_chemproduction_output_names[iextra], chemproduction[iextra]);
 #endif
 }
 
@@ -6602,142 +6867,27 @@ void GetExtraBHProperties(Options &opt, PropData &pdata, Int_t n, Particle *Pval
 {
 #ifdef BHON
     if (opt.bh_internalprop_names.size() + opt.bh_chem_names.size() + opt.bh_chemproduction_names.size() == 0) return;
-    BHProperties x;
-    map<string, double> value, weightsum;
-    string extrafield, outputfield, outputfield2;
-    double oldweight, weight, curvalue, result;
-    map<string, ExtraPropFunc> funcs;
-
     //initialize map stored in the properties data
-    for (auto iextra=0;iextra<opt.bh_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.bh_internalprop_names[iextra];
-        outputfield = opt.bh_internalprop_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.bh_internalprop_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.bh_internalprop_function[iextra]);
-        pdata.bhprop.SetInternalProperties(outputfield, 0);
-    }
-    for (auto iextra=0;iextra<opt.bh_chem_names.size();iextra++)
-    {
-        extrafield = opt.bh_chem_names[iextra];
-        outputfield = opt.bh_chem_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.bh_chem_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.bh_chem_function[iextra]);
-        pdata.bhprop.SetChemistry(outputfield, 0);
-    }
-    for (auto iextra=0;iextra<opt.bh_chemproduction_names.size();iextra++)
-    {
-        extrafield = opt.bh_chemproduction_names[iextra];
-        outputfield = opt.bh_chemproduction_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.bh_chemproduction_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.bh_chemproduction_function[iextra]);
-        pdata.bhprop.SetChemistryProduction(outputfield, 0);
-    }
+    for (auto &outputfield:opt.bh_internalprop_output_names) pdata.bhprop.SetInternalProperties(outputfield, 0);
+    for (auto &outputfield:opt.bh_chem_output_names) pdata.bhprop.SetChemistry(outputfield, 0);
+    for (auto &outputfield:opt.bh_chemproduction_output_names) pdata.bhprop.SetChemistryProduction(outputfield, 0);
     if (pdata.n_bh == 0 ) return;
-    for (auto i=0;i<n;i++)
-    {
-        if (Pval[i].GetType()!=BHTYPE) continue;
-        x = Pval[i].GetBHProperties();
-        oldweight = Pval[i].GetMass();
-        for (auto iextra=0;iextra<opt.bh_internalprop_names.size();iextra++)
-        {
-            extrafield = opt.bh_internalprop_names[iextra];
-            outputfield = opt.bh_internalprop_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.bh_internalprop_function[iextra], oldweight);
-            curvalue = x.GetInternalProperties(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-        for (auto iextra=0;iextra<opt.bh_chem_names.size();iextra++)
-        {
-            extrafield = opt.bh_chem_names[iextra];
-            outputfield = opt.bh_chem_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.bh_chem_function[iextra], oldweight);
-            curvalue = x.GetChemistry(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-        for (auto iextra=0;iextra<opt.bh_chemproduction_names.size();iextra++)
-        {
-            extrafield = opt.bh_chemproduction_names[iextra];
-            outputfield = opt.bh_chemproduction_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.bh_chemproduction_function[iextra], oldweight);
-            curvalue = x.GetChemistryProduction(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-    }
 
-    //normalize as necessary
-    for (auto iextra=0;iextra<opt.bh_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.bh_internalprop_names[iextra];
-        outputfield = opt.bh_internalprop_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.bh_internalprop_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.bh_chem_names.size();iextra++)
-    {
-        extrafield = opt.bh_chem_names[iextra];
-        outputfield = opt.bh_chem_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.bh_chem_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.bh_chemproduction_names.size();iextra++)
-    {
-        extrafield = opt.bh_chemproduction_names[iextra];
-        outputfield = opt.bh_chemproduction_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.bh_chemproduction_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-
-    //for calculations that depend on other values
-    for (auto iextra=0;iextra<opt.bh_internalprop_names.size();iextra++)
-    {
-        if (opt.bh_internalprop_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.bh_internalprop_index_paired_calc[iextra];
-        outputfield = opt.bh_internalprop_output_names[iextra];
-        outputfield2 = opt.bh_internalprop_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.bh_internalprop_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.bh_chem_names.size();iextra++)
-    {
-        if (opt.bh_chem_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.bh_chem_index_paired_calc[iextra];
-        outputfield = opt.bh_chem_output_names[iextra];
-        outputfield2 = opt.bh_chem_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.bh_chem_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.bh_chemproduction_names.size();iextra++)
-    {
-        if (opt.bh_chemproduction_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.bh_chemproduction_index_paired_calc[iextra];
-        outputfield = opt.bh_chemproduction_output_names[iextra];
-        outputfield2 = opt.bh_chemproduction_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.bh_chemproduction_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
+    ExtraPropColumns columns;
+    columns.SelectParticles(n, Pval, [](Particle &p){return p.GetType()==BHTYPE;});
+    auto internal = columns.Reduce(opt.bh_internalprop_names, opt.bh_internalprop_function, opt.bh_internalprop_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetBHProperties().GetInternalProperties(field);});
+    auto chem = columns.Reduce(opt.bh_chem_names, opt.bh_chem_function, opt.bh_chem_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetBHProperties().GetChemistry(field);});
+    auto chemproduction = columns.Reduce(opt.bh_chemproduction_names, opt.bh_chemproduction_function, opt.bh_chemproduction_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetBHProperties().GetChemistryProduction(field);});
 
     for (auto iextra=0;iextra<opt.bh_internalprop_names.size();iextra++)
-    {
-        outputfield = opt.bh_internalprop_output_names[iextra];
-        pdata.bhprop.SetInternalProperties(outputfield, value[outputfield]);
-    }
+        pdata.bhprop.SetInternalProperties(opt.bh_internalprop_output_names[iextra], internal[iextra]);
     for (auto iextra=0;iextra<opt.bh_chem_names.size();iextra++)
-    {
-        outputfield = opt.bh_chem_output_names[iextra];
-        pdata.bhprop.SetChemistry(outputfield, value[outputfield]);
-    }
+        pdata.bhprop.SetChemistry(opt.bh_chem_output_names[iextra], chem[iextra]);
     for (auto iextra=0;iextra<opt.bh_chemproduction_names.size();iextra++)
-    {
-        outputfield = opt.bh_chemproduction_output_names[iextra];
-        pdata.bhprop.SetChemistryProduction(outputfield, value[outputfield]);
-    }
+        pdata.bhprop.SetChemistryProduction(opt.bh_chemproduction_output_names[iextra], chemproduction[iextra]);
 #endif
 }
 
@@ -6745,64 +6895,21 @@ void GetExtraDMProperties(Options &opt, PropData &pdata, Int_t n, Particle *Pval
 {
 #ifdef EXTRADMON
     if (opt.extra_dm_internalprop_names.size() == 0) return;
-    ExtraDMProperties x;
-    map<string, double> value, weightsum;
-    string extrafield, outputfield, outputfield2;
-    double oldweight, weight, curvalue, result;
-    map<string, ExtraPropFunc> funcs;
-
     //initialize map stored in the properties data
-    for (auto iextra=0;iextra<opt.extra_dm_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.extra_dm_internalprop_names[iextra];
-        outputfield = opt.extra_dm_internalprop_output_names[iextra];
-        value[outputfield] = ExtraPropInitValue(opt.extra_dm_internalprop_function[iextra]);
-        weightsum[outputfield] = 0;
-        funcs[outputfield] = ExtraPropSetCalc(opt.extra_dm_internalprop_function[iextra]);
-        pdata.extradmprop.SetExtraProperties(outputfield, 0);
-    }
+    for (auto &outputfield:opt.extra_dm_internalprop_output_names) pdata.extradmprop.SetExtraProperties(outputfield, 0);
     if (pdata.n_dm == 0) return;
-    for (auto i=0;i<n;i++)
-    {
-        if (Pval[i].GetType()!=DARKTYPE) continue;
+
+    ExtraPropColumns columns;
+    columns.SelectParticles(n, Pval, [](Particle &p){
 #ifdef HIGHRES
-        if (!Pval[i].HasExtraDMProperties()) continue;
+        if (!p.HasExtraDMProperties()) return false;
 #endif
-        x = Pval[i].GetExtraDMProperties();
-        oldweight = Pval[i].GetMass();
-        for (auto iextra=0;iextra<opt.extra_dm_internalprop_names.size();iextra++)
-        {
-            extrafield = opt.extra_dm_internalprop_names[iextra];
-            outputfield = opt.extra_dm_internalprop_output_names[iextra];
-            weight = ExtraPropGetWeight(opt.extra_dm_internalprop_function[iextra], oldweight);
-            curvalue = x.GetExtraProperties(extrafield);
-            weightsum[outputfield] += weight;
-            funcs[outputfield](weight, curvalue, value[outputfield]);
-        }
-    }
-    //normalize as necessary
-    for (auto iextra=0;iextra<opt.extra_dm_internalprop_names.size();iextra++)
-    {
-        extrafield = opt.extra_dm_internalprop_names[iextra];
-        outputfield = opt.extra_dm_internalprop_output_names[iextra];
-        result = ExtraPropNormalizeValue(opt.extra_dm_internalprop_function[iextra], value[outputfield], weightsum[outputfield]);
-        value[outputfield] = result;
-    }
-    //for calculations that depend on other values
+        return p.GetType()==DARKTYPE;
+    });
+    auto internal = columns.Reduce(opt.extra_dm_internalprop_names, opt.extra_dm_internalprop_function, opt.extra_dm_internalprop_index_paired_calc,
+        [Pval](Int_t i, string &field){return Pval[i].GetExtraDMProperties().GetExtraProperties(field);});
     for (auto iextra=0;iextra<opt.extra_dm_internalprop_names.size();iextra++)
-    {
-        if (opt.extra_dm_internalprop_index_paired_calc[iextra] == iextra) continue;
-        int iextra2 = opt.extra_dm_internalprop_index_paired_calc[iextra];
-        outputfield = opt.extra_dm_internalprop_output_names[iextra];
-        outputfield2 = opt.extra_dm_internalprop_output_names[iextra2];
-        result = ExtraPropAdjustForPairedValue(opt.extra_dm_internalprop_function[iextra], value[outputfield], value[outputfield2]);
-        value[outputfield] = result;
-    }
-    for (auto iextra=0;iextra<opt.extra_dm_internalprop_names.size();iextra++)
-    {
-        outputfield = opt.extra_dm_internalprop_output_names[iextra];
-        pdata.extradmprop.SetExtraProperties(outputfield, value[outputfield]);
-    }
+        pdata.extradmprop.SetExtraProperties(opt.extra_dm_internalprop_output_names[iextra], internal[iextra]);
 #endif
 }
 //@}
@@ -7305,7 +7412,7 @@ void SetSphericalOverdensityMasstoTotalMassExclusive(Options &opt, PropData &pda
 
 void CalculateExtraSphericalOverdensityProperties(Options &opt, PropData &pdata,
     vector<Double_t> &radii, vector<Double_t> &masses, vector<Int_t> &indices,
-    vector<Coordinate> &posparts, vector<Coordinate> &velparts, 
+    vector<Coordinate> &angmomparts,
 #if (defined(GASON)) || (defined(GASON) && defined(SWIFTINTERFACE))
     vector<int> &typeparts, int sonum_hotgas, int SOthreshNorm, 
     vector<Double_t> &temp, vector<Double_t> &sfr, vector<Double_t> &Zgas)
@@ -7385,7 +7492,7 @@ void CalculateExtraSphericalOverdensityProperties(Options &opt, PropData &pdata,
 #endif
         auto jj = indices[j];
         auto typeval = typeparts[jj];
-        J=Coordinate(posparts[jj]).Cross(velparts[jj])*massval;
+        J=angmomparts[jj]*massval;
         auto rc=radii[jj];
         if (rc<=pdata.gR200c) pdata.gJ200c+=J;
         if (rc<=pdata.gR200m) pdata.gJ200m+=J;
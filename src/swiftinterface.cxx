@@ -162,6 +162,8 @@ int InitVelociraptor(Options &opt, char* configname, unitinfo u, siminfo s, cons
     //initialize the mpi write communicator to comm world;
     MPIInitWriteComm();
 #endif
+    //a warm start file from a previous run seeds the SO search radii of the first invocation
+    if (opt.warmstartinputname.size()>0) ReadWarmStart(opt);
 
     LOG_RANK0(info) << "Finished initialising VELOCIraptor";
 
@@ -590,6 +592,7 @@ vr_return_data InvokeVelociraptorHydro(const int snapnum, char* outputname,
     //if returning to swift as swift is writing a snapshot, then write for the groups where the particles are found in a file
     //assuming that the swift task and swift index can be used to determine where a particle will be written.
     if (ireturngroupinfoflag != 1 ) WriteSwiftExtendedOutput (libvelociraptorOpt, ngroup, numingroup, pglist, parts);
+    if (libvelociraptorOpt.iwritewarmstart) WriteWarmStart(libvelociraptorOpt, ngroup, pdata, libvelociraptorOpt.outname);
     LOG(info) << "Wrote all data in " << write_timer;
 
     // Find offset to first group on each MPI rank
@@ -700,6 +703,10 @@ vr_return_data InvokeVelociraptorHydro(const int snapnum, char* outputname,
     free(s.cellloc);
     free(cell_node_ids);
     parts.clear();
+#ifdef USEMPI
+    //free the write communicator and hints, they are built again by the next invocation's output
+    MPIFreeWriteComm();
+#endif
 
     LOG(info) << "VELOCIraptor returning.";
     return return_data;
@@ -26,6 +26,75 @@ auto ceil_div(T a, U b) -> decltype(a + b)
     return (a + b - 1) / b;
 }
 
+static int nfailures = 0;
+
+// Datasets written in parallel are only shared by all ranks with parallel HDF5
+#ifdef USEPARALLELHDF
+constexpr bool parallel_hdf = true;
+#else
+constexpr bool parallel_hdf = false;
+#endif
+
+void check(bool condition, const std::string &what)
+{
+    if (!condition) {
+        LOG(error) << "Check failed: " << what;
+        nfailures++;
+    }
+}
+
+// Read a whole dataset back from a closed file
+template <typename T>
+std::vector<T> read_dataset(const std::string &filename, const std::string &name)
+{
+    auto file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    auto dset_id = H5Dopen(file_id, name.c_str(), H5P_DEFAULT);
+    auto space_id = H5Dget_space(dset_id);
+    std::vector<T> data(H5Sget_simple_extent_npoints(space_id));
+    if (!data.empty()) {
+        H5Dread(dset_id, hdf5_type(T{}), H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+    }
+    H5Sclose(space_id);
+    H5Dclose(dset_id);
+    H5Fclose(file_id);
+    return data;
+}
+
+// Describe the chunking and filters a dataset was created with
+struct dataset_filters {
+    bool chunked = false;
+    hsize_t chunk_rows = 0;
+    bool shuffle = false;
+    int deflate_level = -1;
+    int nfilters = 0;
+};
+
+dataset_filters read_dataset_filters(const std::string &filename, const std::string &name)
+{
+    dataset_filters filters;
+    auto file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    auto dset_id = H5Dopen(file_id, name.c_str(), H5P_DEFAULT);
+    auto plist_id = H5Dget_create_plist(dset_id);
+    filters.chunked = (H5Pget_layout(plist_id) == H5D_CHUNKED);
+    if (filters.chunked) {
+        std::array<hsize_t, 3> chunk_dims {};
+        H5Pget_chunk(plist_id, chunk_dims.size(), chunk_dims.data());
+        filters.chunk_rows = chunk_dims[0];
+    }
+    filters.nfilters = H5Pget_nfilters(plist_id);
+    for (int i = 0; i != filters.nfilters; i++) {
+        unsigned int flags, cd_values[4];
+        size_t cd_nelmts = 4;
+        auto filter = H5Pget_filter2(plist_id, i, &flags, &cd_nelmts, cd_values, 0, nullptr, nullptr);
+        if (filter == H5Z_FILTER_SHUFFLE) filters.shuffle = true;
+        if (filter == H5Z_FILTER_DEFLATE) filters.deflate_level = cd_values[0];
+    }
+    H5Pclose(plist_id);
+    H5Dclose(dset_id);
+    H5Fclose(file_id);
+    return filters;
+}
+
 int main(int argc, char *argv[])
 {
 #ifdef USEMPI
@@ -90,6 +159,105 @@ int main(int argc, char *argv[])
         out.close();
     }
 
+    // Filters chosen per dataset type, written in serial so they apply with any HDF5 build
+    {
+        Options filter_opts = opts;
+        filter_opts.hdfoutputintdeflate = 6;
+        filter_opts.hdfoutputfloatdeflate = 1;
+        filter_opts.ihdfoutputshuffle = 1;
+        filter_opts.hdfoutputchunkbytes = 1024;
+        hsize_t dims2[2] = {1000, 3};
+        auto floats = generate_vector(dims2[0] * dims2[1]);
+        std::vector<long long> ints(1000);
+        std::iota(ints.begin(), ints.end(), 0);
+        auto small = generate_vector(10);
+        H5OutputFile out;
+        out.append(outfile, H5F_ACC_RDWR, 0, false);
+        if (ThisWriteTask == 0) {
+            out.write_dataset_nd(filter_opts, "filtered-doubles", 2, dims2, floats.data(), -1, -1, false);
+            out.write_dataset(filter_opts, "filtered-longs", ints.size(), ints.data(), -1, -1, false);
+            out.write_dataset(filter_opts, "small-doubles", small.size(), small.data(), -1, -1, false);
+        }
+        out.close();
+
+        if (ThisTask == 0 && H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+            // chunks span whole rows and hold as many rows as fit in hdfoutputchunkbytes
+            auto doubles = read_dataset_filters(outfile, "filtered-doubles");
+            check(doubles.chunked, "float dataset is chunked");
+            check(doubles.chunk_rows == 1024 / (3 * sizeof(double)), "float chunk rows follow from the chunk bytes");
+            check(doubles.deflate_level == 1, "float dataset uses the float deflate level");
+            check(doubles.shuffle, "float dataset is shuffled");
+            auto longs = read_dataset_filters(outfile, "filtered-longs");
+            check(longs.chunk_rows == 1024 / sizeof(long long), "integer chunk rows follow from the chunk bytes");
+            check(longs.deflate_level == 6, "integer dataset uses the integer deflate level");
+            check(longs.shuffle, "integer dataset is shuffled");
+            // datasets that fit in a single chunk are not filtered
+            auto smalls = read_dataset_filters(outfile, "small-doubles");
+            check(!smalls.chunked && smalls.nfilters == 0, "small dataset is not filtered");
+            check(read_dataset<long long>(outfile, "filtered-longs") == ints, "filtered integers read back");
+        }
+    }
+
+    // Rank sizes and offsets, computed from the command line so they can be checked independently
+    std::vector<unsigned long long> sizes(NProcs);
+    for (int rank = 0; rank != NProcs; rank++) sizes[rank] = std::stoull(argv[rank + 2]);
+    auto total_size = std::accumulate(sizes.begin(), sizes.end(), 0ull);
+    auto offset = std::accumulate(sizes.begin(), sizes.begin() + ThisTask, 0ull);
+
+    // A parallel layout shared by several datasets
+    {
+        H5OutputFile out;
+        out.append(outfile);
+        out.set_parallel_layout(array_size);
+#ifdef USEPARALLELHDF
+        check(out.parallel_layout_offset() == offset, "parallel layout offset is the sum of the preceding ranks' rows");
+#endif
+        check(out.parallel_layout_matches(array_size), "parallel layout matches its own number of rows");
+        check(!out.parallel_layout_matches(array_size + 1), "parallel layout rejects a different number of rows");
+        std::vector<long long> data(array_size);
+        std::iota(data.begin(), data.end(), offset);
+        out.write_dataset(opts, "layout-a", data.size(), data.data());
+        out.write_dataset(opts, "layout-b", data.size(), data.data());
+        out.clear_parallel_layout();
+        check(out.parallel_layout_matches(array_size + 1), "cleared parallel layout accepts any number of rows");
+        out.close();
+
+        if (ThisTask == 0 && (NProcs == 1 || parallel_hdf)) {
+            std::vector<long long> expected(total_size);
+            std::iota(expected.begin(), expected.end(), 0);
+            check(read_dataset<long long>(outfile, "layout-a") == expected, "first dataset written with the layout");
+            check(read_dataset<long long>(outfile, "layout-b") == expected, "second dataset written with the layout");
+        }
+    }
+
+    // Streamed writing with unequal lengths per rank, so ranks that finish early write empty rounds
+    {
+        constexpr hsize_t nbuffer = 4;
+        std::vector<unsigned long long> lengths(NProcs);
+        for (int rank = 0; rank != NProcs; rank++) lengths[rank] = (rank == 1) ? 0 : 5 + 11 * rank;
+        auto length = lengths[ThisTask];
+        auto stream_offset = std::accumulate(lengths.begin(), lengths.begin() + ThisTask, 0ull);
+        hsize_t next_start = 0;
+        H5OutputFile out;
+        out.append(outfile);
+        out.write_dataset_streamed(opts, "streamed", length, nbuffer,
+            [&](hsize_t start, hsize_t n, void *buffer) {
+                check(start == next_start && n > 0 && n <= nbuffer, "streamed fill is called with consecutive ranges");
+                auto values = static_cast<long long *>(buffer);
+                for (hsize_t i = 0; i != n; i++) values[i] = stream_offset + start + i;
+                next_start = start + n;
+            },
+            H5T_NATIVE_LLONG);
+        out.close();
+        check(next_start == length, "streamed fill covers the whole rank's share");
+
+        if (ThisTask == 0 && (NProcs == 1 || parallel_hdf)) {
+            std::vector<long long> expected(std::accumulate(lengths.begin(), lengths.end(), 0ull));
+            std::iota(expected.begin(), expected.end(), 0);
+            check(read_dataset<long long>(outfile, "streamed") == expected, "streamed dataset read back");
+        }
+    }
+
     // Attribute writing in serial
     {
         H5OutputFile out;
@@ -103,6 +271,11 @@ int main(int argc, char *argv[])
 
 #ifdef USEMPI
     MPIFreeWriteComm();
+    MPI_Allreduce(MPI_IN_PLACE, &nfailures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     MPI_Finalize();
 #endif // USEMPI
+    if (nfailures > 0) {
+        LOG(error) << nfailures << " checks failed";
+        return 1;
+    }
 }
\ No newline at end of file
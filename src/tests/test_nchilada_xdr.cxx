@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "allvars.h"
+#include "logging.h"
+#include "nchiladaitems.h"
+
+static int nfailures = 0;
+
+void check(bool condition, const std::string &what)
+{
+    if (!condition) {
+        LOG(error) << "Check failed: " << what;
+        nfailures++;
+    }
+}
+
+// Encode values one at a time with xdr_template into a temporary file, the way nchilada fields are written
+template <typename T>
+FILE *encode_field(const std::vector<T> &values)
+{
+    FILE *fp = tmpfile();
+    XDR xdrs;
+    xdrstdio_create(&xdrs, fp, XDR_ENCODE);
+    for (auto v : values) xdr_template(&xdrs, &v);
+    xdr_destroy(&xdrs);
+    fflush(fp);
+    rewind(fp);
+    return fp;
+}
+
+// Check that xdr_read_block and xdr_decode_block give back what xdr_template encoded,
+// and that asking for one element more than was written is reported as a short read
+template <typename T>
+void test_round_trip(const std::vector<T> &values, const std::string &type_name)
+{
+    FILE *fp = encode_field(values);
+    XDR xdrs;
+    xdrstdio_create(&xdrs, fp, XDR_DECODE);
+    std::vector<T> read(values.size());
+    check(xdr_read_block(&xdrs, read.data(), read.size()), type_name + " block read succeeds");
+    check(read == values, type_name + " block read matches xdr_template encoding");
+    xdr_destroy(&xdrs);
+
+    rewind(fp);
+    std::vector<unsigned char> raw(values.size() * xdr_unit_size<T>());
+    check(fread(raw.data(), 1, raw.size(), fp) == raw.size(), type_name + " raw encoding has the XDR unit size");
+    std::vector<T> decoded(values.size());
+    xdr_decode_block(raw.data(), decoded.data(), decoded.size());
+    check(decoded == values, type_name + " block decode matches xdr_template encoding");
+
+    rewind(fp);
+    xdrstdio_create(&xdrs, fp, XDR_DECODE);
+    std::vector<T> tooshort(values.size() + 1);
+    check(!xdr_read_block(&xdrs, tooshort.data(), tooshort.size()), type_name + " short read is reported");
+    xdr_destroy(&xdrs);
+    fclose(fp);
+}
+
+int main()
+{
+    vr::init_logging(vr::LogLevel::trace);
+
+    test_round_trip<short>({0, 1, -1, 12345, -12345, 32767, -32768}, "short");
+    test_round_trip<unsigned short>({0, 1, 65535}, "unsigned short");
+    test_round_trip<int>({0, 1, -1, 2147483647, -2147483647 - 1, -123456}, "int");
+    test_round_trip<unsigned int>({0, 1, 4294967295u}, "unsigned int");
+    test_round_trip<long>({0, 1, -1, 2147483647, -2147483647L - 1}, "long");
+    test_round_trip<unsigned long>({0, 1, 4294967295ul}, "unsigned long");
+    test_round_trip<float>({0.0f, -0.0f, 1.5f, -3.25e-20f, 6.5e30f}, "float");
+    test_round_trip<double>({0.0, -0.0, 1.5, -3.25e-200, 6.5e300}, "double");
+
+    if (nfailures > 0) {
+        LOG(error) << nfailures << " checks failed";
+        return 1;
+    }
+}
@@ -1042,6 +1042,8 @@ void GetParamFile(Options &opt)
                         opt.uinfo.approxpotminnum = atoi(vbuff);
                     else if (strcmp(tbuff, "Approximate_potential_calculation_method")==0)
                         opt.uinfo.approxpotmethod = atoi(vbuff);
+                    else if (strcmp(tbuff, "Approximate_potential_calculation_random_seed")==0)
+                        opt.uinfo.approxpotrandseed = strtoull(vbuff,NULL,10);
 
                     //property related
                     else if (strcmp(tbuff, "Reference_frame_for_properties")==0)
@@ -1057,6 +1059,12 @@ void GetParamFile(Options &opt)
                         opt.SphericalOverdensitySeachMaxStructLevel = HALOSTYPE;
                         opt.SphericalOverdensitySeachMaxStructLevel += HALOCORESTYPE*stype;
                     }
+                    else if (strcmp(tbuff, "Spherical_overdensity_remote_profile")==0)
+                        opt.iSphericalOverdensityRemoteProfile = atoi(vbuff);
+                    else if (strcmp(tbuff, "Spherical_overdensity_remote_profile_num_bins")==0)
+                        opt.SphericalOverdensityRemoteProfileNumBins = atoi(vbuff);
+                    else if (strcmp(tbuff, "Spherical_overdensity_shell_factor")==0)
+                        opt.SphericalOverdensityShellFac = atof(vbuff);
                     else if (strcmp(tbuff, "Extensive_halo_properties_output")==0)
                         opt.iextrahalooutput = atoi(vbuff);
                     else if (strcmp(tbuff, "Extensive_gas_properties_output")==0)
@@ -1127,6 +1135,16 @@ void GetParamFile(Options &opt)
                         opt.iverbose = atoi(vbuff);
                     else if (strcmp(tbuff, "Write_group_array_file")==0)
                         opt.iwritefof = atoi(vbuff);
+                    else if (strcmp(tbuff, "Write_FOF_membership_file")==0)
+                        opt.iwritefofmembership = atoi(vbuff);
+                    else if (strcmp(tbuff, "Input_FOF_membership_file")==0)
+                        opt.fofmembershipinputname = string(vbuff);
+                    else if (strcmp(tbuff, "Write_warm_start_file")==0)
+                        opt.iwritewarmstart = atoi(vbuff);
+                    else if (strcmp(tbuff, "Input_warm_start_file")==0)
+                        opt.warmstartinputname = string(vbuff);
+                    else if (strcmp(tbuff, "Warm_start_SO_radius_factor")==0)
+                        opt.warmstartsoradiusfac = atof(vbuff);
                     else if (strcmp(tbuff, "Snapshot_value")==0)
                         opt.snapshotvalue = HALOIDSNVAL*atoi(vbuff);
 
@@ -1143,6 +1161,8 @@ void GetParamFile(Options &opt)
                         opt.mpipartfac = atof(vbuff);
                     else if (strcmp(tbuff, "MPI_number_of_tasks_per_write")==0)
                         opt.mpinprocswritesize = atoi(vbuff);
+                    else if (strcmp(tbuff, "MPI_number_of_tasks_per_write_aggregator")==0)
+                        opt.mpinprocsperwriteaggregator = atoi(vbuff);
                     else if (strcmp(tbuff, "MPI_use_zcurve_mesh_decomposition")==0)
                         opt.impiusemesh = (atoi(vbuff)>0);
                     else if (strcmp(tbuff, "MPI_zcurve_mesh_decomposition_min_num_cells_per_dim")==0)
@@ -1883,6 +1903,14 @@ void GetParamFile(Options &opt)
                     //input related to info for stars, bhs, winds/tracers, etc
                     else if (strcmp(tbuff, "HDF_name_convention")==0)
                         opt.ihdfnameconvention = atoi(vbuff);
+                    else if (strcmp(tbuff, "HDF_output_int_compression_level")==0)
+                        opt.hdfoutputintdeflate = atoi(vbuff);
+                    else if (strcmp(tbuff, "HDF_output_float_compression_level")==0)
+                        opt.hdfoutputfloatdeflate = atoi(vbuff);
+                    else if (strcmp(tbuff, "HDF_output_shuffle")==0)
+                        opt.ihdfoutputshuffle = atoi(vbuff);
+                    else if (strcmp(tbuff, "HDF_output_chunk_bytes")==0)
+                        opt.hdfoutputchunkbytes = atol(vbuff);
                     else if (strcmp(tbuff, "Input_includes_dm_particle")==0)
                         opt.iusedmparticles = atoi(vbuff);
                     else if (strcmp(tbuff, "Input_includes_gas_particle")==0)
@@ -1948,6 +1976,22 @@ void ConfigCheck(Options &opt)
     {
         ConfigExit("Conflict in config file: Asking for Bound Field objects but also asking to keep the 3DFOF/then run 6DFOF. This is incompatible. Check config");
     }
+    if (opt.fofmembershipinputname.size()>0 && opt.iKeepFOF)
+    {
+        ConfigExit("Conflict in config file: Reading FOF membership files but also asking to keep the 3DFOF envelopes, which are not stored in these files. Check config");
+    }
+    if (opt.warmstartsoradiusfac <= 1.0)
+    {
+        ConfigExit("Invalid warm start SO radius factor (<=1). Check config");
+    }
+    if (opt.SphericalOverdensityShellFac <= 1.0)
+    {
+        ConfigExit("Invalid spherical overdensity shell factor (<=1). Check config");
+    }
+    if (opt.fofmembershipinputname.size()>0 && opt.iSingleHalo)
+    {
+        LOG_RANK0(warning) << "Reading FOF membership files but searching single halo, FOF membership files will be ignored";
+    }
     if (opt.HaloMinSize==-1) opt.HaloMinSize=opt.MinSize;
 
     if (opt.lengthtokpc<=0){
@@ -2047,6 +2091,9 @@ void ConfigCheck(Options &opt)
     else if (opt.mpipartfac>1){
         LOG_RANK0(warning) << "MPI Particle allocation factor is high (>1)";
     }
+    if (opt.iSphericalOverdensityRemoteProfile && opt.SphericalOverdensityRemoteProfileNumBins<1){
+        ConfigExit("Invalid number of bins for remote spherical overdensity profiles, must be >=1");
+    }
     if (opt.mpinprocswritesize<1){
 #ifdef USEPARALLELHDF
         LOG_RANK0(warning) << "Number of MPI task writing collectively < 1. Setting to 1";
@@ -2059,6 +2106,9 @@ void ConfigCheck(Options &opt)
         opt.mpinprocswritesize = NProcs;
 #endif
     }
+    if (opt.mpinprocsperwriteaggregator<0){
+        ConfigExit("Invalid number of MPI tasks per write aggregator, must be >=0");
+    }
 #endif
 
 #ifdef USEOPENMP
@@ -2076,6 +2126,12 @@ void ConfigCheck(Options &opt)
         ConfigExit("Code not compiled with HDF output enabled. Recompile with this enabled to produce subfind like output or turn off subfind like output");
     }
 #endif
+    if (opt.hdfoutputintdeflate < 0 || opt.hdfoutputintdeflate > 9 || opt.hdfoutputfloatdeflate < 0 || opt.hdfoutputfloatdeflate > 9) {
+        ConfigExit("HDF output compression levels must be between 0 (no compression) and 9");
+    }
+    if (opt.hdfoutputchunkbytes == 0) {
+        ConfigExit("HDF_output_chunk_bytes must be positive");
+    }
 
 #ifndef USEADIOS
     if (opt.ibinaryout==OUTADIOS){
@@ -2502,6 +2558,7 @@ ConfigInfo::ConfigInfo(Options &opt){
     AddEntry("Approximate_potential_calculation_particle_number_fraction", opt.uinfo.approxpotnumfrac);
     AddEntry("Approximate_potential_calculation_min_particle", opt.uinfo.approxpotminnum);
     AddEntry("Approximate_potential_calculation_method", opt.uinfo.approxpotmethod);
+    AddEntry("Approximate_potential_calculation_random_seed", opt.uinfo.approxpotrandseed);
 
     //property related
     AddEntry("Inclusive_halo_masses", opt.iInclusiveHalo);
@@ -2529,6 +2586,9 @@ ConfigInfo::ConfigInfo(Options &opt){
     AddEntry("Number_of_overdensities", opt.SOnum);
     AddEntry("Overdensity_values_in_critical_density", opt.SOthresholds_values_crit);
     AddEntry("Spherical_overdenisty_calculation_limited_to_structure_types", (opt.SphericalOverdensitySeachMaxStructLevel-HALOSTYPE)/HALOCORESTYPE);
+    AddEntry("Spherical_overdensity_remote_profile", opt.iSphericalOverdensityRemoteProfile);
+    AddEntry("Spherical_overdensity_remote_profile_num_bins", opt.SphericalOverdensityRemoteProfileNumBins);
+    AddEntry("Spherical_overdensity_shell_factor", opt.SphericalOverdensityShellFac);
 
     //try removing index that is now stored in
     vector<string> name;
@@ -2651,6 +2711,11 @@ ConfigInfo::ConfigInfo(Options &opt){
     //other options
     AddEntry("Verbose", opt.iverbose);
     AddEntry("Write_group_array_file",opt.iwritefof);
+    AddEntry("Write_FOF_membership_file",opt.iwritefofmembership);
+    AddEntry("Input_FOF_membership_file",opt.fofmembershipinputname);
+    AddEntry("Write_warm_start_file",opt.iwritewarmstart);
+    AddEntry("Input_warm_start_file",opt.warmstartinputname);
+    AddEntry("Warm_start_SO_radius_factor",opt.warmstartsoradiusfac);
     AddEntry("Snapshot_value",opt.snapshotvalue);
 
     //io related
@@ -2664,6 +2729,10 @@ ConfigInfo::ConfigInfo(Options &opt){
 
     //HDF io related info
     AddEntry("HDF_name_convention", opt.ihdfnameconvention);
+    AddEntry("HDF_output_int_compression_level", opt.hdfoutputintdeflate);
+    AddEntry("HDF_output_float_compression_level", opt.hdfoutputfloatdeflate);
+    AddEntry("HDF_output_shuffle", opt.ihdfoutputshuffle);
+    AddEntry("HDF_output_chunk_bytes", opt.hdfoutputchunkbytes);
     AddEntry("Input_includes_dm_particle", opt.iusedmparticles);
     AddEntry("Input_includes_gas_particle",opt.iusegasparticles);
     AddEntry("Input_includes_star_particle", opt.iusestarparticles);
@@ -2679,6 +2748,7 @@ ConfigInfo::ConfigInfo(Options &opt){
 
     //mpi related configuration
     AddEntry("MPI_part_allocation_fac", opt.mpipartfac);
+    AddEntry("MPI_number_of_tasks_per_write_aggregator", opt.mpinprocsperwriteaggregator);
 #endif
     AddEntry("#Compilation Info");
 #ifdef USEMPI
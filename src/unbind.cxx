@@ -23,6 +23,24 @@ void GetNodeList(Node *np, Int_t &ncell, Node **nodelist, const Int_t bsize){
     //else ncell++;
 }
 
+///subroutine that collects the leaf nodes of a tree, ordered as they are stored in the tree
+void GetLeafNodeList(Node *np, vector<Node*> &leafnodes, const Int_t bsize){
+    if (np->GetCount()>bsize){
+        GetLeafNodeList(((SplitNode*)np)->GetLeft(),leafnodes,bsize);
+        GetLeafNodeList(((SplitNode*)np)->GetRight(),leafnodes,bsize);
+    }
+    else leafnodes.push_back(np);
+}
+
+///simple counter based 64-bit hash (splitmix64) used to generate reproducible random numbers
+///that do not depend on the order in which they are drawn
+inline unsigned long long SplitMix64(unsigned long long x){
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
 ///subroutine that marks a cell for a given particle in tree-walk
 inline void MarkCell(Node *np, Int_t *marktreecell, Int_t *markleafcell, Int_t &ntreecell, Int_t &nleafcell, Double_t *r2val, const Int_t bsize, Double_t *cR2max, Coordinate *cm, Double_t *cmtot, const Coordinate &xpos, Double_t eps2){
     Int_t nid=np->GetID();
@@ -954,7 +972,6 @@ void Potential(Options &opt, Int_t nbodies, Particle *Part)
     Int_t oldnbodies;
     KDTree *tree;
     Particle *part;
-    bool runomp = false;
     int nsearch;
     double mr;
     int bsize = opt.uinfo.BucketSize;
@@ -967,8 +984,7 @@ void Potential(Options &opt, Int_t nbodies, Particle *Part)
     if (part != Part) bsize = ceil(bsize*opt.uinfo.approxpotnumfrac);
 
     //build tree and calculate a tree based potential
-    tree = new KDTree(part, nbodies, bsize, tree->TPHYS, tree->KEPAN,
-        100, 0, 0, 0, NULL, NULL, runomp);
+    tree = BuildKDTree(part, nbodies, bsize, KDTree::TPHYS, KDTree::KEPAN, 100);
     if (part != Part) tree->OverWriteInputOrder();
     PotentialTree(opt, nbodies, part, tree);
     //and assign potentials back if running approximate potential calculation
@@ -1100,58 +1116,55 @@ void ParticleSubSample(Options &opt, const Int_t nbodies, Particle *&Part,
                 //number of particles per leaf node
                 Int_t bsize = ceil(nbodies/(float)newnbodies);
                 KDTree *tree;
-                tree = new KDTree(Part, nbodies, bsize, tree->TPHYS,tree->KEPAN,100);
-                //first get all local leaf nodes;
-                newnbodies = tree->GetNumLeafNodes();
+                tree = BuildKDTree(Part, nbodies, bsize, KDTree::TPHYS,KDTree::KEPAN,100);
+                //get all leaf nodes in a single walk of the tree rather than
+                //searching for the leaf node of each particle
+                vector<Node*> leafnodes;
+                leafnodes.reserve(tree->GetNumLeafNodes());
+                GetLeafNodeList(tree->GetRoot(), leafnodes, bsize);
+                newnbodies = leafnodes.size();
                 newpart = new Particle[newnbodies];
                 mr = (double)nbodies/(double)newnbodies;
-                Node *node;
-                vector<leaf_node_info> leafnodes(newnbodies);
-                Int_t inode=0, ipart=0;
-                while (ipart<nbodies) {
-                    node=tree->FindLeafNode(ipart);
-                    leafnodes[inode].id = inode;
-                    leafnodes[inode].istart = node->GetStart();
-                    leafnodes[inode].iend = node->GetEnd();
-                    leafnodes[inode].numtot = node->GetCount();
-                    ipart+=leafnodes[inode].numtot;
-                    inode++;
-                }
-                node=NULL;
 
+                //leaf nodes are independent so mass moments can be calculated in parallel
 #ifdef USEOPENMP
-#pragma omp parallel for default(shared) schedule(dynamic)
+#pragma omp parallel for default(shared) schedule(dynamic) if (nbodies > POTOMPCALCNUM)
 #endif
                 for (auto i=0;i<newnbodies;i++)
                 {
                     double mass = 0;
-                    leafnodes[i].cm[0]=leafnodes[i].cm[1]=leafnodes[i].cm[2]=0;
-                    for (auto j=leafnodes[i].istart;j<leafnodes[i].iend;j++)
+                    Coordinate cm(0.);
+                    for (auto j=leafnodes[i]->GetStart();j<leafnodes[i]->GetEnd();j++)
                     {
                         mass += Part[j].GetMass();
-                        for (auto k=0;k<3;k++) leafnodes[i].cm[k] += Part[j].GetPosition(k)*Part[j].GetMass();
+                        for (auto k=0;k<3;k++) cm[k] += Part[j].GetPosition(k)*Part[j].GetMass();
                     }
-                    for (auto k=0;k<3;k++) newpart[i].SetPosition(k, leafnodes[i].cm[k]/mass);
+                    for (auto k=0;k<3;k++) newpart[i].SetPosition(k, cm[k]/mass);
                     newpart[i].SetMass(mass);
                 }
                 leafnodes.clear();
                 delete tree;
             }
             else if (opt.uinfo.approxpotmethod == POTAPPROXMETHODRAND) {
-                //randomly sample particle distribution
+                //stratified random sample of the particle distribution. The particle list is split into
+                //newnbodies contiguous strata of ~mr particles and one particle is drawn from each using a
+                //counter based generator, so every particle is equally likely to be selected and the
+                //selection is reproducible and independent of the number of threads
                 mr = (double)nbodies/(double)newnbodies;
                 newpart = new Particle[newnbodies];
-                vector<Int_t> indices(nbodies);
-                std::random_device rd;
-                std::mt19937 g(rd());
-                for (auto i=0;i<nbodies;i++) indices[i] = i;
-                std::shuffle(indices.begin(), indices.end(), g);
+                unsigned long long seed = opt.uinfo.approxpotrandseed + (unsigned long long)nbodies;
+#ifdef USEOPENMP
+#pragma omp parallel for default(shared) schedule(static) if (nbodies > POTOMPCALCNUM)
+#endif
                 for (auto i=0;i<newnbodies;i++) {
-                    Int_t index = indices[i];
+                    Int_t istart = (Int_t)(i*mr), iend = (Int_t)((i+1)*mr);
+                    if (iend <= istart) iend = istart + 1;
+                    if (iend > nbodies) iend = nbodies;
+                    Double_t u = (SplitMix64(seed + i) >> 11) * (1.0/9007199254740992.0);
+                    Int_t index = min(istart + (Int_t)(u*(iend-istart)), iend-1);
                     newpart[i] = Part[index];
                     newpart[i].SetMass(newpart[i].GetMass()*mr);
                 }
-                indices.clear();
             }
         }
         else newnbodies = nbodies;
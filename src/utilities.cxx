@@ -5,6 +5,7 @@
 #include "ioutils.h"
 #include "logging.h"
 #include "stf.h"
+#include "timer.h"
 
 namespace vr {
 
@@ -72,6 +73,33 @@ namespace vr {
     }
 } // namespace vr
 
+/// Every tree VELOCIraptor builds comes through here. The KD-Tree median splits of the top levels are
+/// partitioned as concurrent tasks when the tree holds more than \ref ompsubsearchnum particles and
+/// the call is not already inside a parallel region (such as the per group trees of the 6DFOF and
+/// unbinding loops, which are built serially by each thread). With iautoparallel false the choice is
+/// left to the KD-Tree library's own default instead
+KDTree *BuildKDTree(Particle *Part, Int_t nbodies, Int_t bucketsize, int treetype,
+    int kerntype, int kernres, int splittingcriterion, int aniso, int scalespace,
+    Double_t *period, Double_t **metric, bool iautoparallel)
+{
+    vr::Timer timer;
+    if (!iautoparallel) {
+        KDTree *tree = new KDTree(Part, nbodies, bucketsize, treetype, kerntype, kernres,
+            splittingcriterion, aniso, scalespace, period, metric);
+        LOG(trace) << "Built tree of " << nbodies << " particles in " << timer;
+        return tree;
+    }
+    bool runomp = false;
+#ifdef USEOPENMP
+    runomp = (nbodies > ompsubsearchnum && !omp_in_parallel());
+#endif
+    KDTree *tree = new KDTree(Part, nbodies, bucketsize, treetype, kerntype, kernres,
+        splittingcriterion, aniso, scalespace, period, metric, runomp);
+    if (runomp) LOG(debug) << "Built tree of " << nbodies << " particles in parallel in " << timer;
+    else LOG(trace) << "Built tree of " << nbodies << " particles in " << timer;
+    return tree;
+}
+
 std::string GetMemUsage(const std::string &function)
 {
     auto memory_usage = vr::get_memory_usage();